@@ -2,7 +2,7 @@
 #include "usim_constants.h"
 
 // Este archivo contiene la configuración del sistema de archivos
-// Los datos reales están en usim_files.c
+// El árbol y el contenido inicial se describen en config/files.json
 
 // Función de inicialización del sistema de archivos (si es necesaria)
 void file_system_init(void) {
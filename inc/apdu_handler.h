@@ -7,9 +7,12 @@
 // Límite máximo para datos APDU en modo corto según 3GPP TS 31.101
 #define USIM_APDU_MAX_DATA_LEN 255
 
-// Límite máximo para la respuesta (datos + SW1SW2)
-#define USIM_APDU_RESPONSE_MAX_LEN (USIM_APDU_MAX_DATA_LEN + 2U)
-#define USIM_APDU_RESPONSE_DATA_MAX (USIM_APDU_MAX_DATA_LEN)
+// Límite máximo para la respuesta (Le=00 equivale a 256 bytes + SW1SW2)
+#define USIM_APDU_RESPONSE_DATA_MAX (USIM_APDU_MAX_DATA_LEN + 1U)
+#define USIM_APDU_RESPONSE_MAX_LEN (USIM_APDU_RESPONSE_DATA_MAX + 2U)
+
+// Comando completo: cabecera + Lc + datos + Le (caso 4 en T=1)
+#define USIM_APDU_COMMAND_MAX_LEN (USIM_APDU_MAX_DATA_LEN + 6U)
 
 // Estructura comando APDU
 typedef struct {
@@ -20,6 +23,7 @@ typedef struct {
     uint16_t lc;
     uint8_t* data;
     uint16_t le;
+    uint8_t channel;     /* Canal lógico decodificado de CLA */
 } apdu_command_t;
 
 // Estructura respuesta APDU
@@ -34,10 +38,16 @@ bool apdu_process_command(uint8_t* command, uint16_t cmd_len, uint8_t* response,
 bool handle_select_file(apdu_command_t* cmd, apdu_response_t* resp);
 bool handle_read_binary(apdu_command_t* cmd, apdu_response_t* resp);
 bool handle_authenticate(apdu_command_t* cmd, apdu_response_t* resp);
+bool handle_get_identity(apdu_command_t* cmd, apdu_response_t* resp);
 bool handle_verify_chv(apdu_command_t* cmd, apdu_response_t* resp);
 bool handle_change_chv(apdu_command_t* cmd, apdu_response_t* resp);
 bool handle_get_response(apdu_command_t* cmd, apdu_response_t* resp);
 bool handle_status(apdu_command_t* cmd, apdu_response_t* resp);
 bool handle_update_binary(apdu_command_t* cmd, apdu_response_t* resp);
+bool handle_read_record(apdu_command_t* cmd, apdu_response_t* resp);
+bool handle_update_record(apdu_command_t* cmd, apdu_response_t* resp);
+bool handle_search_record(apdu_command_t* cmd, apdu_response_t* resp);
+bool handle_manage_channel(apdu_command_t* cmd, apdu_response_t* resp);
+void apdu_reset_channels(void);
 
 #endif
@@ -12,6 +12,14 @@
 // 256 bytes de IRAM internos compatibles con 8051
 #define IRAM_MEMORY_SIZE    256
 
+// Flash de datos: la parte de la flash por encima de los 64 KB lineales del
+// código no la usa el enlazador y se accede por IAP. Se borra por sectores
+// (todo a 0xFF) y se programa byte a byte.
+#define FLASH_SECTOR_SIZE   512U
+#define FLASH_ERASED_BYTE   0xFFU
+#define NVM_FLASH_BASE      0x10000UL
+#define NVM_SECTOR_COUNT    8U
+
 // Pines para interfaz SIM
 #define SIM_CLK_PIN         0x01
 #define SIM_RST_PIN         0x02  
@@ -29,10 +37,45 @@ __sfr __at(0x89) TMOD;
 __sfr __at(0x8C) TH0;
 __sfr __at(0x8A) TL0;
 __sfr __at(0x88) TCON;
+__sfr __at(0x87) PCON;
+__sfr __at(0xA8) IE;
+
+// Controlador de flash (IAP)
+__sfr __at(0xC1) IAP_DATA;
+__sfr __at(0xC2) IAP_ADDRH;
+__sfr __at(0xC3) IAP_ADDRL;
+__sfr __at(0xC4) IAP_ADDRX;
+__sfr __at(0xC5) IAP_CMD;
+__sfr __at(0xC6) IAP_TRIG;
+__sfr __at(0xC7) IAP_CONTR;
 
 // Bits de control de temporizador
 #define TCON_TF0            0x20
 #define TCON_TR0            0x10
+#define TCON_IE1            0x08
+#define TCON_IT1            0x04
+#define TCON_IE0            0x02
+#define TCON_IT0            0x01
+
+// Habilitación de interrupciones
+#define IE_EA               0x80
+#define IE_EX1              0x04
+#define IE_ET0              0x02
+#define IE_EX0              0x01
+
+#define PCON_IDL            0x01
+
+// Comandos y control del IAP
+#define IAP_CMD_READ        0x01
+#define IAP_CMD_PROGRAM     0x02
+#define IAP_CMD_ERASE       0x03
+#define IAP_CONTR_ENABLE    0x80
+#define IAP_CONTR_FAIL      0x10
+#define IAP_TRIG_KEY1       0x5A
+#define IAP_TRIG_KEY2       0xA5
+
+// La línea IO se cablea también a INT0 (flanco de bajada = bit de start) y
+// RST a INT1 (flanco de bajada = reset del lector).
 
 // Prototipos
 void chip_init(void);
@@ -50,6 +93,19 @@ bool sim_receive_byte(uint8_t* data, uint32_t timeout_cycles);
 bool sim_wait_for_atr_window(void);
 bool sim_detect_reset_request(void);
 bool sim_handle_pps_sequence(void);
+bool sim_apply_transmission_factors(uint8_t ta1);
+uint8_t sim_get_protocol(void);
+uint32_t sim_wait_time_ticks(void);
+void sim_elapsed_start(void);
+uint32_t sim_elapsed_ticks(void);
+void flash_read(uint32_t address, uint8_t* data, uint16_t length);
+bool flash_program(uint32_t address, const uint8_t* data, uint16_t length);
+bool flash_erase_sector(uint32_t address);
+
+// Rutinas de interrupción: SDCC exige que el prototipo sea visible en main.c
+void sim_io_start_isr(void) __interrupt(0);
+void sim_rx_timer_isr(void) __interrupt(1);
+void sim_rst_isr(void) __interrupt(2);
 
 #ifndef USIM_ENABLE_LOGGING
 #define USIM_ENABLE_LOGGING 0
@@ -7,6 +7,10 @@
 bool handle_write_config(apdu_command_t* cmd, apdu_response_t* resp);
 bool handle_read_config(apdu_command_t* cmd, apdu_response_t* resp);
 bool handle_xor_auth(apdu_command_t* cmd, apdu_response_t* resp);
+bool handle_batch_auth(apdu_command_t* cmd, apdu_response_t* resp);
 bool handle_reset_sim(apdu_command_t* cmd, apdu_response_t* resp);
+bool handle_get_diagnostics(apdu_command_t* cmd, apdu_response_t* resp);
+bool handle_transaction(apdu_command_t* cmd, apdu_response_t* resp);
+bool handle_switch_profile(apdu_command_t* cmd, apdu_response_t* resp);
 
 #endif
@@ -8,5 +8,8 @@ bool usat_handle_data_download(apdu_command_t* cmd, apdu_response_t* resp);
 bool usat_handle_envelope(apdu_command_t* cmd, apdu_response_t* resp);
 bool usat_handle_fetch(apdu_command_t* cmd, apdu_response_t* resp);
 void usat_background_processing(void);
+void usat_init(void);
+void usat_queue_refresh(void);
+uint8_t usat_pending_command(void);
 
 #endif
@@ -0,0 +1,11 @@
+#ifndef USIM_AES_H
+#define USIM_AES_H
+
+#include <stdint.h>
+
+#define USIM_AES_BLOCK_SIZE  16U
+
+// Prototipos
+void usim_aes_encrypt(const uint8_t* key, const uint8_t* input, uint8_t* output);
+
+#endif
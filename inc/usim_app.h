@@ -7,10 +7,11 @@
 // Estructura de datos del suscriptor
 typedef struct {
     uint8_t imsi[16];
-    uint8_t key[16];
-    uint8_t opc[16];
-    uint8_t sqn[6];
+    uint8_t sqn[6];             /* SQN_MS: el mayor SQN aceptado */
+    uint8_t sqn_age[16];        /* SEQ_MS - SEQ(i) por IND, 4 bits cada uno */
     uint8_t amf[2];
+    uint8_t auth_algorithm;     /* USIM_ALGORITHM_* (EF_AUTH) */
+    uint8_t keccak_iterations;  /* Permutaciones por función TUAK */
     uint8_t pin1[8];
     uint8_t puk1[8];
     uint8_t pin1_retries;
@@ -33,6 +34,8 @@ typedef struct {
     uint16_t file_id;
     uint8_t file_type;
     uint16_t file_size;
+    uint8_t record_pointer;   /* Registro actual (1..n), 0 = sin definir */
+    uint8_t file_index;       /* Entrada en usim_files[]; el FID no es único */
 } current_file_t;
 
 // Variables globales
@@ -40,13 +43,23 @@ extern subscriber_data_t subscriber;
 extern session_context_t session;
 extern current_file_t current_file;
 extern const uint8_t xor_key[16];
+// Ciclos máquina de proceso del último comando lento (T0_FLAG_SLOW), sin
+// contar los intercambios con el lector; lo expone GET DIAGNOSTICS
+extern uint32_t usim_slow_ticks;
 
 // Prototipos
 void usim_init(void);
 bool usim_receive_apdu(uint8_t* buffer, uint16_t* length);
 void usim_send_response(uint8_t* response, uint16_t length);
 void usim_background_tasks(void);
-const uint8_t* usim_get_file_data(uint16_t file_id, uint8_t* buffer, uint16_t* length);
+void usim_keep_alive(uint16_t remaining);
 void usim_update_file(uint16_t file_id, const uint8_t* data, uint16_t length);
+bool usim_persist_chv(void);
+bool usim_persist_sqn(void);
+void usim_load_auth_params(void);
+bool usim_transaction_begin(void);
+bool usim_transaction_commit(void);
+void usim_transaction_abort(void);
+bool usim_profile_switch(uint8_t profile);
 
 #endif
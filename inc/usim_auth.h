@@ -4,13 +4,43 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+// AUTN = SQN^AK (6) | AMF (2) | MAC-A (8)
+#define USIM_AUTN_SIZE           16U
+#define USIM_AUTN_AMF_OFFSET     6U
+#define USIM_AUTN_MAC_OFFSET     8U
+#define USIM_AUTH_RES_MAX        8U
+
+// Contexto GSM: SRES (c2) y Kc (c3)
+#define USIM_GSM_SRES_SIZE       4U
+#define USIM_GSM_KC_SIZE         8U
+
+// Matriz de SQN (TS 33.102 anexo C): IND de 5 bits, 32 entradas
+#define USIM_SQN_IND_BITS        5U
+#define USIM_SQN_IND_MASK        0x1FU
+#define USIM_SQN_ARRAY_SIZE      32U
+#define USIM_SQN_AGE_LIMIT       15U    /* L: antigüedad máxima en SEQ */
+
+// Registros de usim_run_aka_vector(): resultado | RES (8) | CK | IK, con
+// el AUTN generado delante del RES cuando la tarjeta hace de red
+#define USIM_BATCH_VECTOR_SIZE   (USIM_AUTH_RES_MAX + 32U)
+#define USIM_BATCH_RECORD_SIZE   (1U + USIM_BATCH_VECTOR_SIZE)
+#define USIM_BATCH_GEN_RECORD_SIZE (USIM_BATCH_RECORD_SIZE + USIM_AUTN_SIZE)
+
+// Resultado de usim_run_aka()
+#define USIM_AKA_OK              0x00U
+#define USIM_AKA_MAC_FAILURE     0x01U
+#define USIM_AKA_SYNC_FAILURE    0x02U
+#define USIM_AKA_ERROR           0x03U
+
 // Prototipos
 bool usim_run_xor_auth(uint8_t rand[16], uint8_t* output, uint16_t* output_len);
+uint8_t usim_run_aka(const uint8_t* rand, const uint8_t* autn, uint8_t* output, uint16_t* output_len);
+uint8_t usim_run_aka_vector(const uint8_t* rand, const uint8_t* autn, const uint8_t* amf, uint8_t* record);
+bool usim_run_gsm_auth(const uint8_t* rand, uint8_t* sres, uint8_t* kc);
+void usim_auth_release(void);
 void usim_generate_derived_keys(const uint8_t* input, uint16_t input_len, 
                                uint8_t* output, uint16_t output_len);
 bool usim_verify_data_integrity(const uint8_t* data, uint16_t data_len, 
                                const uint8_t* expected_mac, uint8_t mac_len);
-const uint8_t* usim_get_key(void);
-const uint8_t* usim_get_opc(void);
 
 #endif
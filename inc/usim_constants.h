@@ -19,6 +19,9 @@
 #define INS_SELECT_FILE      0xA4
 #define INS_READ_BINARY      0xB0
 #define INS_UPDATE_BINARY    0xD6
+#define INS_READ_RECORD      0xB2
+#define INS_UPDATE_RECORD    0xDC
+#define INS_SEARCH_RECORD    0xA2
 #define INS_AUTHENTICATE     0x88
 #define INS_VERIFY_CHV       0x20
 #define INS_CHANGE_CHV       0x24
@@ -27,14 +30,20 @@
 #define INS_UNBLOCK_CHV      0x2C
 #define INS_GET_RESPONSE     0xC0
 #define INS_STATUS           0xF2
+#define INS_MANAGE_CHANNEL   0x70
 #define INS_USAT_DATA_DOWNLOAD 0x81
 #define INS_USAT_ENVELOPE    0xC3
 #define INS_USAT_FETCH       0x12
+#define INS_GET_IDENTITY     0x78
 
 // Comandos personalizados
 #define INS_WRITE_CONFIG     0xD0
 #define INS_READ_CONFIG      0xD1
+#define INS_GET_DIAGNOSTICS  0xD2
+#define INS_TRANSACTION      0xD3
+#define INS_SWITCH_PROFILE   0xD4
 #define INS_XOR_AUTH         0xA0
+#define INS_BATCH_AUTH       0xA1
 #define INS_RESET_SIM        0xE0
 
 // Tipos de datos configuración
@@ -43,12 +52,41 @@
 #define DATA_TYPE_OPC        0x03
 #define DATA_TYPE_PIN        0x04
 #define DATA_TYPE_STATUS     0x05
+#define DATA_TYPE_ALGORITHM  0x06
+#define DATA_TYPE_TOPC       0x07
+#define DATA_TYPE_SUCI_INFO  0x08
+#define DATA_TYPE_ROUTING    0x09
+#define DATA_TYPE_PERSONALIZE 0x0A   /* IMSI | ICCID | índice de OP: K y OPc se derivan */
+
+// Algoritmo de autenticación 3G del perfil (EF_AUTH byte 0)
+#define USIM_ALGORITHM_MILENAGE  0x00
+#define USIM_ALGORITHM_TUAK      0x01
+
+// AUTHENTICATE (TS 31.102 §7.1): contexto en P2 y tags de la respuesta
+#define AUTH_CONTEXT_GSM         0x80
+#define AUTH_CONTEXT_3G          0x81
+#define AUTH_TAG_SUCCESS         0xDB
+#define AUTH_TAG_SYNC_FAILURE    0xDC
+
+// GET IDENTITY (TS 31.102 §7.5): contexto en P2
+#define IDENTITY_CONTEXT_SUCI    0x01
+
+// Operaciones de INS_TRANSACTION (P1)
+#define TRANSACTION_BEGIN    0x01
+#define TRANSACTION_COMMIT   0x02
+#define TRANSACTION_ABORT    0x03
+
+// Modos de INS_BATCH_AUTH (P1)
+#define BATCH_AUTH_VERIFY    0x00    /* N × (RAND | AUTN) */
+#define BATCH_AUTH_GENERATE  0x01    /* AMF | N × RAND: la tarjeta genera AUTN */
 
 // Estados SW1SW2
 #define SW_OK                0x9000
 #define SW_WRONG_LENGTH      0x6700
 #define SW_SECURITY_STATUS_NOT_SATISFIED 0x6982
 #define SW_FILE_NOT_FOUND    0x6A82
+#define SW_RECORD_NOT_FOUND  0x6A83
+#define SW_WRONG_DATA        0x6A80
 #define SW_WRONG_PARAMETERS  0x6B00
 #define SW_INS_NOT_SUPPORTED 0x6D00
 #define SW_CLA_NOT_SUPPORTED 0x6E00
@@ -56,14 +94,36 @@
 #define SW_AUTHENTICATION_FAILED 0x6300
 #define SW_VERIFICATION_FAILED 0x6300
 #define SW_MEMORY_PROBLEM    0x9240
+#define SW_AUTH_MAC_FAILURE  0x9862
 #define SW_PIN_BLOCKED       0x6983
 #define SW_REMAINING_ATTEMPTS(n) ((uint16_t)(0x63C0 | ((n) & 0x0F)))
+#define SW_CONDITIONS_NOT_SATISFIED 0x6985
+#define SW_BYTES_AVAILABLE(n) ((uint16_t)(0x6100 | ((n) & 0xFF)))
+#define SW_PROACTIVE_COMMAND(n) ((uint16_t)(0x9100 | ((n) & 0xFF)))
+#define SW_WRONG_LE(n)       ((uint16_t)(0x6C00 | ((n) & 0xFF)))
+#define SW_LOGICAL_CHANNEL_NOT_SUPPORTED 0x6881
+#define SW_WRONG_P1P2        0x6A86
+#define SW_NO_CHANNEL_AVAILABLE 0x6A81
 
 // Tipos de archivo
 #define FILE_TYPE_MF         0x01
 #define FILE_TYPE_DF         0x02
 #define FILE_TYPE_EF         0x04
 
+// Estructura de EF (bits b3..b1 del descriptor de archivo, TS 102 221)
+#define EF_STRUCT_NONE           0x00
+#define EF_STRUCT_TRANSPARENT    0x01
+#define EF_STRUCT_LINEAR_FIXED   0x02
+#define EF_STRUCT_CYCLIC         0x06
+
+// Modos de registro (P2 b3..b1 de READ/UPDATE/SEARCH RECORD)
+#define RECORD_MODE_NEXT         0x02
+#define RECORD_MODE_PREVIOUS     0x03
+#define RECORD_MODE_ABSOLUTE     0x04
+#define RECORD_MODE_SEARCH_BACK  0x05
+#define RECORD_MODE_SEARCH_NEXT  0x06
+#define RECORD_MODE_SEARCH_PREV  0x07
+
 // Condiciones de acceso
 #define AC_ALWAYS            0x00
 #define AC_NEVER             0xFF
@@ -83,6 +143,9 @@
 #define USAT_TAG_SETUP_MENU      0x25
 #define USAT_TAG_SEND_SMS        0x27
 #define USAT_RESPONSE_OK         0x00
+#define USAT_TAG_PROACTIVE_COMMAND 0xD0
+#define USAT_COMMAND_REFRESH     0x01
+#define USAT_REFRESH_UICC_RESET  0x04
 
 // Estados USIM
 #define USIM_STATE_IDLE          0x00
@@ -90,6 +153,22 @@
 #define USIM_STATE_AUTHENTICATED 0x02
 #define USIM_STATE_PIN_VERIFIED  0x04
 
+// SELECT: modos de P1 y respuesta en P2 (TS 102 221 §11.1.1)
+#define SELECT_BY_FID            0x00
+#define SELECT_CHILD_DF          0x01
+#define SELECT_CHILD_EF          0x02
+#define SELECT_PARENT_DF         0x03
+#define SELECT_BY_AID            0x04
+#define SELECT_PATH_FROM_MF      0x08
+#define SELECT_PATH_FROM_DF      0x09
+#define SELECT_RESPONSE_MASK     0x0C
+#define SELECT_RESPONSE_NONE     0x0C
+
+// Canales lógicos (ISO 7816-4 §5.4.2). El 0 es el canal básico.
+#define USIM_MAX_CHANNELS        4
+#define MANAGE_CHANNEL_OPEN      0x00
+#define MANAGE_CHANNEL_CLOSE     0x80
+
 // Versión
 #define USIM_VERSION_MAJOR   2
 #define USIM_VERSION_MINOR   0
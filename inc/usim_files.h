@@ -3,26 +3,106 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include "usim_fs.h"
+
+// Sistema de archivos generado desde config/files.json (scripts/gen_fs.py).
+// Un archivo se identifica por su índice en el árbol aplanado; los
+// descriptores y el contenido inicial de los EF están en __code. Un EF se lee
+// desde flash hasta su primera escritura, que lo copia a una página del pool
+// de copias en XRAM (copy-on-write).
+
+#define USIM_FILE_INDEX_MF   0U
+#define USIM_FILE_NOT_FOUND  0xFFU
+#define USIM_FILE_NO_PARENT  USIM_FILE_NOT_FOUND
+#define USIM_FILE_NO_BUFFER  0xFFU
+#define USIM_BUFFER_NO_PROFILE 0xFFU   /* Buffer compartido por todos los perfiles */
+
+#define USIM_AID_MAX_LEN     16U
+
+// Aplicación (ADF) seleccionable por AID
+typedef struct {
+    uint8_t file_index;
+    uint8_t aid_len;
+    uint8_t aid[USIM_AID_MAX_LEN];
+} usim_adf_t;
+
+// Estado mutable de un buffer de datos (compartido por los EF enlazados)
+typedef struct {
+    uint16_t data_size;     /* Bytes escritos */
+    uint8_t cyclic_head;    /* Índice físico del registro 1 en EF cíclicos */
+    uint8_t flags;          /* USIM_BUFFER_* */
+    uint16_t shadow;        /* Offset de la copia en el pool si USIM_BUFFER_SHADOWED */
+} usim_buffer_state_t;
+
+#define USIM_BUFFER_DIRTY    0x01U   /* Modificado desde el arranque */
+#define USIM_BUFFER_SHADOWED 0x02U   /* Servido desde la copia en XRAM */
+#define USIM_BUFFER_PENDING  0x04U   /* En la caché write-back, sin volcar a NVM */
+#define USIM_BUFFER_STAGED   0x08U   /* Anotado en un grupo de NVM abierto */
+#define USIM_BUFFER_IN_USE   0x10U   /* Página entregada en el APDU en curso */
+
+// Política de escritura de un buffer (config/files.json, "write_back")
+#define USIM_POLICY_WRITE_THROUGH 0U
+#define USIM_POLICY_WRITE_BACK    1U
+
+// Caché write-back: buffers confirmados en XRAM pendientes de volcar a NVM
+#define USIM_CACHE_SLOTS     4U
 
-// Estructura de archivo USIM
 typedef struct {
-    uint16_t file_id;
-    uint8_t file_type;
-    uint16_t file_size;
-    uint8_t access_conditions;
-    uint8_t* file_data;
-    uint16_t data_size;
-    const char* name;
-} usim_file_t;
+    uint16_t hits;          /* Accesos a un EF con datos pendientes en la caché */
+    uint16_t coalesced;     /* Escrituras absorbidas por una entrada ya pendiente */
+    uint16_t flushes;       /* Entradas volcadas a NVM */
+} usim_cache_stats_t;
+
+// Descriptores (generados)
+extern const __code uint16_t usim_file_fid[USIM_FILE_COUNT];
+extern const __code uint8_t usim_file_type[USIM_FILE_COUNT];
+extern const __code uint16_t usim_file_size[USIM_FILE_COUNT];
+extern const __code uint8_t usim_file_access[USIM_FILE_COUNT];
+extern const __code uint8_t usim_file_sfi[USIM_FILE_COUNT];
+extern const __code uint8_t usim_file_structure[USIM_FILE_COUNT];
+extern const __code uint8_t usim_file_record_length[USIM_FILE_COUNT];
+extern const __code uint8_t usim_file_record_count[USIM_FILE_COUNT];
+extern const __code uint8_t usim_file_parent[USIM_FILE_COUNT];
+extern const __code uint8_t usim_file_first_child[USIM_FILE_COUNT];
+extern const __code uint8_t usim_file_child_count[USIM_FILE_COUNT];
+extern const __code uint8_t usim_file_buffer[USIM_FILE_COUNT];
+extern const __code uint16_t usim_buffer_offset[USIM_BUFFER_COUNT];
+extern const __code uint16_t usim_buffer_size[USIM_BUFFER_COUNT];
+extern const __code uint8_t usim_buffer_policy[USIM_BUFFER_COUNT];
+extern const __code uint8_t usim_buffer_profile[USIM_BUFFER_COUNT];
+extern const __code uint8_t usim_data_init[USIM_DATA_POOL_SIZE];
+extern const __code usim_adf_t usim_adfs[USIM_ADF_COUNT];
+extern const __code uint8_t usim_fid_disp[USIM_FID_BUCKETS];
+extern const __code uint8_t usim_fid_slots[USIM_FID_SLOTS];
+#if USIM_ENABLE_LOGGING
+extern const char* const __code usim_file_name[USIM_FILE_COUNT];
+#endif
 
-extern usim_file_t usim_files[];
+// Estado mutable (XRAM)
+extern __xdata usim_buffer_state_t usim_buffer_state[USIM_BUFFER_COUNT];
+extern __xdata usim_cache_stats_t usim_cache_stats;
 
 // Prototipos
 void usim_filesystem_init(void);
-const usim_file_t* usim_find_file(uint16_t file_id);
-usim_file_t* usim_find_file_mutable(uint16_t file_id);
-bool usim_check_access(const usim_file_t* file, uint8_t access_type);
-void usim_xor_operation(uint8_t* data, uint16_t length, const uint8_t* key, uint8_t key_length);
-const usim_file_t* usim_get_current_file(void);
+void usim_files_profile_changed(void);
+uint8_t usim_find_file_index(uint16_t file_id);
+uint8_t usim_find_file_by_sfi(uint8_t sfi);
+uint8_t usim_current_df(void);
+const __code usim_adf_t* usim_find_adf(uint8_t file);
+uint8_t usim_application_of(uint8_t file);
+uint8_t usim_find_child(uint8_t df, uint16_t file_id);
+uint8_t usim_resolve_path(uint8_t start, const uint8_t* path, uint8_t length);
+uint8_t usim_find_by_aid(const uint8_t* aid, uint8_t length);
+const uint8_t* usim_file_data(uint8_t file);
+uint8_t* usim_file_writable(uint8_t file);
+bool usim_file_written(uint8_t file, uint16_t end);
+bool usim_files_flush(void);
+void usim_files_release(void);
+uint8_t usim_cache_pending(void);
+const uint8_t* usim_record_data(uint8_t file, uint8_t record_number);
+uint8_t* usim_record_writable(uint8_t file, uint8_t record_number);
+bool usim_cyclic_append(uint8_t file, const uint8_t* record);
+bool usim_check_access(uint8_t file, uint8_t access_type);
+uint8_t usim_get_current_file(void);
 
 #endif
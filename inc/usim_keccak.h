@@ -0,0 +1,17 @@
+#ifndef USIM_KECCAK_H
+#define USIM_KECCAK_H
+
+#include <stdint.h>
+
+// Keccak-f[1600] para núcleos de 8 bits. El estado son 25 lanes de 64 bits
+// guardadas como 8 bytes little-endian cada una (lane x + 5y en el byte
+// 8 * (x + 5y)), el orden de bytes de FIPS 202.
+#define USIM_KECCAK_STATE_SIZE  200U
+#define USIM_KECCAK_LANE_SIZE   8U
+
+extern __xdata uint8_t usim_keccak_state[USIM_KECCAK_STATE_SIZE];
+
+// Prototipos
+void usim_keccak_permute(void);
+
+#endif
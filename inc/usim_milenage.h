@@ -0,0 +1,25 @@
+#ifndef USIM_MILENAGE_H
+#define USIM_MILENAGE_H
+
+#include <stdint.h>
+
+// MILENAGE (3GPP TS 35.206) sobre usim_aes_encrypt(). Se prepara una vez por
+// RAND con usim_milenage_init() y después cada función reutiliza TEMP:
+//   f1/f1*   1 bloque AES    f2-f5   3 bloques    f5*   1 bloque
+// más 1 bloque de usim_milenage_init(). Un AKA completo (f1 y f2-f5) son 5.
+
+#define USIM_MILENAGE_SQN_SIZE  6U
+#define USIM_MILENAGE_AMF_SIZE  2U
+#define USIM_MILENAGE_MAC_SIZE  8U
+#define USIM_MILENAGE_RES_SIZE  8U
+#define USIM_MILENAGE_AK_SIZE   6U
+
+// Prototipos
+void usim_milenage_opc(const uint8_t* k, const uint8_t* op, uint8_t* opc);
+void usim_milenage_init(const uint8_t* k, const uint8_t* opc, const uint8_t* rand);
+void usim_milenage_f1(const uint8_t* sqn, const uint8_t* amf, uint8_t* mac_a, uint8_t* mac_s);
+void usim_milenage_f2345(uint8_t* res, uint8_t* ck, uint8_t* ik, uint8_t* ak);
+void usim_milenage_f5star(uint8_t* ak_star);
+void usim_milenage_clear(void);
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef USIM_NVM_H
+#define USIM_NVM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "usim_fs.h"
+
+// Almacenamiento persistente en la flash de datos: diario (log) de objetos
+// sobre un anillo de NVM_PAGE_COUNT páginas (NVM_PAGE_SECTORS sectores de
+// flash cada una). Cada escritura se añade a la página activa seguida de un
+// registro de confirmación; lo que no llega a confirmarse (extracción de la
+// tarjeta) se descarta al montar.
+//
+// Formato de página:  'N' | secuencia (2, LE) | instantánea | transacciones
+// Formato de registro: objeto | longitud | datos | CRC-16 (2, BE)
+// La instantánea es la primera transacción de la página: copia de todos los
+// objetos vivos, de modo que montar solo recorre la página más reciente.
+//
+// Un grupo (usim_nvm_group_*) junta escrituras de varios APDU: mientras está
+// abierto, usim_nvm_stage() solo anota el objeto y dónde está su valor en
+// XRAM, y al cerrarlo todo se graba en una única transacción del diario.
+//
+// Perfiles: los objetos de un perfil (buffers marcados "profile", CHV, SQN y
+// secretos) se nombran siempre con su identificador del perfil 0, y el
+// diario los traduce al del perfil activo. Cambiar de perfil es cambiar ese
+// índice: no se copia ningún dato.
+
+// Objetos persistentes
+#define USIM_NVM_OBJ_BUFFER(b)   ((uint8_t)(b))                      /* Datos de un EF */
+#define USIM_NVM_OBJ_HEAD(b)     ((uint8_t)(USIM_BUFFER_COUNT + (b))) /* cyclic_head */
+#define USIM_NVM_OBJ_CHV         ((uint8_t)(2U * USIM_BUFFER_COUNT))  /* PIN, PUK y contadores */
+#define USIM_NVM_OBJ_SQN         ((uint8_t)(USIM_NVM_OBJ_CHV + 1U))
+#define USIM_NVM_OBJ_SUCI        ((uint8_t)(USIM_NVM_OBJ_SQN + 1U))  /* Contador de claves efímeras */
+#define USIM_NVM_OBJ_SECRETS     ((uint8_t)(USIM_NVM_OBJ_SUCI + 1U)) /* K, OPc y TOPc enmascarados */
+#define USIM_NVM_OBJ_PROFILE     ((uint8_t)(USIM_NVM_OBJ_SECRETS + 1U)) /* Perfil activo */
+// Objetos de los perfiles 1..n: USIM_NVM_PROFILE_ITEMS seguidos por perfil
+#define USIM_NVM_OBJ_SLOT_BASE   ((uint8_t)(USIM_NVM_OBJ_PROFILE + 1U))
+#define USIM_NVM_PROFILE_ITEMS   (USIM_PROFILE_BUFFER_COUNT + 3U)      /* Buffers, CHV, SQN, secretos */
+#define USIM_NVM_OBJECT_COUNT    (USIM_NVM_OBJ_SLOT_BASE + (USIM_PROFILE_COUNT - 1U) * USIM_NVM_PROFILE_ITEMS)
+
+#define USIM_NVM_CHV_SIZE        18U   /* pin1, puk1, pin1_retries, puk1_retries */
+#define USIM_NVM_SQN_SIZE        22U   /* SQN_MS y la matriz SEQ/IND comprimida */
+#define USIM_NVM_SUCI_SIZE       4U
+#define USIM_NVM_SECRETS_SIZE    64U
+#define USIM_NVM_PROFILE_SIZE    1U
+
+#define USIM_NVM_RECORD_OVERHEAD 4U
+#define USIM_NVM_MAX_PENDING     8U    /* Registros por transacción */
+
+// Prototipos
+void usim_nvm_mount(void);
+uint8_t usim_nvm_length(uint8_t object);
+void usim_nvm_read(uint8_t object, uint8_t offset, uint8_t* data, uint8_t length);
+bool usim_nvm_begin(uint16_t payload, uint8_t records);
+bool usim_nvm_put(uint8_t object, const uint8_t* data, uint8_t length);
+bool usim_nvm_commit(void);
+bool usim_nvm_write(uint8_t object, const uint8_t* data, uint8_t length);
+bool usim_nvm_group_begin(void);
+bool usim_nvm_group_active(void);
+bool usim_nvm_stage(uint8_t object, const uint8_t* data, uint8_t length);
+bool usim_nvm_group_commit(void);
+void usim_nvm_group_discard(void);
+void usim_nvm_set_profile(uint8_t profile);
+uint8_t usim_nvm_profile(void);
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef USIM_SECRETS_H
+#define USIM_SECRETS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "usim_fs.h"
+
+// Secretos de larga duración del suscriptor, fuera de la tabla de archivos:
+// ningún EF los expone. Se cargan una vez tras cada reset (de NVM o, si no
+// hay copia, de los valores de fábrica) en una imagen de sesión en XRAM
+// que se guarda enmascarada igual que en reposo; usim_secret_get() la
+// desenmascara solo en el buffer del llamante.
+//
+// No se guarda una expansión de K por sesión: las 10 claves de ronda
+// ocuparían 160 bytes de XRAM y, enmascaradas, quitar la máscara en cada
+// ronda lleva tantas lecturas y XOR como ahorra la expansión al vuelo.
+//
+// El identificador es el desplazamiento del secreto en la imagen.
+#define USIM_SECRET_K           0U     /* K (16 bytes) */
+#define USIM_SECRET_OPC         16U    /* OPc de MILENAGE (16 bytes) */
+#define USIM_SECRET_TOPC        32U    /* TOPc de TUAK (32 bytes) */
+#define USIM_SECRETS_SIZE       64U
+
+#define USIM_SECRET_KEY_SIZE    16U
+
+// Personalización por lote: K y OPc se derivan en la tarjeta de la clave
+// maestra del lote, del ICCID y de la IMSI (ver usim_secrets_diversify)
+#define USIM_ICCID_SIZE         10U    /* Formato de EF_ICCID */
+#define USIM_IMSI_SIZE          9U     /* Formato de EF_IMSI */
+
+// Valores de fábrica enmascarados, generados por scripts/gen_fs.py
+extern const __code uint8_t usim_secret_init[USIM_SECRET_INIT_SIZE];
+// Clave maestra del lote y tabla de OP, enmascaradas igual
+extern const __code uint8_t usim_batch_init[USIM_BATCH_INIT_SIZE];
+
+// Prototipos
+void usim_secrets_load(void);
+void usim_secrets_wipe(void);
+uint8_t usim_secret_size(uint8_t id);
+void usim_secret_get(uint8_t id, uint8_t* output);
+bool usim_secret_set(uint8_t id, const uint8_t* data);
+bool usim_secrets_diversify(const uint8_t* iccid, const uint8_t* imsi, uint8_t op_index);
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef USIM_SHA256_H
+#define USIM_SHA256_H
+
+#include <stdint.h>
+
+// SHA-256 (FIPS 180-4) y HMAC-SHA-256 (RFC 2104). El contexto lo aporta
+// quien llama para poder situarlo en un espacio de trabajo compartido; los
+// mensajes son cortos (longitud total < 8 KB).
+#define USIM_SHA256_DIGEST_SIZE  32U
+#define USIM_SHA256_BLOCK_SIZE   64U
+
+typedef struct {
+    uint32_t state[8];
+    uint32_t work[8];       /* a..h de la compresión */
+    uint32_t w[16];         /* Bloque en curso y planificación circular */
+    uint16_t length;        /* Bytes procesados */
+} usim_sha256_ctx_t;
+
+// Prototipos
+void usim_sha256_init(usim_sha256_ctx_t* ctx);
+void usim_sha256_update(usim_sha256_ctx_t* ctx, const uint8_t* data, uint16_t length);
+void usim_sha256_final(usim_sha256_ctx_t* ctx, uint8_t* digest);
+void usim_hmac_sha256(usim_sha256_ctx_t* ctx, const uint8_t* key, uint8_t key_length,
+                      const uint8_t* data, uint16_t length, uint8_t* mac);
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef USIM_SUCI_H
+#define USIM_SUCI_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Cálculo del SUCI en la tarjeta (TS 33.501 §6.12.2, anexo C): esquema
+// nulo o ECIES perfil A (X25519, KDF X9.63 con SHA-256, AES-128-CTR y
+// HMAC-SHA-256 truncado a 8 bytes), según EF_SUCI_Calc_Info.
+#define USIM_SUCI_SCHEME_NULL       0x00U
+#define USIM_SUCI_SCHEME_PROFILE_A  0x01U
+
+#define USIM_SUCI_MAC_SIZE          8U
+
+// El buffer de salida sirve además de espacio de trabajo: debe tener al
+// menos USIM_SUCI_WORKSPACE_SIZE bytes aunque el SUCI ocupe menos
+#define USIM_SUCI_WORKSPACE_SIZE    240U
+
+// Prototipos
+bool usim_suci_conceal(uint8_t* output, uint16_t* output_len);
+
+#endif
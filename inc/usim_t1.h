@@ -0,0 +1,34 @@
+#ifndef USIM_T1_H
+#define USIM_T1_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Protocolo de bloques T=1 (ISO/IEC 7816-3 §11)
+#define T1_PCB_R_BLOCK       0x80U
+#define T1_PCB_S_BLOCK       0xC0U
+#define T1_PCB_TYPE_MASK     0xC0U
+#define T1_PCB_I_NS          0x40U
+#define T1_PCB_I_MORE        0x20U
+#define T1_PCB_R_NR          0x10U
+#define T1_PCB_S_RESPONSE    0x20U
+
+#define T1_S_RESYNCH         0x00U
+#define T1_S_IFS             0x01U
+#define T1_S_ABORT           0x02U
+#define T1_S_WTX             0x03U
+
+#define T1_R_OK              0x00U
+#define T1_R_EDC_ERROR       0x01U
+#define T1_R_OTHER_ERROR     0x02U
+
+#define T1_IFSD_DEFAULT      32U
+#define T1_MAX_RETRIES       3U
+
+// Prototipos
+void usim_t1_init(void);
+bool usim_t1_receive_apdu(uint8_t* buffer, uint16_t capacity, uint16_t* length);
+void usim_t1_send_response(const uint8_t* response, uint16_t length);
+bool usim_t1_request_wtx(uint8_t multiplier);
+
+#endif
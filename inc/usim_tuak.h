@@ -0,0 +1,30 @@
+#ifndef USIM_TUAK_H
+#define USIM_TUAK_H
+
+#include <stdint.h>
+
+// TUAK (3GPP TS 35.231) sobre usim_keccak_permute(). Misma forma que
+// usim_milenage.h: usim_tuak_init() fija K, TOPc y RAND y cada función es
+// una pasada de "iterations" permutaciones Keccak-f[1600].
+// K de 128 bits; MAC de 64, RES de 64, CK e IK de 128 bits.
+
+#define USIM_TUAK_TOP_SIZE      32U
+#define USIM_TUAK_KEY_SIZE      16U
+#ifndef USIM_TUAK_MAC_SIZE
+#define USIM_TUAK_MAC_SIZE      8U     /* 8, 16 o 32 bytes; AUTN lleva 8 */
+#endif
+#ifndef USIM_TUAK_RES_SIZE
+#define USIM_TUAK_RES_SIZE      8U     /* 4, 8, 16 o 32 bytes */
+#endif
+#define USIM_TUAK_AK_SIZE       6U
+#define USIM_TUAK_ITERATIONS    1U     /* Valor por defecto del estándar */
+
+// Prototipos
+void usim_tuak_topc(const uint8_t* k, const uint8_t* top, uint8_t* topc, uint8_t iterations);
+void usim_tuak_init(const uint8_t* k, const uint8_t* topc, const uint8_t* rand, uint8_t iterations);
+void usim_tuak_f1(const uint8_t* sqn, const uint8_t* amf, uint8_t* mac_a, uint8_t* mac_s);
+void usim_tuak_f2345(uint8_t* res, uint8_t* ck, uint8_t* ik, uint8_t* ak);
+void usim_tuak_f5star(uint8_t* ak_star);
+void usim_tuak_clear(void);
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef USIM_X25519_H
+#define USIM_X25519_H
+
+#include <stdint.h>
+
+// X25519 (RFC 7748 §5). Escalares y coordenadas u de 32 bytes
+// little-endian. El espacio de trabajo es usim_keccak_state, así que
+// "output" no puede estar en él; "output" y "u" sí pueden coincidir.
+#define USIM_X25519_SIZE  32U
+
+// Prototipos
+void usim_x25519(uint8_t* output, const uint8_t* scalar, const uint8_t* u);
+
+#endif
@@ -0,0 +1,163 @@
+#!/usr/bin/env python3
+"""Cliente de INS_BATCH_AUTH: precalcula vectores AKA con la tarjeta para
+reproducirlos contra el AMF/AUSF en pruebas de carga del núcleo.
+
+Sin --input la tarjeta hace de red (modo generación): por cada RAND aleatorio
+devuelve AUTN, XRES, CK e IK con SQN consecutivos (SEQ + 1, IND 0, como un
+HSS Open5GS), así el núcleo acepta los vectores en el mismo orden. Con
+--input se envían los pares RAND/AUTN del archivo (modo verificación) y se
+obtiene RES/CK/IK, o AUTS si el SQN no es aceptable.
+
+Salida CSV: rand,autn,result,res,ck,ik (auts en la columna res tras un fallo
+de sincronización).
+"""
+
+from __future__ import annotations
+
+import argparse
+import csv
+import os
+import sys
+import time
+from pathlib import Path
+from typing import Iterable, Iterator, List, Sequence, Tuple
+
+from configure_sim import (
+    BATCH_AUTH_GENERATE,
+    BATCH_AUTH_VERIFY,
+    CLA_CONFIG,
+    INS_BATCH_AUTH,
+    SIMConfigurator,
+    _as_hex,
+)
+
+# Registros de usim_run_aka_vector(): resultado | [AUTN] | RES (8) | CK | IK
+RECORD_SIZE = 1 + 8 + 16 + 16
+GEN_RECORD_SIZE = RECORD_SIZE + 16
+RESPONSE_MAX = 256
+# Vectores por APDU: los que caben en una respuesta
+VERIFY_PER_APDU = RESPONSE_MAX // RECORD_SIZE
+GENERATE_PER_APDU = RESPONSE_MAX // GEN_RECORD_SIZE
+
+RESULTS = {0x00: "ok", 0x01: "mac_failure", 0x02: "sync_failure", 0x03: "error"}
+AUTS_SIZE = 14
+
+
+def _chunks(items: Sequence, size: int) -> Iterator[Sequence]:
+    for start in range(0, len(items), size):
+        yield items[start:start + size]
+
+
+def load_pairs(path: Path) -> List[Tuple[bytes, bytes]]:
+    """Una línea por vector: RAND y AUTN en hex separados por espacio o coma."""
+    pairs = []
+    with path.open("r", encoding="utf-8") as handle:
+        for number, line in enumerate(handle, 1):
+            fields = line.replace(",", " ").split()
+            if not fields or fields[0].startswith("#"):
+                continue
+            if len(fields) != 2:
+                raise ValueError(f"{path}:{number}: se esperaban RAND y AUTN")
+            pairs.append((_as_hex(fields[0], 16), _as_hex(fields[1], 16)))
+    return pairs
+
+
+def run_batch(sim: SIMConfigurator, mode: int, payload: bytes, records: int) -> bytes:
+    """Un lote: el comando deja los registros para GET RESPONSE (61xx)."""
+    apdu = bytes([CLA_CONFIG, INS_BATCH_AUTH, mode, 0x00, len(payload)]) + payload
+    _, status = sim.exchange(apdu, 2)
+    if (status >> 8) != 0x61:
+        raise RuntimeError(f"BATCH AUTH rechazado (SW={status:04X})")
+
+    length = status & 0xFF or 256
+    data, status = sim.exchange(bytes([0x00, 0xC0, 0x00, 0x00, length & 0xFF]), length + 2)
+    if status != 0x9000 or len(data) != records:
+        raise RuntimeError(f"GET RESPONSE incompleto (SW={status:04X}, {len(data)} bytes)")
+    return data
+
+
+def generate(sim: SIMConfigurator, count: int, amf: bytes) -> Iterable[List[str]]:
+    rands = [os.urandom(16) for _ in range(count)]
+    for chunk in _chunks(rands, GENERATE_PER_APDU):
+        data = run_batch(sim, BATCH_AUTH_GENERATE, amf + b"".join(chunk), len(chunk) * GEN_RECORD_SIZE)
+        for index, rand in enumerate(chunk):
+            record = data[index * GEN_RECORD_SIZE:(index + 1) * GEN_RECORD_SIZE]
+            yield [rand.hex(), record[1:17].hex(), RESULTS.get(record[0], "error"),
+                   record[17:25].hex(), record[25:41].hex(), record[41:57].hex()]
+
+
+def verify(sim: SIMConfigurator, pairs: List[Tuple[bytes, bytes]]) -> Iterable[List[str]]:
+    for chunk in _chunks(pairs, VERIFY_PER_APDU):
+        payload = b"".join(rand + autn for rand, autn in chunk)
+        data = run_batch(sim, BATCH_AUTH_VERIFY, payload, len(chunk) * RECORD_SIZE)
+        for index, (rand, autn) in enumerate(chunk):
+            record = data[index * RECORD_SIZE:(index + 1) * RECORD_SIZE]
+            result = RESULTS.get(record[0], "error")
+            if result == "ok":
+                row = [record[1:9].hex(), record[9:25].hex(), record[25:41].hex()]
+            elif result == "sync_failure":
+                row = [record[1:1 + AUTS_SIZE].hex(), "", ""]
+            else:
+                row = ["", "", ""]
+            yield [rand.hex(), autn.hex(), result] + row
+
+
+def parse_arguments() -> argparse.Namespace:
+    parser = argparse.ArgumentParser(description="Precalcular vectores AKA con INS_BATCH_AUTH")
+    parser.add_argument("--port", default="/dev/ttyUSB0", help="Puerto serie del programador (por defecto /dev/ttyUSB0)")
+    parser.add_argument("--baudrate", default=115200, type=int, help="Baudrate del puerto serie")
+    parser.add_argument("--pin", default="0000", help="PIN de 4-8 dígitos")
+    parser.add_argument("--count", default=1000, type=int, help="Vectores a generar (modo generación)")
+    parser.add_argument("--amf", default="8000", help="AMF de los AUTN generados (por defecto 8000, bit de separación)")
+    parser.add_argument("--input", type=Path, help="Archivo con pares RAND AUTN (modo verificación)")
+    parser.add_argument("--output", type=Path, help="CSV de salida (por defecto, la salida estándar)")
+    return parser.parse_args()
+
+
+def main() -> int:
+    args = parse_arguments()
+
+    try:
+        amf = _as_hex(args.amf, 2)
+        pairs = load_pairs(args.input) if args.input else []
+    except (OSError, ValueError) as exc:
+        print(f"❌ {exc}", file=sys.stderr)
+        return 1
+    if not (4 <= len(args.pin) <= 8) or not args.pin.isdigit():
+        print("❌ El PIN debe ser numérico de 4 a 8 dígitos", file=sys.stderr)
+        return 1
+
+    output = args.output.open("w", newline="", encoding="utf-8") if args.output else sys.stdout
+    with SIMConfigurator(args.port, args.baudrate) as sim:
+        if sim.ser is None:
+            return 1
+
+        _, status = sim.exchange(bytes([0x00, 0x20, 0x00, 0x01, 0x08]) + args.pin.encode().ljust(8, b"\xFF"), 2)
+        if status != 0x9000:
+            print(f"❌ PIN rechazado (SW={status:04X})", file=sys.stderr)
+            return 1
+
+        writer = csv.writer(output)
+        writer.writerow(["rand", "autn", "result", "res", "ck", "ik"])
+        rows = verify(sim, pairs) if args.input else generate(sim, args.count, amf)
+        start = time.monotonic()
+        produced = 0
+        try:
+            for row in rows:
+                writer.writerow(row)
+                produced += 1
+        except RuntimeError as exc:
+            print(f"❌ {exc}", file=sys.stderr)
+            return 1
+        finally:
+            elapsed = time.monotonic() - start
+            if output is not sys.stdout:
+                output.close()
+            if elapsed > 0:
+                print(f"📊 {produced} vectores en {elapsed:.1f} s ({produced * 60 / elapsed:.0f}/min)", file=sys.stderr)
+
+    return 0
+
+
+if __name__ == "__main__":
+    raise SystemExit(main())
@@ -7,7 +7,7 @@ import argparse
 import json
 from dataclasses import dataclass
 from pathlib import Path
-from typing import Dict, Optional
+from typing import Dict, Optional, Tuple
 
 import serial
 import time
@@ -15,14 +15,35 @@ import time
 CLA_CONFIG = 0x80
 INS_WRITE_CONFIG = 0xD0
 INS_READ_CONFIG = 0xD1
+INS_GET_DIAGNOSTICS = 0xD2
+INS_TRANSACTION = 0xD3
+INS_SWITCH_PROFILE = 0xD4
 INS_XOR_AUTH = 0xA0
+INS_BATCH_AUTH = 0xA1
 INS_RESET_SIM = 0xE0
+CLA_USAT = 0x80
+INS_USAT_FETCH = 0x12
 
 DATA_TYPE_IMSI = 0x01
 DATA_TYPE_KEY = 0x02
 DATA_TYPE_OPC = 0x03
 DATA_TYPE_PIN = 0x04
 DATA_TYPE_STATUS = 0x05
+DATA_TYPE_ALGORITHM = 0x06
+DATA_TYPE_TOPC = 0x07
+DATA_TYPE_SUCI_INFO = 0x08
+DATA_TYPE_ROUTING = 0x09
+DATA_TYPE_PERSONALIZE = 0x0A
+
+ALGORITHMS = {"milenage": 0x00, "tuak": 0x01}
+SUCI_SCHEME_PROFILE_A = 0x01
+
+TRANSACTION_BEGIN = 0x01
+TRANSACTION_COMMIT = 0x02
+TRANSACTION_ABORT = 0x03
+
+BATCH_AUTH_VERIFY = 0x00
+BATCH_AUTH_GENERATE = 0x01
 
 
 def _as_hex(value: str, expected_length: int) -> bytes:
@@ -54,22 +75,53 @@ def _as_bcd(value: str, pad_to: int = 8) -> bytes:
     return bytes([len(value)]) + bytes(imsi_bytes).ljust(pad_to, b"\xFF")
 
 
+def _as_routing(value: str) -> bytes:
+    # Routing indicator de 1 a 4 dígitos en BCD, nibble bajo primero (TS 31.102 §4.4.11.11)
+    if not value.isdigit() or not (1 <= len(value) <= 4):
+        raise ValueError("El routing indicator debe tener de 1 a 4 dígitos")
+    digits = [int(d) for d in value] + [0xF] * (4 - len(value))
+    return bytes([(digits[1] << 4) | digits[0], (digits[3] << 4) | digits[2]])
+
+
+def _suci_calc_info(public_key: bytes, key_id: int) -> bytes:
+    # EF_SUCI_Calc_Info (TS 31.102 §4.4.11.8): perfil A con la clave 1
+    keys = bytes([0x80, 0x01, key_id, 0x81, len(public_key)]) + public_key
+    return bytes([0xA0, 0x02, SUCI_SCHEME_PROFILE_A, 0x01, 0xA1, len(keys)]) + keys
+
+
 @dataclass
 class Profile:
     imsi: str
     key: str
     opc: str
     pin: str = "0000"
+    algorithm: str = "milenage"
+    topc: str = ""
+    keccak_iterations: str = "1"
+    hn_public_key: str = ""
+    hn_key_id: str = "1"
+    routing_indicator: str = ""
 
     def normalized(self) -> Dict[str, bytes]:
         if not (4 <= len(self.pin) <= 8) or not self.pin.isdigit():
             raise ValueError("El PIN debe ser numérico de 4 a 8 dígitos")
+        if self.algorithm.lower() not in ALGORITHMS:
+            raise ValueError("El algoritmo debe ser 'milenage' o 'tuak'")
+        if not self.keccak_iterations.isdigit() or not (1 <= int(self.keccak_iterations) <= 255):
+            raise ValueError("Las iteraciones de Keccak deben estar entre 1 y 255")
+        if not self.hn_key_id.isdigit() or not (0 <= int(self.hn_key_id) <= 255):
+            raise ValueError("El identificador de la clave de red debe estar entre 0 y 255")
 
         return {
             "imsi": _as_bcd(self.imsi),
             "key": _as_hex(self.key, 16),
             "opc": _as_hex(self.opc, 16),
             "pin": self.pin.encode().ljust(8, b"\xFF"),
+            "algorithm": bytes([ALGORITHMS[self.algorithm.lower()], int(self.keccak_iterations)]),
+            "topc": _as_hex(self.topc, 32) if self.topc else b"",
+            "suci_info": _suci_calc_info(_as_hex(self.hn_public_key, 32), int(self.hn_key_id))
+                         if self.hn_public_key else b"",
+            "routing": _as_routing(self.routing_indicator) if self.routing_indicator else b"",
         }
 
 
@@ -131,6 +183,18 @@ class SIMConfigurator:
         print("❌ Error: Respuesta muy corta")
         return None, 0x6F00
 
+    def exchange(self, apdu: bytes, expected: int) -> Tuple[bytes, int]:
+        """Intercambio sin la pausa fija de send_apdu(): lee los bytes esperados
+        (datos + SW) o lo que llegue antes del timeout del puerto."""
+        if self.ser is None:
+            return b"", 0x6F00
+
+        self.ser.write(apdu)
+        response = self.ser.read(expected)
+        if len(response) < 2:
+            return b"", 0x6F00
+        return response[:-2], (response[-2] << 8) | response[-1]
+
     # ------------------------------------------------------------------
     def configure_imsi(self, imsi_bytes: bytes) -> bool:
         print("🔧 Configurando IMSI")
@@ -159,6 +223,42 @@ class SIMConfigurator:
         print("❌ Error configurando OPc")
         return False
 
+    def configure_algorithm(self, algorithm_bytes: bytes) -> bool:
+        print("🔧 Configurando algoritmo de autenticación")
+        _, status = self.send_apdu(CLA_CONFIG, INS_WRITE_CONFIG, DATA_TYPE_ALGORITHM, 0x00, algorithm_bytes)
+        if status == 0x9000:
+            print("✅ Algoritmo configurado correctamente")
+            return True
+        print("❌ Error configurando algoritmo")
+        return False
+
+    def configure_topc(self, topc_bytes: bytes) -> bool:
+        print("🔧 Configurando TOPc")
+        _, status = self.send_apdu(CLA_CONFIG, INS_WRITE_CONFIG, DATA_TYPE_TOPC, 0x00, topc_bytes)
+        if status == 0x9000:
+            print("✅ TOPc configurado correctamente")
+            return True
+        print("❌ Error configurando TOPc")
+        return False
+
+    def configure_suci_info(self, info_bytes: bytes) -> bool:
+        print("🔧 Configurando cálculo del SUCI")
+        _, status = self.send_apdu(CLA_CONFIG, INS_WRITE_CONFIG, DATA_TYPE_SUCI_INFO, 0x00, info_bytes)
+        if status == 0x9000:
+            print("✅ Clave pública de la red configurada correctamente")
+            return True
+        print("❌ Error configurando el cálculo del SUCI")
+        return False
+
+    def configure_routing(self, routing_bytes: bytes) -> bool:
+        print("🔧 Configurando routing indicator")
+        _, status = self.send_apdu(CLA_CONFIG, INS_WRITE_CONFIG, DATA_TYPE_ROUTING, 0x00, routing_bytes)
+        if status == 0x9000:
+            print("✅ Routing indicator configurado correctamente")
+            return True
+        print("❌ Error configurando routing indicator")
+        return False
+
     def configure_pin(self, pin_bytes: bytes) -> bool:
         print("🔧 Configurando PIN")
         _, status = self.send_apdu(CLA_CONFIG, INS_WRITE_CONFIG, DATA_TYPE_PIN, 0x00, pin_bytes)
@@ -182,6 +282,22 @@ class SIMConfigurator:
         print("❌ Error leyendo estado")
         return False
 
+    def read_diagnostics(self, reset: bool = False) -> bool:
+        print("🔧 Leyendo contadores de la caché write-back...")
+        data, status = self.send_apdu(CLA_CONFIG, INS_GET_DIAGNOSTICS, 0x00, 0x01 if reset else 0x00, le=0x0B)
+        if status == 0x9000 and data and len(data) >= 11:
+            hits, coalesced, flushes = (int.from_bytes(data[i:i + 2], "big") for i in (0, 2, 4))
+            print("📊 Caché write-back:")
+            print(f"   • Aciertos: {hits}")
+            print(f"   • Escrituras fusionadas: {coalesced}")
+            print(f"   • Volcados a flash: {flushes}")
+            print(f"   • Pendientes: {data[6]}")
+            print(f"⏱️ Último comando lento: {int.from_bytes(data[7:11], 'big')} ciclos máquina")
+            return True
+
+        print("❌ Error leyendo diagnóstico")
+        return False
+
     def test_xor_auth(self, rand_hex: str = "000102030405060708090A0B0C0D0E0F") -> bool:
         print(f"🔧 Probando autenticación XOR con RAND: {rand_hex}")
         try:
@@ -204,6 +320,26 @@ class SIMConfigurator:
         print("❌ Autenticación XOR fallida")
         return False
 
+    def transaction(self, operation: int) -> bool:
+        names = {TRANSACTION_BEGIN: "inicio", TRANSACTION_COMMIT: "confirmación", TRANSACTION_ABORT: "anulación"}
+        _, status = self.send_apdu(CLA_CONFIG, INS_TRANSACTION, operation, 0x00)
+        if status == 0x9000:
+            return True
+        print(f"❌ Error en {names.get(operation, 'transacción')} (SW={status:04X})")
+        return False
+
+    def switch_profile(self, slot: int) -> bool:
+        print(f"🔀 Activando el perfil {slot}")
+        _, status = self.send_apdu(CLA_CONFIG, INS_SWITCH_PROFILE, slot, 0x00)
+        if (status >> 8) == 0x91:
+            # La tarjeta deja un REFRESH para la terminal: aquí basta con recogerlo
+            _, status = self.send_apdu(CLA_USAT, INS_USAT_FETCH, 0x00, 0x00, le=status & 0xFF)
+        if status == 0x9000:
+            print(f"✅ Perfil {slot} activo")
+            return True
+        print(f"❌ Error activando el perfil {slot} (SW={status:04X})")
+        return False
+
     def reset_sim(self) -> bool:
         print("🔧 Reiniciando la SIM")
         _, status = self.send_apdu(CLA_CONFIG, INS_RESET_SIM, 0x00, 0x00)
@@ -248,32 +384,63 @@ def parse_arguments() -> argparse.Namespace:
     parser = argparse.ArgumentParser(description="Configurar parámetros de la USIM OpenUSIM")
     parser.add_argument("--port", default="/dev/ttyUSB0", help="Puerto serie del programador (por defecto /dev/ttyUSB0)")
     parser.add_argument("--baudrate", default=115200, type=int, help="Baudrate del puerto serie")
-    parser.add_argument("--profile", type=Path, help="Archivo JSON con imsi/key/opc/pin")
+    parser.add_argument("--profile", type=Path, help="Archivo JSON con imsi/key/opc/pin/algorithm/topc/hn_public_key/routing_indicator")
     parser.add_argument("--imsi", help="IMSI a programar (override)")
     parser.add_argument("--key", help="Clave K en hex de 32 caracteres")
     parser.add_argument("--opc", help="Valor OPc en hex de 32 caracteres")
     parser.add_argument("--pin", help="PIN de 4-8 dígitos")
+    parser.add_argument("--algorithm", choices=sorted(ALGORITHMS), help="Algoritmo de autenticación (por defecto milenage)")
+    parser.add_argument("--topc", help="Valor TOPc para TUAK en hex de 64 caracteres")
+    parser.add_argument("--keccak-iterations", help="Iteraciones de Keccak para TUAK (1-255)")
+    parser.add_argument("--hn-public-key", help="Clave pública X25519 de la red (perfil A) en hex de 64 caracteres")
+    parser.add_argument("--hn-key-id", help="Identificador de la clave pública de la red (por defecto 1)")
+    parser.add_argument("--routing-indicator", help="Routing indicator de 1 a 4 dígitos")
     parser.add_argument("--rand", help="RAND hexadecimal para la prueba XOR")
     parser.add_argument("--skip-auth", action="store_true", help="No ejecutar la prueba de autenticación XOR")
     parser.add_argument("--no-reset", action="store_true", help="No enviar el comando de reset inicial")
+    parser.add_argument("--slot", type=int, help="Perfil de la tarjeta que se activa y personaliza (0-7)")
     return parser.parse_args()
 
 
-def run_configuration(sim: SIMConfigurator, profile: Profile, skip_auth: bool, rand: Optional[str], perform_reset: bool) -> None:
+def run_configuration(sim: SIMConfigurator, profile: Profile, skip_auth: bool, rand: Optional[str], perform_reset: bool,
+                      slot: Optional[int] = None) -> None:
     values = profile.normalized()
 
+    # Lo que sigue (reset de contadores incluido) se aplica al perfil activo
+    if slot is not None and not sim.switch_profile(slot):
+        return
+
     if perform_reset:
         sim.reset_sim()
 
     print("\n📋 Configurando SIM")
     print("===================")
 
+    # Todo en una transacción: si la tarjeta se extrae a medias conserva el
+    # perfil anterior completo, nunca un IMSI nuevo con la K antigua
+    if not sim.transaction(TRANSACTION_BEGIN):
+        return
+
     results = [
         ("IMSI", sim.configure_imsi(values["imsi"])),
         ("Clave K", sim.configure_key(values["key"])),
-        ("OPc", sim.configure_opc(values["opc"])),
         ("PIN", sim.configure_pin(values["pin"])),
     ]
+    results.append(("OPc", sim.configure_opc(values["opc"])))
+    if values["topc"]:
+        results.append(("TOPc", sim.configure_topc(values["topc"])))
+    if values["suci_info"]:
+        results.append(("SUCI", sim.configure_suci_info(values["suci_info"])))
+    if values["routing"]:
+        results.append(("Routing indicator", sim.configure_routing(values["routing"])))
+    results.append(("Algoritmo", sim.configure_algorithm(values["algorithm"])))
+
+    if all(success for _, success in results):
+        committed = sim.transaction(TRANSACTION_COMMIT)
+    else:
+        sim.transaction(TRANSACTION_ABORT)
+        committed = False
+    results.append(("Grabación atómica", committed))
 
     print("\n📊 Resumen de configuración:")
     print("===========================")
@@ -284,6 +451,7 @@ def run_configuration(sim: SIMConfigurator, profile: Profile, skip_auth: bool, r
     print("\n📈 Estado final de la SIM:")
     print("===========================")
     sim.read_status()
+    sim.read_diagnostics()
 
     if not skip_auth:
         print("\n🔐 Probando autenticación:")
@@ -302,6 +470,12 @@ def main() -> int:
             "key": args.key,
             "opc": args.opc,
             "pin": args.pin,
+            "algorithm": args.algorithm,
+            "topc": args.topc,
+            "keccak_iterations": args.keccak_iterations,
+            "hn_public_key": args.hn_public_key,
+            "hn_key_id": args.hn_key_id,
+            "routing_indicator": args.routing_indicator,
         })
     except (RuntimeError, TypeError, ValueError) as exc:
         print(f"❌ {exc}")
@@ -312,7 +486,7 @@ def main() -> int:
             return 1
 
         try:
-            run_configuration(sim, profile, args.skip_auth, args.rand, not args.no_reset)
+            run_configuration(sim, profile, args.skip_auth, args.rand, not args.no_reset, args.slot)
         except ValueError as exc:
             print(f"❌ {exc}")
             return 1
@@ -0,0 +1,223 @@
+#!/usr/bin/env python3
+"""Personalización por lote con diversificación de claves.
+
+La tarjeta guarda la clave maestra del lote y su tabla de OP (sección
+``batch`` de config/files.json) y, con un único APDU (IMSI, ICCID e índice de
+OP), deriva K y OPc igual que este script:
+
+    K   = AES-CBC-MAC(maestra, EF_ICCID | EF_IMSI | 80 00..00)   (2 bloques)
+    OPc = AES_K(OP) ^ OP
+
+Sin --port solo se calculan K y OPc. Con --port, además, se personaliza cada
+tarjeta del lote (una por línea del CSV, insertándolas por turno, o una sola
+con --iccid/--imsi). La salida son órdenes ``open5gs-dbctl add`` o CSV para
+dar de alta los suscriptores en el núcleo.
+"""
+
+from __future__ import annotations
+
+import argparse
+import csv
+import json
+import sys
+from pathlib import Path
+from typing import Dict, Iterable, List, Sequence, Tuple
+
+from configure_sim import (
+    CLA_CONFIG,
+    DATA_TYPE_PERSONALIZE,
+    INS_WRITE_CONFIG,
+    SIMConfigurator,
+    _as_bcd,
+    _as_hex,
+)
+
+ICCID_SIZE = 10
+BLOCK_SIZE = 16
+
+
+# --- AES-128 (FIPS-197), solo cifrado ---------------------------------------
+
+def _xtime(value: int) -> int:
+    value <<= 1
+    return (value ^ 0x11B) if value & 0x100 else value
+
+
+def _build_sbox() -> List[int]:
+    # Inverso en GF(2^8) seguido de la transformación afín
+    sbox = [0x63] * 256
+    p = q = 1
+    while True:
+        p ^= _xtime(p)
+        q ^= q << 1
+        q ^= q << 2
+        q ^= q << 4
+        q &= 0xFF
+        if q & 0x80:
+            q ^= 0x09
+        x = q ^ ((q << 1) | (q >> 7)) ^ ((q << 2) | (q >> 6)) ^ ((q << 3) | (q >> 5)) ^ ((q << 4) | (q >> 4))
+        sbox[p] = (x ^ 0x63) & 0xFF
+        if p == 1:
+            return sbox
+
+
+SBOX = _build_sbox()
+
+
+def aes128_encrypt(key: bytes, block: bytes) -> bytes:
+    state = list(block)
+    round_key = list(key)
+    rcon = 1
+
+    def add_round_key() -> None:
+        for i in range(BLOCK_SIZE):
+            state[i] ^= round_key[i]
+
+    def next_round_key() -> None:
+        nonlocal rcon
+        t = [SBOX[round_key[13]] ^ rcon, SBOX[round_key[14]], SBOX[round_key[15]], SBOX[round_key[12]]]
+        for i in range(BLOCK_SIZE):
+            round_key[i] ^= t[i] if i < 4 else round_key[i - 4]
+        rcon = _xtime(rcon)
+
+    add_round_key()
+    for rnd in range(1, 11):
+        state[:] = [SBOX[b] for b in state]
+        # ShiftRows: la fila r (bytes r, r+4...) rota r posiciones
+        state[:] = [state[(i + 4 * (i % 4)) % BLOCK_SIZE] for i in range(BLOCK_SIZE)]
+        if rnd != 10:
+            for c in range(0, BLOCK_SIZE, 4):
+                a = state[c:c + 4]
+                total = a[0] ^ a[1] ^ a[2] ^ a[3]
+                for r in range(4):
+                    state[c + r] = a[r] ^ total ^ _xtime(a[r] ^ a[(r + 1) % 4])
+        next_round_key()
+        add_round_key()
+    return bytes(state)
+
+
+# --- Derivación (igual que usim_secrets_diversify) --------------------------
+
+def _xor(a: bytes, b: bytes) -> bytes:
+    return bytes(x ^ y for x, y in zip(a, b))
+
+
+def derive(master: bytes, op: bytes, iccid: bytes, imsi: bytes) -> Tuple[bytes, bytes]:
+    message = (iccid + imsi + b"\x80").ljust(2 * BLOCK_SIZE, b"\x00")
+    chained = aes128_encrypt(master, message[:BLOCK_SIZE])
+    k = aes128_encrypt(master, _xor(chained, message[BLOCK_SIZE:]))
+    opc = _xor(aes128_encrypt(k, op), op)
+    return k, opc
+
+
+def _as_iccid(value: str) -> bytes:
+    # EF_ICCID (TS 102 221 §13.2): BCD con los nibbles intercambiados y relleno F
+    if not value.isdigit() or not (18 <= len(value) <= 20):
+        raise ValueError(f"ICCID inválido: {value} (18-20 dígitos)")
+    digits = [int(d) for d in value] + [0xF] * (2 * ICCID_SIZE - len(value))
+    return bytes((digits[i + 1] << 4) | digits[i] for i in range(0, len(digits), 2))
+
+
+def load_batch(path: Path) -> Tuple[bytes, List[bytes]]:
+    with path.open("r", encoding="utf-8") as handle:
+        batch = json.load(handle).get("batch", {})
+    master = _as_hex(batch.get("master_key", ""), BLOCK_SIZE)
+    return master, [_as_hex(op, BLOCK_SIZE) for op in batch.get("op", [])]
+
+
+def load_cards(path: Path) -> List[Dict[str, str]]:
+    """CSV con columnas iccid, imsi y, opcional, op_index."""
+    with path.open("r", encoding="utf-8", newline="") as handle:
+        return [row for row in csv.DictReader(handle) if row.get("iccid", "").strip()]
+
+
+def personalize(sim: SIMConfigurator, imsi: bytes, iccid: bytes, op_index: int) -> int:
+    data = imsi + iccid + bytes([op_index])
+    apdu = bytes([CLA_CONFIG, INS_WRITE_CONFIG, DATA_TYPE_PERSONALIZE, 0x00, len(data)]) + data
+    _, status = sim.exchange(apdu, 2)
+    return status
+
+
+def export(rows: Iterable[Sequence[str]], output_format: str, output) -> None:
+    if output_format == "csv":
+        writer = csv.writer(output)
+        writer.writerow(["imsi", "iccid", "k", "opc"])
+        writer.writerows(rows)
+        return
+    for imsi, _, k, opc in rows:
+        output.write(f"open5gs-dbctl add {imsi} {k} {opc}\n")
+
+
+def parse_arguments() -> argparse.Namespace:
+    parser = argparse.ArgumentParser(description="Derivar K/OPc de la clave maestra del lote y personalizar tarjetas")
+    parser.add_argument("--config", type=Path, default=Path(__file__).resolve().parent.parent / "config" / "files.json",
+                        help="Configuración con la sección batch (por defecto config/files.json)")
+    parser.add_argument("--cards", type=Path, help="CSV del lote: iccid,imsi[,op_index]")
+    parser.add_argument("--iccid", help="ICCID de una sola tarjeta")
+    parser.add_argument("--imsi", help="IMSI de una sola tarjeta")
+    parser.add_argument("--op-index", default=0, type=int, help="Índice del OP en la tabla del lote (por defecto 0)")
+    parser.add_argument("--port", help="Puerto serie: personalizar además de calcular")
+    parser.add_argument("--baudrate", default=115200, type=int, help="Baudrate del puerto serie")
+    parser.add_argument("--format", choices=("dbctl", "csv"), default="dbctl", help="Formato de exportación")
+    parser.add_argument("--output", type=Path, help="Archivo de salida (por defecto, la salida estándar)")
+    return parser.parse_args()
+
+
+def main() -> int:
+    args = parse_arguments()
+
+    try:
+        master, ops = load_batch(args.config)
+        if args.cards:
+            cards = load_cards(args.cards)
+        elif args.iccid and args.imsi:
+            cards = [{"iccid": args.iccid, "imsi": args.imsi, "op_index": str(args.op_index)}]
+        else:
+            raise ValueError("Indica --cards o --iccid y --imsi")
+
+        batch = []
+        for card in cards:
+            op_index = int(card.get("op_index") or args.op_index)
+            if not 0 <= op_index < len(ops):
+                raise ValueError(f"Índice de OP {op_index} fuera de la tabla ({len(ops)} valores)")
+            imsi = card["imsi"].strip()
+            iccid = card["iccid"].strip()
+            batch.append((imsi, iccid, _as_bcd(imsi), _as_iccid(iccid), op_index))
+    except (OSError, KeyError, ValueError, json.JSONDecodeError) as exc:
+        print(f"❌ {exc}", file=sys.stderr)
+        return 1
+
+    rows = []
+    sim = SIMConfigurator(args.port, args.baudrate) if args.port else None
+    try:
+        if sim is not None and sim.ser is None:
+            return 1
+        for imsi, iccid, imsi_bytes, iccid_bytes, op_index in batch:
+            if sim is not None:
+                if len(batch) > 1:
+                    # El aviso va a stderr: stdout puede ser la exportación
+                    print(f"💳 Inserta la tarjeta {iccid} y pulsa Enter", file=sys.stderr)
+                    input()
+                status = personalize(sim, imsi_bytes, iccid_bytes, op_index)
+                if status != 0x9000:
+                    print(f"❌ {iccid}: personalización rechazada (SW={status:04X})", file=sys.stderr)
+                    continue
+            k, opc = derive(master, ops[op_index], iccid_bytes, imsi_bytes)
+            rows.append((imsi, iccid, k.hex().upper(), opc.hex().upper()))
+    finally:
+        if sim is not None:
+            sim.close()
+
+    output = args.output.open("w", newline="", encoding="utf-8") if args.output else sys.stdout
+    try:
+        export(rows, args.format, output)
+    finally:
+        if output is not sys.stdout:
+            output.close()
+
+    print(f"📊 {len(rows)} de {len(batch)} tarjetas", file=sys.stderr)
+    return 0 if len(rows) == len(batch) else 1
+
+
+if __name__ == "__main__":
+    raise SystemExit(main())
@@ -0,0 +1,230 @@
+#!/usr/bin/env python3
+"""Generador del ATR (ISO/IEC 7816-3, ETSI TS 102 221) a partir de config/atr.json.
+
+Produce un ``.c`` con la tabla ``usim_atr`` en ``__code`` y un ``.h`` con las
+macros que usan ``main.c`` (envío del ATR) y ``chip_init.c`` (límite de PPS).
+
+Si ``atr.json`` no fija ``fi``/``di``, TA1 anuncia el par más rápido que
+admite el motor de bits: la ETU mínima se lee de ``SIM_PPS_MIN_ETU_TICKS`` y
+``SIM_MACHINE_CYCLE_DIV`` en ``src/chip_init.c``.
+"""
+
+from __future__ import annotations
+
+import argparse
+import json
+import re
+from pathlib import Path
+from typing import Dict, List, Sequence, Tuple
+
+# Tablas 7 y 8 de ISO/IEC 7816-3
+FI_TABLE = {372: 0x1, 558: 0x2, 744: 0x3, 1116: 0x4, 1488: 0x5, 1860: 0x6,
+            512: 0x9, 768: 0xA, 1024: 0xB, 1536: 0xC, 2048: 0xD}
+DI_TABLE = {1: 0x1, 2: 0x2, 4: 0x3, 8: 0x4, 16: 0x5, 32: 0x6, 64: 0x7, 12: 0x8, 20: 0x9}
+
+CHIP_SOURCE = Path(__file__).resolve().parent.parent / "src" / "chip_init.c"
+
+CLOCK_STOP = {"not_supported": 0x00, "low": 0x40, "high": 0x80, "no_preference": 0xC0}
+VOLTAGE_CLASS = {"A": 0x01, "B": 0x02, "C": 0x04}
+
+SUPPORTED_PROTOCOLS = (0, 1)
+
+# Parámetros T=1 por defecto (ISO/IEC 7816-3 §11.4)
+T1_DEFAULTS = {"ifsc": 254, "bwi": 4, "cwi": 5}
+
+
+class AtrError(ValueError):
+    pass
+
+
+def min_clocks_per_etu(chip_source: Path) -> int:
+    """Ciclos de reloj por ETU más cortos que acepta ``chip_init.c``."""
+    text = chip_source.read_text(encoding="utf-8")
+    values = {}
+    for name in ("SIM_PPS_MIN_ETU_TICKS", "SIM_MACHINE_CYCLE_DIV"):
+        match = re.search(rf"^#define\s+{name}\s+(\d+)U?L?\b", text, re.MULTILINE)
+        if match is None:
+            raise AtrError(f"{name} no aparece en {chip_source}")
+        values[name] = int(match.group(1))
+    return values["SIM_PPS_MIN_ETU_TICKS"] * values["SIM_MACHINE_CYCLE_DIV"]
+
+
+def fastest_pair(min_clocks: int) -> Tuple[int, int]:
+    """Par Fi/Di de las tablas con la ETU más corta no inferior al mínimo.
+
+    A igual ETU se queda el Fi más bajo.
+    """
+    pairs = [(fi / di, fi, di) for fi in FI_TABLE for di in DI_TABLE if fi / di >= min_clocks]
+    _, fi, di = min(pairs)
+    return fi, di
+
+
+def transmission_factors(cfg: Dict, min_clocks: int) -> Tuple[int, int]:
+    if "fi" not in cfg and "di" not in cfg:
+        return fastest_pair(min_clocks)
+    fi = int(cfg.get("fi", 372))
+    di = int(cfg.get("di", 1))
+    if fi not in FI_TABLE or di not in DI_TABLE:
+        raise AtrError(f"Par Fi/Di no definido en ISO/IEC 7816-3: {fi}/{di}")
+    if fi / di < min_clocks:
+        raise AtrError(
+            f"Fi/Di={fi}/{di} ({fi / di:.1f} clk/ETU) supera al motor de bits "
+            f"(mínimo {min_clocks} clk/ETU)")
+    return fi, di
+
+
+def build_atr(cfg: Dict, fi: int, di: int) -> List[int]:
+
+    protocols = [int(t) for t in cfg.get("protocols", [0])]
+    if not protocols or any(t not in SUPPORTED_PROTOCOLS for t in protocols):
+        raise AtrError(f"Protocolos no soportados: {protocols}")
+    if sorted(set(protocols)) != protocols:
+        raise AtrError("Los protocolos deben indicarse en orden ascendente sin repetir")
+
+    historical = bytes.fromhex(cfg.get("historical_bytes", ""))
+    if len(historical) > 15:
+        raise AtrError("Máximo 15 bytes históricos")
+
+    clock_stop = cfg.get("clock_stop", "not_supported")
+    if clock_stop not in CLOCK_STOP:
+        raise AtrError(f"clock_stop inválido: {clock_stop}")
+    classes = 0
+    for name in cfg.get("voltage_classes", ["A"]):
+        if name not in VOLTAGE_CLASS:
+            raise AtrError(f"Clase de tensión inválida: {name}")
+        classes |= VOLTAGE_CLASS[name]
+
+    specific = bool(cfg.get("specific_mode", False))
+
+    # Grupos de bytes de interfaz (TAi, TBi, TCi); groups[n] sigue a TDn
+    ta1 = (FI_TABLE[fi] << 4) | DI_TABLE[di]
+    groups = [
+        {"TA": ta1},
+        {"TA": protocols[0]} if specific else {},
+    ]
+    # TD1 anuncia el primer protocolo; cada TDi posterior anuncia el siguiente
+    # y el último grupo corresponde a T=15 (parámetros globales de la interfaz).
+    # Los parámetros de T=1 van tras el primer TDi (i >= 2) que indique T=1,
+    # por lo que si T=1 es el primer protocolo se repite en TD2.
+    group_protocols = [protocols[0]] + protocols[1:]
+    if protocols[0] == 1:
+        group_protocols.insert(1, 1)
+    group_protocols.append(15)
+    while len(groups) < len(group_protocols) + 1:
+        groups.append({})
+    groups[len(group_protocols)]["TA"] = CLOCK_STOP[clock_stop] | classes
+
+    if 1 in protocols:
+        t1 = dict(T1_DEFAULTS, **cfg.get("t1", {}))
+        if not 1 <= int(t1["ifsc"]) <= 254:
+            raise AtrError("IFSC debe estar entre 1 y 254")
+        if not 0 <= int(t1["bwi"]) <= 9 or not 0 <= int(t1["cwi"]) <= 15:
+            raise AtrError("BWI/CWI fuera de rango")
+        t1_group = group_protocols.index(1, 1) + 1
+        groups[t1_group]["TA"] = int(t1["ifsc"])
+        groups[t1_group]["TB"] = (int(t1["bwi"]) << 4) | int(t1["cwi"])
+
+    atr = [0x3B]
+    t0_index = len(atr)
+    atr.append(len(historical))
+    y_index = t0_index
+    for number, group in enumerate(groups):
+        y = 0
+        body = []
+        for bit, key in ((0x10, "TA"), (0x20, "TB"), (0x40, "TC")):
+            if key in group:
+                y |= bit
+                body.append(group[key])
+        more = number < len(group_protocols)
+        if more:
+            y |= 0x80
+        atr[y_index] |= y
+        atr.extend(body)
+        if more:
+            y_index = len(atr)
+            atr.append(group_protocols[number])
+
+    atr.extend(historical)
+
+    # TCK obligatorio si se indica cualquier protocolo distinto de T=0
+    if any(t != 0 for t in group_protocols):
+        tck = 0
+        for value in atr[1:]:
+            tck ^= value
+        atr.append(tck)
+
+    if len(atr) > 33:
+        raise AtrError("El ATR excede 33 bytes")
+    return atr
+
+
+def render_header(atr: Sequence[int], cfg: Dict, fi: int, di: int) -> str:
+    ta1 = atr[2]
+    protocols = [int(t) for t in cfg.get("protocols", [0])]
+    t1 = dict(T1_DEFAULTS, **cfg.get("t1", {}))
+    return f"""/* Generado por scripts/gen_atr.py - no editar */
+#ifndef USIM_ATR_H
+#define USIM_ATR_H
+
+#include <stdint.h>
+
+#define USIM_ATR_LENGTH        {len(atr)}U
+#define USIM_ATR_TA1           0x{ta1:02X}U
+#define USIM_ATR_FI            {fi}U
+#define USIM_ATR_DI            {di}U
+#define USIM_ATR_SPECIFIC_MODE {1 if cfg.get("specific_mode") else 0}
+#define USIM_ATR_DEFAULT_PROTOCOL {protocols[0]}U
+#define USIM_ATR_OFFERS_T0     {1 if 0 in protocols else 0}
+#define USIM_ATR_OFFERS_T1     {1 if 1 in protocols else 0}
+#define USIM_ATR_T1_IFSC       {int(t1["ifsc"])}U
+#define USIM_ATR_T1_BWI        {int(t1["bwi"])}U
+
+extern const __code uint8_t usim_atr[USIM_ATR_LENGTH];
+
+#endif
+"""
+
+
+def render_source(atr: Sequence[int]) -> str:
+    rows = []
+    for start in range(0, len(atr), 8):
+        rows.append("    " + ", ".join(f"0x{b:02X}" for b in atr[start:start + 8]))
+    body = ",\n".join(rows)
+    return f"""/* Generado por scripts/gen_atr.py - no editar */
+#include "usim_atr.h"
+
+const __code uint8_t usim_atr[USIM_ATR_LENGTH] = {{
+{body}
+}};
+"""
+
+
+def parse_args(argv: Sequence[str] | None = None) -> argparse.Namespace:
+    parser = argparse.ArgumentParser(description="Generar la tabla ATR del firmware")
+    parser.add_argument("config", type=Path, help="Descripción JSON del ATR")
+    parser.add_argument("out_dir", type=Path, help="Directorio de salida (usim_atr.c/.h)")
+    parser.add_argument("--chip", type=Path, default=CHIP_SOURCE,
+                        help="Fuente con la ETU mínima del motor de bits (chip_init.c)")
+    return parser.parse_args(argv)
+
+
+def main(argv: Sequence[str] | None = None) -> int:
+    args = parse_args(argv)
+    try:
+        with args.config.open("r", encoding="utf-8") as handle:
+            cfg = json.load(handle)
+        fi, di = transmission_factors(cfg, min_clocks_per_etu(args.chip))
+        atr = build_atr(cfg, fi, di)
+    except (OSError, json.JSONDecodeError, AtrError, ValueError) as exc:
+        print(f"❌ ATR: {exc}")
+        return 1
+
+    args.out_dir.mkdir(parents=True, exist_ok=True)
+    (args.out_dir / "usim_atr.h").write_text(render_header(atr, cfg, fi, di), encoding="utf-8")
+    (args.out_dir / "usim_atr.c").write_text(render_source(atr), encoding="utf-8")
+    print("ATR: " + " ".join(f"{b:02X}" for b in atr))
+    return 0
+
+
+if __name__ == "__main__":
+    raise SystemExit(main())
@@ -0,0 +1,79 @@
+#!/usr/bin/env python3
+"""Índice FID -> archivo del árbol aplanado (hash perfecto).
+
+Construye, para los FID del árbol que aplana ``gen_fs.py``, un hash
+perfecto de dos niveles (hash y desplazamiento): el FID elige un cubo con
+``(lo + hi) & BUCKET_MASK`` y el desplazamiento del cubo se mezcla con dos
+multiplicaciones de 8 bits, que en el 8051 son dos ``MUL AB``::
+
+    x    = (uint8_t)((lo ^ disp[cubo]) * MIX1)
+    hueco = (uint8_t)((x ^ hi) * MIX2) >> SHIFT
+
+``gen_fs.py`` emite las tablas en ``__code``. Un FID puede aparecer bajo
+varios DF; el índice apunta a la primera entrada, que es la que devuelve
+``usim_find_file_index()``.
+"""
+
+from __future__ import annotations
+
+from typing import Dict, List, Optional, Sequence, Tuple
+
+EMPTY_SLOT = 0xFF
+MIX1 = 0x9D
+MIX2 = 0x3B
+
+
+class FidIndexError(ValueError):
+    pass
+
+
+def fid_bucket(fid: int, bucket_mask: int) -> int:
+    return ((fid & 0xFF) + (fid >> 8)) & 0xFF & bucket_mask
+
+
+def fid_slot(fid: int, disp: int, shift: int) -> int:
+    mixed = (((fid & 0xFF) ^ disp) * MIX1) & 0xFF
+    return (((mixed ^ (fid >> 8)) * MIX2) & 0xFF) >> shift
+
+
+def place_buckets(first: Dict[int, int], size: int, bucket_count: int) -> Optional[Tuple[List[int], List[int]]]:
+    shift = 8 - (size.bit_length() - 1)
+    buckets: Dict[int, List[int]] = {}
+    for fid in first:
+        buckets.setdefault(fid_bucket(fid, bucket_count - 1), []).append(fid)
+
+    slots = [EMPTY_SLOT] * size
+    disps = [0] * bucket_count
+    # Los cubos más poblados se colocan primero
+    for bucket, keys in sorted(buckets.items(), key=lambda item: (-len(item[1]), item[0])):
+        for disp in range(256):
+            candidate = [fid_slot(fid, disp, shift) for fid in keys]
+            if len(set(candidate)) == len(candidate) and all(slots[s] == EMPTY_SLOT for s in candidate):
+                for slot, fid in zip(candidate, keys):
+                    slots[slot] = first[fid]
+                disps[bucket] = disp
+                break
+        else:
+            return None
+    return disps, slots
+
+
+def build_index(fids: Sequence[int]) -> Tuple[List[int], List[int]]:
+    first: Dict[int, int] = {}
+    for index, fid in enumerate(fids):
+        first.setdefault(fid, index)
+
+    size = 1
+    while size < len(first):
+        size <<= 1
+
+    while size <= 256:
+        # Menos cubos = tabla de desplazamientos más pequeña
+        bucket_count = max(1, size // 4)
+        while bucket_count <= size:
+            placed = place_buckets(first, size, bucket_count)
+            if placed is not None:
+                return placed
+            bucket_count <<= 1
+        size <<= 1
+    raise FidIndexError("No existe hash perfecto con esta familia de funciones")
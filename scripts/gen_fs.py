@@ -0,0 +1,350 @@
+#!/usr/bin/env python3
+"""Generador del sistema de archivos a partir de config/files.json.
+
+Los descriptores inmutables de cada archivo (FID, tipo, tamaño, condiciones de
+acceso, SFI, estructura y enlaces del árbol) se emiten como estructura de
+arrays en ``__code``, igual que el contenido inicial de los EF, que se lee
+directamente de flash. En XRAM solo quedan el estado de cada buffer y un pool
+de copias (``shadow_pool_size``) que ``usim_files.c`` reparte al escribir un
+EF o al leer uno con valor guardado en NVM, liberando las copias que puede
+volver a leer; basta con que quepa el buffer mayor.
+
+Los secretos de larga duración (``secrets``: K, OPc y TOPc) no son EF: se
+emiten aparte, ya enmascarados con ``xor_key``, como valores de fábrica de
+``usim_secrets.c``. La clave maestra del lote y su tabla de OP (``batch``),
+de las que la tarjeta deriva K y OPc al personalizarse, se emiten igual.
+Los buffers marcados
+``write_back`` (EF que el terminal reescribe a menudo, como EF_LOCI) se
+confirman en XRAM y se vuelcan a NVM en diferido. Los marcados ``profile``
+(EF_IMSI, EF_AUTH...) tienen un valor por cada uno de los ``profiles``
+perfiles del suscriptor: en NVM se guardan en el objeto del perfil activo.
+
+El árbol se aplana por niveles: los hijos de cada DF ocupan índices
+consecutivos ordenados por FID, de modo que la búsqueda de un hijo es binaria.
+También se incluye el índice FID -> archivo de ``gen_fid_index.py``.
+"""
+
+from __future__ import annotations
+
+import argparse
+import json
+from pathlib import Path
+from typing import Dict, List, Sequence
+
+from gen_fid_index import EMPTY_SLOT, MIX1, MIX2, FidIndexError, build_index
+
+FILE_TYPES = {"MF": "FILE_TYPE_MF", "DF": "FILE_TYPE_DF", "ADF": "FILE_TYPE_DF", "EF": "FILE_TYPE_EF"}
+STRUCTURES = {"transparent": "EF_STRUCT_TRANSPARENT", "linear_fixed": "EF_STRUCT_LINEAR_FIXED",
+              "cyclic": "EF_STRUCT_CYCLIC"}
+ACCESS = {"ALWAYS": "AC_ALWAYS", "CHV1": "AC_CHV1", "ADM": "AC_ADM", "NEVER": "AC_NEVER"}
+RESERVED_FIDS = (0x3F00, 0x7FFF, 0x3FFF, 0xFFFF)
+NO_INDEX = EMPTY_SLOT
+MAX_AID_LEN = 16
+XOR_KEY_LEN = 16
+MAX_BUFFER_SIZE = 250
+MAX_PROFILES = 8
+# Orden y tamaño de los secretos en usim_secret_init (ver usim_secrets.h)
+SECRETS = (("key", 16), ("opc", 16), ("topc", 32))
+MAX_BATCH_OPS = 16
+
+
+class FsError(ValueError):
+    pass
+
+
+def parse_hex(text: str) -> bytes:
+    return bytes.fromhex(text.replace(" ", ""))
+
+
+def build_buffers(cfg: Dict) -> List[Dict]:
+    buffers = []
+    offset = 0
+    for name, spec in cfg.items():
+        size = int(spec["size"])
+        if not 0 < size <= MAX_BUFFER_SIZE:
+            raise FsError(f"Buffer {name}: tamaño fuera de rango (1..{MAX_BUFFER_SIZE}, un registro NVM)")
+        if "init" in spec:
+            init = parse_hex(spec["init"])
+            if len(init) != size:
+                raise FsError(f"Buffer {name}: init de {len(init)} bytes para tamaño {size}")
+        else:
+            init = bytes([int(spec.get("fill", "00"), 16)]) * size
+        policy = "USIM_POLICY_WRITE_BACK" if spec.get("write_back", False) else "USIM_POLICY_WRITE_THROUGH"
+        profile = sum(1 for b in buffers if b["profile"] != NO_INDEX) if spec.get("profile", False) else NO_INDEX
+        buffers.append({"name": name, "size": size, "offset": offset, "init": init, "policy": policy,
+                        "profile": profile})
+        offset += size
+    if offset > 0xFFFF:
+        raise FsError("El pool de datos supera 64 KB")
+    return buffers
+
+
+def build_secrets(cfg: Dict, xor_key: bytes) -> bytes:
+    """Valores de fábrica de los secretos, concatenados y enmascarados."""
+    secrets = b""
+    for name, size in SECRETS:
+        value = parse_hex(cfg.get(name, "00" * size))
+        if len(value) != size:
+            raise FsError(f"Secreto {name}: {len(value)} bytes, se esperaban {size}")
+        secrets += value
+    return bytes(b ^ xor_key[i % XOR_KEY_LEN] for i, b in enumerate(secrets))
+
+
+def build_batch(cfg: Dict, xor_key: bytes) -> bytes:
+    """Clave maestra del lote seguida de los OP, enmascarados como los secretos."""
+    batch = parse_hex(cfg.get("master_key", "00" * 16))
+    if len(batch) != 16:
+        raise FsError(f"batch.master_key: {len(batch)} bytes, se esperaban 16")
+    ops = cfg.get("op", [])
+    if len(ops) > MAX_BATCH_OPS:
+        raise FsError(f"batch.op: {len(ops)} valores, máximo {MAX_BATCH_OPS}")
+    for index, text in enumerate(ops):
+        op = parse_hex(text)
+        if len(op) != 16:
+            raise FsError(f"batch.op[{index}]: {len(op)} bytes, se esperaban 16")
+        batch += op
+    return bytes(b ^ xor_key[i % XOR_KEY_LEN] for i, b in enumerate(batch))
+
+
+def flatten_tree(root: Dict, buffers: List[Dict]) -> List[Dict]:
+    """Aplana el árbol por niveles con los hijos de cada DF contiguos y ordenados."""
+    buffer_index = {buf["name"]: i for i, buf in enumerate(buffers)}
+    files: List[Dict] = []
+
+    def describe(node: Dict, parent: int, path: str) -> Dict:
+        ftype = node.get("type", "EF")
+        if ftype not in FILE_TYPES:
+            raise FsError(f"{path}: tipo desconocido {ftype}")
+        entry = {"name": node["name"], "fid": int(node["fid"], 16), "type": ftype, "parent": parent,
+                 "access": node.get("access", "ALWAYS"), "sfi": int(node.get("sfi", 0)),
+                 "structure": node.get("structure", "transparent" if ftype == "EF" else None),
+                 "record_length": int(node.get("record_length", 0)),
+                 "record_count": int(node.get("record_count", 0)),
+                 "buffer": NO_INDEX, "size": int(node.get("size", 0)),
+                 "aid": parse_hex(node["aid"]) if "aid" in node else None,
+                 "children": node.get("children", []), "path": path,
+                 "first_child": 0, "child_count": 0}
+        if entry["access"] not in ACCESS:
+            raise FsError(f"{path}: condición de acceso desconocida {entry['access']}")
+        if ftype == "EF":
+            if entry["children"]:
+                raise FsError(f"{path}: un EF no puede tener hijos")
+            if entry["structure"] not in STRUCTURES:
+                raise FsError(f"{path}: estructura desconocida {entry['structure']}")
+            if entry["structure"] != "transparent":
+                if not 0 < entry["record_length"] <= 255 or not 0 < entry["record_count"] <= 254:
+                    raise FsError(f"{path}: registros inválidos")
+                entry["size"] = entry["record_length"] * entry["record_count"]
+            if "data" in node:
+                if node["data"] not in buffer_index:
+                    raise FsError(f"{path}: buffer inexistente {node['data']}")
+                entry["buffer"] = buffer_index[node["data"]]
+                buf_size = buffers[entry["buffer"]]["size"]
+                if entry["size"] == 0:
+                    entry["size"] = buf_size
+                if entry["size"] > buf_size:
+                    raise FsError(f"{path}: tamaño {entry['size']} mayor que el buffer ({buf_size})")
+            if not 0 <= entry["sfi"] <= 30:
+                raise FsError(f"{path}: SFI fuera de rango")
+        elif entry["sfi"] or "data" in node:
+            raise FsError(f"{path}: solo los EF tienen SFI y datos")
+        if (entry["aid"] is not None) != (ftype == "ADF"):
+            raise FsError(f"{path}: el AID es obligatorio en los ADF y exclusivo de ellos")
+        if entry["aid"] is not None and not 0 < len(entry["aid"]) <= MAX_AID_LEN:
+            raise FsError(f"{path}: AID de longitud inválida")
+        return entry
+
+    if root.get("type") != "MF" or int(root["fid"], 16) != 0x3F00:
+        raise FsError("La raíz debe ser el MF 3F00")
+    files.append(describe(root, NO_INDEX, "MF"))
+
+    level = 0
+    while level < len(files):
+        df = files[level]
+        children = sorted(df["children"], key=lambda node: int(node["fid"], 16))
+        fids = [int(node["fid"], 16) for node in children]
+        if len(set(fids)) != len(fids):
+            raise FsError(f"{df['path']}: FID repetido entre hermanos")
+        sfis = [int(node.get("sfi", 0)) for node in children if int(node.get("sfi", 0))]
+        if len(set(sfis)) != len(sfis):
+            raise FsError(f"{df['path']}: SFI repetido en el mismo DF")
+        df["first_child"] = len(files) if children else 0
+        df["child_count"] = len(children)
+        for node in children:
+            path = f"{df['path']}/{node['name']}"
+            if int(node["fid"], 16) in RESERVED_FIDS:
+                raise FsError(f"{path}: FID reservado")
+            files.append(describe(node, level, path))
+        level += 1
+
+    if len(files) >= NO_INDEX:
+        raise FsError(f"Demasiados archivos ({len(files)}) para índices de 8 bits")
+    return files
+
+
+def render_rows(values: Sequence[str], per_row: int = 8) -> str:
+    rows = []
+    for start in range(0, len(values), per_row):
+        rows.append("    " + ", ".join(values[start:start + per_row]))
+    return ",\n".join(rows)
+
+
+def hex8(values: Sequence[int]) -> List[str]:
+    return [f"0x{v:02X}" for v in values]
+
+
+def hex16(values: Sequence[int]) -> List[str]:
+    return [f"0x{v:04X}" for v in values]
+
+
+def render_header(files: Sequence[Dict], buffers: Sequence[Dict], secrets: bytes, batch: bytes, shadow_pool: int,
+                  profiles: int, disps: Sequence[int], slots: Sequence[int]) -> str:
+    adfs = sum(1 for f in files if f["aid"] is not None)
+    pool = sum(b["size"] for b in buffers)
+    profiled = [b for b in buffers if b["profile"] != NO_INDEX]
+    cyclic = len({f["buffer"] for f in files if f["structure"] == "cyclic" and f["buffer"] != NO_INDEX})
+    shift = 8 - (len(slots).bit_length() - 1)
+    return f"""/* Generado por scripts/gen_fs.py - no editar */
+#ifndef USIM_FS_H
+#define USIM_FS_H
+
+#define USIM_FILE_COUNT        {len(files)}U
+#define USIM_ADF_COUNT         {adfs}U
+#define USIM_BUFFER_COUNT      {len(buffers)}U
+#define USIM_DATA_POOL_SIZE    {pool}U
+#define USIM_SHADOW_POOL_SIZE  {shadow_pool}U
+#define USIM_CYCLIC_BUFFER_COUNT {cyclic}U
+#define USIM_SECRET_INIT_SIZE  {len(secrets)}U
+#define USIM_BATCH_INIT_SIZE   {len(batch)}U
+#define USIM_BATCH_OP_COUNT    {len(batch) // 16 - 1}U
+
+// Perfiles del suscriptor y buffers con un valor por perfil
+#define USIM_PROFILE_COUNT     {profiles}U
+#define USIM_PROFILE_BUFFER_COUNT {len(profiled)}U
+#define USIM_PROFILE_DATA_SIZE {sum(b["size"] for b in profiled)}U
+
+// Índice FID -> archivo (hash perfecto, ver scripts/gen_fid_index.py)
+#define USIM_FID_BUCKETS       {len(disps)}U
+#define USIM_FID_SLOTS         {len(slots)}U
+#define USIM_FID_SLOT_SHIFT    {shift}U
+#define USIM_FID_MIX1          0x{MIX1:02X}U
+#define USIM_FID_MIX2          0x{MIX2:02X}U
+#define USIM_FID_SLOT_EMPTY    0x{EMPTY_SLOT:02X}U
+
+#endif
+"""
+
+
+def render_source(files: Sequence[Dict], buffers: Sequence[Dict], secrets: bytes, batch: bytes, xor_key: bytes,
+                  disps: Sequence[int], slots: Sequence[int]) -> str:
+    def column(ctype: str, name: str, size: str, values: Sequence[str], per_row: int = 8) -> str:
+        return f"const __code {ctype} {name}[{size}] = {{\n{render_rows(values, per_row)}\n}};\n"
+
+    n = "USIM_FILE_COUNT"
+    parts = ["""/* Generado por scripts/gen_fs.py - no editar */
+#include "usim_files.h"
+#include "usim_constants.h"
+#include "usim_app.h"
+#include "chip_specific.h"
+"""]
+    parts.append("// Descriptores de archivo (índice = posición en el árbol aplanado)\n/*  "
+                 + "\n    ".join(f"{i:2d} {f['fid']:04X} {f['path']}" for i, f in enumerate(files)) + " */\n")
+    parts.append(column("uint16_t", "usim_file_fid", n, hex16([f["fid"] for f in files])))
+    parts.append(column("uint8_t", "usim_file_type", n, [FILE_TYPES[f["type"]] for f in files], 4))
+    parts.append(column("uint16_t", "usim_file_size", n, hex16([f["size"] for f in files])))
+    parts.append(column("uint8_t", "usim_file_access", n, [ACCESS[f["access"]] for f in files], 4))
+    parts.append(column("uint8_t", "usim_file_sfi", n, hex8([f["sfi"] for f in files])))
+    parts.append(column("uint8_t", "usim_file_structure", n,
+                        [STRUCTURES[f["structure"]] if f["structure"] else "EF_STRUCT_NONE"
+                         for f in files], 4))
+    parts.append(column("uint8_t", "usim_file_record_length", n, [str(f["record_length"]) for f in files]))
+    parts.append(column("uint8_t", "usim_file_record_count", n, [str(f["record_count"]) for f in files]))
+    parts.append(column("uint8_t", "usim_file_parent", n, hex8([f["parent"] for f in files])))
+    parts.append(column("uint8_t", "usim_file_first_child", n, [str(f["first_child"]) for f in files]))
+    parts.append(column("uint8_t", "usim_file_child_count", n, [str(f["child_count"]) for f in files]))
+    parts.append(column("uint8_t", "usim_file_buffer", n, hex8([f["buffer"] for f in files])))
+
+    parts.append("// Clave de ofuscación de los datos sensibles\n"
+                 f"const uint8_t xor_key[{XOR_KEY_LEN}] = {{\n{render_rows(hex8(list(xor_key)))}\n}};\n")
+    parts.append("// Secretos de fábrica enmascarados: " + " | ".join(name for name, _ in SECRETS) + "\n"
+                 + column("uint8_t", "usim_secret_init", "USIM_SECRET_INIT_SIZE", hex8(list(secrets))))
+    parts.append("// Clave maestra del lote y OP enmascarados\n"
+                 + column("uint8_t", "usim_batch_init", "USIM_BATCH_INIT_SIZE", hex8(list(batch))))
+
+    parts.append("// Contenido inicial de los EF (se sirve desde flash hasta la primera escritura)\n/*  "
+                 + "\n    ".join(f"{i:2d} {b['name']}" for i, b in enumerate(buffers)) + " */\n")
+    parts.append(column("uint16_t", "usim_buffer_offset", "USIM_BUFFER_COUNT",
+                        [str(b["offset"]) for b in buffers]))
+    parts.append(column("uint16_t", "usim_buffer_size", "USIM_BUFFER_COUNT",
+                        [str(b["size"]) for b in buffers]))
+    parts.append(column("uint8_t", "usim_buffer_policy", "USIM_BUFFER_COUNT",
+                        [b["policy"] for b in buffers], 2))
+    parts.append(column("uint8_t", "usim_buffer_profile", "USIM_BUFFER_COUNT",
+                        hex8([b["profile"] for b in buffers])))
+    init = b"".join(b["init"] for b in buffers)
+    parts.append(column("uint8_t", "usim_data_init", "USIM_DATA_POOL_SIZE", hex8(list(init))))
+
+    adf_rows = []
+    for i, f in enumerate(files):
+        if f["aid"] is not None:
+            aid = ", ".join(hex8(list(f["aid"])))
+            adf_rows.append(f"    {{{i}, {len(f['aid'])}, {{{aid}}}}}")
+    parts.append("// Aplicaciones seleccionables por AID\n"
+                 "const __code usim_adf_t usim_adfs[USIM_ADF_COUNT] = {\n" + ",\n".join(adf_rows) + "\n};\n")
+
+    parts.append("// Índice FID -> archivo\n"
+                 + column("uint8_t", "usim_fid_disp", "USIM_FID_BUCKETS", hex8(disps)))
+    parts.append(column("uint8_t", "usim_fid_slots", "USIM_FID_SLOTS", hex8(slots)))
+
+    names = [f'"{f["name"]}"' for f in files]
+    parts.append("#if USIM_ENABLE_LOGGING\n"
+                 f"const char* const __code usim_file_name[{n}] = {{\n{render_rows(names, 4)}\n}};\n"
+                 "#endif\n")
+    return "\n".join(part.rstrip("\n") + "\n" for part in parts)
+
+
+def parse_args(argv: Sequence[str] | None = None) -> argparse.Namespace:
+    parser = argparse.ArgumentParser(description="Generar las tablas del sistema de archivos")
+    parser.add_argument("config", type=Path, help="Descripción JSON del sistema de archivos")
+    parser.add_argument("out_dir", type=Path, help="Directorio de salida (usim_fs.c/.h)")
+    return parser.parse_args(argv)
+
+
+def main(argv: Sequence[str] | None = None) -> int:
+    args = parse_args(argv)
+    try:
+        with args.config.open("r", encoding="utf-8") as handle:
+            cfg = json.load(handle)
+        xor_key = parse_hex(cfg["xor_key"])
+        if len(xor_key) != XOR_KEY_LEN:
+            raise FsError(f"xor_key debe tener {XOR_KEY_LEN} bytes")
+        buffers = build_buffers(cfg.get("buffers", {}))
+        secrets = build_secrets(cfg.get("secrets", {}), xor_key)
+        batch = build_batch(cfg.get("batch", {}), xor_key)
+        shadow_pool = int(cfg["shadow_pool_size"])
+        largest = max((b["size"] for b in buffers), default=0)
+        if not largest <= shadow_pool <= 0xFFFE:
+            raise FsError(f"shadow_pool_size ({shadow_pool}) debe admitir el buffer mayor ({largest} bytes)")
+        profiles = int(cfg.get("profiles", 1))
+        if not 1 <= profiles <= MAX_PROFILES:
+            raise FsError(f"profiles ({profiles}) fuera de rango (1..{MAX_PROFILES})")
+        files = flatten_tree(cfg["tree"], buffers)
+        for f in files:
+            if f["structure"] == "cyclic" and f["buffer"] != NO_INDEX and buffers[f["buffer"]]["profile"] != NO_INDEX:
+                raise FsError(f"{f['name']}: un EF cíclico no puede tener un valor por perfil")
+        disps, slots = build_index([f["fid"] for f in files])
+    except (OSError, json.JSONDecodeError, KeyError, FsError, FidIndexError, ValueError) as exc:
+        print(f"❌ Sistema de archivos: {exc}")
+        return 1
+
+    args.out_dir.mkdir(parents=True, exist_ok=True)
+    (args.out_dir / "usim_fs.h").write_text(render_header(files, buffers, secrets, batch, shadow_pool, profiles, disps, slots), encoding="utf-8")
+    (args.out_dir / "usim_fs.c").write_text(render_source(files, buffers, secrets, batch, xor_key, disps, slots), encoding="utf-8")
+    print(f"Sistema de archivos: {len(files)} archivos, {len(buffers)} buffers, "
+          f"{sum(b['size'] for b in buffers)} bytes de datos en flash, {shadow_pool} bytes de copias en XRAM, "
+          f"{profiles} perfiles")
+    return 0
+
+
+if __name__ == "__main__":
+    raise SystemExit(main())
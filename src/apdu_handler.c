@@ -6,11 +6,32 @@
 #include "chip_specific.h"
 #include "usim_app.h"
 #include "usim_constants.h"
+#include "usim_nvm.h"
+#include "usim_suci.h"
 #include <string.h>
 
 static apdu_command_t g_apdu_cmd;
 static apdu_response_t g_apdu_resp;
 
+// Respuesta pendiente de GET RESPONSE. Los comandos sin Le (caso 4 sobre
+// T=0) escriben aquí directamente y se contesta 61xx; cualquier comando
+// distinto de GET RESPONSE la invalida.
+static __xdata uint8_t apdu_pending_data[USIM_APDU_RESPONSE_DATA_MAX];
+static uint16_t apdu_pending_offset = 0U;
+static uint16_t apdu_pending_len = 0U;
+
+// Contexto de cada canal lógico: archivo actual y estado de selección.
+// El canal activo se copia en current_file/session al recibir el APDU y se
+// guarda al terminar, así los handlers siguen trabajando sobre el global.
+typedef struct {
+    current_file_t file;
+    uint8_t state;          /* CHANNEL_OPEN | USIM_STATE_SELECTED */
+} apdu_channel_t;
+
+#define CHANNEL_OPEN 0x80U
+
+static __xdata apdu_channel_t apdu_channels[USIM_MAX_CHANNELS];
+
 #if USIM_ENABLE_LOGGING
 static void uart_send_uint16(uint16_t value) {
     char buffer[6];
@@ -39,23 +60,117 @@ static void uart_send_uint16(uint16_t value) {
 #define USIM_LOG_UINT16(value) ((void)0)
 #endif
 
-// Procesar comando SELECT FILE
-bool handle_select_file(apdu_command_t* cmd, apdu_response_t* resp) {
-    if(cmd->lc != 2U) {
-        resp->sw1sw2 = SW_WRONG_LENGTH;
-        return false;
+// Convertir un archivo en el actual; el puntero de registro se reinicia
+static void apdu_make_current(uint8_t file) {
+    current_file.file_id = usim_file_fid[file];
+    current_file.file_type = usim_file_type[file];
+    current_file.file_size = usim_file_size[file];
+    current_file.record_pointer = 0U;
+    current_file.file_index = file;
+    session.state |= USIM_STATE_SELECTED;
+}
+
+// Resolver el destino de SELECT según P1 (TS 102 221 §11.1.1.2)
+static uint8_t apdu_resolve_select(const apdu_command_t* cmd, apdu_response_t* resp) {
+    uint8_t df = usim_current_df();
+    uint8_t file = USIM_FILE_NOT_FOUND;
+    uint16_t file_id = 0U;
+
+    if(cmd->lc == 2U) {
+        file_id = (uint16_t)(((uint16_t)cmd->data[0] << 8) | cmd->data[1]);
     }
 
-    if(cmd->le != 0U && cmd->le < 13U) {
-        resp->sw1sw2 = SW_WRONG_LENGTH;
-        return false;
+    switch(cmd->p1) {
+        case SELECT_BY_FID:
+            if(cmd->lc == 0U || file_id == 0x3F00) {
+                return USIM_FILE_INDEX_MF;
+            }
+            if(cmd->lc != 2U) {
+                resp->sw1sw2 = SW_WRONG_LENGTH;
+                return USIM_FILE_NOT_FOUND;
+            }
+            if(file_id == 0x7FFF) {
+                file = usim_application_of(df);
+            } else if(file_id == usim_file_fid[df]) {
+                file = df;
+            } else {
+                // Hijo del DF actual, el DF padre o un DF hermano
+                uint8_t parent = usim_file_parent[df];
+
+                file = usim_find_child(df, file_id);
+                if(file == USIM_FILE_NOT_FOUND && parent != USIM_FILE_NO_PARENT) {
+                    if(usim_file_fid[parent] == file_id) {
+                        file = parent;
+                    } else {
+                        file = usim_find_child(parent, file_id);
+                        if(file != USIM_FILE_NOT_FOUND && usim_file_type[file] == FILE_TYPE_EF) {
+                            file = USIM_FILE_NOT_FOUND;
+                        }
+                    }
+                }
+            }
+            break;
+
+        case SELECT_CHILD_DF:
+        case SELECT_CHILD_EF:
+            if(cmd->lc != 2U) {
+                resp->sw1sw2 = SW_WRONG_LENGTH;
+                return USIM_FILE_NOT_FOUND;
+            }
+            file = usim_find_child(df, file_id);
+            if(file != USIM_FILE_NOT_FOUND &&
+               ((usim_file_type[file] == FILE_TYPE_EF) != (cmd->p1 == SELECT_CHILD_EF))) {
+                file = USIM_FILE_NOT_FOUND;
+            }
+            break;
+
+        case SELECT_PARENT_DF:
+            if(cmd->lc != 0U) {
+                resp->sw1sw2 = SW_WRONG_LENGTH;
+                return USIM_FILE_NOT_FOUND;
+            }
+            file = usim_file_parent[df];
+            break;
+
+        case SELECT_BY_AID:
+            if(cmd->lc == 0U || cmd->lc > USIM_AID_MAX_LEN) {
+                resp->sw1sw2 = SW_WRONG_LENGTH;
+                return USIM_FILE_NOT_FOUND;
+            }
+            // Solo hay una aparición de cada AID: "siguiente" no encuentra nada
+            if((cmd->p2 & 0x03U) == 0U) {
+                file = usim_find_by_aid(cmd->data, (uint8_t)cmd->lc);
+            }
+            break;
+
+        case SELECT_PATH_FROM_MF:
+        case SELECT_PATH_FROM_DF:
+            if(cmd->lc == 0U || (cmd->lc & 1U) != 0U) {
+                resp->sw1sw2 = SW_WRONG_LENGTH;
+                return USIM_FILE_NOT_FOUND;
+            }
+            if(cmd->p1 == SELECT_PATH_FROM_MF) {
+                df = USIM_FILE_INDEX_MF;
+            }
+            file = usim_resolve_path(df, cmd->data, (uint8_t)cmd->lc);
+            break;
+
+        default:
+            resp->sw1sw2 = SW_WRONG_P1P2;
+            return USIM_FILE_NOT_FOUND;
     }
-    
-    uint16_t file_id = (cmd->data[0] << 8) | cmd->data[1];
-    const usim_file_t* file = usim_find_file(file_id);
-    
-    if(file == NULL) {
+
+    if(file == USIM_FILE_NOT_FOUND) {
         resp->sw1sw2 = SW_FILE_NOT_FOUND;
+    }
+    return file;
+}
+
+// Procesar comando SELECT FILE
+bool handle_select_file(apdu_command_t* cmd, apdu_response_t* resp) {
+    uint8_t file = apdu_resolve_select(cmd, resp);
+
+    if(file == USIM_FILE_NOT_FOUND) {
         return false;
     }
     
@@ -65,47 +180,119 @@ bool handle_select_file(apdu_command_t* cmd, apdu_response_t* resp) {
     }
     
     // Actualizar archivo actual
-    current_file.file_id = file_id;
-    current_file.file_type = file->file_type;
-    current_file.file_size = file->file_size;
-    session.state |= USIM_STATE_SELECTED;
+    apdu_make_current(file);
 
-    // Preparar respuesta FCP mínima conforme a 3GPP TS 31.102
-    resp->data[0] = 0x62;                 // Tag FCP template
-    resp->data[1] = 0x0B;                 // Longitud del contenido
-    resp->data[2] = 0x80;                 // Tag: Tamaño del archivo
-    resp->data[3] = 0x02;
-    resp->data[4] = (uint8_t)((file->file_size >> 8) & 0xFF);
-    resp->data[5] = (uint8_t)(file->file_size & 0xFF);
-    resp->data[6] = 0x82;                 // Descriptor de archivo
-    resp->data[7] = 0x01;
-    resp->data[8] = (file->file_type == FILE_TYPE_EF) ? 0x21U : 0x38U;
-    resp->data[9] = 0x83;                 // File Identifier
-    resp->data[10] = 0x02;
-    resp->data[11] = (uint8_t)((file_id >> 8) & 0xFF);
-    resp->data[12] = (uint8_t)(file_id & 0xFF);
-    resp->data_len = 13U;
+    // Preparar respuesta FCP mínima conforme a 3GPP TS 31.102 (P2 = 0C: sin datos)
+    if((cmd->p2 & SELECT_RESPONSE_MASK) == SELECT_RESPONSE_NONE) {
+        resp->data_len = 0U;
+    } else {
+        uint8_t pos = 0U;
+
+        resp->data[pos++] = 0x62;             // Tag FCP template
+        resp->data[pos++] = 0x00;             // Longitud (se completa al final)
+        resp->data[pos++] = 0x80;             // Tag: Tamaño del archivo
+        resp->data[pos++] = 0x02;
+        resp->data[pos++] = (uint8_t)((usim_file_size[file] >> 8) & 0xFF);
+        resp->data[pos++] = (uint8_t)(usim_file_size[file] & 0xFF);
+        resp->data[pos++] = 0x82;             // Descriptor de archivo
+        if(usim_file_type[file] != FILE_TYPE_EF) {
+            resp->data[pos++] = 0x01;
+            resp->data[pos++] = 0x38U;
+        } else if(usim_file_structure[file] == EF_STRUCT_TRANSPARENT) {
+            resp->data[pos++] = 0x01;
+            resp->data[pos++] = EF_STRUCT_TRANSPARENT;
+        } else {
+            // Registros: descriptor, codificación, longitud y número
+            resp->data[pos++] = 0x05;
+            resp->data[pos++] = usim_file_structure[file];
+            resp->data[pos++] = 0x21;
+            resp->data[pos++] = 0x00;
+            resp->data[pos++] = usim_file_record_length[file];
+            resp->data[pos++] = usim_file_record_count[file];
+        }
+        resp->data[pos++] = 0x83;             // File Identifier
+        resp->data[pos++] = 0x02;
+        resp->data[pos++] = (uint8_t)((usim_file_fid[file] >> 8) & 0xFF);
+        resp->data[pos++] = (uint8_t)(usim_file_fid[file] & 0xFF);
+
+        {
+            // Nombre del DF (AID) si es un ADF
+            const __code usim_adf_t* adf = usim_find_adf(file);
+
+            if(adf != NULL) {
+                resp->data[pos++] = 0x84;
+                resp->data[pos++] = adf->aid_len;
+                memcpy(&resp->data[pos], adf->aid, adf->aid_len);
+                pos = (uint8_t)(pos + adf->aid_len);
+            }
+        }
+
+        if(usim_file_type[file] == FILE_TYPE_EF) {
+            // SFI: longitud 0 indica que el EF no admite direccionamiento por SFI
+            resp->data[pos++] = 0x88;
+            if(usim_file_sfi[file] != 0U) {
+                resp->data[pos++] = 0x01;
+                resp->data[pos++] = (uint8_t)(usim_file_sfi[file] << 3);
+            } else {
+                resp->data[pos++] = 0x00;
+            }
+        }
+
+        resp->data[1] = (uint8_t)(pos - 2U);
+        resp->data_len = pos;
+    }
 
     resp->sw1sw2 = SW_OK;
 
     USIM_LOG_STRING("SELECT FILE: ");
-    USIM_LOG_STRING(file->name);
+    USIM_LOG_STRING(usim_file_name[file]);
     USIM_LOG_STRING("\r\n");
     
     return true;
 }
 
+// Resolver el EF de READ/UPDATE BINARY. Con P1 b8=1, P1 b5..b1 es el SFI y
+// P2 el offset; el EF pasa a ser el archivo actual. Si no, P1P2 es un
+// offset de 15 bits dentro del archivo actual.
+static uint8_t apdu_resolve_binary_target(const apdu_command_t* cmd, uint16_t* offset,
+                                          apdu_response_t* resp) {
+    uint8_t file;
+
+    if((cmd->p1 & 0x80U) != 0U) {
+        if((cmd->p1 & 0x60U) != 0U) {
+            resp->sw1sw2 = SW_WRONG_PARAMETERS;
+            return USIM_FILE_NOT_FOUND;
+        }
+
+        file = usim_find_file_by_sfi((uint8_t)(cmd->p1 & 0x1FU));
+        if(file == USIM_FILE_NOT_FOUND) {
+            resp->sw1sw2 = SW_FILE_NOT_FOUND;
+            return USIM_FILE_NOT_FOUND;
+        }
+
+        apdu_make_current(file);
+        *offset = cmd->p2;
+        return file;
+    }
+
+    file = usim_get_current_file();
+
+    *offset = (uint16_t)(((uint16_t)cmd->p1 << 8) | cmd->p2);
+    return file;
+}
+
 // Procesar comando READ BINARY
 bool handle_read_binary(apdu_command_t* cmd, apdu_response_t* resp) {
-    uint16_t offset = (cmd->p1 << 8) | cmd->p2;
+    uint16_t offset = 0U;
 
-    const usim_file_t* file = usim_find_file(current_file.file_id);
-    if(file == NULL) {
-        resp->sw1sw2 = SW_FILE_NOT_FOUND;
+    uint8_t file = apdu_resolve_binary_target(cmd, &offset, resp);
+    const uint8_t* data;
+
+    if(file == USIM_FILE_NOT_FOUND) {
         return false;
     }
 
-    if(file->file_type != FILE_TYPE_EF) {
+    if(usim_file_type[file] != FILE_TYPE_EF || usim_file_structure[file] != EF_STRUCT_TRANSPARENT) {
         resp->sw1sw2 = SW_COMMAND_NOT_ALLOWED;
         return false;
     }
@@ -115,36 +302,26 @@ bool handle_read_binary(apdu_command_t* cmd, apdu_response_t* resp) {
         return false;
     }
 
-    if(offset >= file->file_size || file->file_data == NULL) {
+    data = usim_file_data(file);
+    if(offset >= usim_file_size[file] || data == NULL) {
         resp->sw1sw2 = SW_WRONG_PARAMETERS;
         return false;
     }
 
     {
-        uint16_t available = file->file_size - offset;
+        uint16_t available = usim_file_size[file] - offset;
         uint16_t requested = available;
 
-        if(cmd->le != 0U) {
-            if(cmd->le == 256U) {
-                requested = (available > 256U) ? 256U : available;
-            } else if(cmd->le < available) {
-                requested = cmd->le;
-            }
-        } else if(requested > USIM_APDU_RESPONSE_DATA_MAX) {
-            requested = USIM_APDU_RESPONSE_DATA_MAX;
+        if(cmd->le != 0U && cmd->le < available) {
+            requested = cmd->le;
         }
 
-        if(current_file.file_id == 0x6F08 || current_file.file_id == 0x6F09) {
-            uint8_t temp_buffer[16];
-            uint16_t data_len = 0U;
-            const uint8_t* file_data = usim_get_file_data(current_file.file_id, temp_buffer, &data_len);
-            if(file_data != NULL) {
-                memcpy(resp->data, &file_data[offset], requested);
-            }
-        } else {
-            memcpy(resp->data, &file->file_data[offset], requested);
+        if(requested > USIM_APDU_RESPONSE_DATA_MAX) {
+            requested = USIM_APDU_RESPONSE_DATA_MAX;
         }
 
+        memcpy(resp->data, &data[offset], requested);
+
         resp->data_len = requested;
     }
     resp->sw1sw2 = SW_OK;
@@ -156,39 +333,148 @@ bool handle_read_binary(apdu_command_t* cmd, apdu_response_t* resp) {
     return true;
 }
 
-// Procesar comando AUTHENTICATE
-bool handle_authenticate(apdu_command_t* cmd, apdu_response_t* resp) {
-    if(cmd->lc < 16U) {
+// RUN GSM ALGORITHM (CLA A0, TS 51.011 §9.2.16) y AUTHENTICATE en
+// contexto GSM (P2 = 0x80): RAND -> SRES y Kc
+static bool handle_gsm_authenticate(apdu_command_t* cmd, apdu_response_t* resp) {
+    bool run_gsm = (cmd->cla == CLA_GSM);
+    uint8_t header = run_gsm ? 0U : 1U;   /* Byte de longitud de 31.102 */
+
+    if(cmd->lc != (uint16_t)(header + 16U)) {
         resp->sw1sw2 = SW_WRONG_LENGTH;
         return false;
     }
 
+    if(!run_gsm && cmd->data[0] != 16U) {
+        resp->sw1sw2 = SW_WRONG_DATA;
+        return false;
+    }
+
     if((session.state & USIM_STATE_PIN_VERIFIED) == 0U) {
         resp->sw1sw2 = SW_SECURITY_STATUS_NOT_SATISFIED;
         return false;
     }
 
-    if(cmd->le != 0U && cmd->le != 256U && cmd->le < 54U) {
+    // 51.011: SRES Kc; 31.102: L SRES L Kc
+    if(!usim_run_gsm_auth(&cmd->data[header], &resp->data[header],
+                          &resp->data[2U * header + USIM_GSM_SRES_SIZE])) {
+        resp->sw1sw2 = SW_AUTHENTICATION_FAILED;
+        USIM_LOG_STRING("AUTHENTICATE: GSM failed\r\n");
+        return false;
+    }
+    if(!run_gsm) {
+        resp->data[0] = USIM_GSM_SRES_SIZE;
+        resp->data[1U + USIM_GSM_SRES_SIZE] = USIM_GSM_KC_SIZE;
+    }
+
+    resp->data_len = (uint16_t)(2U * header + USIM_GSM_SRES_SIZE + USIM_GSM_KC_SIZE);
+    resp->sw1sw2 = SW_OK;
+    USIM_LOG_STRING("AUTHENTICATE: GSM success\r\n");
+    return true;
+}
+
+// Procesar comando AUTHENTICATE (TS 31.102 §7.1.2). Contexto 3G:
+// datos = L RAND L AUTN
+bool handle_authenticate(apdu_command_t* cmd, apdu_response_t* resp) {
+    if(cmd->cla == CLA_GSM) {
+        if(cmd->p1 != 0x00U || cmd->p2 != 0x00U) {
+            resp->sw1sw2 = SW_WRONG_P1P2;
+            return false;
+        }
+        return handle_gsm_authenticate(cmd, resp);
+    }
+
+    if(cmd->p1 != 0x00U || (cmd->p2 != AUTH_CONTEXT_3G && cmd->p2 != AUTH_CONTEXT_GSM)) {
+        resp->sw1sw2 = SW_WRONG_P1P2;
+        return false;
+    }
+
+    if(cmd->p2 == AUTH_CONTEXT_GSM) {
+        return handle_gsm_authenticate(cmd, resp);
+    }
+
+    if(cmd->lc != (uint16_t)(2U + 16U + USIM_AUTN_SIZE)) {
         resp->sw1sw2 = SW_WRONG_LENGTH;
         return false;
     }
 
-    {
-        uint8_t rand[16];
-        memcpy(rand, cmd->data, 16U);
+    if(cmd->data[0] != 16U || cmd->data[17] != USIM_AUTN_SIZE) {
+        resp->sw1sw2 = SW_WRONG_DATA;
+        return false;
+    }
+
+    if((session.state & USIM_STATE_PIN_VERIFIED) == 0U) {
+        resp->sw1sw2 = SW_SECURITY_STATUS_NOT_SATISFIED;
+        return false;
+    }
+
+    // El SQN aceptado se graba en el acto: no puede quedar en un grupo
+    // que luego se descarte
+    if(usim_nvm_group_active()) {
+        resp->sw1sw2 = SW_CONDITIONS_NOT_SATISFIED;
+        return false;
+    }
 
-        if(usim_run_xor_auth(rand, resp->data, &resp->data_len)) {
+    switch(usim_run_aka(&cmd->data[1], &cmd->data[18], resp->data, &resp->data_len)) {
+        case USIM_AKA_OK:
             resp->sw1sw2 = SW_OK;
-            USIM_LOG_STRING("AUTHENTICATE: XOR Success\r\n");
+            USIM_LOG_STRING("AUTHENTICATE: Success\r\n");
             return true;
-        }
+
+        case USIM_AKA_SYNC_FAILURE:
+            resp->sw1sw2 = SW_OK;
+            USIM_LOG_STRING("AUTHENTICATE: Sync failure\r\n");
+            return true;
+
+        case USIM_AKA_MAC_FAILURE:
+            resp->sw1sw2 = SW_AUTH_MAC_FAILURE;
+            USIM_LOG_STRING("AUTHENTICATE: MAC failure\r\n");
+            return false;
+
+        default:
+            break;
     }
 
     resp->sw1sw2 = SW_AUTHENTICATION_FAILED;
-    USIM_LOG_STRING("AUTHENTICATE: XOR Failed\r\n");
+    USIM_LOG_STRING("AUTHENTICATE: Failed\r\n");
     return false;
 }
 
+// Procesar comando GET IDENTITY (TS 31.102 §7.5) en contexto SUCI: la
+// respuesta es el SUCI codificado como en TS 24.501 §9.11.3.4
+bool handle_get_identity(apdu_command_t* cmd, apdu_response_t* resp) {
+    if(cmd->p1 != 0x00U || cmd->p2 != IDENTITY_CONTEXT_SUCI) {
+        resp->sw1sw2 = SW_WRONG_P1P2;
+        return false;
+    }
+
+    if(cmd->lc != 0U) {
+        resp->sw1sw2 = SW_WRONG_LENGTH;
+        return false;
+    }
+
+    if((session.state & USIM_STATE_PIN_VERIFIED) == 0U) {
+        resp->sw1sw2 = SW_SECURITY_STATUS_NOT_SATISFIED;
+        return false;
+    }
+
+    // El contador de claves efímeras se graba en el acto, como el SQN
+    if(usim_nvm_group_active()) {
+        resp->sw1sw2 = SW_CONDITIONS_NOT_SATISFIED;
+        return false;
+    }
+
+    if(!usim_suci_conceal(resp->data, &resp->data_len)) {
+        resp->data_len = 0U;
+        resp->sw1sw2 = SW_CONDITIONS_NOT_SATISFIED;
+        USIM_LOG_STRING("GET IDENTITY: SUCI not available\r\n");
+        return false;
+    }
+
+    resp->sw1sw2 = SW_OK;
+    USIM_LOG_STRING("GET IDENTITY: SUCI computed\r\n");
+    return true;
+}
+
 // Procesar comando VERIFY CHV (PIN)
 bool handle_verify_chv(apdu_command_t* cmd, apdu_response_t* resp) {
     if(cmd->lc != 8U) {
@@ -201,22 +487,38 @@ bool handle_verify_chv(apdu_command_t* cmd, apdu_response_t* resp) {
         return false;
     }
 
+    // Dentro de una transacción el intento descontado no llegaría a NVM
+    // hasta confirmarla
+    if(usim_nvm_group_active()) {
+        resp->sw1sw2 = SW_CONDITIONS_NOT_SATISFIED;
+        return false;
+    }
+
     if(subscriber.pin1_retries == 0U) {
         resp->sw1sw2 = SW_PIN_BLOCKED;
         return false;
     }
 
+    // El intento se descuenta en NVM antes de comparar: cortar la
+    // alimentación durante la verificación no devuelve el intento
+    subscriber.pin1_retries--;
+    if(!usim_persist_chv()) {
+        resp->sw1sw2 = SW_MEMORY_PROBLEM;
+        return false;
+    }
+
     // Verificar PIN
     if(memcmp(cmd->data, subscriber.pin1, 8) == 0) {
-        session.state |= USIM_STATE_PIN_VERIFIED;
         subscriber.pin1_retries = 3;
+        if(!usim_persist_chv()) {
+            resp->sw1sw2 = SW_MEMORY_PROBLEM;
+            return false;
+        }
+        session.state |= USIM_STATE_PIN_VERIFIED;
         resp->sw1sw2 = SW_OK;
         USIM_LOG_STRING("VERIFY CHV: PIN Correct\r\n");
         return true;
     } else {
-        if(subscriber.pin1_retries > 0) {
-            subscriber.pin1_retries--;
-        }
         if(subscriber.pin1_retries == 0U) {
             resp->sw1sw2 = SW_PIN_BLOCKED;
             USIM_LOG_STRING("VERIFY CHV: PIN Blocked\r\n");
@@ -240,16 +542,24 @@ bool handle_change_chv(apdu_command_t* cmd, apdu_response_t* resp) {
         return false;
     }
 
+    // Como en VERIFY CHV: no se cambia el PIN con una transacción abierta
+    if(usim_nvm_group_active()) {
+        resp->sw1sw2 = SW_CONDITIONS_NOT_SATISFIED;
+        return false;
+    }
+
     if(subscriber.pin1_retries == 0U) {
         resp->sw1sw2 = SW_PIN_BLOCKED;
         return false;
     }
 
-    if(memcmp(cmd->data, subscriber.pin1, 8) != 0) {
-        if(subscriber.pin1_retries > 0U) {
-            subscriber.pin1_retries--;
-        }
+    subscriber.pin1_retries--;
+    if(!usim_persist_chv()) {
+        resp->sw1sw2 = SW_MEMORY_PROBLEM;
+        return false;
+    }
 
+    if(memcmp(cmd->data, subscriber.pin1, 8) != 0) {
         if(subscriber.pin1_retries == 0U) {
             resp->sw1sw2 = SW_PIN_BLOCKED;
             USIM_LOG_STRING("CHANGE CHV: PIN Blocked\r\n");
@@ -262,6 +572,10 @@ bool handle_change_chv(apdu_command_t* cmd, apdu_response_t* resp) {
 
     memcpy(subscriber.pin1, &cmd->data[8], 8);
     subscriber.pin1_retries = 3;
+    if(!usim_persist_chv()) {
+        resp->sw1sw2 = SW_MEMORY_PROBLEM;
+        return false;
+    }
     session.state |= USIM_STATE_PIN_VERIFIED;
 
     resp->sw1sw2 = SW_OK;
@@ -271,29 +585,33 @@ bool handle_change_chv(apdu_command_t* cmd, apdu_response_t* resp) {
 
 // Procesar comando GET RESPONSE
 bool handle_get_response(apdu_command_t* cmd, apdu_response_t* resp) {
-    {
-        uint16_t requested_length = cmd->le;
-
-        if(requested_length == 0U) {
-            requested_length = 256U;
-        }
+    uint16_t requested = cmd->le;
 
-        if(requested_length > 256U) {
-            resp->sw1sw2 = SW_WRONG_LENGTH;
-            return false;
-        }
+    if(apdu_pending_len == 0U) {
+        resp->sw1sw2 = SW_CONDITIONS_NOT_SATISFIED;
+        return false;
+    }
 
-        resp->data_len = (requested_length > 32U) ? 32U : requested_length;
+    if(requested == 0U) {
+        requested = 256U;
+    }
 
-        {
-            uint16_t i;
-            for(i = 0U; i < resp->data_len; i++) {
-                resp->data[i] = (uint8_t)(i + 0x10U);
-            }
+    if(requested > apdu_pending_len) {
+        // En T=1 Le=00 pide "todo lo disponible"; en T=0 P3 debe ser exacto
+        if(requested == 256U && sim_get_protocol() == 1U) {
+            requested = apdu_pending_len;
+        } else {
+            resp->sw1sw2 = SW_WRONG_LE(apdu_pending_len);
+            return false;
         }
     }
 
-    resp->sw1sw2 = SW_OK;
+    memcpy(resp->data, &apdu_pending_data[apdu_pending_offset], requested);
+    resp->data_len = requested;
+    apdu_pending_offset = (uint16_t)(apdu_pending_offset + requested);
+    apdu_pending_len = (uint16_t)(apdu_pending_len - requested);
+
+    resp->sw1sw2 = (apdu_pending_len > 0U) ? SW_BYTES_AVAILABLE(apdu_pending_len) : SW_OK;
     return true;
 }
 
@@ -316,21 +634,20 @@ bool handle_status(apdu_command_t* cmd, apdu_response_t* resp) {
 }
 
 bool handle_update_binary(apdu_command_t* cmd, apdu_response_t* resp) {
-    usim_file_t* file = usim_find_file_mutable(current_file.file_id);
-    const usim_file_t* file_const = usim_find_file(current_file.file_id);
-    uint16_t offset = (cmd->p1 << 8) | cmd->p2;
+    uint16_t offset = 0U;
+    uint8_t file = apdu_resolve_binary_target(cmd, &offset, resp);
+    uint8_t* data;
 
-    if(file == NULL || file_const == NULL) {
-        resp->sw1sw2 = SW_FILE_NOT_FOUND;
+    if(file == USIM_FILE_NOT_FOUND) {
         return false;
     }
 
-    if(file_const->file_type != FILE_TYPE_EF) {
+    if(usim_file_type[file] != FILE_TYPE_EF || usim_file_structure[file] != EF_STRUCT_TRANSPARENT) {
         resp->sw1sw2 = SW_COMMAND_NOT_ALLOWED;
         return false;
     }
 
-    if(!usim_check_access(file_const, ACCESS_UPDATE)) {
+    if(!usim_check_access(file, ACCESS_UPDATE)) {
         resp->sw1sw2 = SW_SECURITY_STATUS_NOT_SATISFIED;
         return false;
     }
@@ -340,19 +657,21 @@ bool handle_update_binary(apdu_command_t* cmd, apdu_response_t* resp) {
         return false;
     }
 
-    if((offset + cmd->lc) > file_const->file_size) {
+    if((offset + cmd->lc) > usim_file_size[file]) {
         resp->sw1sw2 = SW_WRONG_PARAMETERS;
         return false;
     }
 
-    if(file->file_data == NULL) {
+    data = usim_file_writable(file);
+    if(data == NULL) {
         resp->sw1sw2 = SW_MEMORY_PROBLEM;
         return false;
     }
 
-    memcpy(&file->file_data[offset], cmd->data, cmd->lc);
-    if((offset + cmd->lc) > file->data_size) {
-        file->data_size = offset + cmd->lc;
+    memcpy(&data[offset], cmd->data, cmd->lc);
+    if(!usim_file_written(file, (uint16_t)(offset + cmd->lc))) {
+        resp->sw1sw2 = SW_MEMORY_PROBLEM;
+        return false;
     }
 
     resp->sw1sw2 = SW_OK;
@@ -364,6 +683,374 @@ bool handle_update_binary(apdu_command_t* cmd, apdu_response_t* resp) {
     return true;
 }
 
+// Resolver el EF de un comando de registros. P2 b8..b4 es el SFI (0 = EF
+// actual); seleccionar por SFI reinicia el puntero de registro.
+static uint8_t apdu_resolve_record_target(const apdu_command_t* cmd, uint8_t access,
+                                          apdu_response_t* resp) {
+    uint8_t file;
+    uint8_t sfi = (uint8_t)(cmd->p2 >> 3);
+
+    if(sfi == 0x1FU) {
+        resp->sw1sw2 = SW_WRONG_PARAMETERS;
+        return USIM_FILE_NOT_FOUND;
+    }
+
+    if(sfi != 0U) {
+        file = usim_find_file_by_sfi(sfi);
+        if(file != USIM_FILE_NOT_FOUND) {
+            apdu_make_current(file);
+        }
+    } else {
+        file = usim_get_current_file();
+    }
+
+    if(file == USIM_FILE_NOT_FOUND) {
+        resp->sw1sw2 = SW_FILE_NOT_FOUND;
+        return USIM_FILE_NOT_FOUND;
+    }
+
+    if(usim_file_type[file] != FILE_TYPE_EF ||
+       (usim_file_structure[file] != EF_STRUCT_LINEAR_FIXED && usim_file_structure[file] != EF_STRUCT_CYCLIC)) {
+        resp->sw1sw2 = SW_COMMAND_NOT_ALLOWED;
+        return USIM_FILE_NOT_FOUND;
+    }
+
+    if(!usim_check_access(file, access)) {
+        resp->sw1sw2 = SW_SECURITY_STATUS_NOT_SATISFIED;
+        return USIM_FILE_NOT_FOUND;
+    }
+
+    if(usim_file_data(file) == NULL) {
+        resp->sw1sw2 = SW_MEMORY_PROBLEM;
+        return USIM_FILE_NOT_FOUND;
+    }
+
+    return file;
+}
+
+// Calcular el registro objetivo según el modo de P2. Devuelve 0 si no existe.
+// NEXT/PREVIOUS mueven el puntero; en EF cíclicos dan la vuelta.
+static uint8_t apdu_select_record(uint8_t file, uint8_t p1, uint8_t mode) {
+    uint8_t pointer = current_file.record_pointer;
+    uint8_t count = usim_file_record_count[file];
+    bool cyclic = (usim_file_structure[file] == EF_STRUCT_CYCLIC);
+
+    switch(mode) {
+        case RECORD_MODE_ABSOLUTE:
+            return (p1 == 0U) ? pointer : ((p1 <= count) ? p1 : 0U);
+
+        case RECORD_MODE_NEXT:
+            if(pointer == 0U) {
+                pointer = 1U;
+            } else if(pointer < count) {
+                pointer++;
+            } else if(cyclic) {
+                pointer = 1U;
+            } else {
+                return 0U;
+            }
+            break;
+
+        case RECORD_MODE_PREVIOUS:
+            if(pointer == 0U) {
+                pointer = count;
+            } else if(pointer > 1U) {
+                pointer--;
+            } else if(cyclic) {
+                pointer = count;
+            } else {
+                return 0U;
+            }
+            break;
+
+        default:
+            return 0U;
+    }
+
+    current_file.record_pointer = pointer;
+    return pointer;
+}
+
+// Procesar comando READ RECORD
+bool handle_read_record(apdu_command_t* cmd, apdu_response_t* resp) {
+    uint8_t file = apdu_resolve_record_target(cmd, ACCESS_READ, resp);
+    uint8_t mode = (uint8_t)(cmd->p2 & 0x07U);
+    uint8_t record;
+    const uint8_t* data;
+
+    if(file == USIM_FILE_NOT_FOUND) {
+        return false;
+    }
+
+    if(mode != RECORD_MODE_NEXT && mode != RECORD_MODE_PREVIOUS && mode != RECORD_MODE_ABSOLUTE) {
+        resp->sw1sw2 = SW_WRONG_PARAMETERS;
+        return false;
+    }
+
+    // Le = 00 pide el registro completo solo en T=1; en T=0 P3 debe ser
+    // exacto y se comprueba antes de mover el puntero de registro
+    if(cmd->le != 0U && cmd->le != usim_file_record_length[file] &&
+       (cmd->le != 256U || sim_get_protocol() != 1U)) {
+        resp->sw1sw2 = SW_WRONG_LE(usim_file_record_length[file]);
+        return false;
+    }
+
+    record = apdu_select_record(file, cmd->p1, mode);
+    data = usim_record_data(file, record);
+    if(data == NULL) {
+        resp->sw1sw2 = SW_RECORD_NOT_FOUND;
+        return false;
+    }
+
+    memcpy(resp->data, data, usim_file_record_length[file]);
+    resp->data_len = usim_file_record_length[file];
+    resp->sw1sw2 = SW_OK;
+    return true;
+}
+
+// Procesar comando UPDATE RECORD
+bool handle_update_record(apdu_command_t* cmd, apdu_response_t* resp) {
+    uint8_t file = apdu_resolve_record_target(cmd, ACCESS_UPDATE, resp);
+    uint8_t mode = (uint8_t)(cmd->p2 & 0x07U);
+    uint8_t record;
+    uint8_t* data;
+
+    if(file == USIM_FILE_NOT_FOUND) {
+        return false;
+    }
+
+    if(cmd->lc != usim_file_record_length[file]) {
+        resp->sw1sw2 = SW_WRONG_LENGTH;
+        return false;
+    }
+
+    if(usim_file_structure[file] == EF_STRUCT_CYCLIC) {
+        // Solo PREVIOUS: se sobrescribe el más antiguo, que pasa a ser el 1
+        if(mode != RECORD_MODE_PREVIOUS) {
+            resp->sw1sw2 = SW_WRONG_PARAMETERS;
+            return false;
+        }
+        if(!usim_cyclic_append(file, cmd->data)) {
+            resp->sw1sw2 = SW_MEMORY_PROBLEM;
+            return false;
+        }
+        record = 1U;
+        current_file.record_pointer = 1U;
+    } else {
+        if(mode != RECORD_MODE_NEXT && mode != RECORD_MODE_PREVIOUS && mode != RECORD_MODE_ABSOLUTE) {
+            resp->sw1sw2 = SW_WRONG_PARAMETERS;
+            return false;
+        }
+        record = apdu_select_record(file, cmd->p1, mode);
+
+        if(usim_record_data(file, record) == NULL) {
+            resp->sw1sw2 = SW_RECORD_NOT_FOUND;
+            return false;
+        }
+
+        data = usim_record_writable(file, record);
+        if(data == NULL) {
+            resp->sw1sw2 = SW_MEMORY_PROBLEM;
+            return false;
+        }
+
+        memcpy(data, cmd->data, usim_file_record_length[file]);
+        if(!usim_file_written(file, usim_file_size[file])) {
+            resp->sw1sw2 = SW_MEMORY_PROBLEM;
+            return false;
+        }
+    }
+
+    resp->data_len = 0U;
+    resp->sw1sw2 = SW_OK;
+
+    USIM_LOG_STRING("UPDATE RECORD: ");
+    USIM_LOG_UINT16(record);
+    USIM_LOG_STRING("\r\n");
+    return true;
+}
+
+// Procesar comando SEARCH RECORD (búsqueda simple): devuelve los números
+// de los registros que contienen el patrón y deja el puntero en el primero
+bool handle_search_record(apdu_command_t* cmd, apdu_response_t* resp) {
+    uint8_t file = apdu_resolve_record_target(cmd, ACCESS_READ, resp);
+    uint8_t mode = (uint8_t)(cmd->p2 & 0x07U);
+    uint8_t record;
+    uint8_t last;
+    int8_t step;
+    uint8_t found = 0U;
+
+    if(file == USIM_FILE_NOT_FOUND) {
+        return false;
+    }
+
+    if(cmd->lc == 0U || cmd->lc > usim_file_record_length[file]) {
+        resp->sw1sw2 = SW_WRONG_LENGTH;
+        return false;
+    }
+
+    // P1 es el registro de partida (00: el actual); 06 y 07 empiezan en el
+    // siguiente o el anterior a él (TS 102 221 §11.1.7)
+    record = (cmd->p1 == 0U) ? current_file.record_pointer : cmd->p1;
+
+    switch(mode) {
+        case RECORD_MODE_ABSOLUTE:
+            step = 1;
+            break;
+
+        case RECORD_MODE_SEARCH_BACK:
+            step = -1;
+            break;
+
+        case RECORD_MODE_SEARCH_NEXT:
+            step = 1;
+            record++;
+            break;
+
+        case RECORD_MODE_SEARCH_PREV:
+            step = -1;
+            record = (record == 0U) ? usim_file_record_count[file] : (uint8_t)(record - 1U);
+            break;
+
+        default:
+            resp->sw1sw2 = SW_WRONG_P1P2;
+            return false;
+    }
+
+    last = (step > 0) ? usim_file_record_count[file] : 1U;
+
+    if(record == 0U || record > usim_file_record_count[file]) {
+        resp->sw1sw2 = SW_RECORD_NOT_FOUND;
+        return false;
+    }
+
+    while(1) {
+        const uint8_t* data = usim_record_data(file, record);
+        uint8_t offset;
+
+        for(offset = 0U; (uint16_t)(offset + cmd->lc) <= usim_file_record_length[file]; ++offset) {
+            if(memcmp(&data[offset], cmd->data, cmd->lc) == 0) {
+                resp->data[found++] = record;
+                break;
+            }
+        }
+
+        if(record == last) {
+            break;
+        }
+        record = (uint8_t)(record + step);
+    }
+
+    if(found > 0U) {
+        current_file.record_pointer = resp->data[0];
+    }
+
+    resp->data_len = found;
+    resp->sw1sw2 = SW_OK;
+    return true;
+}
+
+// Cerrar todos los canales y dejar el básico con el archivo actual
+void apdu_reset_channels(void) {
+    memset(apdu_channels, 0, sizeof(apdu_channels));
+    apdu_channels[0].file = current_file;
+    apdu_channels[0].state = (uint8_t)(CHANNEL_OPEN | (session.state & USIM_STATE_SELECTED));
+}
+
+// Decodificar el canal lógico de CLA (ISO 7816-4 §5.4.1, TS 102 221 §10.1.1)
+// y dejar en cmd->cla la clase base sin bits de canal. La clase GSM no
+// admite canales y se deja intacta.
+static void apdu_decode_class(apdu_command_t* cmd) {
+    uint8_t cla = cmd->cla;
+
+    if((cla & 0xF0U) == CLA_GSM) {
+        cmd->channel = 0U;
+    } else if((cla & 0x40U) != 0U) {
+        // Clase ampliada: canales 4..19, sin mensajería segura
+        cmd->channel = (uint8_t)(4U + (cla & 0x0FU));
+        cmd->cla = (uint8_t)(cla & 0x80U);
+    } else {
+        // Clase básica: canales 0..3 en b2..b1
+        cmd->channel = (uint8_t)(cla & 0x03U);
+        cmd->cla = (uint8_t)(cla & 0xFCU);
+    }
+}
+
+// Procesar comando MANAGE CHANNEL
+bool handle_manage_channel(apdu_command_t* cmd, apdu_response_t* resp) {
+    uint8_t channel;
+
+    if(cmd->lc != 0U) {
+        resp->sw1sw2 = SW_WRONG_LENGTH;
+        return false;
+    }
+
+    if(cmd->p1 == MANAGE_CHANNEL_OPEN) {
+        channel = cmd->p2;
+
+        if(channel == 0U) {
+            // La tarjeta asigna el primer canal libre y lo devuelve
+            for(channel = 1U; channel < USIM_MAX_CHANNELS; channel++) {
+                if((apdu_channels[channel].state & CHANNEL_OPEN) == 0U) {
+                    break;
+                }
+            }
+            if(channel == USIM_MAX_CHANNELS) {
+                resp->sw1sw2 = SW_NO_CHANNEL_AVAILABLE;
+                return false;
+            }
+            resp->data[0] = channel;
+            resp->data_len = 1U;
+        } else if(channel >= USIM_MAX_CHANNELS) {
+            resp->sw1sw2 = SW_WRONG_P1P2;
+            return false;
+        } else if((apdu_channels[channel].state & CHANNEL_OPEN) != 0U) {
+            resp->sw1sw2 = SW_CONDITIONS_NOT_SATISFIED;
+            return false;
+        }
+
+        // Abierto desde el canal básico se selecciona el MF; desde otro
+        // canal se hereda su archivo actual (ISO 7816-4 §5.4.2)
+        if(cmd->channel == 0U) {
+            apdu_channels[channel].file.file_id = 0x3F00;
+            apdu_channels[channel].file.file_type = FILE_TYPE_MF;
+            apdu_channels[channel].file.file_size = 0U;
+            apdu_channels[channel].file.record_pointer = 0U;
+            apdu_channels[channel].file.file_index = USIM_FILE_INDEX_MF;
+            apdu_channels[channel].state = CHANNEL_OPEN;
+        } else {
+            apdu_channels[channel].file = current_file;
+            apdu_channels[channel].state =
+                (uint8_t)(CHANNEL_OPEN | (session.state & USIM_STATE_SELECTED));
+        }
+
+        USIM_LOG_STRING("MANAGE CHANNEL: open ");
+        USIM_LOG_UINT16(channel);
+        USIM_LOG_STRING("\r\n");
+    } else if(cmd->p1 == MANAGE_CHANNEL_CLOSE) {
+        channel = (cmd->p2 == 0U) ? cmd->channel : cmd->p2;
+
+        // El canal básico no se puede cerrar
+        if(channel == 0U || channel >= USIM_MAX_CHANNELS ||
+           (apdu_channels[channel].state & CHANNEL_OPEN) == 0U) {
+            resp->sw1sw2 = SW_WRONG_P1P2;
+            return false;
+        }
+
+        apdu_channels[channel].state = 0U;
+
+        USIM_LOG_STRING("MANAGE CHANNEL: close ");
+        USIM_LOG_UINT16(channel);
+        USIM_LOG_STRING("\r\n");
+    } else {
+        resp->sw1sw2 = SW_WRONG_P1P2;
+        return false;
+    }
+
+    resp->sw1sw2 = SW_OK;
+    return true;
+}
+
 // Procesador principal de APDU
 bool apdu_process_command(uint8_t* command, uint16_t cmd_len, uint8_t* response, uint16_t* resp_len) {
     apdu_command_t* cmd = &g_apdu_cmd;
@@ -374,6 +1061,9 @@ bool apdu_process_command(uint8_t* command, uint16_t cmd_len, uint8_t* response,
     memset(resp, 0, sizeof(*resp));
     resp->data = response;
 
+    // Las páginas del pool que entregó el APDU anterior se pueden liberar
+    usim_files_release();
+
     if(cmd_len < 4U) {
         resp->sw1sw2 = SW_WRONG_LENGTH;
         goto send_response;
@@ -385,6 +1075,7 @@ bool apdu_process_command(uint8_t* command, uint16_t cmd_len, uint8_t* response,
     cmd->p2 = command[3];
     cmd->lc = 0U;
     cmd->le = 0U;
+    apdu_decode_class(cmd);
 
     if(cmd_len == 5U) {
         cmd->le = command[4];
@@ -424,6 +1115,28 @@ bool apdu_process_command(uint8_t* command, uint16_t cmd_len, uint8_t* response,
         goto send_response;
     }
 
+    if(cmd->ins != INS_GET_RESPONSE) {
+        apdu_pending_len = 0U;
+        apdu_pending_offset = 0U;
+
+        // Sin Le no se pueden devolver datos en esta respuesta: el handler
+        // escribe en el buffer pendiente y se anuncia con 61xx.
+        if(!has_le) {
+            resp->data = apdu_pending_data;
+        }
+    }
+
+    if(cmd->channel >= USIM_MAX_CHANNELS ||
+       (apdu_channels[cmd->channel].state & CHANNEL_OPEN) == 0U) {
+        resp->sw1sw2 = SW_LOGICAL_CHANNEL_NOT_SUPPORTED;
+        goto send_response;
+    }
+
+    // Cargar el contexto del canal
+    current_file = apdu_channels[cmd->channel].file;
+    session.state = (uint8_t)((session.state & (uint8_t)~USIM_STATE_SELECTED) |
+                              (apdu_channels[cmd->channel].state & USIM_STATE_SELECTED));
+
     {
         bool invoked = false;
         bool success = false;
@@ -445,6 +1158,21 @@ bool apdu_process_command(uint8_t* command, uint16_t cmd_len, uint8_t* response,
                     invoked = true;
                     break;
 
+                case INS_READ_RECORD:
+                    success = handle_read_record(cmd, resp);
+                    invoked = true;
+                    break;
+
+                case INS_UPDATE_RECORD:
+                    success = handle_update_record(cmd, resp);
+                    invoked = true;
+                    break;
+
+                case INS_SEARCH_RECORD:
+                    success = handle_search_record(cmd, resp);
+                    invoked = true;
+                    break;
+
                 case INS_VERIFY_CHV:
                     success = handle_verify_chv(cmd, resp);
                     invoked = true;
@@ -470,13 +1198,22 @@ bool apdu_process_command(uint8_t* command, uint16_t cmd_len, uint8_t* response,
                     invoked = true;
                     break;
 
+                case INS_MANAGE_CHANNEL:
+                    success = handle_manage_channel(cmd, resp);
+                    invoked = true;
+                    break;
+
                 default:
                     break;
             }
         }
-#if USIM_ENABLE_USAT || USIM_ENABLE_CONFIG_APDU
         else if(cmd->cla == CLA_USAT || cmd->cla == CLA_CONFIG) {
             switch(cmd->ins) {
+                case INS_GET_IDENTITY:
+                    success = handle_get_identity(cmd, resp);
+                    invoked = true;
+                    break;
+
 #if USIM_ENABLE_USAT
                 case INS_USAT_DATA_DOWNLOAD:
                     success = usat_handle_data_download(cmd, resp);
@@ -509,16 +1246,35 @@ bool apdu_process_command(uint8_t* command, uint16_t cmd_len, uint8_t* response,
                     invoked = true;
                     break;
 
+                case INS_BATCH_AUTH:
+                    success = handle_batch_auth(cmd, resp);
+                    invoked = true;
+                    break;
+
                 case INS_RESET_SIM:
                     success = handle_reset_sim(cmd, resp);
                     invoked = true;
                     break;
+
+                case INS_GET_DIAGNOSTICS:
+                    success = handle_get_diagnostics(cmd, resp);
+                    invoked = true;
+                    break;
+
+                case INS_TRANSACTION:
+                    success = handle_transaction(cmd, resp);
+                    invoked = true;
+                    break;
+
+                case INS_SWITCH_PROFILE:
+                    success = handle_switch_profile(cmd, resp);
+                    invoked = true;
+                    break;
 #endif
                 default:
                     break;
             }
         }
-#endif
         else {
             resp->sw1sw2 = SW_CLA_NOT_SUPPORTED;
         }
@@ -537,6 +1293,42 @@ bool apdu_process_command(uint8_t* command, uint16_t cmd_len, uint8_t* response,
         }
     }
 
+    // Guardar el contexto (MANAGE CHANNEL o RESET pueden haberlo cerrado)
+    if((apdu_channels[cmd->channel].state & CHANNEL_OPEN) != 0U) {
+        apdu_channels[cmd->channel].file = current_file;
+        apdu_channels[cmd->channel].state =
+            (uint8_t)(CHANNEL_OPEN | (session.state & USIM_STATE_SELECTED));
+    }
+
+    if(resp->data == apdu_pending_data) {
+        if(resp->sw1sw2 == SW_OK && resp->data_len > 0U) {
+            apdu_pending_len = resp->data_len;
+            resp->sw1sw2 = SW_BYTES_AVAILABLE(apdu_pending_len);
+        }
+        resp->data = response;
+        resp->data_len = 0U;
+    } else if(has_le && resp->data_len > cmd->le && resp->sw1sw2 == SW_OK) {
+        // Más datos que Le: el resto queda para GET RESPONSE
+        apdu_pending_len = (uint16_t)(resp->data_len - cmd->le);
+        apdu_pending_offset = 0U;
+        memcpy(apdu_pending_data, &resp->data[cmd->le], apdu_pending_len);
+        resp->data_len = cmd->le;
+        resp->sw1sw2 = SW_BYTES_AVAILABLE(apdu_pending_len);
+    } else if(has_le && resp->data_len > 0U && resp->data_len < cmd->le && resp->sw1sw2 == SW_OK &&
+              sim_get_protocol() == 0U) {
+        // En T=0, tras el byte de procedimiento el lector espera exactamente
+        // P3 bytes: con menos se le indica la longitud con 6Cxx y repite el
+        // comando (TS 102 221 §7.3.1.1.4)
+        resp->sw1sw2 = SW_WRONG_LE(resp->data_len);
+        resp->data_len = 0U;
+    }
+
+    // Comando proactivo pendiente (REFRESH tras cambiar de perfil): 91xx en
+    // lugar de 9000 para que la terminal haga FETCH
+    if(resp->sw1sw2 == SW_OK && usat_pending_command() != 0U) {
+        resp->sw1sw2 = SW_PROACTIVE_COMMAND(usat_pending_command());
+    }
+
 send_response:
     // Construir respuesta
     if(resp->data_len > 0U && resp->data != response) {
@@ -546,5 +1338,5 @@ send_response:
     response[resp->data_len + 1U] = (uint8_t)(resp->sw1sw2 & 0xFFU);
     *resp_len = (uint16_t)(resp->data_len + 2U);
 
-    return (resp->sw1sw2 == SW_OK);
+    return (resp->sw1sw2 == SW_OK || (resp->sw1sw2 & 0xFF00U) == SW_PROACTIVE_COMMAND(0U));
 }
@@ -1,5 +1,7 @@
 #include "chip_specific.h"
 #include "usim_constants.h"
+#include "usim_atr.h"
+#include "usim_files.h"
 
 #include <stddef.h>
 
@@ -14,12 +16,57 @@
 #define SIM_PPS_INTERBYTE_TIMEOUT 60000UL
 #define SIM_VCC_FALLBACK_ITER   80000UL
 #define SIM_PREFETCH_CAPACITY   8U
+#define SIM_RX_RING_SIZE        32U    /* Potencia de 2 */
+#define SIM_RX_RING_MASK        (SIM_RX_RING_SIZE - 1U)
+#define SIM_RX_IDLE_PERIOD      0x4000UL /* Ticks entre comprobaciones de timeout */
+#define SIM_RX_STATE_OFF        0U
+#define SIM_RX_STATE_IDLE       1U
+#define SIM_RX_STATE_SAMPLING   2U
+#define SIM_RX_PARITY_BIT       9U
+#define SIM_WWT_CLOCKS          (960UL * 10UL) /* WWT = 960·WI·Fi ciclos; sin TC2, WI = 10 */
+#define SIM_BWT_CLOCKS          960UL          /* BWT = 11 ETU + 2^BWI·960·372 ciclos */
+
+// Volver al modo de espera desde las ISR (macro: sin llamadas en interrupción)
+#define sim_rx_enter_idle() do { \
+        TCON &= (uint8_t)~TCON_TR0; \
+        TH0 = (uint8_t)((0x10000UL - SIM_RX_IDLE_PERIOD) >> 8); \
+        TL0 = (uint8_t)((0x10000UL - SIM_RX_IDLE_PERIOD) & 0xFFU); \
+        TCON |= TCON_TR0; \
+        sim_rx_state = SIM_RX_STATE_IDLE; \
+    } while(0)
+#define SIM_PPSS                0xFFU
+#define SIM_PPS0_PPS1_PRESENT   0x10U
+#define SIM_PPS0_PPS2_PRESENT   0x20U
+#define SIM_PPS0_PPS3_PRESENT   0x40U
+#define SIM_PPS0_RESERVED       0x80U
+#define SIM_PPS1_DEFAULT        0x11U  /* Fi=372, Di=1 */
+/* Peor caso de sim_rx_timer_isr() al muestrear un bit de datos, en ciclos
+ * máquina: entrada a la interrupción, LJMP y RETI (13), guardar y restaurar
+ * 7 registros (28), recarga acumulativa (12) y muestreo con desplazamiento
+ * (9). El bit de paridad escribe además en el anillo, pero le sigue el stop
+ * y la guarda (2 ETU) antes del siguiente flanco. */
+#define SIM_RX_ISR_WORST_TICKS  62UL
+/* ETU mínima (en ticks del temporizador): la ISR de un bit debe terminar
+ * antes del siguiente muestreo. En envío las recargas son acumulativas y la
+ * latencia de sondeo no alarga los bits. scripts/gen_atr.py lee este valor
+ * para anunciar en TA1 el par Fi/Di más rápido que cumple el mínimo. */
+#define SIM_PPS_MIN_ETU_TICKS   64UL
+
+#if SIM_PPS_MIN_ETU_TICKS <= SIM_RX_ISR_WORST_TICKS
+#error "SIM_PPS_MIN_ETU_TICKS no deja tiempo a la ISR de recepción"
+#endif
+
+#if (USIM_ATR_FI / USIM_ATR_DI) < (SIM_PPS_MIN_ETU_TICKS * SIM_MACHINE_CYCLE_DIV)
+#error "TA1 del ATR (config/atr.json) es más rápido de lo que admite el motor de bits"
+#endif
 
 static uint32_t sim_etu_ticks = SIM_DEFAULT_ETU_TICKS;
+static uint32_t sim_base_etu_ticks = SIM_DEFAULT_ETU_TICKS; /* ETU con Fi=372, Di=1 */
 static uint32_t sim_half_etu_ticks = SIM_DEFAULT_ETU_TICKS / 2U;
 static uint32_t sim_quarter_etu_ticks = (SIM_DEFAULT_ETU_TICKS / 4U) ? (SIM_DEFAULT_ETU_TICKS / 4U) : 1U;
 static bool sim_etu_ready = false;
 static bool sim_vcc_present = false;
+static bool sim_vcc_sensed = false;   /* VCC visto en el pin (no supuesto) */
 static bool sim_reset_pending = true;
 static bool sim_atr_ready_flag = false;
 static uint8_t sim_rst_last = 0U;
@@ -27,14 +74,46 @@ static uint32_t sim_poll_counter = 0UL;
 static uint8_t sim_rx_prefetch_buf[SIM_PREFETCH_CAPACITY];
 static uint8_t sim_rx_prefetch_count = 0U;
 static bool sim_pps_processed = false;
+static uint8_t sim_protocol = USIM_ATR_DEFAULT_PROTOCOL;
+static uint16_t sim_fi = (uint16_t)SIM_ETU_FACTOR;
+
+// Recepción por interrupciones: INT0 detecta el bit de start y el Timer 0
+// muestrea cada bit en el centro de la ETU. Entre bytes el mismo Timer 0
+// descuenta el timeout de recepción mientras la CPU duerme en modo IDLE.
+static __xdata uint8_t sim_rx_ring[SIM_RX_RING_SIZE];
+static volatile uint8_t sim_rx_head = 0U;
+static volatile uint8_t sim_rx_tail = 0U;
+static volatile uint8_t sim_rx_state = SIM_RX_STATE_OFF;
+static volatile uint8_t sim_rx_shift = 0U;
+static volatile uint8_t sim_rx_bitcount = 0U;
+static volatile uint8_t sim_rx_parity = 0U;
+static volatile uint32_t sim_rx_wait_ticks = 0UL;
+static volatile bool sim_rx_timed_out = false;
+static volatile bool sim_rst_event = false;
+static volatile bool sim_rst_flush_due = false;
+static volatile uint8_t sim_rx_parity_errors = 0U;
+static volatile uint8_t sim_rx_overruns = 0U;
+static volatile bool sim_elapsed_running = false;
+static volatile uint16_t sim_elapsed_overflows = 0U;
+static uint16_t sim_etu_reload = (uint16_t)(0x10000UL - SIM_DEFAULT_ETU_TICKS);
+static uint16_t sim_half_etu_reload = (uint16_t)(0x10000UL - (SIM_DEFAULT_ETU_TICKS / 2U));
+
+// Tablas ISO/IEC 7816-3 (tabla 7 y 8). Un valor 0 marca códigos RFU.
+static const __code uint16_t sim_fi_table[16] = {
+    372U, 372U, 558U, 744U, 1116U, 1488U, 1860U, 0U,
+    0U, 512U, 768U, 1024U, 1536U, 2048U, 0U, 0U
+};
+static const __code uint8_t sim_di_table[16] = {
+    0U, 1U, 2U, 4U, 8U, 16U, 32U, 64U,
+    12U, 20U, 0U, 0U, 0U, 0U, 0U, 0U
+};
 
 static void sim_set_etu_ticks(uint32_t ticks);
 static void sim_delay_ticks(uint32_t ticks);
 static void sim_delay_etus(uint16_t etus);
-static void sim_delay_quarter_etu(void);
+static void sim_tx_next_etu(void);
 static void sim_io_drive_low(void);
 static void sim_io_release(void);
-static uint8_t sim_io_read(void);
 static bool sim_prefetch_pop(uint8_t* value);
 static void sim_prefetch_push(uint8_t value);
 static void sim_prefetch_clear(void);
@@ -42,6 +121,11 @@ static uint32_t sim_measure_clock_period(void);
 static void sim_update_clock_from_reader(void);
 static void sim_prepare_after_reset(void);
 static void sim_transport_poll(void);
+static uint32_t sim_etu_ticks_for_pps1(uint8_t pps1);
+static bool sim_protocol_offered(uint8_t protocol);
+static void sim_rx_stop(void);
+static void sim_rx_start(void);
+static void sim_rx_flush(void);
 
 static void sim_set_etu_ticks(uint32_t ticks) {
     if(ticks < SIM_MIN_ETU_TICKS) {
@@ -60,9 +144,46 @@ static void sim_set_etu_ticks(uint32_t ticks) {
     if(sim_quarter_etu_ticks == 0UL) {
         sim_quarter_etu_ticks = 1UL;
     }
+
+    sim_etu_reload = (uint16_t)(0x10000UL - sim_etu_ticks);
+    sim_half_etu_reload = (uint16_t)(0x10000UL - sim_half_etu_ticks);
+}
+
+// Detener el motor de recepción y liberar el Timer 0 para uso por sondeo
+static void sim_rx_stop(void) {
+    IE &= (uint8_t)~(IE_EX0 | IE_ET0);
+    TCON &= (uint8_t)~(TCON_TR0 | TCON_TF0);
+    sim_rx_state = SIM_RX_STATE_OFF;
+    sim_elapsed_running = false;
+}
+
+// Armar INT0 y el Timer 0 en modo de espera (cuenta de timeout)
+static void sim_rx_start(void) {
+    if(sim_rx_state != SIM_RX_STATE_OFF) {
+        return;
+    }
+
+    sim_elapsed_running = false;
+
+    sim_io_release();
+
+    TCON &= (uint8_t)~(TCON_TF0 | TCON_IE0);
+    sim_rx_enter_idle();
+    IE |= (uint8_t)(IE_EX0 | IE_ET0);
+}
+
+static void sim_rx_flush(void) {
+    sim_rx_head = 0U;
+    sim_rx_tail = 0U;
 }
 
 static void sim_delay_ticks(uint32_t ticks) {
+    // El Timer 0 se comparte con la recepción y el cronómetro: semidúplex,
+    // nunca a la vez
+    if(sim_rx_state != SIM_RX_STATE_OFF || sim_elapsed_running) {
+        sim_rx_stop();
+    }
+
     while(ticks > 0UL) {
         uint16_t chunk = (ticks > 0xFFFFUL) ? 0xFFFFU : (uint16_t)ticks;
         uint16_t reload = (uint16_t)(0x10000UL - chunk);
@@ -88,8 +209,23 @@ static void sim_delay_etus(uint16_t etus) {
     }
 }
 
-static void sim_delay_quarter_etu(void) {
-    sim_delay_ticks(sim_quarter_etu_ticks);
+// Envío: esperar por sondeo el desborde que marca el siguiente flanco y
+// recargar sumando una ETU a lo que el Timer 0 ya ha contado desde entonces,
+// como hace sim_rx_timer_isr(). El tiempo de detectar el desborde y mover el
+// pin no se acumula bit a bit: cada flanco cae a la misma distancia de su
+// desborde.
+static void sim_tx_next_etu(void) {
+    uint16_t next;
+
+    while((TCON & TCON_TF0) == 0U) {
+        /* Esperar el fin del bit */
+    }
+
+    TCON &= (uint8_t)~(TCON_TR0 | TCON_TF0);
+    next = (uint16_t)((((uint16_t)TH0 << 8) | TL0) + sim_etu_reload);
+    TH0 = (uint8_t)(next >> 8);
+    TL0 = (uint8_t)(next & 0xFFU);
+    TCON |= TCON_TR0;
 }
 
 static void sim_io_drive_low(void) {
@@ -100,10 +236,6 @@ static void sim_io_release(void) {
     P1 |= SIM_IO_PIN;
 }
 
-static uint8_t sim_io_read(void) {
-    return (uint8_t)((P1 & SIM_IO_PIN) != 0U ? 1U : 0U);
-}
-
 static bool sim_prefetch_pop(uint8_t* value) {
     if(sim_rx_prefetch_count == 0U) {
         return false;
@@ -128,6 +260,8 @@ static void sim_prefetch_clear(void) {
 static uint32_t sim_measure_clock_period(void) {
     uint32_t guard;
 
+    sim_rx_stop();
+
     guard = SIM_MEASURE_GUARD;
     while(((P1 & SIM_CLK_PIN) != 0U) && guard-- != 0UL) {
         /* Esperar a que el reloj vaya a bajo */
@@ -176,24 +310,56 @@ static void sim_update_clock_from_reader(void) {
     uint32_t period = sim_measure_clock_period();
 
     if(period != 0UL) {
-        uint32_t etu = period * 372UL;
+        uint32_t etu = period * SIM_ETU_FACTOR;
+        sim_base_etu_ticks = etu;
         sim_set_etu_ticks(etu);
         sim_etu_ready = true;
         USIM_LOG_STRING("SIM clock synchronised\r\n");
     } else {
-        if(!sim_etu_ready) {
-            sim_set_etu_ticks(SIM_DEFAULT_ETU_TICKS);
-            sim_etu_ready = true;
-        }
+        // Tras un reset siempre se vuelve a Fi=372/Di=1
+        sim_set_etu_ticks(sim_base_etu_ticks);
+        sim_etu_ready = true;
         USIM_LOG_STRING("SIM clock measurement fallback\r\n");
     }
 }
 
+// Calcula la ETU para un PPS1 (Fi/Di). Devuelve 0 si el par es RFU, si es
+// más rápido que lo anunciado en TA1 o si la ETU resultante es más corta de
+// lo que el motor de bits puede sostener.
+static uint32_t sim_etu_ticks_for_pps1(uint8_t pps1) {
+    uint16_t fi = sim_fi_table[(pps1 >> 4) & 0x0FU];
+    uint8_t di = sim_di_table[pps1 & 0x0FU];
+    uint32_t divisor;
+    uint32_t ticks;
+
+    if(fi == 0U || di == 0U) {
+        return 0UL;
+    }
+
+    if(((uint32_t)fi * USIM_ATR_DI) < ((uint32_t)USIM_ATR_FI * di)) {
+        return 0UL;
+    }
+
+    divisor = SIM_ETU_FACTOR * (uint32_t)di;
+    ticks = ((sim_base_etu_ticks * fi) + (divisor / 2UL)) / divisor;
+
+    if(ticks < SIM_PPS_MIN_ETU_TICKS || ticks > SIM_MAX_ETU_TICKS) {
+        return 0UL;
+    }
+
+    return ticks;
+}
+
 static void sim_prepare_after_reset(void) {
+    sim_rx_stop();
     sim_update_clock_from_reader();
     sim_io_release();
+    sim_rx_flush();
+    sim_rst_event = false;
     sim_prefetch_clear();
     sim_pps_processed = false;
+    sim_protocol = USIM_ATR_DEFAULT_PROTOCOL;
+    sim_fi = (uint16_t)SIM_ETU_FACTOR;
 }
 
 static void sim_transport_poll(void) {
@@ -204,6 +370,7 @@ static void sim_transport_poll(void) {
     if(!sim_vcc_present) {
         if((P1 & SIM_VCC_PIN) != 0U) {
             sim_vcc_present = true;
+            sim_vcc_sensed = true;
             USIM_LOG_STRING("SIM VCC detected\r\n");
         } else if(sim_poll_counter > SIM_VCC_FALLBACK_ITER) {
             sim_vcc_present = true;
@@ -213,9 +380,22 @@ static void sim_transport_poll(void) {
         }
     }
 
+    // Caída de VCC: volcar la caché write-back mientras quede carga
+    if(sim_vcc_sensed && (P1 & SIM_VCC_PIN) == 0U) {
+        sim_vcc_sensed = false;
+        USIM_LOG_STRING("SIM VCC lost\r\n");
+        (void)usim_files_flush();
+    }
+
     rst_state = (uint8_t)((P1 & SIM_RST_PIN) != 0U ? 1U : 0U);
 
     if(rst_state == 0U) {
+        // Flanco de bajada en RST (visto por sondeo o por INT1): volcar la
+        // caché una sola vez; mientras RST siga en bajo no se escribe nada
+        if(sim_rst_last != 0U || sim_rst_flush_due) {
+            sim_rst_flush_due = false;
+            (void)usim_files_flush();
+        }
         sim_reset_pending = true;
     } else if(sim_reset_pending && sim_rst_last == 0U) {
         sim_prepare_after_reset();
@@ -296,6 +476,65 @@ void delay_ms(uint16_t ms) {
     }
 }
 
+// Lanzar un comando IAP sobre la dirección indicada. La CPU queda detenida
+// hasta que termina; las interrupciones se enmascaran durante la secuencia
+// de disparo.
+static bool iap_execute(uint8_t command, uint32_t address) {
+    uint8_t ie_saved = IE;
+    bool ok;
+
+    IAP_ADDRX = (uint8_t)(address >> 16);
+    IAP_ADDRH = (uint8_t)(address >> 8);
+    IAP_ADDRL = (uint8_t)address;
+    IAP_CMD = command;
+
+    IE &= (uint8_t)~IE_EA;
+    IAP_TRIG = IAP_TRIG_KEY1;
+    IAP_TRIG = IAP_TRIG_KEY2;
+    __asm nop __endasm;
+    IE = ie_saved;
+
+    ok = (IAP_CONTR & IAP_CONTR_FAIL) == 0U;
+    IAP_CONTR &= (uint8_t)~IAP_CONTR_FAIL;
+    return ok;
+}
+
+// Lectura de la flash de datos (fuera del espacio de código lineal)
+void flash_read(uint32_t address, uint8_t* data, uint16_t length) {
+    uint16_t i;
+
+    IAP_CONTR = IAP_CONTR_ENABLE;
+    for(i = 0U; i < length; i++) {
+        (void)iap_execute(IAP_CMD_READ, address + i);
+        data[i] = IAP_DATA;
+    }
+    IAP_CONTR = 0U;
+}
+
+// Programación byte a byte: solo puede pasar bits de 1 a 0
+bool flash_program(uint32_t address, const uint8_t* data, uint16_t length) {
+    uint16_t i;
+    bool ok = true;
+
+    IAP_CONTR = IAP_CONTR_ENABLE;
+    for(i = 0U; i < length && ok; i++) {
+        IAP_DATA = data[i];
+        ok = iap_execute(IAP_CMD_PROGRAM, address + i);
+    }
+    IAP_CONTR = 0U;
+    return ok;
+}
+
+// Borrado del sector que contiene "address"
+bool flash_erase_sector(uint32_t address) {
+    bool ok;
+
+    IAP_CONTR = IAP_CONTR_ENABLE;
+    ok = iap_execute(IAP_CMD_ERASE, address & ~((uint32_t)FLASH_SECTOR_SIZE - 1UL));
+    IAP_CONTR = 0U;
+    return ok;
+}
+
 // Control de energía SIM (ahora solo se asegura que las líneas queden liberadas)
 void sim_power_on(void) {
     sim_io_release();
@@ -315,16 +554,29 @@ void chip_init(void) {
     uart_init(9600);
     timer_init();
 
+    sim_base_etu_ticks = SIM_DEFAULT_ETU_TICKS;
     sim_set_etu_ticks(SIM_DEFAULT_ETU_TICKS);
     sim_etu_ready = true;
 
     sim_vcc_present = ((P1 & SIM_VCC_PIN) != 0U);
+    sim_vcc_sensed = sim_vcc_present;
     sim_reset_pending = true;
     sim_atr_ready_flag = false;
     sim_rst_last = 0U;
     sim_poll_counter = 0UL;
     sim_prefetch_clear();
     sim_pps_processed = false;
+    sim_protocol = USIM_ATR_DEFAULT_PROTOCOL;
+    sim_fi = (uint16_t)SIM_ETU_FACTOR;
+
+    sim_rx_stop();
+    sim_rx_flush();
+    sim_rst_event = false;
+
+    // INT0 (IO) e INT1 (RST) por flanco de bajada
+    TCON |= (uint8_t)(TCON_IT0 | TCON_IT1);
+    TCON &= (uint8_t)~(TCON_IE0 | TCON_IE1);
+    IE |= (uint8_t)(IE_EX1 | IE_EA);
 
     sim_io_release();
 
@@ -362,7 +614,10 @@ bool sim_detect_reset_request(void) {
 
         sim_delay_etus(SIM_ATR_GUARD_ETUS);
         sim_prefetch_clear();
+        sim_rx_flush();
         sim_pps_processed = false;
+        sim_protocol = USIM_ATR_DEFAULT_PROTOCOL;
+        sim_fi = (uint16_t)SIM_ETU_FACTOR;
         return true;
     }
 
@@ -378,42 +633,52 @@ bool sim_send_byte(uint8_t data) {
         sim_etu_ready = true;
     }
 
+    // El Timer 0 se comparte con la recepción y el cronómetro
+    if(sim_rx_state != SIM_RX_STATE_OFF || sim_elapsed_running) {
+        sim_rx_stop();
+    }
+
+    // Media ETU de guarda antes del start; desde aquí el temporizador no se
+    // reinicia y cada flanco sigue a un desborde
+    TCON &= (uint8_t)~(TCON_TR0 | TCON_TF0);
+    TH0 = (uint8_t)(sim_half_etu_reload >> 8);
+    TL0 = (uint8_t)(sim_half_etu_reload & 0xFFU);
+    TCON |= TCON_TR0;
+
+    sim_tx_next_etu();
     sim_io_drive_low();
-    sim_delay_ticks(sim_etu_ticks);
 
     for(bit_index = 0U; bit_index < 8U; ++bit_index) {
+        sim_tx_next_etu();
         if((data & 0x01U) != 0U) {
             sim_io_release();
             parity ^= 1U;
         } else {
             sim_io_drive_low();
         }
-
-        sim_delay_ticks(sim_etu_ticks);
         data >>= 1U;
     }
 
+    sim_tx_next_etu();
     if(parity != 0U) {
         sim_io_release();
     } else {
         sim_io_drive_low();
     }
-    sim_delay_ticks(sim_etu_ticks);
 
+    sim_tx_next_etu();
     sim_io_release();
-    sim_delay_ticks(sim_etu_ticks);
 
-    sim_delay_ticks(sim_half_etu_ticks);
+    // Fin del bit de stop
+    while((TCON & TCON_TF0) == 0U) {
+        /* Esperar */
+    }
+    TCON &= (uint8_t)~(TCON_TR0 | TCON_TF0);
     return true;
 }
 
 bool sim_receive_byte(uint8_t* data, uint32_t timeout_cycles) {
-    uint32_t guard = timeout_cycles;
-    uint8_t bit_index;
-    uint8_t value = 0U;
-    uint8_t parity = 0U;
-    uint8_t parity_bit;
-    uint8_t stop_bit;
+    uint8_t tail;
 
     if(data == NULL) {
         return false;
@@ -428,75 +693,245 @@ bool sim_receive_byte(uint8_t* data, uint32_t timeout_cycles) {
         sim_etu_ready = true;
     }
 
-    if(guard == 0UL) {
-        guard = SIM_MEASURE_GUARD;
+    if(timeout_cycles == 0UL) {
+        timeout_cycles = SIM_MEASURE_GUARD;
     }
 
-    sim_io_release();
+    // El timeout se expresa en cuartos de ETU, como en el antiguo sondeo
+    IE &= (uint8_t)~IE_ET0;
+    sim_rx_wait_ticks = timeout_cycles * sim_quarter_etu_ticks;
+    sim_rx_timed_out = false;
+    IE |= IE_ET0;
 
-    while(guard > 0UL) {
-        if(sim_io_read() == 0U) {
-            break;
+    sim_rx_start();
+
+    while(sim_rx_head == sim_rx_tail) {
+        if(sim_rst_event) {
+            sim_rx_stop();
+            return false;
         }
-        sim_delay_quarter_etu();
-        guard--;
 
-        sim_transport_poll();
-        if(sim_atr_ready_flag) {
+        if(sim_rx_timed_out && sim_rx_state != SIM_RX_STATE_SAMPLING) {
             return false;
         }
+
+        // Dormir hasta la siguiente interrupción (flanco de start o timer)
+        PCON |= PCON_IDL;
     }
 
-    if(guard == 0UL && sim_io_read() != 0U) {
-        return false;
+    tail = sim_rx_tail;
+    *data = sim_rx_ring[tail];
+    sim_rx_tail = (uint8_t)((tail + 1U) & SIM_RX_RING_MASK);
+
+    if(sim_rx_parity_errors != 0U) {
+        sim_rx_parity_errors = 0U;
+        USIM_LOG_STRING("SIM RX parity error\r\n");
     }
 
-    sim_delay_ticks(sim_half_etu_ticks);
-    if(sim_io_read() != 0U) {
-        return false;
+    if(sim_rx_overruns != 0U) {
+        sim_rx_overruns = 0U;
+        USIM_LOG_STRING("SIM RX ring overrun\r\n");
+    }
+
+    return true;
+}
+
+// Flanco de bajada en IO: bit de start. Se arma el Timer 0 a media ETU para
+// muestrear en el centro de cada bit.
+void sim_io_start_isr(void) __interrupt(0) {
+    if(sim_rx_state == SIM_RX_STATE_OFF) {
+        return;
     }
 
-    sim_delay_ticks(sim_etu_ticks);
+    IE &= (uint8_t)~IE_EX0;
+    TCON &= (uint8_t)~(TCON_TR0 | TCON_TF0);
+    TH0 = (uint8_t)(sim_half_etu_reload >> 8);
+    TL0 = (uint8_t)(sim_half_etu_reload & 0xFFU);
+    TCON |= TCON_TR0;
 
-    for(bit_index = 0U; bit_index < 8U; ++bit_index) {
-        if(sim_io_read() != 0U) {
-            value |= (uint8_t)(1U << bit_index);
-            parity ^= 1U;
+    sim_rx_shift = 0U;
+    sim_rx_parity = 0U;
+    sim_rx_bitcount = 0U;
+    sim_rx_state = SIM_RX_STATE_SAMPLING;
+}
+
+void sim_rx_timer_isr(void) __interrupt(1) {
+    uint16_t next;
+    uint8_t bit;
+
+    if(sim_rx_state == SIM_RX_STATE_IDLE) {
+        sim_rx_enter_idle();
+
+        if(sim_rx_wait_ticks > SIM_RX_IDLE_PERIOD) {
+            sim_rx_wait_ticks -= SIM_RX_IDLE_PERIOD;
+        } else {
+            sim_rx_wait_ticks = 0UL;
+            sim_rx_timed_out = true;
         }
-        sim_delay_ticks(sim_etu_ticks);
+        return;
     }
 
-    parity_bit = sim_io_read();
-    sim_delay_ticks(sim_etu_ticks);
+    if(sim_rx_state != SIM_RX_STATE_SAMPLING) {
+        if(sim_elapsed_running) {
+            // Cronómetro: el modo 1 sigue contando desde 0000
+            sim_elapsed_overflows++;
+            return;
+        }
+        TCON &= (uint8_t)~TCON_TR0;
+        return;
+    }
 
-    stop_bit = sim_io_read();
-    sim_delay_ticks(sim_etu_ticks);
+    // Recarga acumulativa: se suma al valor actual para absorber la latencia
+    // de la interrupción y que el punto de muestreo no se desplace.
+    TCON &= (uint8_t)~TCON_TR0;
+    next = (uint16_t)((((uint16_t)TH0 << 8) | TL0) + sim_etu_reload);
+    TH0 = (uint8_t)(next >> 8);
+    TL0 = (uint8_t)(next & 0xFFU);
+    TCON |= TCON_TR0;
 
-    sim_delay_ticks(sim_half_etu_ticks);
+    bit = (uint8_t)((P1 & SIM_IO_PIN) != 0U ? 1U : 0U);
 
-    if(((parity ^ parity_bit) & 0x01U) != 0U) {
-        USIM_LOG_STRING("SIM RX parity error\r\n");
+    if(sim_rx_bitcount == 0U) {
+        if(bit != 0U) {
+            // Falso start (ruido): volver a esperar flanco
+            sim_rx_enter_idle();
+            TCON &= (uint8_t)~TCON_IE0;
+            IE |= IE_EX0;
+            return;
+        }
+    } else if(sim_rx_bitcount < SIM_RX_PARITY_BIT) {
+        sim_rx_shift >>= 1;
+        if(bit != 0U) {
+            sim_rx_shift |= 0x80U;
+            sim_rx_parity ^= 1U;
+        }
+    } else {
+        uint8_t head = sim_rx_head;
+        uint8_t next_head = (uint8_t)((head + 1U) & SIM_RX_RING_MASK);
+
+        if(((sim_rx_parity ^ bit) & 0x01U) != 0U) {
+            sim_rx_parity_errors++;
+        }
+
+        if(next_head != sim_rx_tail) {
+            sim_rx_ring[head] = sim_rx_shift;
+            sim_rx_head = next_head;
+        } else {
+            sim_rx_overruns++;
+        }
+
+        // Durante el bit de stop la línea está en alto: el siguiente flanco
+        // de bajada solo puede ser el start del próximo carácter.
+        sim_rx_enter_idle();
+        TCON &= (uint8_t)~TCON_IE0;
+        IE |= IE_EX0;
+        return;
     }
 
-    if(stop_bit == 0U) {
-        USIM_LOG_STRING("SIM RX stop bit missing\r\n");
+    sim_rx_bitcount++;
+}
+
+// Flanco de bajada en RST: el lector reinicia la tarjeta
+void sim_rst_isr(void) __interrupt(2) {
+    sim_rst_event = true;
+    sim_reset_pending = true;
+    sim_rst_last = 0U;
+    sim_rst_flush_due = true;
+}
+
+static bool sim_protocol_offered(uint8_t protocol) {
+#if USIM_ATR_OFFERS_T0
+    if(protocol == 0U) {
+        return true;
     }
+#endif
+#if USIM_ATR_OFFERS_T1
+    if(protocol == 1U) {
+        return true;
+    }
+#endif
+    return false;
+}
 
-    *data = value;
+// Protocolo activo (0 o 1) tras el ATR y el PPS
+uint8_t sim_get_protocol(void) {
+    return sim_protocol;
+}
+
+// Tiempo que el lector espera a la tarjeta, en ticks del Timer 0: WWT en T=0
+// (960·WI·Fi ciclos de reloj) o BWT en T=1 (11 ETU + 2^BWI·960·372 ciclos).
+// sim_base_etu_ticks son los ticks de 372 ciclos del reloj del lector.
+uint32_t sim_wait_time_ticks(void) {
+    if(sim_protocol == 1U) {
+        return ((SIM_BWT_CLOCKS << USIM_ATR_T1_BWI) * sim_base_etu_ticks) + (11UL * sim_etu_ticks);
+    }
+    return ((SIM_WWT_CLOCKS * sim_fi) / SIM_ETU_FACTOR) * sim_base_etu_ticks;
+}
+
+// Cronómetro en ciclos máquina sobre el Timer 0 mientras se procesa un
+// comando: la ISR cuenta los desbordes. Enviar o recibir lo detiene.
+void sim_elapsed_start(void) {
+    sim_rx_stop();
+    TH0 = 0U;
+    TL0 = 0U;
+    sim_elapsed_overflows = 0U;
+    sim_elapsed_running = true;
+    TCON |= TCON_TR0;
+    IE |= IE_ET0;
+}
+
+uint32_t sim_elapsed_ticks(void) {
+    uint8_t high;
+    uint8_t low;
+    uint16_t overflows;
+
+    if(!sim_elapsed_running) {
+        return 0UL;
+    }
+
+    IE &= (uint8_t)~IE_ET0;
+    do {
+        high = TH0;
+        low = TL0;
+    } while(high != TH0);
+    overflows = sim_elapsed_overflows;
+    // Desborde aún sin atender: la lectura ya es del ciclo siguiente
+    if((TCON & TCON_TF0) != 0U && high < 0x80U) {
+        overflows++;
+    }
+    IE |= IE_ET0;
+
+    return ((uint32_t)overflows << 16) | ((uint16_t)high << 8) | low;
+}
+
+// Modo específico (TA2): aplicar directamente los parámetros de TA1 tras el ATR
+bool sim_apply_transmission_factors(uint8_t ta1) {
+    uint32_t etu = sim_etu_ticks_for_pps1(ta1);
+
+    sim_pps_processed = true;
+
+    if(etu == 0UL) {
+        USIM_LOG_STRING("TA1 out of reach - keeping default\r\n");
+        return false;
+    }
+
+    sim_set_etu_ticks(etu);
+    sim_fi = sim_fi_table[(ta1 >> 4) & 0x0FU];
     return true;
 }
 
 bool sim_handle_pps_sequence(void) {
     uint8_t first_byte;
     uint8_t pps0;
-    uint8_t optional_mask;
-    uint8_t optional_bytes[3];
-    uint8_t optional_count = 0U;
+    uint8_t pps1 = SIM_PPS1_DEFAULT;
+    uint8_t pps_byte;
     uint8_t pck;
     uint8_t xor_acc;
     uint8_t index;
     uint8_t consumed[6];
     uint8_t consumed_len = 0U;
+    uint8_t reply_pps0;
+    uint32_t new_etu = 0UL;
 
     if(sim_pps_processed) {
         return true;
@@ -509,7 +944,7 @@ bool sim_handle_pps_sequence(void) {
 
     consumed[consumed_len++] = first_byte;
 
-    if(first_byte != 0xFFU) {
+    if(first_byte != SIM_PPSS) {
         sim_prefetch_push(first_byte);
         sim_pps_processed = true;
         return true;
@@ -521,11 +956,9 @@ bool sim_handle_pps_sequence(void) {
         return true;
     }
 
-    if(consumed_len < sizeof(consumed)) {
-        consumed[consumed_len++] = pps0;
-    }
+    consumed[consumed_len++] = pps0;
 
-    if(pps0 < 0x10U || pps0 > 0x1FU) {
+    if((pps0 & SIM_PPS0_RESERVED) != 0U) {
         for(index = 0U; index < consumed_len; ++index) {
             sim_prefetch_push(consumed[consumed_len - 1U - index]);
         }
@@ -533,26 +966,22 @@ bool sim_handle_pps_sequence(void) {
         return true;
     }
 
-    optional_mask = (uint8_t)(pps0 & 0x0FU);
     xor_acc = (uint8_t)(first_byte ^ pps0);
 
+    // PPS1, PPS2 y PPS3 llegan en orden según los bits b5..b7 de PPS0
     for(index = 0U; index < 3U; ++index) {
-        if((optional_mask & (1U << index)) != 0U) {
-            if(optional_count >= 3U) {
-                break;
-            }
-
-            if(!sim_receive_byte(&optional_bytes[optional_count], SIM_PPS_INTERBYTE_TIMEOUT)) {
+        if((pps0 & (uint8_t)(SIM_PPS0_PPS1_PRESENT << index)) != 0U) {
+            if(!sim_receive_byte(&pps_byte, SIM_PPS_INTERBYTE_TIMEOUT)) {
                 sim_pps_processed = true;
                 return true;
             }
 
-            if(consumed_len < sizeof(consumed)) {
-                consumed[consumed_len++] = optional_bytes[optional_count];
-            }
+            consumed[consumed_len++] = pps_byte;
+            xor_acc ^= pps_byte;
 
-            xor_acc ^= optional_bytes[optional_count];
-            optional_count++;
+            if(index == 0U) {
+                pps1 = pps_byte;
+            }
         }
     }
 
@@ -561,10 +990,7 @@ bool sim_handle_pps_sequence(void) {
         return true;
     }
 
-    if(consumed_len < sizeof(consumed)) {
-        consumed[consumed_len++] = pck;
-    }
-
+    consumed[consumed_len++] = pck;
     xor_acc ^= pck;
 
     if(xor_acc != 0U) {
@@ -578,31 +1004,53 @@ bool sim_handle_pps_sequence(void) {
 
     sim_pps_processed = true;
 
-    if((pps0 & 0xF0U) != 0x10U) {
+    if(!sim_protocol_offered((uint8_t)(pps0 & 0x0FU))) {
         USIM_LOG_STRING("PPS protocol unsupported\r\n");
         return true;
     }
 
-    if((optional_mask & 0x08U) != 0U) {
-        USIM_LOG_STRING("PPS reserved bits set\r\n");
-        return true;
-    }
+    // Respuesta: PPS2/PPS3 no se soportan y nunca se devuelven. PPS1 solo se
+    // devuelve si el par Fi/Di es alcanzable; si no, se responde sin PPS1 y
+    // ambos lados continúan con Fi=372/Di=1.
+    reply_pps0 = (uint8_t)(pps0 & 0x0FU);
 
-    if(optional_count > 0U) {
-        USIM_LOG_STRING("PPS parameter change ignored\r\n");
-        return true;
+    if((pps0 & SIM_PPS0_PPS1_PRESENT) != 0U) {
+        new_etu = sim_etu_ticks_for_pps1(pps1);
+        if(new_etu != 0UL) {
+            reply_pps0 |= SIM_PPS0_PPS1_PRESENT;
+        } else {
+            USIM_LOG_STRING("PPS Fi/Di out of reach - keeping default\r\n");
+        }
     }
 
-    if(!sim_send_byte(first_byte)) {
+    pck = (uint8_t)(SIM_PPSS ^ reply_pps0);
+
+    if(!sim_send_byte(SIM_PPSS)) {
         return false;
     }
-    if(!sim_send_byte(pps0)) {
+    if(!sim_send_byte(reply_pps0)) {
         return false;
     }
+    if((reply_pps0 & SIM_PPS0_PPS1_PRESENT) != 0U) {
+        if(!sim_send_byte(pps1)) {
+            return false;
+        }
+        pck ^= pps1;
+    }
     if(!sim_send_byte(pck)) {
         return false;
     }
 
-    USIM_LOG_STRING("PPS echoed\r\n");
+    sim_protocol = (uint8_t)(pps0 & 0x0FU);
+
+    // La nueva velocidad rige a partir del primer byte posterior al PPS
+    if(new_etu != 0UL) {
+        sim_set_etu_ticks(new_etu);
+        sim_fi = sim_fi_table[(pps1 >> 4) & 0x0FU];
+        USIM_LOG_STRING("PPS accepted - new Fi/Di active\r\n");
+    } else {
+        USIM_LOG_STRING("PPS echoed\r\n");
+    }
+
     return true;
 }
@@ -4,10 +4,71 @@
 #include "chip_specific.h"
 #include "usim_app.h"
 #include "usim_constants.h"
+#include "usim_nvm.h"
+#include "usim_secrets.h"
+#include "usim_milenage.h"
 #include <string.h>
 
 #if USIM_ENABLE_CONFIG_APDU
 
+// DATA_TYPE_PERSONALIZE: IMSI (formato EF_IMSI) | ICCID (formato EF_ICCID) | índice de OP
+#define PERSONALIZE_ICCID_OFFSET USIM_IMSI_SIZE
+#define PERSONALIZE_OP_OFFSET    (USIM_IMSI_SIZE + USIM_ICCID_SIZE)
+#define PERSONALIZE_DATA_SIZE    (PERSONALIZE_OP_OFFSET + 1U)
+
+// Copiar "length" bytes en un EF transparente y grabarlo
+static bool config_store_file(uint16_t file_id, const uint8_t* data, uint8_t length) {
+    uint8_t file = usim_find_file_index(file_id);
+    uint8_t* file_data = usim_file_writable(file);
+
+    if(file_data == NULL) {
+        return false;
+    }
+    memcpy(file_data, data, length);
+    return usim_file_written(file, length);
+}
+
+// Personalización de lote en un solo APDU: se graban EF_IMSI y EF_ICCID y la
+// tarjeta deriva K y OPc (usim_secrets_diversify). Va todo junto, en la
+// transacción abierta o, si no la hay, en una propia.
+static bool config_personalize(apdu_command_t* cmd, apdu_response_t* resp) {
+    bool own = !usim_nvm_group_active();
+    bool stored;
+
+    if(cmd->lc != PERSONALIZE_DATA_SIZE) {
+        resp->sw1sw2 = SW_WRONG_LENGTH;
+        return false;
+    }
+    if(cmd->data[PERSONALIZE_OP_OFFSET] >= USIM_BATCH_OP_COUNT) {
+        resp->sw1sw2 = SW_WRONG_DATA;
+        return false;
+    }
+
+    if(own && !usim_transaction_begin()) {
+        resp->sw1sw2 = SW_MEMORY_PROBLEM;
+        return false;
+    }
+
+    stored = config_store_file(0x6F07, cmd->data, USIM_IMSI_SIZE) &&
+             config_store_file(0x2FE2, &cmd->data[PERSONALIZE_ICCID_OFFSET], USIM_ICCID_SIZE) &&
+             usim_secrets_diversify(&cmd->data[PERSONALIZE_ICCID_OFFSET], cmd->data,
+                                    cmd->data[PERSONALIZE_OP_OFFSET]);
+
+    if(own) {
+        if(stored) {
+            stored = usim_transaction_commit();
+        } else {
+            usim_transaction_abort();
+        }
+    }
+
+    if(!stored) {
+        resp->sw1sw2 = SW_MEMORY_PROBLEM;
+        return false;
+    }
+    return true;
+}
+
 // Comando personalizado para escribir datos
 bool handle_write_config(apdu_command_t* cmd, apdu_response_t* resp) {
     if(cmd->lc == 0U) {
@@ -30,13 +91,18 @@ bool handle_write_config(apdu_command_t* cmd, apdu_response_t* resp) {
                 return false;
             }
 
-            usim_file_t* file = usim_find_file_mutable(0x6F07);
-            if(file == NULL || file->file_data == NULL) {
+            uint8_t file = usim_find_file_index(0x6F07);
+            uint8_t* file_data = usim_file_writable(file);
+            if(file_data == NULL) {
                 resp->sw1sw2 = SW_MEMORY_PROBLEM;
                 return false;
             }
 
-            memcpy(file->file_data, cmd->data, 9);
+            memcpy(file_data, cmd->data, 9);
+            if(!usim_file_written(file, 9U)) {
+                resp->sw1sw2 = SW_MEMORY_PROBLEM;
+                return false;
+            }
 #if USIM_ENABLE_LOGGING
             type_str = "IMSI";
 #endif
@@ -51,16 +117,10 @@ bool handle_write_config(apdu_command_t* cmd, apdu_response_t* resp) {
                 return false;
             }
 
-            usim_file_t* file = usim_find_file_mutable(0x6F08);
-            if(file == NULL || file->file_data == NULL) {
+            if(!usim_secret_set(USIM_SECRET_K, cmd->data)) {
                 resp->sw1sw2 = SW_MEMORY_PROBLEM;
                 return false;
             }
-
-            uint8_t encrypted_key[16];
-            memcpy(encrypted_key, cmd->data, 16);
-            usim_xor_operation(encrypted_key, 16, xor_key, 16);
-            memcpy(file->file_data, encrypted_key, 16);
 #if USIM_ENABLE_LOGGING
             type_str = "KEY";
 #endif
@@ -75,16 +135,10 @@ bool handle_write_config(apdu_command_t* cmd, apdu_response_t* resp) {
                 return false;
             }
 
-            usim_file_t* file = usim_find_file_mutable(0x6F09);
-            if(file == NULL || file->file_data == NULL) {
+            if(!usim_secret_set(USIM_SECRET_OPC, cmd->data)) {
                 resp->sw1sw2 = SW_MEMORY_PROBLEM;
                 return false;
             }
-
-            uint8_t encrypted_opc[16];
-            memcpy(encrypted_opc, cmd->data, 16);
-            usim_xor_operation(encrypted_opc, 16, xor_key, 16);
-            memcpy(file->file_data, encrypted_opc, 16);
 #if USIM_ENABLE_LOGGING
             type_str = "OPC";
 #endif
@@ -100,12 +154,136 @@ bool handle_write_config(apdu_command_t* cmd, apdu_response_t* resp) {
 
             memcpy(subscriber.pin1, cmd->data, 8);
             subscriber.pin1_retries = 3;
+            if(!usim_persist_chv()) {
+                resp->sw1sw2 = SW_MEMORY_PROBLEM;
+                return false;
+            }
 #if USIM_ENABLE_LOGGING
             type_str = "PIN";
 #endif
             USIM_LOG_STRING("CONFIG: PIN updated via APDU\r\n");
             break;
 
+        case DATA_TYPE_ALGORITHM:
+        {
+            // Algoritmo (MILENAGE/TUAK) e iteraciones de Keccak del perfil
+            if(cmd->lc != 2U) {
+                resp->sw1sw2 = SW_WRONG_LENGTH;
+                return false;
+            }
+            if((cmd->data[0] != USIM_ALGORITHM_MILENAGE && cmd->data[0] != USIM_ALGORITHM_TUAK) ||
+               cmd->data[1] == 0U) {
+                resp->sw1sw2 = SW_WRONG_DATA;
+                return false;
+            }
+
+            uint8_t file = usim_find_file_index(0x6F0A);
+            uint8_t* file_data = usim_file_writable(file);
+            if(file_data == NULL) {
+                resp->sw1sw2 = SW_MEMORY_PROBLEM;
+                return false;
+            }
+
+            memcpy(file_data, cmd->data, 2U);
+            if(!usim_file_written(file, 2U)) {
+                resp->sw1sw2 = SW_MEMORY_PROBLEM;
+                return false;
+            }
+            usim_load_auth_params();
+#if USIM_ENABLE_LOGGING
+            type_str = "ALGORITHM";
+#endif
+            USIM_LOG_STRING("CONFIG: Algorithm updated via APDU\r\n");
+            break;
+        }
+
+        case DATA_TYPE_TOPC:
+        {
+            if(cmd->lc != 32U) {
+                resp->sw1sw2 = SW_WRONG_LENGTH;
+                return false;
+            }
+
+            if(!usim_secret_set(USIM_SECRET_TOPC, cmd->data)) {
+                resp->sw1sw2 = SW_MEMORY_PROBLEM;
+                return false;
+            }
+#if USIM_ENABLE_LOGGING
+            type_str = "TOPC";
+#endif
+            USIM_LOG_STRING("CONFIG: TOPc updated via APDU\r\n");
+            break;
+        }
+
+        case DATA_TYPE_SUCI_INFO:
+        {
+            // EF_SUCI_Calc_Info: esquemas y claves públicas de la red;
+            // el resto del archivo queda relleno con FF
+            uint8_t file = usim_find_file_index(0x4F07);
+            uint16_t size = usim_file_size[file];
+
+            if(cmd->lc > size) {
+                resp->sw1sw2 = SW_WRONG_LENGTH;
+                return false;
+            }
+
+            uint8_t* file_data = usim_file_writable(file);
+            if(file_data == NULL) {
+                resp->sw1sw2 = SW_MEMORY_PROBLEM;
+                return false;
+            }
+
+            memcpy(file_data, cmd->data, cmd->lc);
+            memset(&file_data[cmd->lc], 0xFF, size - cmd->lc);
+            if(!usim_file_written(file, size)) {
+                resp->sw1sw2 = SW_MEMORY_PROBLEM;
+                return false;
+            }
+#if USIM_ENABLE_LOGGING
+            type_str = "SUCI_INFO";
+#endif
+            USIM_LOG_STRING("CONFIG: SUCI calculation info updated via APDU\r\n");
+            break;
+        }
+
+        case DATA_TYPE_ROUTING:
+        {
+            // Routing indicator en BCD (2 bytes); los 2 bytes RFU a FF
+            if(cmd->lc != 2U) {
+                resp->sw1sw2 = SW_WRONG_LENGTH;
+                return false;
+            }
+
+            uint8_t file = usim_find_file_index(0x4F0A);
+            uint8_t* file_data = usim_file_writable(file);
+            if(file_data == NULL) {
+                resp->sw1sw2 = SW_MEMORY_PROBLEM;
+                return false;
+            }
+
+            memcpy(file_data, cmd->data, 2U);
+            memset(&file_data[2], 0xFF, 2U);
+            if(!usim_file_written(file, 4U)) {
+                resp->sw1sw2 = SW_MEMORY_PROBLEM;
+                return false;
+            }
+#if USIM_ENABLE_LOGGING
+            type_str = "ROUTING";
+#endif
+            USIM_LOG_STRING("CONFIG: Routing indicator updated via APDU\r\n");
+            break;
+        }
+
+        case DATA_TYPE_PERSONALIZE:
+            if(!config_personalize(cmd, resp)) {
+                return false;
+            }
+#if USIM_ENABLE_LOGGING
+            type_str = "PERSONALIZE";
+#endif
+            USIM_LOG_STRING("CONFIG: K/OPc derived from batch key via APDU\r\n");
+            break;
+
         default:
             resp->sw1sw2 = SW_WRONG_PARAMETERS;
             USIM_LOG_STRING("CONFIG: Unknown data type\r\n");
@@ -130,6 +308,9 @@ bool handle_write_config(apdu_command_t* cmd, apdu_response_t* resp) {
     }
 #endif
 
+    // K, OPc o TOPc pueden haber cambiado: no reutilizar el RAND preparado
+    usim_auth_release();
+
     resp->sw1sw2 = SW_OK;
     return true;
 }
@@ -141,13 +322,13 @@ bool handle_read_config(apdu_command_t* cmd, apdu_response_t* resp) {
     switch(data_type) {
         case DATA_TYPE_IMSI:
         {
-            const usim_file_t* file = usim_find_file(0x6F07);
-            if(file == NULL || file->file_data == NULL) {
+            const uint8_t* file_data = usim_file_data(usim_find_file_index(0x6F07));
+            if(file_data == NULL) {
                 resp->sw1sw2 = SW_MEMORY_PROBLEM;
                 return false;
             }
 
-            memcpy(resp->data, file->file_data, 9U);
+            memcpy(resp->data, file_data, 9U);
             resp->data_len = 9U;
             USIM_LOG_STRING("CONFIG: Reading IMSI\r\n");
             break;
@@ -208,6 +389,88 @@ bool handle_xor_auth(apdu_command_t* cmd, apdu_response_t* resp) {
     }
 }
 
+// Lote de AKA para pruebas de carga del núcleo: N vectores seguidos en un
+// solo comando, y los registros de usim_run_aka_vector() por GET RESPONSE.
+// P1 = BATCH_AUTH_VERIFY: N × (RAND | AUTN), verificados como en
+// AUTHENTICATE. P1 = BATCH_AUTH_GENERATE: AMF | N × RAND, con AUTN
+// generado por la tarjeta y SQN consecutivos. N está limitado por lo que
+// cabe en una respuesta; el SQN se graba una vez, antes de entregarla.
+bool handle_batch_auth(apdu_command_t* cmd, apdu_response_t* resp) {
+    const uint8_t* amf = NULL;
+    const uint8_t* entry = cmd->data;
+    uint8_t entry_size = 16U + USIM_AUTN_SIZE;
+    uint8_t record_size = USIM_BATCH_RECORD_SIZE;
+    uint16_t length = cmd->lc;
+    uint8_t count;
+    uint8_t i;
+
+    if(cmd->p2 != 0x00U) {
+        resp->sw1sw2 = SW_WRONG_P1P2;
+        return false;
+    }
+
+    if(cmd->p1 == BATCH_AUTH_GENERATE) {
+        if(length <= USIM_MILENAGE_AMF_SIZE) {
+            resp->sw1sw2 = SW_WRONG_LENGTH;
+            return false;
+        }
+        amf = cmd->data;
+        entry = &cmd->data[USIM_MILENAGE_AMF_SIZE];
+        length = (uint16_t)(length - USIM_MILENAGE_AMF_SIZE);
+        entry_size = 16U;
+        record_size = USIM_BATCH_GEN_RECORD_SIZE;
+    } else if(cmd->p1 != BATCH_AUTH_VERIFY) {
+        resp->sw1sw2 = SW_WRONG_P1P2;
+        return false;
+    }
+
+    // entry_size es potencia de 2: sin división
+    count = (uint8_t)(length >> ((entry_size == 16U) ? 4 : 5));
+    if(count == 0U || (length & (entry_size - 1U)) != 0U ||
+       (uint16_t)count * record_size > USIM_APDU_RESPONSE_DATA_MAX) {
+        resp->sw1sw2 = SW_WRONG_LENGTH;
+        return false;
+    }
+
+    if((session.state & USIM_STATE_PIN_VERIFIED) == 0U) {
+        resp->sw1sw2 = SW_SECURITY_STATUS_NOT_SATISFIED;
+        return false;
+    }
+
+    // Como en AUTHENTICATE, el SQN no puede quedar en un grupo
+    if(usim_nvm_group_active()) {
+        resp->sw1sw2 = SW_CONDITIONS_NOT_SATISFIED;
+        return false;
+    }
+
+    resp->data_len = 0U;
+    for(i = 0U; i < count; i++) {
+        if(usim_run_aka_vector(entry, (amf == NULL) ? &entry[16] : NULL, amf,
+                               &resp->data[resp->data_len]) == USIM_AKA_ERROR) {
+            resp->data_len = 0U;
+            resp->sw1sw2 = SW_AUTHENTICATION_FAILED;
+            USIM_LOG_STRING("BATCH_AUTH: Failed\r\n");
+            return false;
+        }
+        entry = &entry[entry_size];
+        resp->data_len = (uint16_t)(resp->data_len + record_size);
+
+        // N vectores superan el tiempo de espera del lector: el aviso (NULL
+        // o WTX) se dimensiona con el coste medido de un vector
+        usim_keep_alive((uint16_t)(count - i - 1U));
+    }
+
+    if(!usim_persist_sqn()) {
+        resp->data_len = 0U;
+        resp->sw1sw2 = SW_MEMORY_PROBLEM;
+        return false;
+    }
+
+    resp->sw1sw2 = SW_OK;
+    USIM_LOG_STRING("BATCH_AUTH: Success\r\n");
+    return true;
+}
+
 // Comando para resetear la SIM
 bool handle_reset_sim(apdu_command_t* cmd, apdu_response_t* resp) {
     (void)cmd;
@@ -217,11 +480,18 @@ bool handle_reset_sim(apdu_command_t* cmd, apdu_response_t* resp) {
     session.state = USIM_STATE_IDLE;
     subscriber.pin1_retries = 3;
     subscriber.puk1_retries = 10;
+    if(!usim_persist_chv()) {
+        resp->sw1sw2 = SW_MEMORY_PROBLEM;
+        return false;
+    }
 
     // Resetear archivo actual
     current_file.file_id = 0x3F00;
     current_file.file_type = FILE_TYPE_MF;
     current_file.file_size = 0;
+    current_file.record_pointer = 0U;
+    current_file.file_index = USIM_FILE_INDEX_MF;
+    apdu_reset_channels();
 
     resp->sw1sw2 = SW_OK;
 
@@ -229,6 +499,119 @@ bool handle_reset_sim(apdu_command_t* cmd, apdu_response_t* resp) {
     return true;
 }
 
+// Contadores de la caché write-back: aciertos, escrituras fusionadas y
+// volcados (2 bytes cada uno, big-endian) más las entradas pendientes, y
+// los ciclos máquina del último comando lento (4 bytes, usim_slow_ticks).
+// P2 bit 0 pone los contadores a cero después de leerlos.
+bool handle_get_diagnostics(apdu_command_t* cmd, apdu_response_t* resp) {
+    if(cmd->p1 != 0U || (cmd->p2 & 0xFEU) != 0U) {
+        resp->sw1sw2 = SW_WRONG_PARAMETERS;
+        return false;
+    }
+
+    resp->data[0] = (uint8_t)(usim_cache_stats.hits >> 8);
+    resp->data[1] = (uint8_t)usim_cache_stats.hits;
+    resp->data[2] = (uint8_t)(usim_cache_stats.coalesced >> 8);
+    resp->data[3] = (uint8_t)usim_cache_stats.coalesced;
+    resp->data[4] = (uint8_t)(usim_cache_stats.flushes >> 8);
+    resp->data[5] = (uint8_t)usim_cache_stats.flushes;
+    resp->data[6] = usim_cache_pending();
+    resp->data[7] = (uint8_t)(usim_slow_ticks >> 24);
+    resp->data[8] = (uint8_t)(usim_slow_ticks >> 16);
+    resp->data[9] = (uint8_t)(usim_slow_ticks >> 8);
+    resp->data[10] = (uint8_t)usim_slow_ticks;
+    resp->data_len = 11U;
+
+    if((cmd->p2 & 0x01U) != 0U) {
+        memset(&usim_cache_stats, 0, sizeof(usim_cache_stats));
+        usim_slow_ticks = 0UL;
+    }
+
+    resp->sw1sw2 = SW_OK;
+    USIM_LOG_STRING("CONFIG: Reading diagnostics\r\n");
+    return true;
+}
+
+// Transacción de personalización (P1): entre BEGIN y COMMIT las escrituras
+// de configuración y los UPDATE se aplican en XRAM y se graban todas juntas
+// al confirmar; ABORT, un fallo al grabar o un reset las deshacen.
+bool handle_transaction(apdu_command_t* cmd, apdu_response_t* resp) {
+    bool open = usim_nvm_group_active();
+
+    if(cmd->p2 != 0U) {
+        resp->sw1sw2 = SW_WRONG_PARAMETERS;
+        return false;
+    }
+
+    switch(cmd->p1) {
+        case TRANSACTION_BEGIN:
+            if(open) {
+                resp->sw1sw2 = SW_CONDITIONS_NOT_SATISFIED;
+                return false;
+            }
+            if(!usim_transaction_begin()) {
+                resp->sw1sw2 = SW_MEMORY_PROBLEM;
+                return false;
+            }
+            USIM_LOG_STRING("CONFIG: Transaction started\r\n");
+            break;
+
+        case TRANSACTION_COMMIT:
+            if(!open) {
+                resp->sw1sw2 = SW_CONDITIONS_NOT_SATISFIED;
+                return false;
+            }
+            if(!usim_transaction_commit()) {
+                resp->sw1sw2 = SW_MEMORY_PROBLEM;
+                return false;
+            }
+            USIM_LOG_STRING("CONFIG: Transaction committed\r\n");
+            break;
+
+        case TRANSACTION_ABORT:
+            if(!open) {
+                resp->sw1sw2 = SW_CONDITIONS_NOT_SATISFIED;
+                return false;
+            }
+            usim_transaction_abort();
+            USIM_LOG_STRING("CONFIG: Transaction aborted\r\n");
+            break;
+
+        default:
+            resp->sw1sw2 = SW_WRONG_PARAMETERS;
+            return false;
+    }
+
+    resp->sw1sw2 = SW_OK;
+    return true;
+}
+
+// Cambiar el perfil activo (P1). No se admite con una transacción abierta:
+// lo anotado iría al perfil saliente.
+bool handle_switch_profile(apdu_command_t* cmd, apdu_response_t* resp) {
+    if(cmd->p2 != 0U || cmd->lc != 0U) {
+        resp->sw1sw2 = SW_WRONG_PARAMETERS;
+        return false;
+    }
+    if(cmd->p1 >= USIM_PROFILE_COUNT) {
+        resp->sw1sw2 = SW_WRONG_P1P2;
+        return false;
+    }
+    if(usim_nvm_group_active()) {
+        resp->sw1sw2 = SW_CONDITIONS_NOT_SATISFIED;
+        return false;
+    }
+
+    if(!usim_profile_switch(cmd->p1)) {
+        resp->sw1sw2 = SW_MEMORY_PROBLEM;
+        return false;
+    }
+
+    resp->sw1sw2 = SW_OK;
+    USIM_LOG_STRING("CONFIG: Profile switched\r\n");
+    return true;
+}
+
 #else
 
 bool handle_write_config(apdu_command_t* cmd, apdu_response_t* resp) {
@@ -258,6 +641,15 @@ bool handle_xor_auth(apdu_command_t* cmd, apdu_response_t* resp) {
     return false;
 }
 
+bool handle_batch_auth(apdu_command_t* cmd, apdu_response_t* resp) {
+    (void)cmd;
+    if(resp != NULL) {
+        resp->sw1sw2 = SW_INS_NOT_SUPPORTED;
+        resp->data_len = 0U;
+    }
+    return false;
+}
+
 bool handle_reset_sim(apdu_command_t* cmd, apdu_response_t* resp) {
     (void)cmd;
 
@@ -265,10 +657,20 @@ bool handle_reset_sim(apdu_command_t* cmd, apdu_response_t* resp) {
     session.state = USIM_STATE_IDLE;
     subscriber.pin1_retries = 3;
     subscriber.puk1_retries = 10;
+    if(!usim_persist_chv()) {
+        if(resp != NULL) {
+            resp->sw1sw2 = SW_MEMORY_PROBLEM;
+            resp->data_len = 0U;
+        }
+        return false;
+    }
 
     current_file.file_id = 0x3F00;
     current_file.file_type = FILE_TYPE_MF;
     current_file.file_size = 0;
+    current_file.record_pointer = 0U;
+    current_file.file_index = USIM_FILE_INDEX_MF;
+    apdu_reset_channels();
 
     if(resp != NULL) {
         resp->sw1sw2 = SW_OK;
@@ -278,4 +680,31 @@ bool handle_reset_sim(apdu_command_t* cmd, apdu_response_t* resp) {
     return true;
 }
 
+bool handle_get_diagnostics(apdu_command_t* cmd, apdu_response_t* resp) {
+    (void)cmd;
+    if(resp != NULL) {
+        resp->sw1sw2 = SW_INS_NOT_SUPPORTED;
+        resp->data_len = 0U;
+    }
+    return false;
+}
+
+bool handle_transaction(apdu_command_t* cmd, apdu_response_t* resp) {
+    (void)cmd;
+    if(resp != NULL) {
+        resp->sw1sw2 = SW_INS_NOT_SUPPORTED;
+        resp->data_len = 0U;
+    }
+    return false;
+}
+
+bool handle_switch_profile(apdu_command_t* cmd, apdu_response_t* resp) {
+    (void)cmd;
+    if(resp != NULL) {
+        resp->sw1sw2 = SW_INS_NOT_SUPPORTED;
+        resp->data_len = 0U;
+    }
+    return false;
+}
+
 #endif
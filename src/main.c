@@ -1,12 +1,14 @@
 #include "chip_specific.h"
 #include "usim_app.h"
+#include "usim_files.h"
 #include "apdu_handler.h"
 #include "usat_handler.h"
 #include "usim_constants.h"
+#include "usim_atr.h"
 #include <string.h>
 
 // Tamaños de buffer derivados de la especificación APDU
-#define APDU_BUFFER_SIZE       (USIM_APDU_MAX_DATA_LEN + 5U)
+#define APDU_BUFFER_SIZE       (USIM_APDU_COMMAND_MAX_LEN)
 
 // Variables globales
 __xdata uint8_t apdu_buffer[APDU_BUFFER_SIZE];
@@ -15,16 +17,11 @@ __xdata session_context_t session;
 __xdata subscriber_data_t subscriber;
 __xdata current_file_t current_file;
 
-// Clave XOR para operaciones criptográficas
-const uint8_t xor_key[16] = {
-    0x2A, 0x4F, 0x1C, 0x93, 0x76, 0xA8, 0xDF, 0x35,
-    0xB9, 0x62, 0x8C, 0x17, 0xE4, 0x50, 0x3B, 0xCE
-};
-
 // Prototipos de funciones locales
 void send_hex_byte(uint8_t byte);
 void simple_delay(void);
 static void usim_send_default_atr(void);
+static void usim_negotiate_after_atr(void);
 
 void main(void) {
     // 1. Inicialización del hardware
@@ -39,9 +36,7 @@ void main(void) {
     // 3. Esperar a que el lector active la tarjeta y enviar ATR
     if(sim_wait_for_atr_window()) {
         usim_send_default_atr();
-        if(!sim_handle_pps_sequence()) {
-            USIM_LOG_STRING("PPS handling failed\r\n");
-        }
+        usim_negotiate_after_atr();
     } else {
         USIM_LOG_STRING("ATR window failed\r\n");
     }
@@ -56,9 +51,7 @@ void main(void) {
             usim_init();
             if(sim_wait_for_atr_window()) {
                 usim_send_default_atr();
-                if(!sim_handle_pps_sequence()) {
-                    USIM_LOG_STRING("PPS handling failed\r\n");
-                }
+                usim_negotiate_after_atr();
             }
             continue;
         }
@@ -70,6 +63,9 @@ void main(void) {
             if(resp_len > 0U) {
                 usim_send_response(apdu_response, resp_len);
             }
+        } else {
+            // Sin comando del terminal: tiempo libre para volcar la caché
+            (void)usim_files_flush();
         }
 
         usat_background_processing();
@@ -97,23 +93,26 @@ void simple_delay(void) {
 }
 
 static void usim_send_default_atr(void) {
-    // ATR genérico compatible con USIM (TS 102 221)
-    static const uint8_t atr[] = {
-        0x3B, 0x9F, 0x96, 0x80, 0x1F, 0xC7, 0x80, 0x31,
-        0xE0, 0x73, 0xFE, 0x21, 0x13, 0x57, 0x4A
-    };
-
+    // ATR generado en compilación desde config/atr.json (scripts/gen_atr.py)
     uint8_t index;
 
-    for(index = 0U; index < sizeof(atr); ++index) {
-        if(!sim_send_byte(atr[index])) {
+    for(index = 0U; index < USIM_ATR_LENGTH; ++index) {
+        if(!sim_send_byte(usim_atr[index])) {
             USIM_LOG_STRING("ATR transmission failure\r\n");
             break;
         }
     }
 }
 
-// Handler de interrupciones vacío
-void usim_isr(void) __interrupt(0) {
-    // Vacío por ahora
+static void usim_negotiate_after_atr(void) {
+#if USIM_ATR_SPECIFIC_MODE
+    // Con TA2 el lector no envía PPS: la velocidad de TA1 rige desde ya
+    if(!sim_apply_transmission_factors(USIM_ATR_TA1)) {
+        USIM_LOG_STRING("Specific mode speed not applied\r\n");
+    }
+#else
+    if(!sim_handle_pps_sequence()) {
+        USIM_LOG_STRING("PPS handling failed\r\n");
+    }
+#endif
 }
@@ -5,6 +5,31 @@
 
 #if USIM_ENABLE_USAT
 
+// REFRESH (TS 102 223 §6.6.13) con calificador 04, reset de la UICC: la
+// terminal vuelve a leer todo tras un cambio de perfil
+static const __code uint8_t usat_refresh_command[] = {
+    USAT_TAG_PROACTIVE_COMMAND, 0x09,
+    0x81, 0x03, 0x01, USAT_COMMAND_REFRESH, USAT_REFRESH_UICC_RESET,  /* Detalles del comando */
+    0x82, 0x02, 0x81, 0x82                                            /* UICC -> terminal */
+};
+
+// Comando proactivo pendiente de FETCH
+static bool usat_refresh_pending;
+
+void usat_init(void) {
+    usat_refresh_pending = false;
+}
+
+void usat_queue_refresh(void) {
+    usat_refresh_pending = true;
+    USIM_LOG_STRING("USAT: REFRESH queued\r\n");
+}
+
+// Longitud del comando proactivo pendiente (SW 91xx), 0 si no hay
+uint8_t usat_pending_command(void) {
+    return usat_refresh_pending ? (uint8_t)sizeof(usat_refresh_command) : 0U;
+}
+
 // Procesar comando USAT DATA DOWNLOAD
 bool usat_handle_data_download(apdu_command_t* cmd, apdu_response_t* resp) {
     if(cmd->lc < 5) {
@@ -88,8 +113,17 @@ bool usat_handle_envelope(apdu_command_t* cmd, apdu_response_t* resp) {
 
 // Procesar comando FETCH (USAT)
 bool usat_handle_fetch(apdu_command_t* cmd, apdu_response_t* resp) {
-    // La USIM indica a la terminal que tiene comandos pendientes
-    
+    (void)cmd;
+
+    if(usat_refresh_pending) {
+        memcpy(resp->data, usat_refresh_command, sizeof(usat_refresh_command));
+        resp->data_len = sizeof(usat_refresh_command);
+        resp->sw1sw2 = SW_OK;
+        usat_refresh_pending = false;
+        USIM_LOG_STRING("USAT: FETCH - REFRESH\r\n");
+        return true;
+    }
+
     // Simular comando DISPLAY TEXT pendiente
     resp->data[0] = USAT_TAG_DISPLAY_TEXT;
     resp->data[1] = 0x0D;
@@ -127,6 +161,18 @@ void usat_background_processing(void) {
 
 #else
 
+void usat_init(void) {
+}
+
+// Sin USAT la terminal no puede hacer FETCH: el cambio de perfil se ve en
+// el siguiente reset
+void usat_queue_refresh(void) {
+}
+
+uint8_t usat_pending_command(void) {
+    return 0U;
+}
+
 bool usat_handle_data_download(apdu_command_t* cmd, apdu_response_t* resp) {
     (void)cmd;
     if(resp != NULL) {
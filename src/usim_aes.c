@@ -0,0 +1,143 @@
+#include "usim_aes.h"
+
+// AES-128 (FIPS-197), solo cifrado, pensado para el 8051: las tablas van en
+// __code (MOVC), el estado y la clave de ronda en IRAM (acceso directo, sin
+// MOVX) y las claves de ronda se calculan al vuelo, ronda a ronda, sobre los
+// mismos 16 bytes. No hace falta memoria en XRAM más allá de la de quien
+// llama. MixColumns usa la tabla xtime en lugar de desplazar y reducir.
+static __idata uint8_t aes_state[USIM_AES_BLOCK_SIZE];
+static __idata uint8_t aes_round_key[USIM_AES_BLOCK_SIZE];
+
+static const __code uint8_t aes_sbox[256] = {
+    0x63, 0x7C, 0x77, 0x7B, 0xF2, 0x6B, 0x6F, 0xC5, 0x30, 0x01, 0x67, 0x2B, 0xFE, 0xD7, 0xAB, 0x76,
+    0xCA, 0x82, 0xC9, 0x7D, 0xFA, 0x59, 0x47, 0xF0, 0xAD, 0xD4, 0xA2, 0xAF, 0x9C, 0xA4, 0x72, 0xC0,
+    0xB7, 0xFD, 0x93, 0x26, 0x36, 0x3F, 0xF7, 0xCC, 0x34, 0xA5, 0xE5, 0xF1, 0x71, 0xD8, 0x31, 0x15,
+    0x04, 0xC7, 0x23, 0xC3, 0x18, 0x96, 0x05, 0x9A, 0x07, 0x12, 0x80, 0xE2, 0xEB, 0x27, 0xB2, 0x75,
+    0x09, 0x83, 0x2C, 0x1A, 0x1B, 0x6E, 0x5A, 0xA0, 0x52, 0x3B, 0xD6, 0xB3, 0x29, 0xE3, 0x2F, 0x84,
+    0x53, 0xD1, 0x00, 0xED, 0x20, 0xFC, 0xB1, 0x5B, 0x6A, 0xCB, 0xBE, 0x39, 0x4A, 0x4C, 0x58, 0xCF,
+    0xD0, 0xEF, 0xAA, 0xFB, 0x43, 0x4D, 0x33, 0x85, 0x45, 0xF9, 0x02, 0x7F, 0x50, 0x3C, 0x9F, 0xA8,
+    0x51, 0xA3, 0x40, 0x8F, 0x92, 0x9D, 0x38, 0xF5, 0xBC, 0xB6, 0xDA, 0x21, 0x10, 0xFF, 0xF3, 0xD2,
+    0xCD, 0x0C, 0x13, 0xEC, 0x5F, 0x97, 0x44, 0x17, 0xC4, 0xA7, 0x7E, 0x3D, 0x64, 0x5D, 0x19, 0x73,
+    0x60, 0x81, 0x4F, 0xDC, 0x22, 0x2A, 0x90, 0x88, 0x46, 0xEE, 0xB8, 0x14, 0xDE, 0x5E, 0x0B, 0xDB,
+    0xE0, 0x32, 0x3A, 0x0A, 0x49, 0x06, 0x24, 0x5C, 0xC2, 0xD3, 0xAC, 0x62, 0x91, 0x95, 0xE4, 0x79,
+    0xE7, 0xC8, 0x37, 0x6D, 0x8D, 0xD5, 0x4E, 0xA9, 0x6C, 0x56, 0xF4, 0xEA, 0x65, 0x7A, 0xAE, 0x08,
+    0xBA, 0x78, 0x25, 0x2E, 0x1C, 0xA6, 0xB4, 0xC6, 0xE8, 0xDD, 0x74, 0x1F, 0x4B, 0xBD, 0x8B, 0x8A,
+    0x70, 0x3E, 0xB5, 0x66, 0x48, 0x03, 0xF6, 0x0E, 0x61, 0x35, 0x57, 0xB9, 0x86, 0xC1, 0x1D, 0x9E,
+    0xE1, 0xF8, 0x98, 0x11, 0x69, 0xD9, 0x8E, 0x94, 0x9B, 0x1E, 0x87, 0xE9, 0xCE, 0x55, 0x28, 0xDF,
+    0x8C, 0xA1, 0x89, 0x0D, 0xBF, 0xE6, 0x42, 0x68, 0x41, 0x99, 0x2D, 0x0F, 0xB0, 0x54, 0xBB, 0x16
+};
+
+// xtime(a) = a * 2 en GF(2^8)
+static const __code uint8_t aes_xtime[256] = {
+    0x00, 0x02, 0x04, 0x06, 0x08, 0x0A, 0x0C, 0x0E, 0x10, 0x12, 0x14, 0x16, 0x18, 0x1A, 0x1C, 0x1E,
+    0x20, 0x22, 0x24, 0x26, 0x28, 0x2A, 0x2C, 0x2E, 0x30, 0x32, 0x34, 0x36, 0x38, 0x3A, 0x3C, 0x3E,
+    0x40, 0x42, 0x44, 0x46, 0x48, 0x4A, 0x4C, 0x4E, 0x50, 0x52, 0x54, 0x56, 0x58, 0x5A, 0x5C, 0x5E,
+    0x60, 0x62, 0x64, 0x66, 0x68, 0x6A, 0x6C, 0x6E, 0x70, 0x72, 0x74, 0x76, 0x78, 0x7A, 0x7C, 0x7E,
+    0x80, 0x82, 0x84, 0x86, 0x88, 0x8A, 0x8C, 0x8E, 0x90, 0x92, 0x94, 0x96, 0x98, 0x9A, 0x9C, 0x9E,
+    0xA0, 0xA2, 0xA4, 0xA6, 0xA8, 0xAA, 0xAC, 0xAE, 0xB0, 0xB2, 0xB4, 0xB6, 0xB8, 0xBA, 0xBC, 0xBE,
+    0xC0, 0xC2, 0xC4, 0xC6, 0xC8, 0xCA, 0xCC, 0xCE, 0xD0, 0xD2, 0xD4, 0xD6, 0xD8, 0xDA, 0xDC, 0xDE,
+    0xE0, 0xE2, 0xE4, 0xE6, 0xE8, 0xEA, 0xEC, 0xEE, 0xF0, 0xF2, 0xF4, 0xF6, 0xF8, 0xFA, 0xFC, 0xFE,
+    0x1B, 0x19, 0x1F, 0x1D, 0x13, 0x11, 0x17, 0x15, 0x0B, 0x09, 0x0F, 0x0D, 0x03, 0x01, 0x07, 0x05,
+    0x3B, 0x39, 0x3F, 0x3D, 0x33, 0x31, 0x37, 0x35, 0x2B, 0x29, 0x2F, 0x2D, 0x23, 0x21, 0x27, 0x25,
+    0x5B, 0x59, 0x5F, 0x5D, 0x53, 0x51, 0x57, 0x55, 0x4B, 0x49, 0x4F, 0x4D, 0x43, 0x41, 0x47, 0x45,
+    0x7B, 0x79, 0x7F, 0x7D, 0x73, 0x71, 0x77, 0x75, 0x6B, 0x69, 0x6F, 0x6D, 0x63, 0x61, 0x67, 0x65,
+    0x9B, 0x99, 0x9F, 0x9D, 0x93, 0x91, 0x97, 0x95, 0x8B, 0x89, 0x8F, 0x8D, 0x83, 0x81, 0x87, 0x85,
+    0xBB, 0xB9, 0xBF, 0xBD, 0xB3, 0xB1, 0xB7, 0xB5, 0xAB, 0xA9, 0xAF, 0xAD, 0xA3, 0xA1, 0xA7, 0xA5,
+    0xDB, 0xD9, 0xDF, 0xDD, 0xD3, 0xD1, 0xD7, 0xD5, 0xCB, 0xC9, 0xCF, 0xCD, 0xC3, 0xC1, 0xC7, 0xC5,
+    0xFB, 0xF9, 0xFF, 0xFD, 0xF3, 0xF1, 0xF7, 0xF5, 0xEB, 0xE9, 0xEF, 0xED, 0xE3, 0xE1, 0xE7, 0xE5
+};
+
+// SubBytes y ShiftRows en una pasada (estado por columnas, byte 4*c + f)
+static void aes_sub_shift(void) {
+    uint8_t t;
+
+    aes_state[0] = aes_sbox[aes_state[0]];
+    aes_state[4] = aes_sbox[aes_state[4]];
+    aes_state[8] = aes_sbox[aes_state[8]];
+    aes_state[12] = aes_sbox[aes_state[12]];
+
+    t = aes_state[1];
+    aes_state[1] = aes_sbox[aes_state[5]];
+    aes_state[5] = aes_sbox[aes_state[9]];
+    aes_state[9] = aes_sbox[aes_state[13]];
+    aes_state[13] = aes_sbox[t];
+
+    t = aes_state[2];
+    aes_state[2] = aes_sbox[aes_state[10]];
+    aes_state[10] = aes_sbox[t];
+    t = aes_state[6];
+    aes_state[6] = aes_sbox[aes_state[14]];
+    aes_state[14] = aes_sbox[t];
+
+    t = aes_state[15];
+    aes_state[15] = aes_sbox[aes_state[11]];
+    aes_state[11] = aes_sbox[aes_state[7]];
+    aes_state[7] = aes_sbox[aes_state[3]];
+    aes_state[3] = aes_sbox[t];
+}
+
+static void aes_mix_columns(void) {
+    uint8_t c;
+
+    for(c = 0U; c < USIM_AES_BLOCK_SIZE; c = (uint8_t)(c + 4U)) {
+        uint8_t a0 = aes_state[c];
+        uint8_t a1 = aes_state[c + 1U];
+        uint8_t a2 = aes_state[c + 2U];
+        uint8_t a3 = aes_state[c + 3U];
+        uint8_t all = (uint8_t)(a0 ^ a1 ^ a2 ^ a3);
+
+        aes_state[c] = (uint8_t)(a0 ^ all ^ aes_xtime[(uint8_t)(a0 ^ a1)]);
+        aes_state[c + 1U] = (uint8_t)(a1 ^ all ^ aes_xtime[(uint8_t)(a1 ^ a2)]);
+        aes_state[c + 2U] = (uint8_t)(a2 ^ all ^ aes_xtime[(uint8_t)(a2 ^ a3)]);
+        aes_state[c + 3U] = (uint8_t)(a3 ^ all ^ aes_xtime[(uint8_t)(a3 ^ a0)]);
+    }
+}
+
+// Clave de la ronda siguiente a partir de la actual (expansión al vuelo)
+static void aes_next_round_key(uint8_t rcon) {
+    uint8_t i;
+
+    aes_round_key[0] ^= (uint8_t)(aes_sbox[aes_round_key[13]] ^ rcon);
+    aes_round_key[1] ^= aes_sbox[aes_round_key[14]];
+    aes_round_key[2] ^= aes_sbox[aes_round_key[15]];
+    aes_round_key[3] ^= aes_sbox[aes_round_key[12]];
+    for(i = 4U; i < USIM_AES_BLOCK_SIZE; i++) {
+        aes_round_key[i] ^= aes_round_key[i - 4U];
+    }
+}
+
+static void aes_add_round_key(void) {
+    uint8_t i;
+
+    for(i = 0U; i < USIM_AES_BLOCK_SIZE; i++) {
+        aes_state[i] ^= aes_round_key[i];
+    }
+}
+
+// Cifrar un bloque de 16 bytes con una clave de 16 bytes. "input" y
+// "output" pueden coincidir. La clave de ronda no queda en IRAM al salir.
+void usim_aes_encrypt(const uint8_t* key, const uint8_t* input, uint8_t* output) {
+    uint8_t i;
+    uint8_t rcon = 0x01U;
+
+    for(i = 0U; i < USIM_AES_BLOCK_SIZE; i++) {
+        aes_round_key[i] = key[i];
+        aes_state[i] = (uint8_t)(input[i] ^ key[i]);
+    }
+
+    for(i = 1U; i <= 10U; i++) {
+        aes_sub_shift();
+        if(i != 10U) {
+            aes_mix_columns();
+        }
+        aes_next_round_key(rcon);
+        rcon = aes_xtime[rcon];
+        aes_add_round_key();
+    }
+
+    for(i = 0U; i < USIM_AES_BLOCK_SIZE; i++) {
+        output[i] = aes_state[i];
+        aes_state[i] = 0U;
+        aes_round_key[i] = 0U;
+    }
+}
@@ -3,68 +3,258 @@
 #include "chip_specific.h"
 #include "usim_constants.h"
 #include "apdu_handler.h"
+#include "usim_t1.h"
+#include "usim_nvm.h"
+#include "usim_tuak.h"
+#include "usim_auth.h"
+#include "usim_secrets.h"
+#include "usat_handler.h"
+#include <stddef.h>
 #include <string.h>
 
 #define SIM_RX_START_TIMEOUT     (120000UL)
 #define SIM_RX_INTERBYTE_TIMEOUT (60000UL)
 
-static bool apdu_instruction_requires_lc(uint8_t ins) {
-    switch(ins) {
-        case INS_SELECT_FILE:
-        case INS_UPDATE_BINARY:
-        case INS_VERIFY_CHV:
-        case INS_CHANGE_CHV:
-        case INS_AUTHENTICATE:
+// Metadatos por instrucción: sentido de los datos (en T=0, significado de P3)
+#define T0_FLAG_DATA_IN          0x01U  /* P3 = Lc: el lector envía datos */
+#define T0_FLAG_DATA_OUT         0x02U  /* P3 = Le: la tarjeta devuelve datos */
+#define T0_FLAG_SLOW             0x04U  /* Procesado largo: usim_keep_alive() activo */
+#define T0_NULL_BYTE             0x60U  /* Byte de procedimiento NULL: reinicia WWT */
+#define T1_WTX_MAX               255UL
+
+typedef struct {
+    uint8_t ins;
+    uint8_t flags;
+} t0_ins_info_t;
+
+// PIN, PUK y contadores se guardan en NVM como un solo objeto contiguo
+typedef char usim_chv_layout[(sizeof(subscriber_data_t) - offsetof(subscriber_data_t, pin1) ==
+                              USIM_NVM_CHV_SIZE) ? 1 : -1];
+typedef char usim_sqn_layout[(offsetof(subscriber_data_t, amf) - offsetof(subscriber_data_t, sqn) ==
+                              USIM_NVM_SQN_SIZE) ? 1 : -1];
+
+static const __code t0_ins_info_t t0_ins_table[] = {
+    {INS_SELECT_FILE,        T0_FLAG_DATA_IN},
+    {INS_READ_BINARY,        T0_FLAG_DATA_OUT},
+    {INS_UPDATE_BINARY,      T0_FLAG_DATA_IN},
+    {INS_READ_RECORD,        T0_FLAG_DATA_OUT},
+    {INS_UPDATE_RECORD,      T0_FLAG_DATA_IN},
+    {INS_SEARCH_RECORD,      T0_FLAG_DATA_IN},
+    {INS_AUTHENTICATE,       T0_FLAG_DATA_IN | T0_FLAG_SLOW},
+    {INS_VERIFY_CHV,         T0_FLAG_DATA_IN},
+    {INS_CHANGE_CHV,         T0_FLAG_DATA_IN},
+    {INS_GET_RESPONSE,       T0_FLAG_DATA_OUT},
+    {INS_MANAGE_CHANNEL,     T0_FLAG_DATA_OUT},
+    {INS_STATUS,             T0_FLAG_DATA_OUT},
+    {INS_GET_IDENTITY,       T0_FLAG_DATA_OUT | T0_FLAG_SLOW},
 #if USIM_ENABLE_USAT
-        case INS_USAT_DATA_DOWNLOAD:
-        case INS_USAT_ENVELOPE:
+    {INS_USAT_DATA_DOWNLOAD, T0_FLAG_DATA_IN},
+    {INS_USAT_ENVELOPE,      T0_FLAG_DATA_IN},
+    {INS_USAT_FETCH,         T0_FLAG_DATA_OUT},
 #endif
 #if USIM_ENABLE_CONFIG_APDU
-        case INS_WRITE_CONFIG:
-        case INS_XOR_AUTH:
+    {INS_WRITE_CONFIG,       T0_FLAG_DATA_IN},
+    {INS_READ_CONFIG,        T0_FLAG_DATA_OUT},
+    {INS_GET_DIAGNOSTICS,    T0_FLAG_DATA_OUT},
+    {INS_TRANSACTION,        T0_FLAG_SLOW},
+    {INS_SWITCH_PROFILE,     T0_FLAG_SLOW},
+    {INS_XOR_AUTH,           T0_FLAG_DATA_IN | T0_FLAG_SLOW},
+    {INS_BATCH_AUTH,         T0_FLAG_DATA_IN | T0_FLAG_SLOW},
 #endif
-            return true;
-        default:
-            return false;
+};
+
+// Estados de la recepción T=0
+typedef enum {
+    T0_STATE_HEADER = 0,
+    T0_STATE_P3,
+    T0_STATE_DATA,
+    T0_STATE_DONE
+} t0_state_t;
+
+// Instrucción en curso, necesaria para el byte de procedimiento de salida
+static uint8_t t0_current_ins = 0U;
+static uint8_t t0_current_flags = 0U;
+
+// Procesado largo en curso: ticks del cronómetro hasta el próximo aviso al
+// lector, lectura en la llamada anterior a usim_keep_alive() y ticks de los
+// tramos ya cerrados por un aviso
+static bool usim_wait_armed = false;
+static uint32_t usim_wait_budget = 0UL;
+static uint32_t usim_wait_mark = 0UL;
+static uint32_t usim_wait_total = 0UL;
+
+uint32_t usim_slow_ticks = 0UL;
+
+static uint8_t t0_lookup_flags(uint8_t ins) {
+    uint8_t index;
+
+    for(index = 0U; index < (uint8_t)(sizeof(t0_ins_table) / sizeof(t0_ins_table[0])); ++index) {
+        if(t0_ins_table[index].ins == ins) {
+            return t0_ins_table[index].flags;
+        }
     }
+
+    // Instrucción desconocida: P3 es Le y el handler responderá 6D00
+    return 0U;
 }
 
-// Inicialización de la USIM
-void usim_init(void) {
-    // Inicializar estructura del suscriptor
-    memset(&subscriber, 0, sizeof(subscriber));
-    subscriber.pin1_retries = 3;
-    subscriber.puk1_retries = 10;
-    
-    // Configurar PIN por defecto (0000)
+// Arrancar el cronómetro si la instrucción es lenta. El primer aviso se da a
+// mitad del tiempo de espera del lector.
+static void usim_wait_arm(uint8_t flags) {
+    usim_wait_armed = ((flags & T0_FLAG_SLOW) != 0U);
+    if(usim_wait_armed) {
+        usim_wait_budget = sim_wait_time_ticks() / 2U;
+        usim_wait_mark = 0UL;
+        usim_wait_total = 0UL;
+        sim_elapsed_start();
+    }
+}
+
+// Llamada desde los bucles largos (ladder de X25519, permutaciones de
+// Keccak, vectores de un lote) con los pasos que faltan. Cuando el tiempo
+// medido se acerca al límite del lector, en T=0 se envía un byte NULL y en
+// T=1 se pide un WTX que cubra lo que falta al ritmo medido en el último
+// paso.
+void usim_keep_alive(uint16_t remaining) {
+    uint32_t elapsed;
+    uint32_t step;
+    uint32_t wait;
+    uint32_t multiplier;
+
+    if(!usim_wait_armed) {
+        return;
+    }
+
+    elapsed = sim_elapsed_ticks();
+    step = elapsed - usim_wait_mark;
+    usim_wait_mark = elapsed;
+    if(elapsed < usim_wait_budget) {
+        return;
+    }
+
+    wait = sim_wait_time_ticks();
+    usim_wait_budget = wait / 2U;
+    if(sim_get_protocol() == 1U) {
+        if(remaining > (uint16_t)T1_WTX_MAX) {
+            remaining = (uint16_t)T1_WTX_MAX;
+        }
+        multiplier = ((step * remaining) / wait) + 1UL;
+        if(multiplier > T1_WTX_MAX) {
+            multiplier = T1_WTX_MAX;
+        }
+        if(usim_t1_request_wtx((uint8_t)multiplier)) {
+            usim_wait_budget *= multiplier;
+        }
+    } else {
+        (void)sim_send_byte(T0_NULL_BYTE);
+    }
+
+    usim_wait_total += elapsed;
+    usim_wait_mark = 0UL;
+    sim_elapsed_start();
+}
+
+// PIN, PUK y contadores: los guardados en NVM o, si no hay, los de fábrica
+// (PIN 0000)
+static void usim_load_chv(void) {
+    memset(subscriber.pin1, 0, USIM_NVM_CHV_SIZE);
     memcpy(subscriber.pin1, "0000", 4U);
     memset(&subscriber.pin1[4], 0xFF, 4U);
-    
-    // Inicializar sesión
+    subscriber.pin1_retries = 3;
+    subscriber.puk1_retries = 10;
+
+    if(usim_nvm_length(USIM_NVM_OBJ_CHV) == USIM_NVM_CHV_SIZE) {
+        usim_nvm_read(USIM_NVM_OBJ_CHV, 0U, subscriber.pin1, USIM_NVM_CHV_SIZE);
+    }
+}
+
+// Algoritmo 3G del perfil (EF_AUTH: algoritmo, iteraciones de Keccak). El
+// contexto de autenticación preparado deja de valer.
+void usim_load_auth_params(void) {
+    const uint8_t* params = usim_file_data(usim_find_file_index(0x6F0A));
+
+    usim_auth_release();
+
+    subscriber.auth_algorithm = USIM_ALGORITHM_MILENAGE;
+    subscriber.keccak_iterations = USIM_TUAK_ITERATIONS;
+    if(params != NULL) {
+        subscriber.auth_algorithm = params[0];
+        if(params[1] != 0U) {
+            subscriber.keccak_iterations = params[1];
+        }
+    }
+}
+
+// Estado del suscriptor del perfil activo. Lo guardado en NVM (PIN,
+// contadores, SQN, secretos) sustituye a los valores por defecto: los
+// intentos restantes no se recuperan con un reset. Un perfil que no se ha
+// personalizado empieza con los valores de fábrica.
+static void usim_load_subscriber(void) {
+    memset(&subscriber, 0, sizeof(subscriber));
+    usim_load_chv();
+    usim_secrets_load();
+    if(usim_nvm_length(USIM_NVM_OBJ_SQN) == USIM_NVM_SQN_SIZE) {
+        usim_nvm_read(USIM_NVM_OBJ_SQN, 0U, subscriber.sqn, USIM_NVM_SQN_SIZE);
+    }
+}
+
+// Arranque: suscriptor y sistema de archivos completo
+static void usim_load_profile(void) {
+    usim_load_subscriber();
+    usim_filesystem_init();
+    usim_load_auth_params();
+}
+
+// Sesión y archivo actual tras un reset o un cambio de perfil
+static void usim_reset_session(void) {
     memset(&session, 0, sizeof(session));
     session.state = USIM_STATE_IDLE;
     session.authenticated = false;
-    
-    // Inicializar archivo actual
+
     current_file.file_id = 0x3F00; // MF
     current_file.file_type = FILE_TYPE_MF;
     current_file.file_size = 0;
-    
-    // Inicializar sistema de archivos
-    usim_filesystem_init();
-    
+    current_file.record_pointer = 0U;
+    current_file.file_index = USIM_FILE_INDEX_MF;
+    apdu_reset_channels();
+}
+
+// Inicialización de la USIM
+void usim_init(void) {
+    uint8_t profile = 0U;
+
+    // Un reset en caliente no debe perder lo que quedó en la caché write-back
+    usim_files_flush();
+
+    // Montar descarta una transacción de personalización sin confirmar
+    usim_nvm_mount();
+    if(usim_nvm_length(USIM_NVM_OBJ_PROFILE) == USIM_NVM_PROFILE_SIZE) {
+        usim_nvm_read(USIM_NVM_OBJ_PROFILE, 0U, &profile, USIM_NVM_PROFILE_SIZE);
+    }
+    if(profile >= USIM_PROFILE_COUNT) {
+        profile = 0U;
+    }
+    usim_nvm_set_profile(profile);
+    usim_load_profile();
+    usim_reset_session();
+    usat_init();
+
+    // Estado del protocolo de bloques (N(S), IFSD) tras cada reset
+    usim_t1_init();
+
     USIM_LOG_STRING("USIM Application Initialized\r\n");
 }
 
-// Recepción real de APDU a través de la interfaz SIM (modo T=0)
+// Recepción real de APDU a través de la interfaz SIM (T=0, o T=1 si se
+// negoció por PPS).
+// El caso del comando se decide con la tabla de instrucciones en cuanto
+// llega INS: P3 siempre se transmite y no hay Le adicional en T=0. Un caso 1
+// (P3 = 00 en una instrucción sin datos de salida) se entrega sin P3, como
+// el APDU de 4 bytes que representa, para que P3 no se tome por Le = 256.
 bool usim_receive_apdu(uint8_t* buffer, uint16_t* length) {
-    uint8_t header[4];
-    uint8_t index;
+    t0_state_t state = T0_STATE_HEADER;
     uint16_t offset = 0U;
-    uint8_t p3 = 0U;
-    uint8_t data_buffer[USIM_APDU_MAX_DATA_LEN];
-    uint16_t data_len = 0U;
-    bool expects_lc = false;
+    uint16_t remaining = 0U;
 
     if(buffer == NULL || length == NULL) {
         return false;
@@ -72,78 +262,72 @@ bool usim_receive_apdu(uint8_t* buffer, uint16_t* length) {
 
     *length = 0U;
 
-    // Leer cabecera mínima (CLA, INS, P1, P2)
-    if(!sim_receive_byte(&header[0], SIM_RX_START_TIMEOUT)) {
-        return false;
-    }
-
-    for(index = 1U; index < 4U; ++index) {
-        if(!sim_receive_byte(&header[index], SIM_RX_INTERBYTE_TIMEOUT)) {
+    if(sim_get_protocol() == 1U) {
+        if(!usim_t1_receive_apdu(buffer, USIM_APDU_COMMAND_MAX_LEN, length)) {
             return false;
         }
-    }
-
-    memcpy(buffer, header, sizeof(header));
-    offset = sizeof(header);
-
-    expects_lc = apdu_instruction_requires_lc(header[1]);
-
-    // Intentar obtener P3 (Lc o Le). Si no llega más información, Case 1.
-    if(!sim_receive_byte(&p3, SIM_RX_INTERBYTE_TIMEOUT)) {
-        if(!sim_send_byte(0x60U)) {
-            USIM_LOG_STRING("APDU procedure NULL failed\r\n");
-        }
-        *length = offset;
+        usim_wait_arm((*length >= 2U) ? t0_lookup_flags(buffer[1]) : 0U);
         return true;
     }
 
-    buffer[offset++] = p3;
-
-    if(expects_lc) {
-        uint16_t remaining = p3;
-
-        if(remaining > 0U) {
-            if(!sim_send_byte(header[1])) {
-                USIM_LOG_STRING("APDU RX failed to request data\r\n");
-                return false;
-            }
-
-            while(remaining > 0U) {
-                uint8_t data_byte;
+    while(state != T0_STATE_DONE) {
+        switch(state) {
+            case T0_STATE_HEADER:
+                // CLA, INS, P1, P2
+                if(!sim_receive_byte(&buffer[offset],
+                                     (offset == 0U) ? SIM_RX_START_TIMEOUT : SIM_RX_INTERBYTE_TIMEOUT)) {
+                    return false;
+                }
+                offset++;
+                if(offset == 4U) {
+                    t0_current_ins = buffer[1];
+                    t0_current_flags = t0_lookup_flags(buffer[1]);
+                    state = T0_STATE_P3;
+                }
+                break;
 
-                if(!sim_receive_byte(&data_byte, SIM_RX_INTERBYTE_TIMEOUT)) {
-                    USIM_LOG_STRING("APDU RX timeout in data phase\r\n");
+            case T0_STATE_P3:
+                if(!sim_receive_byte(&buffer[offset], SIM_RX_INTERBYTE_TIMEOUT)) {
                     return false;
                 }
+                remaining = buffer[offset];
+                offset++;
+
+                if((t0_current_flags & T0_FLAG_DATA_IN) != 0U && remaining > 0U) {
+                    // Byte de procedimiento INS: el lector envía todo Lc
+                    if(!sim_send_byte(t0_current_ins)) {
+                        USIM_LOG_STRING("APDU RX failed to request data\r\n");
+                        return false;
+                    }
+                    state = T0_STATE_DATA;
+                } else {
+                    if(remaining == 0U && (t0_current_flags & T0_FLAG_DATA_OUT) == 0U) {
+                        offset--;
+                    }
+                    state = T0_STATE_DONE;
+                }
+                break;
 
-                if(data_len < USIM_APDU_MAX_DATA_LEN) {
-                    data_buffer[data_len++] = data_byte;
+            case T0_STATE_DATA:
+                if(!sim_receive_byte(&buffer[offset], SIM_RX_INTERBYTE_TIMEOUT)) {
+                    USIM_LOG_STRING("APDU RX timeout in data phase\r\n");
+                    return false;
                 }
+                offset++;
                 remaining--;
-            }
-
-            if(data_len > 0U) {
-                memcpy(&buffer[offset], data_buffer, data_len);
-                offset = (uint16_t)(offset + data_len);
-            }
-        }
+                if(remaining == 0U) {
+                    state = T0_STATE_DONE;
+                }
+                break;
 
-        // Intentar leer un posible Le adicional (Case 4).
-        {
-            uint8_t le_byte;
-            if(sim_receive_byte(&le_byte, SIM_RX_INTERBYTE_TIMEOUT)) {
-                buffer[offset++] = le_byte;
-            }
+            default:
+                state = T0_STATE_DONE;
+                break;
         }
-    } else {
-        // Case 2: no se espera carga adicional, P3 actúa como Le
-    }
-
-    if(!sim_send_byte(0x60U)) {
-        USIM_LOG_STRING("APDU procedure NULL failed\r\n");
     }
 
     *length = offset;
+    usim_wait_arm(t0_current_flags);
     return true;
 }
 
@@ -151,10 +335,28 @@ bool usim_receive_apdu(uint8_t* buffer, uint16_t* length) {
 void usim_send_response(uint8_t* response, uint16_t length) {
     uint16_t index;
 
+    if(usim_wait_armed) {
+        usim_slow_ticks = usim_wait_total + sim_elapsed_ticks();
+        usim_wait_armed = false;
+    }
+
     if(response == NULL || length == 0U) {
         return;
     }
 
+    if(sim_get_protocol() == 1U) {
+        usim_t1_send_response(response, length);
+        return;
+    }
+
+    // Caso 2: los datos van precedidos del byte de procedimiento INS
+    if(length > 2U && (t0_current_flags & T0_FLAG_DATA_OUT) != 0U) {
+        if(!sim_send_byte(t0_current_ins)) {
+            USIM_LOG_STRING("SIM TX failure\r\n");
+            return;
+        }
+    }
+
     for(index = 0U; index < length; ++index) {
         if(!sim_send_byte(response[index])) {
             USIM_LOG_STRING("SIM TX failure\r\n");
@@ -180,40 +382,107 @@ void usim_background_tasks(void) {
     }
 }
 
-// Obtener datos de archivo
-const uint8_t* usim_get_file_data(uint16_t file_id, uint8_t* buffer, uint16_t* length) {
-    const usim_file_t* file = usim_find_file(file_id);
-    if (file == NULL || file->file_data == NULL) {
-        return NULL;
+// Guardar PIN, PUK y contadores de intentos en NVM (dentro de una
+// transacción, al confirmarla)
+bool usim_persist_chv(void) {
+    bool stored;
+
+    if(usim_nvm_group_active()) {
+        stored = usim_nvm_stage(USIM_NVM_OBJ_CHV, subscriber.pin1, USIM_NVM_CHV_SIZE);
+    } else {
+        stored = usim_nvm_write(USIM_NVM_OBJ_CHV, subscriber.pin1, USIM_NVM_CHV_SIZE);
     }
-    
-    // Para archivos sensibles, aplicar XOR inverso
-    if (file_id == 0x6F08 || file_id == 0x6F09) {
-        memcpy(buffer, file->file_data, file->file_size);
-        usim_xor_operation(buffer, file->file_size, xor_key, 16U);
-        *length = file->file_size;
-        return buffer;
+
+    if(!stored) {
+        USIM_LOG_STRING("NVM: CHV not persisted\r\n");
+        return false;
     }
-    
-    *length = file->file_size;
-    return file->file_data;
+    return true;
+}
+
+// SQN_MS y la matriz SEQ/IND: se graban antes de entregar RES, así un AUTN
+// aceptado no vuelve a serlo aunque la tarjeta se extraiga justo después
+bool usim_persist_sqn(void) {
+    if(!usim_nvm_write(USIM_NVM_OBJ_SQN, subscriber.sqn, USIM_NVM_SQN_SIZE)) {
+        USIM_LOG_STRING("NVM: SQN not persisted\r\n");
+        return false;
+    }
+    return true;
+}
+
+// Transacción de personalización: las escrituras de EF y de PIN de varios
+// APDU se graban juntas al confirmar, o ninguna. La caché write-back se
+// vuelca antes, así deshacer es volver a cargar el estado desde NVM.
+bool usim_transaction_begin(void) {
+    return usim_files_flush() && usim_nvm_group_begin();
+}
+
+// Deshacer lo escrito en XRAM desde usim_transaction_begin()
+static void usim_transaction_revert(void) {
+    usim_load_chv();
+    usim_secrets_load();
+    usim_filesystem_init();
+    usim_load_auth_params();
+}
+
+bool usim_transaction_commit(void) {
+    if(!usim_nvm_group_commit()) {
+        USIM_LOG_STRING("NVM: transaction rolled back\r\n");
+        usim_transaction_revert();
+        return false;
+    }
+    return true;
+}
+
+void usim_transaction_abort(void) {
+    usim_nvm_group_discard();
+    usim_transaction_revert();
+}
+
+// Activar otro perfil: se vuelca la caché write-back al perfil saliente, se
+// guarda el índice del nuevo y se recarga su suscriptor. De los EF solo se
+// sueltan las copias de los buffers de perfil, que se leen del perfil nuevo
+// al usarlos; ni se copia ni se relee nada más. La terminal se entera por un
+// REFRESH (reset de la UICC) pendiente de FETCH.
+bool usim_profile_switch(uint8_t profile) {
+    if(profile >= USIM_PROFILE_COUNT || usim_nvm_group_active()) {
+        return false;
+    }
+
+    if(!usim_files_flush() ||
+       !usim_nvm_write(USIM_NVM_OBJ_PROFILE, &profile, USIM_NVM_PROFILE_SIZE)) {
+        USIM_LOG_STRING("NVM: profile not persisted\r\n");
+        return false;
+    }
+
+    usim_nvm_set_profile(profile);
+    usim_load_subscriber();
+    usim_files_profile_changed();
+    usim_load_auth_params();
+    usim_reset_session();
+    usat_queue_refresh();
+    return true;
 }
 
 // Actualizar archivo (versión corregida)
 void usim_update_file(uint16_t file_id, const uint8_t* data, uint16_t length) {
-    usim_file_t* file = usim_find_file_mutable(file_id);
-    if(file == NULL || file->file_data == NULL) {
+    uint8_t file = usim_find_file_index(file_id);
+    uint8_t* file_data = usim_file_writable(file);
+    if(file_data == NULL) {
         USIM_LOG_STRING("File update failed: not writable\r\n");
         return;
     }
 
-    if(length > file->file_size) {
-        length = file->file_size;
+    if(length > usim_file_size[file]) {
+        length = usim_file_size[file];
     }
 
     if(length > 0U) {
-        memcpy(file->file_data, data, length);
-        file->data_size = length;
+        memcpy(file_data, data, length);
+        if(!usim_file_written(file, length)) {
+            USIM_LOG_STRING("File update failed: not persisted\r\n");
+            return;
+        }
     }
 
     USIM_LOG_STRING("File update - ID: 0x");
@@ -2,21 +2,394 @@
 #include "usim_files.h"
 #include "usim_app.h"
 #include "usim_constants.h"
+#include "usim_milenage.h"
+#include "usim_tuak.h"
+#include "usim_secrets.h"
 #include <string.h>
 
+// RES se guarda en session.res: TUAK no puede configurarse con uno mayor
+typedef char usim_res_fits[(USIM_TUAK_RES_SIZE <= sizeof(((session_context_t*)0)->res)) ? 1 : -1];
+// El MAC de AUTN y de AUTS es de 64 bits con los dos algoritmos
+typedef char usim_mac_fits[(USIM_TUAK_MAC_SIZE == USIM_MILENAGE_MAC_SIZE) ? 1 : -1];
+typedef char usim_sqn_array_fits[(sizeof(((subscriber_data_t*)0)->sqn_age) * 2U ==
+                                  USIM_SQN_ARRAY_SIZE) ? 1 : -1];
+
+// Prepara el algoritmo del perfil (subscriber.auth_algorithm) para un RAND:
+// MILENAGE (TS 35.206) con K y OPc, o TUAK (TS 35.231) con K y TOPc. Las
+// funciones usim_auth_f* siguientes usan el estado que deja.
+static bool usim_auth_setup(const uint8_t* rand) {
+    uint8_t key_buffer[USIM_SECRET_KEY_SIZE];
+    uint8_t op_buffer[USIM_TUAK_TOP_SIZE];
+    bool ready = false;
+
+    usim_secret_get(USIM_SECRET_K, key_buffer);
+    switch(subscriber.auth_algorithm) {
+        case USIM_ALGORITHM_MILENAGE:
+            usim_secret_get(USIM_SECRET_OPC, op_buffer);
+            usim_milenage_init(key_buffer, op_buffer, rand);
+            ready = true;
+            break;
+
+        case USIM_ALGORITHM_TUAK:
+            usim_secret_get(USIM_SECRET_TOPC, op_buffer);
+            usim_tuak_init(key_buffer, op_buffer, rand, subscriber.keccak_iterations);
+            ready = true;
+            break;
+
+        default:
+            break;
+    }
+
+    memset(key_buffer, 0, sizeof(key_buffer));
+    memset(op_buffer, 0, sizeof(op_buffer));
+    return ready;
+}
+
+static void usim_auth_f1(const uint8_t* sqn, const uint8_t* amf, uint8_t* mac_a, uint8_t* mac_s) {
+    if(subscriber.auth_algorithm == USIM_ALGORITHM_TUAK) {
+        usim_tuak_f1(sqn, amf, mac_a, mac_s);
+    } else {
+        usim_milenage_f1(sqn, amf, mac_a, mac_s);
+    }
+}
+
+static void usim_auth_f2345(uint8_t* res, uint8_t* ck, uint8_t* ik, uint8_t* ak) {
+    if(subscriber.auth_algorithm == USIM_ALGORITHM_TUAK) {
+        usim_tuak_f2345(res, ck, ik, ak);
+    } else {
+        usim_milenage_f2345(res, ck, ik, ak);
+    }
+}
+
+static void usim_auth_f5star(uint8_t* ak_star) {
+    if(subscriber.auth_algorithm == USIM_ALGORITHM_TUAK) {
+        usim_tuak_f5star(ak_star);
+    } else {
+        usim_milenage_f5star(ak_star);
+    }
+}
+
+static uint8_t usim_auth_res_length(void) {
+    return (subscriber.auth_algorithm == USIM_ALGORITHM_TUAK) ?
+           (uint8_t)USIM_TUAK_RES_SIZE : (uint8_t)USIM_MILENAGE_RES_SIZE;
+}
+
+// Contexto preparado: el algoritmo queda inicializado para el último RAND
+// junto con la salida de f2345, así un attach en los dos contextos (3G y
+// GSM con el mismo RAND) hace una sola preparación y una sola f2345. Se
+// libera con otro RAND, al cambiar K/OPc/algoritmo y en el reset.
+static __xdata uint8_t auth_rand[16];
+static __xdata uint8_t auth_res[USIM_AUTH_RES_MAX];
+static __xdata uint8_t auth_ck[16];
+static __xdata uint8_t auth_ik[16];
+static __xdata uint8_t auth_ak[USIM_MILENAGE_AK_SIZE];
+static bool auth_prepared = false;
+
+void usim_auth_release(void) {
+    if(auth_prepared) {
+        usim_milenage_clear();
+        usim_tuak_clear();
+        memset(auth_res, 0, sizeof(auth_res));
+        memset(auth_ck, 0, sizeof(auth_ck));
+        memset(auth_ik, 0, sizeof(auth_ik));
+        memset(auth_ak, 0, sizeof(auth_ak));
+        auth_prepared = false;
+    }
+}
+
+static bool usim_auth_prepare(const uint8_t* rand) {
+    if(auth_prepared && memcmp(auth_rand, rand, sizeof(auth_rand)) == 0) {
+        return true;
+    }
+
+    usim_auth_release();
+    if(!usim_auth_setup(rand)) {
+        return false;
+    }
+    usim_auth_f2345(auth_res, auth_ck, auth_ik, auth_ak);
+    memcpy(auth_rand, rand, sizeof(auth_rand));
+    auth_prepared = true;
+    return true;
+}
+
+// Conversiones de TS 33.102 §6.8.1.2. c2: SRES es el XOR de las palabras de
+// 32 bits de RES (completado con ceros). c3: Kc = CK1^CK2^IK1^IK2.
+static void usim_auth_c2(const uint8_t* res, uint8_t res_len, uint8_t* sres) {
+    uint8_t i;
+
+    memset(sres, 0, USIM_GSM_SRES_SIZE);
+    for(i = 0U; i < res_len; i++) {
+        sres[i & 3U] ^= res[i];
+    }
+}
+
+static void usim_auth_c3(const uint8_t* ck, const uint8_t* ik, uint8_t* kc) {
+    uint8_t i;
+
+    for(i = 0U; i < USIM_GSM_KC_SIZE; i++) {
+        kc[i] = (uint8_t)(ck[i] ^ ck[i + 8U] ^ ik[i] ^ ik[i + 8U]);
+    }
+}
+
+// Matriz de SQN del anexo C de TS 33.102: SQN = SEQ (43 bits) | IND (5 bits)
+// y una entrada SEQ(i) por cada IND. En lugar de 32 SEQ de 43 bits se
+// guarda SQN_MS (el mayor aceptado) y, por IND, la antigüedad SEQ_MS -
+// SEQ(i) en 4 bits, saturada a USIM_SQN_AGE_LIMIT. Saturar solo sube SEQ(i),
+// es decir, rechaza más y nunca acepta una repetición: equivale al límite
+// de antigüedad L opcional del anexo C.2.2.
+static uint8_t usim_sqn_get_age(uint8_t ind) {
+    uint8_t packed = subscriber.sqn_age[ind >> 1];
+    return (uint8_t)(((ind & 1U) != 0U) ? (packed >> 4) : (packed & 0x0FU));
+}
+
+static void usim_sqn_set_age(uint8_t ind, uint8_t age) {
+    uint8_t* packed = &subscriber.sqn_age[ind >> 1];
+
+    if((ind & 1U) != 0U) {
+        *packed = (uint8_t)((*packed & 0x0FU) | (uint8_t)(age << 4));
+    } else {
+        *packed = (uint8_t)((*packed & 0xF0U) | age);
+    }
+}
+
+// diff = SEQ(a) - SEQ(b) sobre los 48 bits con IND a cero. Devuelve true si
+// SEQ(a) < SEQ(b) (hubo acarreo).
+static bool usim_sqn_subtract(const uint8_t* a, const uint8_t* b, uint8_t* diff) {
+    uint8_t borrow = 0U;
+    uint8_t i = USIM_MILENAGE_SQN_SIZE;
+
+    while(i-- > 0U) {
+        uint8_t mask = (i == USIM_MILENAGE_SQN_SIZE - 1U) ? (uint8_t)~USIM_SQN_IND_MASK : 0xFFU;
+        uint16_t value = (uint16_t)((uint16_t)(a[i] & mask) - (uint16_t)(b[i] & mask) - borrow);
+        diff[i] = (uint8_t)value;
+        borrow = (uint8_t)((value >> 8) & 1U);
+    }
+    return borrow != 0U;
+}
+
+// Diferencia en unidades de SEQ, saturada a USIM_SQN_AGE_LIMIT
+static uint8_t usim_sqn_distance(const uint8_t* diff) {
+    uint16_t seq;
+
+    if((diff[0] | diff[1] | diff[2] | diff[3]) != 0U) {
+        return USIM_SQN_AGE_LIMIT;
+    }
+    seq = (uint16_t)((((uint16_t)diff[4] << 8) | diff[5]) >> USIM_SQN_IND_BITS);
+    return (seq >= USIM_SQN_AGE_LIMIT) ? (uint8_t)USIM_SQN_AGE_LIMIT : (uint8_t)seq;
+}
+
+// Comprueba la frescura de SQN y, si es aceptable, lo anota en la matriz
+// (solo en XRAM; usim_persist_sqn() lo graba)
+static bool usim_sqn_accept(const uint8_t* sqn) {
+    uint8_t diff[USIM_MILENAGE_SQN_SIZE];
+    uint8_t ind = (uint8_t)(sqn[USIM_MILENAGE_SQN_SIZE - 1U] & USIM_SQN_IND_MASK);
+    uint8_t age;
+
+    if(!usim_sqn_subtract(sqn, subscriber.sqn, diff) &&
+       (diff[0] | diff[1] | diff[2] | diff[3] | diff[4] | diff[5]) != 0U) {
+        // SEQ > SEQ_MS: aceptable si no salta más de DELTA (2^28 SEQ)
+        if(diff[0] != 0U || diff[1] > 1U) {
+            return false;
+        }
+
+        // Todas las entradas envejecen lo que avanza SEQ_MS
+        age = usim_sqn_distance(diff);
+        {
+            uint8_t i;
+            for(i = 0U; i < USIM_SQN_ARRAY_SIZE; i++) {
+                uint8_t older = (uint8_t)(usim_sqn_get_age(i) + age);
+                usim_sqn_set_age(i, (older > USIM_SQN_AGE_LIMIT) ? (uint8_t)USIM_SQN_AGE_LIMIT : older);
+            }
+        }
+        memcpy(subscriber.sqn, sqn, USIM_MILENAGE_SQN_SIZE);
+        usim_sqn_set_age(ind, 0U);
+        return true;
+    }
+
+    // SEQ <= SEQ_MS: aceptable solo si supera a SEQ(IND)
+    (void)usim_sqn_subtract(subscriber.sqn, sqn, diff);
+    age = usim_sqn_distance(diff);
+    if(age >= usim_sqn_get_age(ind)) {
+        return false;
+    }
+    usim_sqn_set_age(ind, age);
+    return true;
+}
+
+// SQN que generaría la red tras SQN_MS: SEQ_MS + 1 con IND 0 (el paso de 32
+// que usan los HSS sin IND por nodo, como Open5GS)
+static void usim_sqn_next(uint8_t* sqn) {
+    uint8_t i = USIM_MILENAGE_SQN_SIZE - 1U;
+    uint16_t sum = (uint16_t)((subscriber.sqn[i] & (uint8_t)~USIM_SQN_IND_MASK) + (1U << USIM_SQN_IND_BITS));
+
+    memcpy(sqn, subscriber.sqn, USIM_MILENAGE_SQN_SIZE);
+    sqn[i] = (uint8_t)sum;
+    while((sum >> 8) != 0U && i-- > 0U) {
+        sum = (uint16_t)(sqn[i] + 1U);
+        sqn[i] = (uint8_t)sum;
+    }
+}
+
+// Comprueba AUTN = SQN^AK | AMF | MAC-A para el RAND ya preparado. Un SQN
+// aceptable queda anotado solo en XRAM; si no lo es, session.auts recibe
+// AUTS = SQN_MS^AK* | MAC-S (AMF* 0).
+static uint8_t usim_aka_verify(const uint8_t* autn) {
+    uint8_t sqn[USIM_MILENAGE_SQN_SIZE];
+    uint8_t mac[USIM_MILENAGE_MAC_SIZE];
+    uint8_t result = USIM_AKA_OK;
+
+    {
+        uint8_t i;
+        uint8_t mismatch = 0U;
+
+        for(i = 0U; i < USIM_MILENAGE_SQN_SIZE; i++) {
+            sqn[i] = (uint8_t)(autn[i] ^ auth_ak[i]);
+        }
+        usim_auth_f1(sqn, &autn[USIM_AUTN_AMF_OFFSET], mac, NULL);
+
+        // Sin salida anticipada: el tiempo no revela cuántos bytes coinciden
+        for(i = 0U; i < USIM_MILENAGE_MAC_SIZE; i++) {
+            mismatch |= (uint8_t)(mac[i] ^ autn[USIM_AUTN_MAC_OFFSET + i]);
+        }
+        if(mismatch != 0U) {
+            result = USIM_AKA_MAC_FAILURE;
+        }
+    }
+
+    if(result == USIM_AKA_OK && !usim_sqn_accept(sqn)) {
+        static const __code uint8_t amf_resync[USIM_MILENAGE_AMF_SIZE] = {0x00, 0x00};
+        uint8_t ak_star[USIM_MILENAGE_AK_SIZE];
+        uint8_t i;
+
+        usim_auth_f5star(ak_star);
+        usim_auth_f1(subscriber.sqn, amf_resync, NULL, mac);
+        for(i = 0U; i < USIM_MILENAGE_SQN_SIZE; i++) {
+            session.auts[i] = (uint8_t)(subscriber.sqn[i] ^ ak_star[i]);
+        }
+        memcpy(&session.auts[USIM_MILENAGE_SQN_SIZE], mac, USIM_MILENAGE_MAC_SIZE);
+        result = USIM_AKA_SYNC_FAILURE;
+    }
+    return result;
+}
+
+// AKA 3G/EPS (TS 33.102 §6.3.3) con RAND y AUTN = SQN^AK | AMF | MAC-A.
+// Éxito: "DB" L RES L CK L IK L Kc, con Kc de la conversión c3.
+// Fallo de sincronización: "DC" L AUTS.
+uint8_t usim_run_aka(const uint8_t* rand, const uint8_t* autn, uint8_t* output, uint16_t* output_len) {
+    uint8_t res_len = usim_auth_res_length();
+    uint8_t result;
+    uint8_t pos = 0U;
+
+    if(!usim_auth_prepare(rand)) {
+        return USIM_AKA_ERROR;
+    }
+
+    result = usim_aka_verify(autn);
+    if(result == USIM_AKA_SYNC_FAILURE) {
+        output[pos++] = AUTH_TAG_SYNC_FAILURE;
+        output[pos++] = (uint8_t)sizeof(session.auts);
+        memcpy(&output[pos], session.auts, sizeof(session.auts));
+        pos = (uint8_t)(pos + sizeof(session.auts));
+    } else if(result == USIM_AKA_OK && !usim_persist_sqn()) {
+        result = USIM_AKA_ERROR;
+    }
+
+    if(result == USIM_AKA_OK) {
+        memcpy(session.res, auth_res, res_len);
+        memcpy(session.ck, auth_ck, 16U);
+        memcpy(session.ik, auth_ik, 16U);
+        usim_auth_c3(auth_ck, auth_ik, session.kc);
+        session.authenticated = true;
+        session.state |= USIM_STATE_AUTHENTICATED;
+
+        output[pos++] = AUTH_TAG_SUCCESS;
+        output[pos++] = res_len;
+        memcpy(&output[pos], auth_res, res_len);
+        pos = (uint8_t)(pos + res_len);
+        output[pos++] = 16U;
+        memcpy(&output[pos], auth_ck, 16U);
+        pos = (uint8_t)(pos + 16U);
+        output[pos++] = 16U;
+        memcpy(&output[pos], auth_ik, 16U);
+        pos = (uint8_t)(pos + 16U);
+        output[pos++] = USIM_GSM_KC_SIZE;
+        memcpy(&output[pos], session.kc, USIM_GSM_KC_SIZE);
+        pos = (uint8_t)(pos + USIM_GSM_KC_SIZE);
+    }
+
+    *output_len = pos;
+    return result;
+}
+
+// Un vector de un lote (INS_BATCH_AUTH). Con AUTN se verifica como en
+// usim_run_aka(); con autn NULL la tarjeta hace de red: genera AUTN con
+// usim_sqn_next() y "amf" y lo acepta en el acto, así N vectores seguidos
+// llevan SQN consecutivos. El registro es
+//   resultado | [AUTN generado] | RES (completado a 8) | CK | IK
+// o, tras un fallo de sincronización, resultado | AUTS y ceros. El SQN no
+// se graba aquí: el llamante hace un usim_persist_sqn() por lote.
+uint8_t usim_run_aka_vector(const uint8_t* rand, const uint8_t* autn, const uint8_t* amf, uint8_t* record) {
+    uint8_t* body = &record[1];
+    uint8_t result;
+
+    if(!usim_auth_prepare(rand)) {
+        return USIM_AKA_ERROR;
+    }
+
+    if(autn == NULL) {
+        uint8_t sqn[USIM_MILENAGE_SQN_SIZE];
+        uint8_t i;
+
+        usim_sqn_next(sqn);
+        for(i = 0U; i < USIM_MILENAGE_SQN_SIZE; i++) {
+            body[i] = (uint8_t)(sqn[i] ^ auth_ak[i]);
+        }
+        memcpy(&body[USIM_AUTN_AMF_OFFSET], amf, USIM_MILENAGE_AMF_SIZE);
+        usim_auth_f1(sqn, amf, &body[USIM_AUTN_MAC_OFFSET], NULL);
+        result = usim_sqn_accept(sqn) ? USIM_AKA_OK : USIM_AKA_ERROR;
+        body = &body[USIM_AUTN_SIZE];
+    } else {
+        result = usim_aka_verify(autn);
+    }
+
+    record[0] = result;
+    memset(body, 0, USIM_BATCH_VECTOR_SIZE);
+    if(result == USIM_AKA_OK) {
+        memcpy(body, auth_res, usim_auth_res_length());
+        memcpy(&body[USIM_AUTH_RES_MAX], auth_ck, 16U);
+        memcpy(&body[USIM_AUTH_RES_MAX + 16U], auth_ik, 16U);
+    } else if(result == USIM_AKA_SYNC_FAILURE) {
+        memcpy(body, session.auts, sizeof(session.auts));
+    }
+    return result;
+}
+
+// Contexto GSM (TS 33.102 §6.8.2.1): sin AUTN ni SQN; SRES y Kc salen de
+// RES, CK e IK del algoritmo 3G por las conversiones c2 y c3
+bool usim_run_gsm_auth(const uint8_t* rand, uint8_t* sres, uint8_t* kc) {
+    if(!usim_auth_prepare(rand)) {
+        return false;
+    }
+
+    usim_auth_c2(auth_res, usim_auth_res_length(), sres);
+    usim_auth_c3(auth_ck, auth_ik, kc);
+
+    memset(session.res, 0, sizeof(session.res));
+    memcpy(session.res, sres, USIM_GSM_SRES_SIZE);
+    memcpy(session.kc, kc, USIM_GSM_KC_SIZE);
+    session.authenticated = true;
+    session.state |= USIM_STATE_AUTHENTICATED;
+    return true;
+}
+
 // Algoritmo de autenticación simplificado usando XOR
 bool usim_run_xor_auth(uint8_t rand[16], uint8_t* output, uint16_t* output_len) {
-    uint8_t key_buffer[16];
-    uint8_t opc_buffer[16];
-    uint16_t key_len, opc_len;
+    uint8_t key[USIM_SECRET_KEY_SIZE];
+    uint8_t opc[USIM_SECRET_KEY_SIZE];
     
     // Obtener Ki y OPc (protegidos con XOR)
-    const uint8_t* key = usim_get_file_data(0x6F08, key_buffer, &key_len);
-    const uint8_t* opc = usim_get_file_data(0x6F09, opc_buffer, &opc_len);
-    
-    if(key == NULL || opc == NULL || key_len != 16 || opc_len != 16) {
-        return false;
-    }
+    usim_secret_get(USIM_SECRET_K, key);
+    usim_secret_get(USIM_SECRET_OPC, opc);
     
     // Algoritmo XOR simplificado para autenticación
     uint8_t temp[16];
@@ -65,6 +438,8 @@ bool usim_run_xor_auth(uint8_t rand[16], uint8_t* output, uint16_t* output_len)
             ak[i] = rand[i+2U] ^ key[i+5U] ^ opc[i+9U];
         }
     }
+    memset(key, 0, sizeof(key));
+    memset(opc, 0, sizeof(opc));
     
     // Construir respuesta de autenticación
     uint8_t pos = 0;
@@ -87,12 +462,7 @@ bool usim_run_xor_auth(uint8_t rand[16], uint8_t* output, uint16_t* output_len)
     
     // Kc (clave GSM por compatibilidad)
     uint8_t kc[8];
-    {
-        uint8_t i;
-        for(i = 0U; i < 8U; i++) {
-            kc[i] = ck[i] ^ ck[i+8U];
-        }
-    }
+    usim_auth_c3(ck, ik, kc);
     memcpy(&output[pos], kc, 8U);
     pos = (uint8_t)(pos + 8U);
     
@@ -138,17 +508,3 @@ bool usim_verify_data_integrity(const uint8_t* data, uint16_t data_len,
     
     return (memcmp(calculated_mac, expected_mac, mac_len) == 0);
 }
-
-// Obtener clave Ki
-const uint8_t* usim_get_key(void) {
-    uint8_t* buffer = NULL; // Se usaría un buffer temporal
-    // Implementación simplificada
-    return NULL;
-}
-
-// Obtener parámetro OPc
-const uint8_t* usim_get_opc(void) {
-    uint8_t* buffer = NULL;
-    // Implementación simplificada
-    return NULL;
-}
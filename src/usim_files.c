@@ -1,113 +1,484 @@
 #include "usim_files.h"
 #include "usim_constants.h"
 #include "usim_app.h"
+#include "usim_nvm.h"
+#include "chip_specific.h"
 #include <string.h>
 
-// Archivos USIM según 3GPP TS 31.102
-static uint8_t imsi_data[9];
-static uint8_t key_data[16];
-static uint8_t opc_data[16];
-static uint8_t acc_data[2];
-static uint8_t loci_data[11];
-static uint8_t ad_data[2];
-static uint8_t phase_data[1];
-
-static const __code uint8_t imsi_data_init[9] = {0x08, 0x09, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07};
-static const __code uint8_t key_data_init[16] = {0x46, 0x5B, 0x5C, 0xE8, 0xB1, 0x99, 0xB4, 0x9F,
-                                                 0xAA, 0x5F, 0x0A, 0x2E, 0xE2, 0x38, 0xA6, 0xBC};
-static const __code uint8_t opc_data_init[16] = {0xCD, 0x63, 0xCB, 0x71, 0x95, 0x4A, 0x9F, 0x4E,
-                                                 0x48, 0xA5, 0x99, 0x4B, 0x86, 0x5A, 0xE9, 0x55};
-static const __code uint8_t acc_data_init[2] = {0x00, 0x01};
-static const __code uint8_t loci_data_init[11] = {0x07, 0x25, 0x43, 0x10, 0x00, 0x62, 0xF5, 0x35, 0x01, 0x00, 0x00};
-static const __code uint8_t ad_data_init[2] = {0x00, 0x00};
-static const __code uint8_t phase_data_init[1] = {0x03};
-
-#if USIM_ENABLE_LOGGING
-#define FILE_NAME(str) (str)
-#else
-#define FILE_NAME(str) NULL
-#endif
-
-usim_file_t usim_files[] = {
-    // MF (Master File) - 3F00
-    {0x3F00, FILE_TYPE_MF, 0x0000, AC_ALWAYS, NULL, 0, FILE_NAME("MF")},
-    
-    // DF_Telecom (7F10)
-    {0x7F10, FILE_TYPE_DF, 0x0000, AC_ALWAYS, NULL, 0, FILE_NAME("DF_TELECOM")},
-    
-    // DF_GSM (7F20) 
-    {0x7F20, FILE_TYPE_DF, 0x0000, AC_ALWAYS, NULL, 0, FILE_NAME("DF_GSM")},
-    
-    // EF_IMSI (6F07) - International Mobile Subscriber Identity
-    {0x6F07, FILE_TYPE_EF, 0x0009, AC_CHV1, imsi_data, 9, FILE_NAME("EF_IMSI")},
-    
-    // EF_KEY (6F08) - Clave de autenticación Ki
-    {0x6F08, FILE_TYPE_EF, 0x0010, AC_NEVER, key_data, 16, FILE_NAME("EF_KEY")},
-    
-    // EF_OPc (6F09) - Parámetro del operador
-    {0x6F09, FILE_TYPE_EF, 0x0010, AC_NEVER, opc_data, 16, FILE_NAME("EF_OPC")},
-    
-    // EF_PLMNwAcT (6F60) - Lista de redes preferidas
-    {0x6F60, FILE_TYPE_EF, 0x0016, AC_ALWAYS, NULL, 0, FILE_NAME("EF_PLMN")},
-    
-    // EF_ACC (6F78) - Access Control Class
-    {0x6F78, FILE_TYPE_EF, 0x0002, AC_ALWAYS, acc_data, 2, FILE_NAME("EF_ACC")},
-    
-    // EF_LOCI (6F7E) - Location Information
-    {0x6F7E, FILE_TYPE_EF, 0x000B, AC_CHV1, loci_data, 11, FILE_NAME("EF_LOCI")},
-    
-    // EF_AD (6FAD) - Administrative Data
-    {0x6FAD, FILE_TYPE_EF, 0x0002, AC_ALWAYS, ad_data, 2, FILE_NAME("EF_AD")},
-    
-    // EF_PHASE (6FAE) - Phase Identification
-    {0x6FAE, FILE_TYPE_EF, 0x0001, AC_ALWAYS, phase_data, 1, FILE_NAME("EF_PHASE")},
-    
-    // Terminador de tabla
-{0x0000, 0x00, 0x0000, 0x00, NULL, 0, FILE_NAME("")}
-};
-
-#undef FILE_NAME
-
-// Aplicar operación XOR a datos
-void usim_xor_operation(uint8_t* data, uint16_t length, const uint8_t* key, uint8_t key_length) {
-    {
-        uint16_t i;
-        for(i = 0U; i < length; i++) {
-            data[i] ^= key[i % key_length];
+// Archivos USIM según 3GPP TS 31.102. El árbol, los tamaños y el contenido
+// inicial se describen en config/files.json; scripts/gen_fs.py genera los
+// descriptores y el contenido inicial en __code (usim_fs.c). Aquí solo se
+// reserva la parte mutable: el estado de cada buffer y el pool de copias.
+// Un EF recibe página en el pool al escribirlo o, si tiene un valor guardado
+// en NVM, la primera vez que se lee. Las páginas cuyo contenido está ya en
+// NVM se pueden liberar para hacer sitio, salvo las que ha entregado el
+// APDU en curso: el pool no tiene que admitir todos los buffers a la vez.
+static __xdata uint8_t usim_shadow_pool[USIM_SHADOW_POOL_SIZE];
+__xdata usim_buffer_state_t usim_buffer_state[USIM_BUFFER_COUNT];
+
+// Caché write-back: EF con política USIM_POLICY_WRITE_BACK cuya última
+// escritura solo está en el pool. Se guarda el índice de archivo, del más
+// antiguo al más reciente. Los contadores sobreviven a los resets en caliente.
+static __xdata uint8_t usim_cache_file[USIM_CACHE_SLOTS];
+static __xdata uint8_t usim_cache_count;
+__xdata usim_cache_stats_t usim_cache_stats;
+
+static void usim_stat_increment(uint16_t* counter) {
+    if(*counter != 0xFFFFU) {
+        (*counter)++;
+    }
+}
+
+// Buscar archivo por ID: hash perfecto generado en compilación
+// (scripts/gen_fid_index.py). Devuelve la primera entrada con ese FID.
+uint8_t usim_find_file_index(uint16_t file_id) {
+    uint8_t lo = (uint8_t)file_id;
+    uint8_t hi = (uint8_t)(file_id >> 8);
+    uint8_t mixed = (uint8_t)((uint8_t)(lo ^ usim_fid_disp[(uint8_t)(lo + hi) & (USIM_FID_BUCKETS - 1U)]) *
+                              USIM_FID_MIX1);
+    uint8_t index = usim_fid_slots[(uint8_t)((uint8_t)(mixed ^ hi) * USIM_FID_MIX2) >> USIM_FID_SLOT_SHIFT];
+
+    if(index == USIM_FID_SLOT_EMPTY || usim_file_fid[index] != file_id) {
+        return USIM_FILE_NOT_FOUND;
+    }
+    return index;
+}
+
+// DF actual: el archivo actual si es MF/DF/ADF, o el padre del EF actual
+uint8_t usim_current_df(void) {
+    uint8_t file = current_file.file_index;
+
+    if(usim_file_type[file] == FILE_TYPE_EF) {
+        file = usim_file_parent[file];
+    }
+    return file;
+}
+
+// Descriptor de aplicación si el archivo es un ADF
+const __code usim_adf_t* usim_find_adf(uint8_t file) {
+    uint8_t i;
+
+    for(i = 0U; i < USIM_ADF_COUNT; i++) {
+        if(usim_adfs[i].file_index == file) {
+            return &usim_adfs[i];
+        }
+    }
+    return NULL;
+}
+
+// ADF que contiene el archivo, USIM_FILE_NOT_FOUND si está fuera de toda aplicación
+uint8_t usim_application_of(uint8_t file) {
+    while(file != USIM_FILE_NOT_FOUND && usim_find_adf(file) == NULL) {
+        file = usim_file_parent[file];
+    }
+    return file;
+}
+
+// Hijo inmediato de un DF por FID: búsqueda binaria en su rango de hijos
+uint8_t usim_find_child(uint8_t df, uint16_t file_id) {
+    uint8_t low;
+    uint8_t high;
+
+    if(df == USIM_FILE_NOT_FOUND || usim_file_type[df] == FILE_TYPE_EF) {
+        return USIM_FILE_NOT_FOUND;
+    }
+
+    low = usim_file_first_child[df];
+    high = (uint8_t)(low + usim_file_child_count[df]);
+
+    while(low < high) {
+        uint8_t mid = (uint8_t)((low + high) >> 1);
+        uint16_t mid_id = usim_file_fid[mid];
+
+        if(mid_id == file_id) {
+            return mid;
+        }
+        if(mid_id < file_id) {
+            low = (uint8_t)(mid + 1U);
+        } else {
+            high = mid;
+        }
+    }
+    return USIM_FILE_NOT_FOUND;
+}
+
+// Recorrer un camino de FID (2 bytes cada uno) desde "start". Un 7FFF
+// inicial se refiere a la aplicación del archivo actual.
+uint8_t usim_resolve_path(uint8_t start, const uint8_t* path, uint8_t length) {
+    uint8_t file = start;
+    uint8_t i;
+
+    if(length == 0U || (length & 1U) != 0U) {
+        return USIM_FILE_NOT_FOUND;
+    }
+
+    for(i = 0U; i < length && file != USIM_FILE_NOT_FOUND; i = (uint8_t)(i + 2U)) {
+        uint16_t file_id = (uint16_t)(((uint16_t)path[i] << 8) | path[i + 1U]);
+
+        if(i == 0U && file_id == 0x7FFF) {
+            file = usim_application_of(current_file.file_index);
+        } else {
+            file = usim_find_child(file, file_id);
+        }
+    }
+    return file;
+}
+
+// Buscar ADF por nombre (AID); se admite un prefijo del AID (selección parcial)
+uint8_t usim_find_by_aid(const uint8_t* aid, uint8_t length) {
+    uint8_t i;
+
+    if(length == 0U) {
+        return USIM_FILE_NOT_FOUND;
+    }
+
+    for(i = 0U; i < USIM_ADF_COUNT; i++) {
+        if(length <= usim_adfs[i].aid_len && memcmp(usim_adfs[i].aid, aid, length) == 0) {
+            return usim_adfs[i].file_index;
         }
     }
+    return USIM_FILE_NOT_FOUND;
 }
 
-// Buscar archivo por ID
-const usim_file_t* usim_find_file(uint16_t file_id) {
-    {
-        uint16_t i = 0U;
-        while(usim_files[i].file_id != 0x0000) {
-            if(usim_files[i].file_id == file_id) {
-                return &usim_files[i];
+// Buscar EF por SFI (TS 102 221 §8.3) entre los hijos del DF actual
+uint8_t usim_find_file_by_sfi(uint8_t sfi) {
+    uint8_t df = usim_current_df();
+    uint8_t i;
+    uint8_t end;
+
+    if(sfi == 0U) {
+        return USIM_FILE_NOT_FOUND;
+    }
+
+    end = (uint8_t)(usim_file_first_child[df] + usim_file_child_count[df]);
+    for(i = usim_file_first_child[df]; i < end; i++) {
+        if(usim_file_sfi[i] == sfi) {
+            return i;
+        }
+    }
+    return USIM_FILE_NOT_FOUND;
+}
+
+// Valor del buffer guardado en NVM (el del perfil activo si es de perfil).
+// Uno de otro tamaño es de un perfil anterior y se ignora.
+static bool usim_buffer_persisted(uint8_t buffer) {
+    return usim_nvm_length(USIM_NVM_OBJ_BUFFER(buffer)) == usim_buffer_size[buffer];
+}
+
+// Primer hueco del pool de "size" bytes entre las páginas asignadas;
+// USIM_SHADOW_NONE si no hay ninguno
+#define USIM_SHADOW_NONE  0xFFFFU
+
+static uint16_t usim_shadow_gap(uint16_t size) {
+    uint16_t start = 0U;
+    uint8_t i;
+
+    while((uint16_t)(start + size) <= USIM_SHADOW_POOL_SIZE) {
+        uint16_t next = start;
+
+        for(i = 0U; i < USIM_BUFFER_COUNT; i++) {
+            const usim_buffer_state_t* other = &usim_buffer_state[i];
+            uint16_t end = (uint16_t)(other->shadow + usim_buffer_size[i]);
+
+            if((other->flags & USIM_BUFFER_SHADOWED) != 0U &&
+               other->shadow < (uint16_t)(start + size) && end > start && end > next) {
+                next = end;
             }
-            i++;
         }
+        if(next == start) {
+            return start;
+        }
+        start = next;
     }
-    return NULL;
+    return USIM_SHADOW_NONE;
+}
+
+// Liberar una página que se puede volver a leer (de NVM o, si no se ha
+// modificado, de la imagen en flash) y que no está pendiente en la caché,
+// ni anotada en un grupo abierto, ni entregada en el APDU en curso.
+// Devuelve false si no queda ninguna.
+static bool usim_shadow_reclaim(void) {
+    uint8_t i;
+
+    for(i = 0U; i < USIM_BUFFER_COUNT; i++) {
+        usim_buffer_state_t* state = &usim_buffer_state[i];
+
+        if((state->flags & (USIM_BUFFER_SHADOWED | USIM_BUFFER_PENDING | USIM_BUFFER_STAGED |
+                            USIM_BUFFER_IN_USE)) == USIM_BUFFER_SHADOWED &&
+           ((state->flags & USIM_BUFFER_DIRTY) == 0U || usim_buffer_persisted(i))) {
+            state->flags &= (uint8_t)~(USIM_BUFFER_SHADOWED | USIM_BUFFER_DIRTY);
+            return true;
+        }
+    }
+    return false;
 }
 
-usim_file_t* usim_find_file_mutable(uint16_t file_id) {
-    {
-        uint16_t i = 0U;
-        while(usim_files[i].file_id != 0x0000) {
-            if(usim_files[i].file_id == file_id) {
-                return &usim_files[i];
+// Página del pool para un buffer, cargada con su valor en NVM o, si no lo
+// tiene, con la imagen de flash. La página queda en uso hasta el siguiente
+// APDU. NULL si no cabe ni liberando las que se pueden releer.
+static uint8_t* usim_buffer_shadow(uint8_t buffer) {
+    usim_buffer_state_t* state = &usim_buffer_state[buffer];
+    uint16_t size = usim_buffer_size[buffer];
+
+    if((state->flags & USIM_BUFFER_SHADOWED) == 0U) {
+        uint16_t offset = usim_shadow_gap(size);
+
+        while(offset == USIM_SHADOW_NONE) {
+            if(!usim_shadow_reclaim()) {
+                USIM_LOG_STRING("Shadow pool exhausted\r\n");
+                return NULL;
             }
-            i++;
+            offset = usim_shadow_gap(size);
+        }
+
+        state->shadow = offset;
+        state->flags |= USIM_BUFFER_SHADOWED;
+        if(usim_buffer_persisted(buffer)) {
+            usim_nvm_read(USIM_NVM_OBJ_BUFFER(buffer), 0U, &usim_shadow_pool[offset], (uint8_t)size);
+        } else {
+            memcpy(&usim_shadow_pool[offset], &usim_data_init[usim_buffer_offset[buffer]], size);
         }
     }
-    return NULL;
+    state->flags |= USIM_BUFFER_IN_USE;
+    return &usim_shadow_pool[state->shadow];
+}
+
+// Datos de un EF para lectura: la copia en XRAM si existe o si hay un valor
+// en NVM, si no la imagen en flash. NULL si no tiene contenido (o si el
+// valor guardado no cabe en el pool).
+const uint8_t* usim_file_data(uint8_t file) {
+    uint8_t buffer;
+
+    if(file == USIM_FILE_NOT_FOUND) {
+        return NULL;
+    }
+
+    buffer = usim_file_buffer[file];
+    if(buffer == USIM_FILE_NO_BUFFER) {
+        return NULL;
+    }
+
+    if((usim_buffer_state[buffer].flags & USIM_BUFFER_PENDING) != 0U) {
+        usim_stat_increment(&usim_cache_stats.hits);
+    }
+    if((usim_buffer_state[buffer].flags & USIM_BUFFER_SHADOWED) != 0U || usim_buffer_persisted(buffer)) {
+        return usim_buffer_shadow(buffer);
+    }
+    return &usim_data_init[usim_buffer_offset[buffer]];
+}
+
+// Datos de un EF para escritura, siempre en una página del pool; NULL si no
+// tiene contenido o el pool está agotado.
+uint8_t* usim_file_writable(uint8_t file) {
+    uint8_t buffer;
+
+    if(file == USIM_FILE_NOT_FOUND) {
+        return NULL;
+    }
+
+    buffer = usim_file_buffer[file];
+    if(buffer == USIM_FILE_NO_BUFFER) {
+        return NULL;
+    }
+
+    return usim_buffer_shadow(buffer);
+}
+
+// Fin de un APDU: los punteros entregados dejan de usarse y las páginas
+// anotadas en un grupo ya confirmado o descartado se pueden liberar
+void usim_files_release(void) {
+    uint8_t clear = USIM_BUFFER_IN_USE;
+    uint8_t i;
+
+    if(!usim_nvm_group_active()) {
+        clear |= USIM_BUFFER_STAGED;
+    }
+    for(i = 0U; i < USIM_BUFFER_COUNT; i++) {
+        usim_buffer_state[i].flags &= (uint8_t)~clear;
+    }
+}
+
+// Guardar el buffer de un EF en NVM (junto con cyclic_head en los EF
+// cíclicos, en la misma transacción). Dentro de una transacción de
+// usim_transaction_begin() solo se anota y se graba al confirmarla.
+static bool usim_file_persist(uint8_t file, uint8_t head) {
+    uint8_t buffer = usim_file_buffer[file];
+    usim_buffer_state_t* state = &usim_buffer_state[buffer];
+    uint8_t size = (uint8_t)usim_buffer_size[buffer];
+    bool cyclic = (usim_file_structure[file] == EF_STRUCT_CYCLIC);
+
+    if(usim_nvm_group_active()) {
+        // El grupo lee los datos al confirmar: para entonces el puntero
+        // cíclico ya tiene el valor nuevo y la página no se ha liberado
+        state->flags |= USIM_BUFFER_STAGED;
+        return usim_nvm_stage(USIM_NVM_OBJ_BUFFER(buffer), &usim_shadow_pool[state->shadow], size) &&
+               (!cyclic || usim_nvm_stage(USIM_NVM_OBJ_HEAD(buffer), &state->cyclic_head, 1U));
+    }
+
+    if(!usim_nvm_begin((uint16_t)(size + (cyclic ? 1U : 0U)), (uint8_t)(cyclic ? 2U : 1U)) ||
+       !usim_nvm_put(USIM_NVM_OBJ_BUFFER(buffer), &usim_shadow_pool[state->shadow], size) ||
+       (cyclic && !usim_nvm_put(USIM_NVM_OBJ_HEAD(buffer), &head, 1U)) ||
+       !usim_nvm_commit()) {
+        USIM_LOG_STRING("NVM write failed\r\n");
+        return false;
+    }
+    return true;
+}
+
+// Volcar a NVM la entrada más antigua de la caché
+static bool usim_cache_evict(void) {
+    uint8_t file = usim_cache_file[0];
+
+    if(!usim_file_persist(file, usim_buffer_state[usim_file_buffer[file]].cyclic_head)) {
+        return false;
+    }
+
+    usim_buffer_state[usim_file_buffer[file]].flags &= (uint8_t)~USIM_BUFFER_PENDING;
+    usim_cache_count--;
+    memmove(&usim_cache_file[0], &usim_cache_file[1], usim_cache_count);
+    usim_stat_increment(&usim_cache_stats.flushes);
+    return true;
+}
+
+// Registrar una escritura que termina en "end". Los EF write-back quedan en
+// la caché (una nueva escritura sobre una entrada pendiente se fusiona con
+// ella); el resto se guarda en NVM en el acto. Devuelve false si el dato no
+// quedó ni persistente ni en la caché. "head" es el puntero cíclico que se
+// guarda con los datos.
+static bool usim_file_store(uint8_t file, uint16_t end, uint8_t head) {
+    uint8_t buffer = usim_file_buffer[file];
+    usim_buffer_state_t* state = &usim_buffer_state[buffer];
+
+    if((state->flags & USIM_BUFFER_SHADOWED) == 0U) {
+        return false;
+    }
+
+    if(end > state->data_size) {
+        state->data_size = end;
+    }
+    state->flags |= USIM_BUFFER_DIRTY;
+
+    if(usim_buffer_policy[buffer] != USIM_POLICY_WRITE_BACK || usim_nvm_group_active()) {
+        return usim_file_persist(file, head);
+    }
+
+    if((state->flags & USIM_BUFFER_PENDING) != 0U) {
+        usim_stat_increment(&usim_cache_stats.coalesced);
+        return true;
+    }
+
+    if(usim_cache_count == USIM_CACHE_SLOTS && !usim_cache_evict()) {
+        return false;
+    }
+
+    usim_cache_file[usim_cache_count++] = file;
+    state->flags |= USIM_BUFFER_PENDING;
+    return true;
+}
+
+bool usim_file_written(uint8_t file, uint16_t end) {
+    return usim_file_store(file, end, usim_buffer_state[usim_file_buffer[file]].cyclic_head);
+}
+
+// Volcar a NVM todas las entradas pendientes, de la más antigua a la más
+// reciente. Se llama en reposo y al detectar RST o pérdida de VCC.
+bool usim_files_flush(void) {
+    while(usim_cache_count != 0U) {
+        if(!usim_cache_evict()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Entradas pendientes en la caché
+uint8_t usim_cache_pending(void) {
+    return usim_cache_count;
+}
+
+// Offset del registro lógico "record_number" (1..n), USIM_RECORD_INVALID si
+// no existe. En EF cíclicos el registro 1 es el más reciente y se localiza a
+// partir de cyclic_head.
+#define USIM_RECORD_INVALID  0xFFFFU
+
+static uint16_t usim_record_offset(uint8_t file, uint8_t record_number) {
+    uint8_t count = usim_file_record_count[file];
+    uint8_t index;
+
+    if(record_number == 0U || record_number > count) {
+        return USIM_RECORD_INVALID;
+    }
+
+    index = (uint8_t)(record_number - 1U);
+    if(usim_file_structure[file] == EF_STRUCT_CYCLIC) {
+        index = (uint8_t)(index + usim_buffer_state[usim_file_buffer[file]].cyclic_head);
+        if(index >= count) {
+            index = (uint8_t)(index - count);
+        }
+    }
+
+    return (uint16_t)index * usim_file_record_length[file];
+}
+
+// Registro para lectura (flash o copia en XRAM)
+const uint8_t* usim_record_data(uint8_t file, uint8_t record_number) {
+    const uint8_t* data = usim_file_data(file);
+    uint16_t offset;
+
+    if(data == NULL) {
+        return NULL;
+    }
+
+    offset = usim_record_offset(file, record_number);
+    return (offset == USIM_RECORD_INVALID) ? NULL : &data[offset];
+}
+
+// Registro para escritura (copy-on-write del EF completo)
+uint8_t* usim_record_writable(uint8_t file, uint8_t record_number) {
+    uint8_t* data;
+    uint16_t offset;
+
+    if(file == USIM_FILE_NOT_FOUND) {
+        return NULL;
+    }
+
+    offset = usim_record_offset(file, record_number);
+    if(offset == USIM_RECORD_INVALID) {
+        return NULL;
+    }
+
+    data = usim_file_writable(file);
+    return (data == NULL) ? NULL : &data[offset];
+}
+
+// Grabar un registro nuevo en un EF cíclico: ocupa el hueco del más antiguo,
+// que pasa a ser el registro 1 sin mover datos. El puntero cíclico solo
+// avanza cuando el registro ha quedado guardado; si falla, el registro 1
+// sigue siendo el anterior.
+bool usim_cyclic_append(uint8_t file, const uint8_t* record) {
+    usim_buffer_state_t* state = &usim_buffer_state[usim_file_buffer[file]];
+    uint8_t length = usim_file_record_length[file];
+    uint8_t head = state->cyclic_head;
+    uint8_t* data = usim_file_writable(file);
+
+    if(data == NULL) {
+        return false;
+    }
+
+    head = (uint8_t)((head == 0U ? usim_file_record_count[file] : head) - 1U);
+    memcpy(&data[(uint16_t)head * length], record, length);
+
+    if(!usim_file_store(file, usim_file_size[file], head)) {
+        return false;
+    }
+
+    state->cyclic_head = head;
+    return true;
 }
 
 // Verificar condiciones de acceso
-bool usim_check_access(const usim_file_t* file, uint8_t access_type) {
-    if(file == NULL) {
+bool usim_check_access(uint8_t file, uint8_t access_type) {
+    if(file == USIM_FILE_NOT_FOUND) {
         return false;
     }
 
@@ -115,7 +486,7 @@ bool usim_check_access(const usim_file_t* file, uint8_t access_type) {
         return true;
     }
 
-    switch(file->access_conditions) {
+    switch(usim_file_access[file]) {
         case AC_ALWAYS:
             return true;
 
@@ -133,22 +504,43 @@ bool usim_check_access(const usim_file_t* file, uint8_t access_type) {
     }
 }
 
-// Inicializar sistema de archivos
+// Inicializar sistema de archivos: se vacía el pool y los EF se cargan al
+// leerlos, desde NVM (el valor del perfil activo, si el buffer es de perfil)
+// o desde la imagen en flash. Solo los punteros cíclicos se leen ya.
+// Requiere el NVM montado; la caché write-back debe haberse volcado antes
+// (usim_files_flush).
 void usim_filesystem_init(void) {
-    memcpy(imsi_data, imsi_data_init, sizeof(imsi_data));
-    memcpy(key_data, key_data_init, sizeof(key_data));
-    memcpy(opc_data, opc_data_init, sizeof(opc_data));
-    memcpy(acc_data, acc_data_init, sizeof(acc_data));
-    memcpy(loci_data, loci_data_init, sizeof(loci_data));
-    memcpy(ad_data, ad_data_init, sizeof(ad_data));
-    memcpy(phase_data, phase_data_init, sizeof(phase_data));
+    uint8_t i;
+
+    for(i = 0U; i < USIM_BUFFER_COUNT; i++) {
+        usim_buffer_state[i].data_size = usim_buffer_size[i];
+        usim_buffer_state[i].cyclic_head = 0U;
+        usim_buffer_state[i].flags = 0U;
+        usim_buffer_state[i].shadow = 0U;
+
+        if(usim_buffer_persisted(i) && usim_nvm_length(USIM_NVM_OBJ_HEAD(i)) == 1U) {
+            usim_nvm_read(USIM_NVM_OBJ_HEAD(i), 0U, &usim_buffer_state[i].cyclic_head, 1U);
+        }
+    }
+    usim_cache_count = 0U;
+}
+
+// Cambio de perfil: solo se sueltan las páginas de los buffers de perfil,
+// que se leerán del perfil nuevo al usarlos. Los compartidos y los punteros
+// cíclicos (un EF cíclico nunca es de perfil) no cambian. La caché
+// write-back debe haberse volcado antes.
+void usim_files_profile_changed(void) {
+    uint8_t i;
 
-    // Aplicar XOR a los datos sensibles durante inicialización
-    usim_xor_operation(key_data, 16, xor_key, 16);
-    usim_xor_operation(opc_data, 16, xor_key, 16);
+    for(i = 0U; i < USIM_BUFFER_COUNT; i++) {
+        if(usim_buffer_profile[i] != USIM_BUFFER_NO_PROFILE) {
+            usim_buffer_state[i].data_size = usim_buffer_size[i];
+            usim_buffer_state[i].flags = 0U;
+        }
+    }
 }
 
 // Obtener archivo actual
-const usim_file_t* usim_get_current_file(void) {
-    return usim_find_file(current_file.file_id);
+uint8_t usim_get_current_file(void) {
+    return current_file.file_index;
 }
@@ -0,0 +1,156 @@
+#include "usim_keccak.h"
+#include <string.h>
+
+// Keccak-f[1600] (FIPS 202 §3.3) sobre lanes de 8 bytes. Sin aritmética de
+// 64 bits: cada paso recorre los bytes de la lane (byte-sliced) y las
+// rotaciones se separan en un desplazamiento de bytes y otro de 0-7 bits.
+// rho y pi se hacen juntos siguiendo el ciclo de pi (una lane de reserva) y
+// chi fila a fila con 5 bytes de trabajo, así que solo hacen falta las
+// paridades de theta (40 bytes) además del estado.
+#define KECCAK_ROUNDS  24U
+
+__xdata uint8_t usim_keccak_state[USIM_KECCAK_STATE_SIZE];
+static __xdata uint8_t keccak_parity[5 * USIM_KECCAK_LANE_SIZE];
+
+// Constantes de ronda de iota, little-endian
+static const __code uint8_t keccak_round_constants[KECCAK_ROUNDS * USIM_KECCAK_LANE_SIZE] = {
+    0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x82, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x8A, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x80,
+    0x00, 0x80, 0x00, 0x80, 0x00, 0x00, 0x00, 0x80,
+    0x8B, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x01, 0x00, 0x00, 0x80, 0x00, 0x00, 0x00, 0x00,
+    0x81, 0x80, 0x00, 0x80, 0x00, 0x00, 0x00, 0x80,
+    0x09, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x80,
+    0x8A, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x88, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x09, 0x80, 0x00, 0x80, 0x00, 0x00, 0x00, 0x00,
+    0x0A, 0x00, 0x00, 0x80, 0x00, 0x00, 0x00, 0x00,
+    0x8B, 0x80, 0x00, 0x80, 0x00, 0x00, 0x00, 0x00,
+    0x8B, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x80,
+    0x89, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x80,
+    0x03, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x80,
+    0x02, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x80,
+    0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x80,
+    0x0A, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x0A, 0x00, 0x00, 0x80, 0x00, 0x00, 0x00, 0x80,
+    0x81, 0x80, 0x00, 0x80, 0x00, 0x00, 0x00, 0x80,
+    0x80, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x80,
+    0x01, 0x00, 0x00, 0x80, 0x00, 0x00, 0x00, 0x00,
+    0x08, 0x80, 0x00, 0x80, 0x00, 0x00, 0x00, 0x80
+};
+
+// Ciclo de pi empezando en la lane 1 y rotación de rho de cada paso
+static const __code uint8_t keccak_pi_lane[24] = {
+    10, 7, 11, 17, 18, 3, 5, 16, 8, 21, 24, 4, 15, 23, 19, 13, 12, 2, 20, 14, 22, 9, 6, 1
+};
+static const __code uint8_t keccak_rho_offset[24] = {
+    1, 3, 6, 10, 15, 21, 28, 36, 45, 55, 2, 14, 27, 41, 56, 8, 25, 43, 62, 18, 39, 61, 20, 44
+};
+
+// dst = src rotada "count" bits a la izquierda (dst y src no se solapan)
+static void keccak_rotate(uint8_t* dst, const uint8_t* src, uint8_t count) {
+    uint8_t bytes = (uint8_t)(count >> 3);
+    uint8_t bits = (uint8_t)(count & 7U);
+    uint8_t i;
+
+    for(i = 0U; i < USIM_KECCAK_LANE_SIZE; i++) {
+        uint8_t from = (uint8_t)((i - bytes) & (USIM_KECCAK_LANE_SIZE - 1U));
+
+        if(bits == 0U) {
+            dst[i] = src[from];
+        } else {
+            dst[i] = (uint8_t)((uint8_t)(src[from] << bits) |
+                               (src[(from - 1U) & (USIM_KECCAK_LANE_SIZE - 1U)] >> (8U - bits)));
+        }
+    }
+}
+
+static void keccak_theta(void) {
+    uint8_t d[USIM_KECCAK_LANE_SIZE];
+    uint8_t x;
+    uint8_t i;
+
+    for(x = 0U; x < 5U; x++) {
+        uint8_t* parity = &keccak_parity[x * USIM_KECCAK_LANE_SIZE];
+        const uint8_t* lane = &usim_keccak_state[x * USIM_KECCAK_LANE_SIZE];
+
+        for(i = 0U; i < USIM_KECCAK_LANE_SIZE; i++) {
+            parity[i] = (uint8_t)(lane[i] ^ lane[i + 40U] ^ lane[i + 80U] ^ lane[i + 120U] ^ lane[i + 160U]);
+        }
+    }
+
+    for(x = 0U; x < 5U; x++) {
+        const uint8_t* left = &keccak_parity[((x + 4U) % 5U) * USIM_KECCAK_LANE_SIZE];
+        const uint8_t* right = &keccak_parity[((x + 1U) % 5U) * USIM_KECCAK_LANE_SIZE];
+        uint8_t* lane = &usim_keccak_state[x * USIM_KECCAK_LANE_SIZE];
+
+        // D[x] = C[x-1] ^ rot(C[x+1], 1)
+        for(i = 0U; i < USIM_KECCAK_LANE_SIZE; i++) {
+            d[i] = (uint8_t)(left[i] ^ (uint8_t)(right[i] << 1) ^ (right[(i - 1U) & 7U] >> 7));
+        }
+
+        for(i = 0U; i < USIM_KECCAK_LANE_SIZE; i++) {
+            lane[i] ^= d[i];
+            lane[i + 40U] ^= d[i];
+            lane[i + 80U] ^= d[i];
+            lane[i + 120U] ^= d[i];
+            lane[i + 160U] ^= d[i];
+        }
+    }
+}
+
+static void keccak_rho_pi(void) {
+    uint8_t carried[USIM_KECCAK_LANE_SIZE];
+    uint8_t saved[USIM_KECCAK_LANE_SIZE];
+    uint8_t i;
+
+    memcpy(carried, &usim_keccak_state[USIM_KECCAK_LANE_SIZE], USIM_KECCAK_LANE_SIZE);
+    for(i = 0U; i < 24U; i++) {
+        uint8_t* lane = &usim_keccak_state[keccak_pi_lane[i] * USIM_KECCAK_LANE_SIZE];
+
+        memcpy(saved, lane, USIM_KECCAK_LANE_SIZE);
+        keccak_rotate(lane, carried, keccak_rho_offset[i]);
+        memcpy(carried, saved, USIM_KECCAK_LANE_SIZE);
+    }
+}
+
+static void keccak_chi(void) {
+    uint8_t row[5];
+    uint8_t y;
+    uint8_t i;
+
+    for(y = 0U; y < USIM_KECCAK_STATE_SIZE; y = (uint8_t)(y + 40U)) {
+        for(i = 0U; i < USIM_KECCAK_LANE_SIZE; i++) {
+            uint8_t* plane = &usim_keccak_state[y + i];
+
+            row[0] = plane[0];
+            row[1] = plane[8];
+            row[2] = plane[16];
+            row[3] = plane[24];
+            row[4] = plane[32];
+            plane[0] = (uint8_t)(row[0] ^ (uint8_t)(~row[1] & row[2]));
+            plane[8] = (uint8_t)(row[1] ^ (uint8_t)(~row[2] & row[3]));
+            plane[16] = (uint8_t)(row[2] ^ (uint8_t)(~row[3] & row[4]));
+            plane[24] = (uint8_t)(row[3] ^ (uint8_t)(~row[4] & row[0]));
+            plane[32] = (uint8_t)(row[4] ^ (uint8_t)(~row[0] & row[1]));
+        }
+    }
+}
+
+// Aplicar la permutación completa (24 rondas) a usim_keccak_state
+void usim_keccak_permute(void) {
+    uint8_t round;
+    uint8_t i;
+
+    for(round = 0U; round < KECCAK_ROUNDS; round++) {
+        keccak_theta();
+        keccak_rho_pi();
+        keccak_chi();
+
+        // iota
+        for(i = 0U; i < USIM_KECCAK_LANE_SIZE; i++) {
+            usim_keccak_state[i] ^= keccak_round_constants[round * USIM_KECCAK_LANE_SIZE + i];
+        }
+    }
+}
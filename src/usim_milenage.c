@@ -0,0 +1,114 @@
+#include "usim_milenage.h"
+#include "usim_aes.h"
+#include <stddef.h>
+#include <string.h>
+
+// Rotaciones r1..r5 en bytes; las constantes c1..c5 solo difieren en el
+// último byte (TS 35.206 §4.1)
+#define MILENAGE_R1   8U
+#define MILENAGE_R2   0U
+#define MILENAGE_R3   4U
+#define MILENAGE_R4   8U
+#define MILENAGE_R5   12U
+#define MILENAGE_C2   0x01U
+#define MILENAGE_C3   0x02U
+#define MILENAGE_C4   0x04U
+#define MILENAGE_C5   0x08U
+
+// Contexto del RAND en curso: K, OPc y TEMP = E_K(RAND ^ OPc)
+static __xdata uint8_t milenage_k[USIM_AES_BLOCK_SIZE];
+static __xdata uint8_t milenage_opc[USIM_AES_BLOCK_SIZE];
+static __xdata uint8_t milenage_temp[USIM_AES_BLOCK_SIZE];
+
+// OUT = E_K(rot(TEMP ^ OPc, r) ^ c) ^ OPc
+static void milenage_out(uint8_t rotate, uint8_t constant, uint8_t* out) {
+    uint8_t i;
+
+    for(i = 0U; i < USIM_AES_BLOCK_SIZE; i++) {
+        uint8_t j = (uint8_t)((i + rotate) & (USIM_AES_BLOCK_SIZE - 1U));
+        out[i] = (uint8_t)(milenage_temp[j] ^ milenage_opc[j]);
+    }
+    out[USIM_AES_BLOCK_SIZE - 1U] ^= constant;
+
+    usim_aes_encrypt(milenage_k, out, out);
+    for(i = 0U; i < USIM_AES_BLOCK_SIZE; i++) {
+        out[i] ^= milenage_opc[i];
+    }
+}
+
+// OPc = E_K(OP) ^ OP (para personalizar a partir del OP del operador)
+void usim_milenage_opc(const uint8_t* k, const uint8_t* op, uint8_t* opc) {
+    uint8_t i;
+
+    usim_aes_encrypt(k, op, opc);
+    for(i = 0U; i < USIM_AES_BLOCK_SIZE; i++) {
+        opc[i] ^= op[i];
+    }
+}
+
+void usim_milenage_init(const uint8_t* k, const uint8_t* opc, const uint8_t* rand) {
+    uint8_t i;
+
+    memcpy(milenage_k, k, USIM_AES_BLOCK_SIZE);
+    memcpy(milenage_opc, opc, USIM_AES_BLOCK_SIZE);
+    for(i = 0U; i < USIM_AES_BLOCK_SIZE; i++) {
+        milenage_temp[i] = (uint8_t)(rand[i] ^ opc[i]);
+    }
+    usim_aes_encrypt(milenage_k, milenage_temp, milenage_temp);
+}
+
+// f1 (MAC-A) y f1* (MAC-S); cualquiera de las dos salidas puede ser NULL
+void usim_milenage_f1(const uint8_t* sqn, const uint8_t* amf, uint8_t* mac_a, uint8_t* mac_s) {
+    uint8_t in1[USIM_AES_BLOCK_SIZE];
+    uint8_t out[USIM_AES_BLOCK_SIZE];
+    uint8_t i;
+
+    memcpy(in1, sqn, USIM_MILENAGE_SQN_SIZE);
+    memcpy(&in1[6], amf, USIM_MILENAGE_AMF_SIZE);
+    memcpy(&in1[8], in1, 8U);
+
+    // TEMP ^ rot(IN1 ^ OPc, r1) ^ c1 (c1 es cero)
+    for(i = 0U; i < USIM_AES_BLOCK_SIZE; i++) {
+        uint8_t j = (uint8_t)((i + MILENAGE_R1) & (USIM_AES_BLOCK_SIZE - 1U));
+        out[i] = (uint8_t)(milenage_temp[i] ^ in1[j] ^ milenage_opc[j]);
+    }
+
+    usim_aes_encrypt(milenage_k, out, out);
+    for(i = 0U; i < USIM_AES_BLOCK_SIZE; i++) {
+        out[i] ^= milenage_opc[i];
+    }
+
+    if(mac_a != NULL) {
+        memcpy(mac_a, out, USIM_MILENAGE_MAC_SIZE);
+    }
+    if(mac_s != NULL) {
+        memcpy(mac_s, &out[8], USIM_MILENAGE_MAC_SIZE);
+    }
+}
+
+// f2 (RES), f3 (CK), f4 (IK) y f5 (AK)
+void usim_milenage_f2345(uint8_t* res, uint8_t* ck, uint8_t* ik, uint8_t* ak) {
+    uint8_t out[USIM_AES_BLOCK_SIZE];
+
+    milenage_out(MILENAGE_R2, MILENAGE_C2, out);
+    memcpy(ak, out, USIM_MILENAGE_AK_SIZE);
+    memcpy(res, &out[8], USIM_MILENAGE_RES_SIZE);
+
+    milenage_out(MILENAGE_R3, MILENAGE_C3, ck);
+    milenage_out(MILENAGE_R4, MILENAGE_C4, ik);
+}
+
+// f5* (AK para AUTS en la resincronización)
+void usim_milenage_f5star(uint8_t* ak_star) {
+    uint8_t out[USIM_AES_BLOCK_SIZE];
+
+    milenage_out(MILENAGE_R5, MILENAGE_C5, out);
+    memcpy(ak_star, out, USIM_MILENAGE_AK_SIZE);
+}
+
+// Borrar K, OPc y TEMP de XRAM al terminar la autenticación
+void usim_milenage_clear(void) {
+    memset(milenage_k, 0, sizeof(milenage_k));
+    memset(milenage_opc, 0, sizeof(milenage_opc));
+    memset(milenage_temp, 0, sizeof(milenage_temp));
+}
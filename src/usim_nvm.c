@@ -0,0 +1,521 @@
+#include "usim_nvm.h"
+#include "usim_files.h"
+#include "chip_specific.h"
+#include <string.h>
+
+#define NVM_MAGIC            0x4EU    /* 'N' */
+#define NVM_HEADER_SIZE      3U
+#define NVM_TYPE_COMMIT      0xC0U
+#define NVM_NO_RECORD        0U       /* El offset 0 es la cabecera de la página */
+#define NVM_CHUNK            16U
+#define NVM_CRC_INIT         0xFFFFU
+#define NVM_CRC_POLY         0x1021U
+
+// Unidad del anillo: la instantánea de todos los perfiles no cabe en un
+// sector de flash, así que cada página ocupa NVM_PAGE_SECTORS consecutivos
+#define NVM_PAGE_SECTORS     2U
+#define NVM_PAGE_SIZE        ((uint16_t)(NVM_PAGE_SECTORS * FLASH_SECTOR_SIZE))
+#define NVM_PAGE_COUNT       (NVM_SECTOR_COUNT / NVM_PAGE_SECTORS)
+
+// Peor caso de la instantánea: todos los objetos con su tamaño máximo. Solo
+// los buffers de EF cíclicos tienen registro de cyclic_head. Los perfiles
+// 1..n añaden sus buffers, CHV, SQN y secretos.
+#define NVM_SNAPSHOT_RECORDS (USIM_NVM_OBJECT_COUNT - USIM_BUFFER_COUNT + USIM_CYCLIC_BUFFER_COUNT)
+#define NVM_PROFILE_MAX      (USIM_PROFILE_DATA_SIZE + USIM_NVM_CHV_SIZE + USIM_NVM_SQN_SIZE + USIM_NVM_SECRETS_SIZE)
+#define NVM_SNAPSHOT_MAX     (NVM_HEADER_SIZE + USIM_DATA_POOL_SIZE + USIM_CYCLIC_BUFFER_COUNT + \
+                              USIM_NVM_CHV_SIZE + USIM_NVM_SQN_SIZE + USIM_NVM_SUCI_SIZE + USIM_NVM_SECRETS_SIZE + \
+                              USIM_NVM_PROFILE_SIZE + (USIM_PROFILE_COUNT - 1U) * NVM_PROFILE_MAX + \
+                              (NVM_SNAPSHOT_RECORDS + 1U) * USIM_NVM_RECORD_OVERHEAD)
+
+// La instantánea debe dejar sitio en la página para al menos una escritura
+typedef char nvm_snapshot_fits[(NVM_SNAPSHOT_MAX + 128U <= NVM_PAGE_SIZE) ? 1 : -1];
+typedef char nvm_objects_fit[(USIM_NVM_OBJECT_COUNT < NVM_TYPE_COMMIT) ? 1 : -1];
+typedef char nvm_pages_fit[(NVM_PAGE_COUNT >= 2U && NVM_PAGE_COUNT <= 8U &&
+                            NVM_PAGE_COUNT * NVM_PAGE_SECTORS == NVM_SECTOR_COUNT) ? 1 : -1];
+
+// Índice: offset del último registro confirmado de cada objeto en la página activa
+static __xdata uint16_t nvm_index[USIM_NVM_OBJECT_COUNT];
+static __xdata uint16_t nvm_sequence;
+static __xdata uint16_t nvm_write_offset;
+static __xdata uint8_t nvm_active;
+// false si tras el último registro confirmado hay restos (escritura cortada):
+// no se vuelve a programar ahí, la siguiente escritura compacta
+static bool nvm_tail_clean;
+
+// Transacción en curso: se aplica al índice al confirmar
+static __xdata uint8_t nvm_pending_object[USIM_NVM_MAX_PENDING];
+static __xdata uint16_t nvm_pending_offset[USIM_NVM_MAX_PENDING];
+static __xdata uint8_t nvm_pending_count;
+static bool nvm_in_transaction;
+
+// Grupo abierto: objetos anotados y su valor en XRAM (se lee al cerrar)
+static __xdata uint8_t nvm_staged_object[USIM_NVM_MAX_PENDING];
+static const uint8_t* __xdata nvm_staged_data[USIM_NVM_MAX_PENDING];
+static __xdata uint8_t nvm_staged_length[USIM_NVM_MAX_PENDING];
+static __xdata uint8_t nvm_staged_count;
+static bool nvm_group_open;
+static bool nvm_group_failed;   /* Algo no se pudo anotar: el grupo no se graba */
+
+// Perfil activo: decide a qué objeto real van los objetos de perfil
+static __xdata uint8_t nvm_profile;
+
+static uint32_t nvm_page_address(uint8_t page) {
+    return NVM_FLASH_BASE + (uint32_t)page * NVM_PAGE_SIZE;
+}
+
+// Identificador real de un objeto en el perfil activo: los del perfil 0 y
+// los compartidos son el nominal
+static uint8_t nvm_object(uint8_t object) {
+    uint8_t item;
+
+    if(nvm_profile == 0U) {
+        return object;
+    }
+
+    if(object < USIM_BUFFER_COUNT && usim_buffer_profile[object] != USIM_BUFFER_NO_PROFILE) {
+        item = usim_buffer_profile[object];
+    } else if(object == USIM_NVM_OBJ_CHV || object == USIM_NVM_OBJ_SQN) {
+        item = (uint8_t)(USIM_PROFILE_BUFFER_COUNT + (object - USIM_NVM_OBJ_CHV));
+    } else if(object == USIM_NVM_OBJ_SECRETS) {
+        item = (uint8_t)(USIM_PROFILE_BUFFER_COUNT + 2U);
+    } else {
+        return object;
+    }
+    return (uint8_t)(USIM_NVM_OBJ_SLOT_BASE + (uint8_t)(nvm_profile - 1U) * USIM_NVM_PROFILE_ITEMS + item);
+}
+
+// CRC-16/CCITT
+static uint16_t nvm_crc(uint16_t crc, const uint8_t* data, uint8_t length) {
+    uint8_t i;
+    uint8_t bit;
+
+    for(i = 0U; i < length; i++) {
+        crc ^= (uint16_t)data[i] << 8;
+        for(bit = 0U; bit < 8U; bit++) {
+            crc = ((crc & 0x8000U) != 0U) ? (uint16_t)((crc << 1) ^ NVM_CRC_POLY) : (uint16_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+// Comprobar un registro completo en flash (cabecera ya leída en "header")
+static bool nvm_record_valid(uint32_t address, uint16_t offset, const uint8_t* header) {
+    uint8_t chunk[NVM_CHUNK];
+    uint16_t crc;
+    uint8_t done;
+    uint8_t step;
+
+    if(header[0] == NVM_TYPE_COMMIT) {
+        if(header[1] != 0U) {
+            return false;
+        }
+    } else if(header[0] >= USIM_NVM_OBJECT_COUNT) {
+        return false;
+    }
+
+    if(offset + header[1] + USIM_NVM_RECORD_OVERHEAD > NVM_PAGE_SIZE) {
+        return false;
+    }
+
+    crc = nvm_crc(NVM_CRC_INIT, header, 2U);
+    for(done = 0U; done < header[1]; done = (uint8_t)(done + step)) {
+        step = (uint8_t)(header[1] - done);
+        if(step > NVM_CHUNK) {
+            step = NVM_CHUNK;
+        }
+        flash_read(address + 2U + done, chunk, step);
+        crc = nvm_crc(crc, chunk, step);
+    }
+
+    flash_read(address + 2U + header[1], chunk, 2U);
+    return chunk[0] == (uint8_t)(crc >> 8) && chunk[1] == (uint8_t)crc;
+}
+
+// Recorrer una página y reconstruir el índice. Devuelve false si no contiene
+// ninguna transacción confirmada (ni siquiera la instantánea).
+static bool nvm_scan(uint8_t page) {
+    uint32_t base = nvm_page_address(page);
+    uint16_t offset = NVM_HEADER_SIZE;
+    uint16_t committed_end = 0U;
+    uint8_t header[2];
+
+    nvm_tail_clean = true;
+
+    // Primera pasada: hasta dónde llegan los registros íntegros
+    while(offset + USIM_NVM_RECORD_OVERHEAD <= NVM_PAGE_SIZE) {
+        flash_read(base + offset, header, 2U);
+        if(header[0] == FLASH_ERASED_BYTE) {
+            break;
+        }
+
+        if(!nvm_record_valid(base + offset, offset, header)) {
+            nvm_tail_clean = false;
+            break;
+        }
+
+        offset = (uint16_t)(offset + header[1] + USIM_NVM_RECORD_OVERHEAD);
+        if(header[0] == NVM_TYPE_COMMIT) {
+            committed_end = offset;
+        }
+    }
+
+    // Lo que queda tras la última confirmación se descarta (rollback)
+    if(committed_end != offset) {
+        nvm_tail_clean = false;
+    }
+    nvm_write_offset = offset;
+
+    if(committed_end == 0U) {
+        return false;
+    }
+
+    // Segunda pasada: el último valor confirmado de cada objeto
+    memset(nvm_index, 0, sizeof(nvm_index));
+    for(offset = NVM_HEADER_SIZE; offset < committed_end;
+        offset = (uint16_t)(offset + header[1] + USIM_NVM_RECORD_OVERHEAD)) {
+        flash_read(base + offset, header, 2U);
+        if(header[0] != NVM_TYPE_COMMIT) {
+            nvm_index[header[0]] = offset;
+        }
+    }
+    return true;
+}
+
+// Programar un registro: cabecera, datos y por último el CRC
+static bool nvm_program_at(uint32_t address, uint8_t type, const uint8_t* data, uint8_t length) {
+    uint8_t header[2];
+    uint8_t trailer[2];
+    uint16_t crc;
+
+    header[0] = type;
+    header[1] = length;
+    crc = nvm_crc(nvm_crc(NVM_CRC_INIT, header, 2U), data, length);
+    trailer[0] = (uint8_t)(crc >> 8);
+    trailer[1] = (uint8_t)crc;
+
+    return flash_program(address, header, 2U) &&
+           flash_program(address + 2U, data, length) &&
+           flash_program(address + 2U + length, trailer, 2U);
+}
+
+// Añadir un registro al final de la página activa
+static bool nvm_program_record(uint8_t type, const uint8_t* data, uint8_t length) {
+    if(!nvm_program_at(nvm_page_address(nvm_active) + nvm_write_offset, type, data, length)) {
+        nvm_tail_clean = false;
+        return false;
+    }
+
+    nvm_write_offset = (uint16_t)(nvm_write_offset + length + USIM_NVM_RECORD_OVERHEAD);
+    return true;
+}
+
+// Pasar a la siguiente página del anillo con una instantánea de los objetos
+// vivos. La página anterior sigue siendo válida hasta que se confirma la
+// instantánea, y la siguiente en borrarse es siempre la más antigua. Si
+// falla, el estado en XRAM no cambia.
+static bool nvm_compact(void) {
+    uint8_t next = (uint8_t)((nvm_active + 1U) % NVM_PAGE_COUNT);
+    uint32_t from = nvm_page_address(nvm_active);
+    uint32_t to = nvm_page_address(next);
+    uint16_t offset = NVM_HEADER_SIZE;
+    uint8_t chunk[NVM_CHUNK];
+    uint8_t object;
+
+    for(object = 0U; object < NVM_PAGE_SECTORS; object++) {
+        if(!flash_erase_sector(to + (uint32_t)object * FLASH_SECTOR_SIZE)) {
+            return false;
+        }
+    }
+
+    chunk[0] = NVM_MAGIC;
+    chunk[1] = (uint8_t)(nvm_sequence + 1U);
+    chunk[2] = (uint8_t)((uint16_t)(nvm_sequence + 1U) >> 8);
+    if(!flash_program(to, chunk, NVM_HEADER_SIZE)) {
+        return false;
+    }
+
+    // Los registros se copian tal cual: el CRC no depende de su posición
+    for(object = 0U; object < USIM_NVM_OBJECT_COUNT; object++) {
+        uint16_t source = nvm_index[object];
+        uint16_t size;
+        uint16_t done;
+        uint8_t step;
+
+        if(source == NVM_NO_RECORD) {
+            continue;
+        }
+
+        flash_read(from + source + 1U, chunk, 1U);
+        size = (uint16_t)(chunk[0] + USIM_NVM_RECORD_OVERHEAD);
+        for(done = 0U; done < size; done = (uint16_t)(done + step)) {
+            step = NVM_CHUNK;
+            if((uint16_t)(size - done) < NVM_CHUNK) {
+                step = (uint8_t)(size - done);
+            }
+            flash_read(from + source + done, chunk, step);
+            if(!flash_program(to + offset + done, chunk, step)) {
+                return false;
+            }
+        }
+        offset = (uint16_t)(offset + size);
+    }
+
+    if(!nvm_program_at(to + offset, NVM_TYPE_COMMIT, NULL, 0U)) {
+        return false;
+    }
+
+    // Confirmada: el índice pasa a apuntar a las copias, en el mismo orden
+    offset = NVM_HEADER_SIZE;
+    for(object = 0U; object < USIM_NVM_OBJECT_COUNT; object++) {
+        if(nvm_index[object] != NVM_NO_RECORD) {
+            flash_read(from + nvm_index[object] + 1U, chunk, 1U);
+            nvm_index[object] = offset;
+            offset = (uint16_t)(offset + chunk[0] + USIM_NVM_RECORD_OVERHEAD);
+        }
+    }
+
+    nvm_active = next;
+    nvm_sequence++;
+    nvm_write_offset = (uint16_t)(offset + USIM_NVM_RECORD_OVERHEAD);
+    nvm_tail_clean = true;
+    USIM_LOG_STRING("NVM: page switched\r\n");
+    return true;
+}
+
+// Montar el diario: se usa la página con la secuencia más alta que tenga la
+// instantánea confirmada. Solo se recorre esa página.
+void usim_nvm_mount(void) {
+    uint16_t sequence[NVM_PAGE_COUNT];
+    uint8_t candidates = 0U;     /* Un bit por página con cabecera válida */
+    uint8_t header[NVM_HEADER_SIZE];
+    uint8_t page;
+
+    nvm_in_transaction = false;
+    nvm_group_open = false;
+    nvm_profile = 0U;
+
+    for(page = 0U; page < NVM_PAGE_COUNT; page++) {
+        flash_read(nvm_page_address(page), header, NVM_HEADER_SIZE);
+        if(header[0] == NVM_MAGIC) {
+            candidates |= (uint8_t)(1U << page);
+        }
+        sequence[page] = (uint16_t)(header[1] | ((uint16_t)header[2] << 8));
+    }
+
+    while(candidates != 0U) {
+        uint8_t best = NVM_PAGE_COUNT;
+
+        for(page = 0U; page < NVM_PAGE_COUNT; page++) {
+            if((candidates & (1U << page)) != 0U &&
+               (best == NVM_PAGE_COUNT || (int16_t)(sequence[page] - sequence[best]) > 0)) {
+                best = page;
+            }
+        }
+
+        if(nvm_scan(best)) {
+            nvm_active = best;
+            nvm_sequence = sequence[best];
+            return;
+        }
+        candidates &= (uint8_t)~(1U << best);
+    }
+
+    // Flash sin formatear: la primera instantánea (vacía) va a la página 0
+    USIM_LOG_STRING("NVM: formatting\r\n");
+    memset(nvm_index, 0, sizeof(nvm_index));
+    nvm_active = (uint8_t)(NVM_PAGE_COUNT - 1U);
+    nvm_sequence = 0U;
+    nvm_write_offset = NVM_PAGE_SIZE;
+    nvm_tail_clean = false;
+    if(!nvm_compact()) {
+        // Sin almacenamiento: las escrituras fallarán con SW_MEMORY_PROBLEM
+        USIM_LOG_STRING("NVM: format failed\r\n");
+    }
+}
+
+// Longitud del valor confirmado de un objeto, 0 si no se ha guardado nunca
+uint8_t usim_nvm_length(uint8_t object) {
+    uint8_t length;
+
+    object = nvm_object(object);
+    if(object >= USIM_NVM_OBJECT_COUNT || nvm_index[object] == NVM_NO_RECORD) {
+        return 0U;
+    }
+
+    flash_read(nvm_page_address(nvm_active) + nvm_index[object] + 1U, &length, 1U);
+    return length;
+}
+
+// Leer parte del valor confirmado de un objeto
+void usim_nvm_read(uint8_t object, uint8_t offset, uint8_t* data, uint8_t length) {
+    flash_read(nvm_page_address(nvm_active) + nvm_index[nvm_object(object)] + 2U + offset, data, length);
+}
+
+// Empezar una transacción de "records" registros con "payload" bytes de
+// datos en total. Compacta antes si no cabe en la página activa.
+bool usim_nvm_begin(uint16_t payload, uint8_t records) {
+    uint16_t needed = (uint16_t)(payload + (uint16_t)(records + 1U) * USIM_NVM_RECORD_OVERHEAD);
+
+    if(nvm_in_transaction || records > USIM_NVM_MAX_PENDING) {
+        return false;
+    }
+
+    if(!nvm_tail_clean || needed > (uint16_t)(NVM_PAGE_SIZE - nvm_write_offset)) {
+        if(!nvm_compact() || needed > (uint16_t)(NVM_PAGE_SIZE - nvm_write_offset)) {
+            return false;
+        }
+    }
+
+    nvm_pending_count = 0U;
+    nvm_in_transaction = true;
+    return true;
+}
+
+// Añadir a la transacción en curso el nuevo valor de un objeto real
+static bool nvm_put(uint8_t object, const uint8_t* data, uint8_t length) {
+    uint16_t offset = nvm_write_offset;
+
+    if(!nvm_in_transaction || object >= USIM_NVM_OBJECT_COUNT || nvm_pending_count == USIM_NVM_MAX_PENDING ||
+       (uint16_t)(offset + length + 2U * USIM_NVM_RECORD_OVERHEAD) > NVM_PAGE_SIZE) {
+        nvm_in_transaction = false;
+        nvm_tail_clean = false;
+        return false;
+    }
+
+    if(!nvm_program_record(object, data, length)) {
+        nvm_in_transaction = false;
+        return false;
+    }
+
+    nvm_pending_object[nvm_pending_count] = object;
+    nvm_pending_offset[nvm_pending_count] = offset;
+    nvm_pending_count++;
+    return true;
+}
+
+bool usim_nvm_put(uint8_t object, const uint8_t* data, uint8_t length) {
+    return nvm_put(nvm_object(object), data, length);
+}
+
+// Confirmar la transacción: a partir de aquí sobrevive a un corte
+bool usim_nvm_commit(void) {
+    uint8_t i;
+
+    if(!nvm_in_transaction) {
+        return false;
+    }
+    nvm_in_transaction = false;
+
+    if(!nvm_program_record(NVM_TYPE_COMMIT, NULL, 0U)) {
+        return false;
+    }
+
+    for(i = 0U; i < nvm_pending_count; i++) {
+        nvm_index[nvm_pending_object[i]] = nvm_pending_offset[i];
+    }
+    nvm_pending_count = 0U;
+    return true;
+}
+
+// Escritura atómica de un solo objeto
+bool usim_nvm_write(uint8_t object, const uint8_t* data, uint8_t length) {
+    return usim_nvm_begin(length, 1U) &&
+           usim_nvm_put(object, data, length) &&
+           usim_nvm_commit();
+}
+
+// Abrir un grupo; no se admiten grupos anidados
+bool usim_nvm_group_begin(void) {
+    if(nvm_group_open) {
+        return false;
+    }
+
+    nvm_staged_count = 0U;
+    nvm_group_open = true;
+    nvm_group_failed = false;
+    return true;
+}
+
+bool usim_nvm_group_active(void) {
+    return nvm_group_open;
+}
+
+// Anotar el valor de un objeto dentro del grupo. "data" debe seguir siendo
+// válido hasta cerrarlo; anotar de nuevo un objeto sustituye la entrada.
+bool usim_nvm_stage(uint8_t object, const uint8_t* data, uint8_t length) {
+    uint8_t i;
+
+    object = nvm_object(object);
+    if(!nvm_group_open || object >= USIM_NVM_OBJECT_COUNT) {
+        return false;
+    }
+
+    for(i = 0U; i < nvm_staged_count; i++) {
+        if(nvm_staged_object[i] == object) {
+            break;
+        }
+    }
+
+    if(i == USIM_NVM_MAX_PENDING) {
+        USIM_LOG_STRING("NVM: too many staged objects\r\n");
+        nvm_group_failed = true;
+        return false;
+    }
+    if(i == nvm_staged_count) {
+        nvm_staged_count++;
+    }
+
+    nvm_staged_object[i] = object;
+    nvm_staged_data[i] = data;
+    nvm_staged_length[i] = length;
+    return true;
+}
+
+// Cerrar el grupo grabando todo lo anotado en una sola transacción: tras un
+// corte queda o todo o nada. El grupo se cierra aunque falle.
+bool usim_nvm_group_commit(void) {
+    uint16_t payload = 0U;
+    uint8_t i;
+
+    if(!nvm_group_open) {
+        return false;
+    }
+    nvm_group_open = false;
+
+    if(nvm_group_failed) {
+        return false;
+    }
+    if(nvm_staged_count == 0U) {
+        return true;
+    }
+
+    for(i = 0U; i < nvm_staged_count; i++) {
+        payload = (uint16_t)(payload + nvm_staged_length[i]);
+    }
+
+    if(!usim_nvm_begin(payload, nvm_staged_count)) {
+        return false;
+    }
+    for(i = 0U; i < nvm_staged_count; i++) {
+        if(!nvm_put(nvm_staged_object[i], nvm_staged_data[i], nvm_staged_length[i])) {
+            return false;
+        }
+    }
+    return usim_nvm_commit();
+}
+
+// Cerrar el grupo sin grabar nada
+void usim_nvm_group_discard(void) {
+    nvm_group_open = false;
+    nvm_staged_count = 0U;
+}
+
+// Cambiar el perfil activo: solo el índice, sin copiar datos. Lo anotado en
+// un grupo abierto seguiría yendo al perfil anterior; el llamante lo evita.
+void usim_nvm_set_profile(uint8_t profile) {
+    nvm_profile = profile;
+}
+
+uint8_t usim_nvm_profile(void) {
+    return nvm_profile;
+}
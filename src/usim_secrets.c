@@ -0,0 +1,126 @@
+#include "usim_secrets.h"
+#include "usim_app.h"
+#include "usim_nvm.h"
+#include "usim_aes.h"
+#include "usim_milenage.h"
+#include "chip_specific.h"
+#include <string.h>
+
+// La imagen en NVM y la de fábrica tienen el mismo formato que la de sesión
+typedef char usim_secrets_layout[(USIM_SECRET_INIT_SIZE == USIM_SECRETS_SIZE &&
+                                  USIM_NVM_SECRETS_SIZE == USIM_SECRETS_SIZE &&
+                                  USIM_SECRET_TOPC + 32U == USIM_SECRETS_SIZE) ? 1 : -1];
+// ICCID | IMSI | 80 cabe en los dos bloques de la derivación
+typedef char usim_batch_layout[(USIM_BATCH_INIT_SIZE == (USIM_BATCH_OP_COUNT + 1U) * USIM_AES_BLOCK_SIZE &&
+                                USIM_ICCID_SIZE + USIM_IMSI_SIZE < 2U * USIM_AES_BLOCK_SIZE) ? 1 : -1];
+
+// Imagen de sesión, enmascarada con xor_key. Es además el valor que se
+// entrega a usim_nvm_stage(): debe seguir viva hasta confirmar el grupo.
+static __xdata uint8_t usim_secrets[USIM_SECRETS_SIZE];
+
+void usim_secrets_wipe(void) {
+    memset(usim_secrets, 0, sizeof(usim_secrets));
+}
+
+// Tras cada reset y al deshacer una transacción de personalización
+void usim_secrets_load(void) {
+    usim_secrets_wipe();
+    if(usim_nvm_length(USIM_NVM_OBJ_SECRETS) == USIM_NVM_SECRETS_SIZE) {
+        usim_nvm_read(USIM_NVM_OBJ_SECRETS, 0U, usim_secrets, USIM_NVM_SECRETS_SIZE);
+    } else {
+        memcpy(usim_secrets, usim_secret_init, USIM_SECRETS_SIZE);
+    }
+}
+
+uint8_t usim_secret_size(uint8_t id) {
+    return (id == USIM_SECRET_TOPC) ? 32U : USIM_SECRET_KEY_SIZE;
+}
+
+// Copia desenmascarada: el llamante la borra en cuanto deja de usarla. Los
+// secretos empiezan en múltiplos de 16, así el índice de xor_key es i & 15.
+void usim_secret_get(uint8_t id, uint8_t* output) {
+    const __xdata uint8_t* stored = &usim_secrets[id];
+    uint8_t size = usim_secret_size(id);
+    uint8_t i;
+
+    for(i = 0U; i < size; i++) {
+        output[i] = stored[i] ^ xor_key[i & 15U];
+    }
+}
+
+// Sustituir un secreto: se graba la imagen completa, dentro de la
+// transacción de personalización si hay una abierta
+bool usim_secret_set(uint8_t id, const uint8_t* data) {
+    __xdata uint8_t* stored = &usim_secrets[id];
+    uint8_t size = usim_secret_size(id);
+    uint8_t i;
+    bool persisted;
+
+    for(i = 0U; i < size; i++) {
+        stored[i] = data[i] ^ xor_key[i & 15U];
+    }
+
+    if(usim_nvm_group_active()) {
+        persisted = usim_nvm_stage(USIM_NVM_OBJ_SECRETS, usim_secrets, USIM_SECRETS_SIZE);
+    } else {
+        persisted = usim_nvm_write(USIM_NVM_OBJ_SECRETS, usim_secrets, USIM_SECRETS_SIZE);
+    }
+
+    if(!persisted) {
+        USIM_LOG_STRING("NVM: secrets not persisted\r\n");
+        usim_secrets_load();
+        return false;
+    }
+    return true;
+}
+
+// Copia desenmascarada de la entrada "index" de usim_batch_init (0 es la
+// clave maestra, 1..n los OP)
+static void usim_batch_get(uint8_t index, uint8_t* output) {
+    const __code uint8_t* stored = &usim_batch_init[(uint16_t)index * USIM_AES_BLOCK_SIZE];
+    uint8_t i;
+
+    for(i = 0U; i < USIM_AES_BLOCK_SIZE; i++) {
+        output[i] = stored[i] ^ xor_key[i];
+    }
+}
+
+// K = AES-CBC-MAC(maestra, ICCID | IMSI | 80 00..00), dos bloques de
+// entrada de longitud fija, y OPc = AES_K(OP) ^ OP con el OP elegido.
+// scripts/diversify.py calcula lo mismo para el núcleo de red.
+bool usim_secrets_diversify(const uint8_t* iccid, const uint8_t* imsi, uint8_t op_index) {
+    uint8_t master[USIM_AES_BLOCK_SIZE];
+    uint8_t block[USIM_AES_BLOCK_SIZE];
+    uint8_t k[USIM_AES_BLOCK_SIZE];
+    uint8_t opc[USIM_AES_BLOCK_SIZE];
+    uint8_t tail = (uint8_t)(USIM_ICCID_SIZE + USIM_IMSI_SIZE - USIM_AES_BLOCK_SIZE);
+    uint8_t i;
+    bool stored = false;
+
+    if(op_index < USIM_BATCH_OP_COUNT) {
+        usim_batch_get(0U, master);
+
+        memcpy(block, iccid, USIM_ICCID_SIZE);
+        memcpy(&block[USIM_ICCID_SIZE], imsi, USIM_AES_BLOCK_SIZE - USIM_ICCID_SIZE);
+        usim_aes_encrypt(master, block, opc);
+
+        memset(block, 0, sizeof(block));
+        memcpy(block, &imsi[USIM_IMSI_SIZE - tail], tail);
+        block[tail] = 0x80U;
+        for(i = 0U; i < USIM_AES_BLOCK_SIZE; i++) {
+            block[i] ^= opc[i];
+        }
+        usim_aes_encrypt(master, block, k);
+
+        usim_batch_get((uint8_t)(op_index + 1U), block);
+        usim_milenage_opc(k, block, opc);
+
+        stored = usim_secret_set(USIM_SECRET_K, k) && usim_secret_set(USIM_SECRET_OPC, opc);
+    }
+
+    memset(master, 0, sizeof(master));
+    memset(block, 0, sizeof(block));
+    memset(k, 0, sizeof(k));
+    memset(opc, 0, sizeof(opc));
+    return stored;
+}
@@ -0,0 +1,136 @@
+#include "usim_sha256.h"
+#include <string.h>
+
+// SHA-256 con la planificación de mensaje en un búfer circular de 16
+// palabras (el propio bloque) y las variables a..h rotando por índice en
+// lugar de desplazarlas en cada ronda.
+#define SHA256_ROUNDS  64U
+
+static const __code uint32_t sha256_k[SHA256_ROUNDS] = {
+    0x428A2F98UL, 0x71374491UL, 0xB5C0FBCFUL, 0xE9B5DBA5UL, 0x3956C25BUL, 0x59F111F1UL, 0x923F82A4UL, 0xAB1C5ED5UL,
+    0xD807AA98UL, 0x12835B01UL, 0x243185BEUL, 0x550C7DC3UL, 0x72BE5D74UL, 0x80DEB1FEUL, 0x9BDC06A7UL, 0xC19BF174UL,
+    0xE49B69C1UL, 0xEFBE4786UL, 0x0FC19DC6UL, 0x240CA1CCUL, 0x2DE92C6FUL, 0x4A7484AAUL, 0x5CB0A9DCUL, 0x76F988DAUL,
+    0x983E5152UL, 0xA831C66DUL, 0xB00327C8UL, 0xBF597FC7UL, 0xC6E00BF3UL, 0xD5A79147UL, 0x06CA6351UL, 0x14292967UL,
+    0x27B70A85UL, 0x2E1B2138UL, 0x4D2C6DFCUL, 0x53380D13UL, 0x650A7354UL, 0x766A0ABBUL, 0x81C2C92EUL, 0x92722C85UL,
+    0xA2BFE8A1UL, 0xA81A664BUL, 0xC24B8B70UL, 0xC76C51A3UL, 0xD192E819UL, 0xD6990624UL, 0xF40E3585UL, 0x106AA070UL,
+    0x19A4C116UL, 0x1E376C08UL, 0x2748774CUL, 0x34B0BCB5UL, 0x391C0CB3UL, 0x4ED8AA4AUL, 0x5B9CCA4FUL, 0x682E6FF3UL,
+    0x748F82EEUL, 0x78A5636FUL, 0x84C87814UL, 0x8CC70208UL, 0x90BEFFFAUL, 0xA4506CEBUL, 0xBEF9A3F7UL, 0xC67178F2UL
+};
+
+static const __code uint32_t sha256_iv[8] = {
+    0x6A09E667UL, 0xBB67AE85UL, 0x3C6EF372UL, 0xA54FF53AUL,
+    0x510E527FUL, 0x9B05688CUL, 0x1F83D9ABUL, 0x5BE0CD19UL
+};
+
+#define ROTR(x, n)  (((x) >> (n)) | ((x) << (32U - (n))))
+
+// Variable lógica j (0 = a ... 7 = h) en la ronda "round"
+#define SHA256_VAR(ctx, j, round)  ((ctx)->work[(uint8_t)((j) - (round)) & 7U])
+
+static void sha256_compress(usim_sha256_ctx_t* ctx) {
+    uint8_t round;
+
+    memcpy(ctx->work, ctx->state, sizeof(ctx->work));
+
+    for(round = 0U; round < SHA256_ROUNDS; round++) {
+        uint32_t a = SHA256_VAR(ctx, 0U, round);
+        uint32_t e = SHA256_VAR(ctx, 4U, round);
+        uint32_t t1;
+        uint32_t t2;
+
+        if(round >= 16U) {
+            uint32_t w2 = ctx->w[(uint8_t)(round - 2U) & 15U];
+            uint32_t w15 = ctx->w[(uint8_t)(round - 15U) & 15U];
+
+            ctx->w[round & 15U] += (ROTR(w2, 17U) ^ ROTR(w2, 19U) ^ (w2 >> 10)) +
+                                   ctx->w[(uint8_t)(round - 7U) & 15U] +
+                                   (ROTR(w15, 7U) ^ ROTR(w15, 18U) ^ (w15 >> 3));
+        }
+
+        t1 = SHA256_VAR(ctx, 7U, round) + (ROTR(e, 6U) ^ ROTR(e, 11U) ^ ROTR(e, 25U)) +
+             ((e & SHA256_VAR(ctx, 5U, round)) ^ (~e & SHA256_VAR(ctx, 6U, round))) +
+             sha256_k[round] + ctx->w[round & 15U];
+        t2 = (ROTR(a, 2U) ^ ROTR(a, 13U) ^ ROTR(a, 22U)) +
+             ((a & SHA256_VAR(ctx, 1U, round)) ^ (a & SHA256_VAR(ctx, 2U, round)) ^
+              (SHA256_VAR(ctx, 1U, round) & SHA256_VAR(ctx, 2U, round)));
+
+        // d pasa a ser e y h el nuevo a de la ronda siguiente
+        SHA256_VAR(ctx, 3U, round) += t1;
+        SHA256_VAR(ctx, 7U, round) = t1 + t2;
+    }
+
+    // Tras 64 rondas los índices vuelven a su posición inicial
+    for(round = 0U; round < 8U; round++) {
+        ctx->state[round] += ctx->work[round];
+    }
+}
+
+static void sha256_byte(usim_sha256_ctx_t* ctx, uint8_t value) {
+    uint8_t offset = (uint8_t)(ctx->length & (USIM_SHA256_BLOCK_SIZE - 1U));
+    uint8_t shift = (uint8_t)(24U - ((offset & 3U) << 3));
+
+    if((offset & 3U) == 0U) {
+        ctx->w[offset >> 2] = (uint32_t)value << 24;
+    } else {
+        ctx->w[offset >> 2] |= (uint32_t)value << shift;
+    }
+    ctx->length++;
+    if(offset == USIM_SHA256_BLOCK_SIZE - 1U) {
+        sha256_compress(ctx);
+    }
+}
+
+void usim_sha256_init(usim_sha256_ctx_t* ctx) {
+    memcpy(ctx->state, sha256_iv, sizeof(ctx->state));
+    ctx->length = 0U;
+}
+
+void usim_sha256_update(usim_sha256_ctx_t* ctx, const uint8_t* data, uint16_t length) {
+    while(length-- > 0U) {
+        sha256_byte(ctx, *data++);
+    }
+}
+
+void usim_sha256_final(usim_sha256_ctx_t* ctx, uint8_t* digest) {
+    uint16_t bits_high = (uint16_t)(ctx->length >> 13);
+    uint16_t bits_low = (uint16_t)(ctx->length << 3);
+    uint8_t i;
+
+    sha256_byte(ctx, 0x80U);
+    while((ctx->length & (USIM_SHA256_BLOCK_SIZE - 1U)) != USIM_SHA256_BLOCK_SIZE - 8U) {
+        sha256_byte(ctx, 0x00U);
+    }
+    for(i = 0U; i < 4U; i++) {
+        sha256_byte(ctx, 0x00U);
+    }
+    sha256_byte(ctx, (uint8_t)(bits_high >> 8));
+    sha256_byte(ctx, (uint8_t)bits_high);
+    sha256_byte(ctx, (uint8_t)(bits_low >> 8));
+    sha256_byte(ctx, (uint8_t)bits_low);
+
+    for(i = 0U; i < USIM_SHA256_DIGEST_SIZE; i++) {
+        digest[i] = (uint8_t)(ctx->state[i >> 2] >> (24U - ((i & 3U) << 3)));
+    }
+}
+
+// Bloque de clave de HMAC: K (<= 64 bytes) completada con ceros, XOR pad
+static void hmac_key_block(usim_sha256_ctx_t* ctx, const uint8_t* key, uint8_t key_length, uint8_t pad) {
+    uint8_t i;
+
+    usim_sha256_init(ctx);
+    for(i = 0U; i < USIM_SHA256_BLOCK_SIZE; i++) {
+        sha256_byte(ctx, (uint8_t)(((i < key_length) ? key[i] : 0U) ^ pad));
+    }
+}
+
+// "mac" recibe los 32 bytes completos y sirve antes para el hash interno
+void usim_hmac_sha256(usim_sha256_ctx_t* ctx, const uint8_t* key, uint8_t key_length,
+                      const uint8_t* data, uint16_t length, uint8_t* mac) {
+    hmac_key_block(ctx, key, key_length, 0x36U);
+    usim_sha256_update(ctx, data, length);
+    usim_sha256_final(ctx, mac);
+
+    hmac_key_block(ctx, key, key_length, 0x5CU);
+    usim_sha256_update(ctx, mac, USIM_SHA256_DIGEST_SIZE);
+    usim_sha256_final(ctx, mac);
+}
@@ -0,0 +1,298 @@
+#include "usim_suci.h"
+#include "usim_files.h"
+#include "usim_app.h"
+#include "chip_specific.h"
+#include "usim_nvm.h"
+#include "usim_aes.h"
+#include "usim_keccak.h"
+#include "usim_sha256.h"
+#include "usim_x25519.h"
+#include "usim_secrets.h"
+#include "apdu_handler.h"
+#include <string.h>
+
+// Valor del SUCI de TS 24.501 §9.11.3.4 (sin IEI ni longitud): tipo, PLMN,
+// routing indicator, esquema, identificador de clave y la salida del
+// esquema. Para el perfil A la salida es la clave pública efímera, el MSIN
+// cifrado y el MAC.
+#define SUCI_OFFSET_TYPE        0U
+#define SUCI_OFFSET_PLMN        1U
+#define SUCI_OFFSET_ROUTING     4U
+#define SUCI_OFFSET_SCHEME      6U
+#define SUCI_OFFSET_KEY_ID      7U
+#define SUCI_OFFSET_OUTPUT      8U
+#define SUCI_OFFSET_CIPHER      (SUCI_OFFSET_OUTPUT + USIM_X25519_SIZE)
+#define SUCI_TYPE_IMSI          0x01U   /* Formato SUPI IMSI, identidad SUCI */
+
+// Espacio de trabajo tras la respuesta (que ocupa como mucho 56 bytes)
+#define SUCI_WS_SCALAR          64U     /* Escalar efímero */
+#define SUCI_WS_SHARED          96U     /* Secreto compartido Z */
+#define SUCI_WS_ENC_KEY         128U    /* Salida del KDF: clave AES */
+#define SUCI_WS_ICB             144U    /*   bloque contador inicial */
+#define SUCI_WS_MAC_KEY         160U    /*   clave de HMAC (32 bytes) */
+#define SUCI_WS_BLOCK           192U    /* Bloque AES / salida de HMAC */
+#define SUCI_WS_KEY             224U    /* K del suscriptor */
+#define SUCI_KDF_SIZE           64U
+
+// EF_SUCI_Calc_Info (TS 31.102 §4.4.11.8)
+#define SUCI_TAG_SCHEME_LIST    0xA0U
+#define SUCI_TAG_KEY_LIST       0xA1U
+#define SUCI_TAG_KEY_ID         0x80U
+#define SUCI_TAG_KEY            0x81U
+#define SUCI_TAG_PADDING        0xFFU
+
+#define SUCI_FID_CALC_INFO      0x4F07U
+#define SUCI_FID_ROUTING        0x4F0AU
+
+// IMSI de hasta 15 dígitos: MSIN de hasta 10, 5 bytes BCD
+#define SUCI_MSIN_MAX           5U
+
+typedef char suci_workspace_fits[(USIM_SUCI_WORKSPACE_SIZE <= USIM_APDU_RESPONSE_DATA_MAX &&
+                                  SUCI_WS_KEY + USIM_SECRET_KEY_SIZE <= USIM_SUCI_WORKSPACE_SIZE) ? 1 : -1];
+typedef char suci_output_fits[(SUCI_OFFSET_CIPHER + SUCI_MSIN_MAX + USIM_SUCI_MAC_SIZE <= SUCI_WS_SCALAR) ? 1 : -1];
+typedef char suci_sha_fits[(sizeof(usim_sha256_ctx_t) <= USIM_KECCAK_STATE_SIZE) ? 1 : -1];
+
+// Dominio del escalar efímero: AES_K("SUCI" | contador | 0... | índice)
+static const __code uint8_t suci_domain[4] = { 'S', 'U', 'C', 'I' };
+
+// Dígito n del IMSI de EF_IMSI (TS 31.102 §4.2.2): el primero en el nibble
+// alto del byte 1, los demás alternando nibble bajo y alto
+static uint8_t suci_imsi_digit(const uint8_t* imsi, uint8_t index) {
+    uint8_t value = imsi[1U + (uint8_t)((index + 1U) >> 1)];
+
+    return (uint8_t)(((index & 1U) != 0U) ? (value & 0x0FU) : (value >> 4));
+}
+
+// Busca "tag" entre los TLV de data (longitudes de un byte) y devuelve su
+// valor, o NULL
+static const uint8_t* suci_find_tlv(const uint8_t* data, uint8_t size, uint8_t tag, uint8_t* length) {
+    uint8_t offset = 0U;
+
+    while((uint16_t)(offset + 2U) <= size && data[offset] != SUCI_TAG_PADDING) {
+        uint8_t item = data[offset + 1U];
+
+        if(item >= 0x80U || (uint16_t)(offset + 2U + item) > size) {
+            break;
+        }
+        if(data[offset] == tag) {
+            *length = item;
+            return &data[offset + 2U];
+        }
+        offset = (uint8_t)(offset + 2U + item);
+    }
+    return NULL;
+}
+
+// Clave pública número "index" (desde 1) de la lista A1 con su identificador
+static const uint8_t* suci_find_key(const uint8_t* list, uint8_t size, uint8_t index, uint8_t* key_id) {
+    uint8_t offset = 0U;
+    uint8_t position = 0U;
+
+    while((uint16_t)(offset + 2U) <= size) {
+        uint8_t tag = list[offset];
+        uint8_t item = list[offset + 1U];
+
+        if((uint16_t)(offset + 2U + item) > size) {
+            break;
+        }
+        if(tag == SUCI_TAG_KEY_ID && item == 1U) {
+            position++;
+            *key_id = list[offset + 2U];
+        } else if(tag == SUCI_TAG_KEY && position == index && item == USIM_X25519_SIZE) {
+            return &list[offset + 2U];
+        }
+        offset = (uint8_t)(offset + 2U + item);
+    }
+    return NULL;
+}
+
+// Primer esquema de la lista de prioridades que la tarjeta sabe calcular
+static bool suci_select_scheme(uint8_t* scheme, uint8_t* key_id, const uint8_t** public_key) {
+    uint8_t file = usim_find_file_index(SUCI_FID_CALC_INFO);
+    const uint8_t* info = usim_file_data(file);
+    const uint8_t* schemes;
+    const uint8_t* keys;
+    uint8_t schemes_len = 0U;
+    uint8_t keys_len = 0U;
+    uint8_t i;
+
+    if(info == NULL) {
+        return false;
+    }
+    schemes = suci_find_tlv(info, (uint8_t)usim_file_size[file], SUCI_TAG_SCHEME_LIST, &schemes_len);
+    keys = suci_find_tlv(info, (uint8_t)usim_file_size[file], SUCI_TAG_KEY_LIST, &keys_len);
+    if(schemes == NULL) {
+        return false;
+    }
+
+    for(i = 0U; (uint16_t)(i + 2U) <= schemes_len; i += 2U) {
+        if(schemes[i] == USIM_SUCI_SCHEME_NULL) {
+            *scheme = USIM_SUCI_SCHEME_NULL;
+            *key_id = 0U;
+            return true;
+        }
+        if(schemes[i] == USIM_SUCI_SCHEME_PROFILE_A && keys != NULL && schemes[i + 1U] != 0U) {
+            *public_key = suci_find_key(keys, keys_len, schemes[i + 1U], key_id);
+            if(*public_key != NULL) {
+                *scheme = USIM_SUCI_SCHEME_PROFILE_A;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// Cabecera del SUCI y MSIN en BCD (nibble bajo primero, relleno F) en
+// "msin". Devuelve la longitud del MSIN en bytes, 0 si el IMSI no vale.
+static uint8_t suci_encode_identity(uint8_t* output, uint8_t* msin) {
+    const uint8_t* imsi = usim_file_data(usim_find_file_index(0x6F07));
+    uint8_t ad_file = usim_find_file_index(0x6FAD);
+    const uint8_t* ad = usim_file_data(ad_file);
+    const uint8_t* routing = usim_file_data(usim_find_file_index(SUCI_FID_ROUTING));
+    uint8_t mnc_len = 2U;
+    uint8_t digits;
+    uint8_t length = 0U;
+    uint8_t i;
+
+    if(imsi == NULL || imsi[0] == 0U || imsi[0] > 8U) {
+        return 0U;
+    }
+    digits = (uint8_t)(2U * imsi[0] - (((imsi[1] & 0x08U) != 0U) ? 1U : 2U));
+
+    // Longitud del MNC en el cuarto byte de EF_AD, si lo tiene
+    if(ad != NULL && usim_file_size[ad_file] >= 4U && (ad[3] & 0x0FU) == 3U) {
+        mnc_len = 3U;
+    }
+    if(digits <= (uint8_t)(3U + mnc_len) ||
+       (uint8_t)(digits - 3U - mnc_len) > 2U * SUCI_MSIN_MAX) {
+        return 0U;
+    }
+
+    output[SUCI_OFFSET_TYPE] = SUCI_TYPE_IMSI;
+    output[SUCI_OFFSET_PLMN] = (uint8_t)((suci_imsi_digit(imsi, 1U) << 4) | suci_imsi_digit(imsi, 0U));
+    output[SUCI_OFFSET_PLMN + 1U] = (uint8_t)(((mnc_len == 3U) ? (uint8_t)(suci_imsi_digit(imsi, 5U) << 4) : 0xF0U) |
+                                              suci_imsi_digit(imsi, 2U));
+    output[SUCI_OFFSET_PLMN + 2U] = (uint8_t)((suci_imsi_digit(imsi, 4U) << 4) | suci_imsi_digit(imsi, 3U));
+
+    // Sin EF_Routing_Indicator el valor por defecto es "0"
+    output[SUCI_OFFSET_ROUTING] = (routing != NULL) ? routing[0] : 0xF0U;
+    output[SUCI_OFFSET_ROUTING + 1U] = (routing != NULL) ? routing[1] : 0xFFU;
+
+    for(i = (uint8_t)(3U + mnc_len); i < digits; i++) {
+        if(((i - 3U - mnc_len) & 1U) == 0U) {
+            msin[length++] = (uint8_t)(0xF0U | suci_imsi_digit(imsi, i));
+        } else {
+            msin[length - 1U] = (uint8_t)((msin[length - 1U] & 0x0FU) | (suci_imsi_digit(imsi, i) << 4));
+        }
+    }
+    return length;
+}
+
+// Escalar efímero a partir de K y un contador en NVM que se incrementa y se
+// graba antes de usarlo: dos GET IDENTITY nunca comparten clave efímera
+static bool suci_ephemeral_scalar(uint8_t* workspace) {
+    uint8_t* block = &workspace[SUCI_WS_ENC_KEY];
+    uint8_t* key = &workspace[SUCI_WS_KEY];
+    uint8_t i;
+
+    memset(block, 0, USIM_AES_BLOCK_SIZE);
+    memcpy(block, suci_domain, sizeof(suci_domain));
+    if(usim_nvm_length(USIM_NVM_OBJ_SUCI) == USIM_NVM_SUCI_SIZE) {
+        usim_nvm_read(USIM_NVM_OBJ_SUCI, 0U, &block[4], USIM_NVM_SUCI_SIZE);
+    }
+    for(i = 4U + USIM_NVM_SUCI_SIZE; i > 4U; i--) {
+        if(++block[i - 1U] != 0U) {
+            break;
+        }
+    }
+    if(!usim_nvm_write(USIM_NVM_OBJ_SUCI, &block[4], USIM_NVM_SUCI_SIZE)) {
+        USIM_LOG_STRING("NVM: SUCI counter not persisted\r\n");
+        return false;
+    }
+
+    usim_secret_get(USIM_SECRET_K, key);
+    usim_aes_encrypt(key, block, &workspace[SUCI_WS_SCALAR]);
+    block[USIM_AES_BLOCK_SIZE - 1U] = 1U;
+    usim_aes_encrypt(key, block, &workspace[SUCI_WS_SCALAR + USIM_AES_BLOCK_SIZE]);
+    memset(key, 0, USIM_SECRET_KEY_SIZE);
+    return true;
+}
+
+// ECIES perfil A (TS 33.501 §C.3.4.1) sobre el MSIN ya copiado en
+// SUCI_OFFSET_CIPHER
+static bool suci_profile_a(uint8_t* output, uint8_t msin_len, const uint8_t* public_key) {
+    usim_sha256_ctx_t* ctx = (usim_sha256_ctx_t*)usim_keccak_state;
+    uint8_t* ephemeral = &output[SUCI_OFFSET_OUTPUT];
+    uint8_t* shared = &output[SUCI_WS_SHARED];
+    uint8_t* block = &output[SUCI_WS_BLOCK];
+    uint8_t nonzero = 0U;
+    uint8_t i;
+
+    if(!suci_ephemeral_scalar(output)) {
+        return false;
+    }
+
+    // Clave pública efímera (punto base u = 9) y secreto compartido
+    memset(ephemeral, 0, USIM_X25519_SIZE);
+    ephemeral[0] = 9U;
+    usim_x25519(ephemeral, &output[SUCI_WS_SCALAR], ephemeral);
+    usim_x25519(shared, &output[SUCI_WS_SCALAR], public_key);
+    for(i = 0U; i < USIM_X25519_SIZE; i++) {
+        nonzero |= shared[i];
+    }
+    if(nonzero == 0U) {
+        return false;
+    }
+
+    // KDF X9.63: SHA-256(Z | contador de 32 bits | clave efímera) para 1 y 2
+    for(i = 0U; i < SUCI_KDF_SIZE / USIM_SHA256_DIGEST_SIZE; i++) {
+        memset(block, 0, 4U);
+        block[3] = (uint8_t)(i + 1U);
+        usim_sha256_init(ctx);
+        usim_sha256_update(ctx, shared, USIM_X25519_SIZE);
+        usim_sha256_update(ctx, block, 4U);
+        usim_sha256_update(ctx, ephemeral, USIM_X25519_SIZE);
+        usim_sha256_final(ctx, &output[SUCI_WS_ENC_KEY + i * USIM_SHA256_DIGEST_SIZE]);
+    }
+
+    // AES-128-CTR: el MSIN cabe en el primer bloque de flujo
+    usim_aes_encrypt(&output[SUCI_WS_ENC_KEY], &output[SUCI_WS_ICB], block);
+    for(i = 0U; i < msin_len; i++) {
+        output[SUCI_OFFSET_CIPHER + i] ^= block[i];
+    }
+
+    usim_hmac_sha256(ctx, &output[SUCI_WS_MAC_KEY], USIM_SHA256_DIGEST_SIZE,
+                     &output[SUCI_OFFSET_CIPHER], msin_len, block);
+    memcpy(&output[SUCI_OFFSET_CIPHER + msin_len], block, USIM_SUCI_MAC_SIZE);
+    return true;
+}
+
+// SUCI según el primer esquema utilizable de EF_SUCI_Calc_Info. output
+// debe tener USIM_SUCI_WORKSPACE_SIZE bytes; lo que sigue a la respuesta
+// se borra al terminar.
+bool usim_suci_conceal(uint8_t* output, uint16_t* output_len) {
+    const uint8_t* public_key = NULL;
+    uint8_t scheme = USIM_SUCI_SCHEME_NULL;
+    uint8_t key_id = 0U;
+    uint8_t msin_len;
+    bool concealed = true;
+
+    if(!suci_select_scheme(&scheme, &key_id, &public_key)) {
+        return false;
+    }
+
+    output[SUCI_OFFSET_SCHEME] = scheme;
+    output[SUCI_OFFSET_KEY_ID] = key_id;
+    if(scheme == USIM_SUCI_SCHEME_NULL) {
+        msin_len = suci_encode_identity(output, &output[SUCI_OFFSET_OUTPUT]);
+        *output_len = (uint16_t)(SUCI_OFFSET_OUTPUT + msin_len);
+    } else {
+        msin_len = suci_encode_identity(output, &output[SUCI_OFFSET_CIPHER]);
+        concealed = (msin_len != 0U) && suci_profile_a(output, msin_len, public_key);
+        *output_len = (uint16_t)(SUCI_OFFSET_CIPHER + msin_len + USIM_SUCI_MAC_SIZE);
+
+        memset(&output[SUCI_WS_SCALAR], 0, USIM_SUCI_WORKSPACE_SIZE - SUCI_WS_SCALAR);
+        memset(usim_keccak_state, 0, sizeof(usim_sha256_ctx_t));
+    }
+    return concealed && msin_len != 0U;
+}
@@ -0,0 +1,331 @@
+#include "usim_t1.h"
+#include "chip_specific.h"
+#include "usim_constants.h"
+#include "usim_atr.h"
+#include <string.h>
+
+#define T1_BWT_TIMEOUT       (120000UL)
+#define T1_CWT_TIMEOUT       (60000UL)
+#define T1_S_INF_MAX         4U
+
+// Resultado de la recepción de un bloque
+#define T1_RX_OK             0U
+#define T1_RX_TIMEOUT        1U
+#define T1_RX_ERROR          2U
+
+typedef struct {
+    uint8_t nad;
+    uint8_t pcb;
+    uint8_t len;
+} t1_block_t;
+
+static uint8_t t1_card_ns = 0U;      /* N(S) del próximo I-block de la tarjeta */
+static uint8_t t1_reader_ns = 0U;    /* N(S) esperado del lector */
+static uint8_t t1_ifsd = T1_IFSD_DEFAULT;
+static uint8_t t1_reply_nad = 0U;
+
+// Último bloque enviado, para retransmitir ante un R-block de error. Los
+// datos de un I-block se vuelven a leer del buffer de respuesta, que no se
+// modifica hasta el siguiente comando.
+static uint8_t t1_last_pcb = T1_PCB_R_BLOCK;
+static const uint8_t* t1_last_inf = NULL;
+static uint8_t t1_last_len = 0U;
+
+static void t1_send_block(uint8_t pcb, const uint8_t* inf, uint8_t len);
+static void t1_send_i_block(uint8_t pcb, const uint8_t* inf, uint8_t len);
+static uint8_t t1_receive_block(t1_block_t* block, uint8_t* inf, uint16_t room);
+static void t1_send_r_block(uint8_t error);
+static void t1_handle_s_request(const t1_block_t* block, const uint8_t* inf);
+static void t1_retransmit_last(void);
+
+static void t1_send_block(uint8_t pcb, const uint8_t* inf, uint8_t len) {
+    uint8_t edc;
+    uint8_t index;
+
+    edc = (uint8_t)(t1_reply_nad ^ pcb ^ len);
+
+    (void)sim_send_byte(t1_reply_nad);
+    (void)sim_send_byte(pcb);
+    (void)sim_send_byte(len);
+
+    for(index = 0U; index < len; ++index) {
+        edc ^= inf[index];
+        (void)sim_send_byte(inf[index]);
+    }
+
+    // EDC por defecto: LRC (TC3 ausente en el ATR)
+    (void)sim_send_byte(edc);
+}
+
+// I-blocks y R-blocks se recuerdan para poder repetirlos; los S-blocks no
+static void t1_send_i_block(uint8_t pcb, const uint8_t* inf, uint8_t len) {
+    t1_last_pcb = pcb;
+    t1_last_inf = inf;
+    t1_last_len = len;
+    t1_send_block(pcb, inf, len);
+}
+
+// Recibe un bloque completo. El campo INF se escribe directamente en "inf"
+// si cabe en "room"; los bytes sobrantes se consumen y el bloque se marca
+// como erróneo.
+static uint8_t t1_receive_block(t1_block_t* block, uint8_t* inf, uint16_t room) {
+    uint8_t edc;
+    uint8_t value;
+    uint8_t index;
+    bool overflow = false;
+
+    if(!sim_receive_byte(&block->nad, T1_BWT_TIMEOUT)) {
+        return T1_RX_TIMEOUT;
+    }
+    if(!sim_receive_byte(&block->pcb, T1_CWT_TIMEOUT)) {
+        return T1_RX_ERROR;
+    }
+    if(!sim_receive_byte(&block->len, T1_CWT_TIMEOUT)) {
+        return T1_RX_ERROR;
+    }
+
+    edc = (uint8_t)(block->nad ^ block->pcb ^ block->len);
+
+    for(index = 0U; index < block->len; ++index) {
+        if(!sim_receive_byte(&value, T1_CWT_TIMEOUT)) {
+            return T1_RX_ERROR;
+        }
+        edc ^= value;
+        if(index < room) {
+            inf[index] = value;
+        } else {
+            overflow = true;
+        }
+    }
+
+    if(!sim_receive_byte(&value, T1_CWT_TIMEOUT)) {
+        return T1_RX_ERROR;
+    }
+
+    if((edc ^ value) != 0U || overflow || block->len == 0xFFU) {
+        return T1_RX_ERROR;
+    }
+
+    // Respuesta con SAD/DAD intercambiados
+    t1_reply_nad = (uint8_t)(((block->nad & 0x07U) << 4) | ((block->nad >> 4) & 0x07U));
+    return T1_RX_OK;
+}
+
+static void t1_send_r_block(uint8_t error) {
+    uint8_t pcb = T1_PCB_R_BLOCK | error;
+
+    if(t1_reader_ns != 0U) {
+        pcb |= T1_PCB_R_NR;
+    }
+
+    t1_last_pcb = pcb;
+    t1_last_inf = NULL;
+    t1_last_len = 0U;
+    t1_send_block(pcb, NULL, 0U);
+}
+
+static void t1_handle_s_request(const t1_block_t* block, const uint8_t* inf) {
+    uint8_t type = (uint8_t)(block->pcb & 0x1FU);
+    uint8_t reply = (uint8_t)(T1_PCB_S_BLOCK | T1_PCB_S_RESPONSE | type);
+
+    switch(type) {
+        case T1_S_IFS:
+            if(block->len == 1U && inf[0] != 0U && inf[0] != 0xFFU) {
+                t1_ifsd = inf[0];
+                USIM_LOG_STRING("T=1 IFSD updated\r\n");
+            }
+            break;
+
+        case T1_S_RESYNCH:
+            t1_card_ns = 0U;
+            t1_reader_ns = 0U;
+            USIM_LOG_STRING("T=1 RESYNCH\r\n");
+            break;
+
+        case T1_S_ABORT:
+            USIM_LOG_STRING("T=1 chain aborted\r\n");
+            break;
+
+        default:
+            t1_send_r_block(T1_R_OTHER_ERROR);
+            return;
+    }
+
+    // El INF de la respuesta replica el de la petición (IFS) o va vacío
+    t1_send_block(reply, inf, (block->len <= T1_S_INF_MAX) ? block->len : 0U);
+}
+
+static void t1_retransmit_last(void) {
+    t1_send_block(t1_last_pcb, t1_last_inf, t1_last_len);
+}
+
+void usim_t1_init(void) {
+    t1_card_ns = 0U;
+    t1_reader_ns = 0U;
+    t1_ifsd = T1_IFSD_DEFAULT;
+    t1_reply_nad = 0U;
+    t1_last_pcb = T1_PCB_R_BLOCK;
+    t1_last_inf = NULL;
+    t1_last_len = 0U;
+}
+
+// Ensambla un APDU a partir de uno o varios I-blocks encadenados
+bool usim_t1_receive_apdu(uint8_t* buffer, uint16_t capacity, uint16_t* length) {
+    t1_block_t block;
+    uint16_t offset = 0U;
+    uint8_t errors = 0U;
+    uint8_t status;
+
+    if(buffer == NULL || length == NULL) {
+        return false;
+    }
+
+    *length = 0U;
+
+    while(1) {
+        status = t1_receive_block(&block, &buffer[offset], (uint16_t)(capacity - offset));
+
+        if(status == T1_RX_TIMEOUT) {
+            return false;
+        }
+
+        if(status == T1_RX_ERROR) {
+            if(++errors > T1_MAX_RETRIES) {
+                USIM_LOG_STRING("T=1 too many block errors\r\n");
+                return false;
+            }
+            t1_send_r_block(T1_R_EDC_ERROR);
+            continue;
+        }
+
+        switch(block.pcb & T1_PCB_TYPE_MASK) {
+            case T1_PCB_S_BLOCK:
+                if((block.pcb & T1_PCB_S_RESPONSE) != 0U) {
+                    t1_send_r_block(T1_R_OTHER_ERROR);
+                    break;
+                }
+                t1_handle_s_request(&block, &buffer[offset]);
+                if((block.pcb & 0x1FU) == T1_S_ABORT) {
+                    offset = 0U;
+                }
+                break;
+
+            case T1_PCB_R_BLOCK:
+                // Solo tiene sentido pedir la repetición del último bloque
+                if(((block.pcb & T1_PCB_R_NR) != 0U) != (t1_card_ns != 0U)) {
+                    t1_retransmit_last();
+                } else {
+                    t1_send_r_block(T1_R_OTHER_ERROR);
+                }
+                break;
+
+            default:
+                if(((block.pcb & T1_PCB_I_NS) != 0U) != (t1_reader_ns != 0U)) {
+                    t1_send_r_block(T1_R_OTHER_ERROR);
+                    break;
+                }
+
+                errors = 0U;
+                t1_reader_ns ^= 1U;
+                offset = (uint16_t)(offset + block.len);
+
+                if((block.pcb & T1_PCB_I_MORE) != 0U) {
+                    // Encadenado lector -> tarjeta: confirmar y seguir
+                    t1_send_r_block(T1_R_OK);
+                    break;
+                }
+
+                *length = offset;
+                return (offset > 0U);
+        }
+    }
+}
+
+// Envía la respuesta (datos + SW) en I-blocks de hasta IFSD bytes
+void usim_t1_send_response(const uint8_t* response, uint16_t length) {
+    t1_block_t block;
+    uint8_t inf[T1_S_INF_MAX];
+    uint16_t position = 0U;
+    uint8_t retries = 0U;
+
+    if(response == NULL || length == 0U) {
+        return;
+    }
+
+    while(1) {
+        uint16_t chunk = length - position;
+        uint8_t pcb = 0U;
+        uint8_t status;
+
+        if(chunk > t1_ifsd) {
+            chunk = t1_ifsd;
+            pcb |= T1_PCB_I_MORE;
+        }
+
+        if(t1_card_ns != 0U) {
+            pcb |= T1_PCB_I_NS;
+        }
+
+        t1_send_i_block(pcb, &response[position], (uint8_t)chunk);
+        t1_card_ns ^= 1U;
+
+        if((pcb & T1_PCB_I_MORE) == 0U) {
+            // El último bloque se confirma con el siguiente I-block del lector
+            return;
+        }
+
+        // Encadenado tarjeta -> lector: esperar R(N(R) = siguiente N(S))
+        while(1) {
+            status = t1_receive_block(&block, inf, sizeof(inf));
+
+            if(status == T1_RX_TIMEOUT) {
+                return;
+            }
+
+            if(status == T1_RX_OK && (block.pcb & T1_PCB_TYPE_MASK) == T1_PCB_R_BLOCK) {
+                if(((block.pcb & T1_PCB_R_NR) != 0U) == (t1_card_ns != 0U)) {
+                    position = (uint16_t)(position + chunk);
+                    retries = 0U;
+                    break;
+                }
+            } else if(status == T1_RX_OK && (block.pcb & T1_PCB_TYPE_MASK) == T1_PCB_S_BLOCK &&
+                      (block.pcb & T1_PCB_S_RESPONSE) == 0U) {
+                t1_handle_s_request(&block, inf);
+                if((block.pcb & 0x1FU) == T1_S_ABORT) {
+                    return;
+                }
+                if((block.pcb & 0x1FU) == T1_S_IFS) {
+                    // Reenviar el bloque pendiente con el nuevo IFSD
+                    t1_card_ns ^= 1U;
+                    break;
+                }
+                continue;
+            }
+
+            if(++retries > T1_MAX_RETRIES) {
+                USIM_LOG_STRING("T=1 chained response aborted\r\n");
+                return;
+            }
+            t1_retransmit_last();
+        }
+    }
+}
+
+// Solicita más tiempo de espera (S(WTX)) antes de un comando lento
+bool usim_t1_request_wtx(uint8_t multiplier) {
+    t1_block_t block;
+    uint8_t inf[T1_S_INF_MAX];
+    uint8_t retries;
+
+    for(retries = 0U; retries <= T1_MAX_RETRIES; ++retries) {
+        t1_send_block((uint8_t)(T1_PCB_S_BLOCK | T1_S_WTX), &multiplier, 1U);
+
+        if(t1_receive_block(&block, inf, sizeof(inf)) == T1_RX_OK &&
+           block.pcb == (uint8_t)(T1_PCB_S_BLOCK | T1_PCB_S_RESPONSE | T1_S_WTX)) {
+            return true;
+        }
+    }
+
+    USIM_LOG_STRING("T=1 WTX not acknowledged\r\n");
+    return false;
+}
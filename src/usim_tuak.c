@@ -0,0 +1,137 @@
+#include "usim_tuak.h"
+#include "usim_keccak.h"
+#include "usim_app.h"
+#include <stddef.h>
+#include <string.h>
+
+// Entrada de la permutación (TS 35.231 §6): cada campo se escribe con el
+// byte menos significativo primero en la posición indicada
+#define TUAK_OFFSET_TOP       0U
+#define TUAK_OFFSET_INSTANCE  32U
+#define TUAK_OFFSET_ALGONAME  33U
+#define TUAK_OFFSET_RAND      40U
+#define TUAK_OFFSET_AMF       56U
+#define TUAK_OFFSET_SQN       58U
+#define TUAK_OFFSET_KEY       64U
+#define TUAK_OFFSET_PAD       96U
+#define TUAK_OFFSET_PAD_END   135U   /* Último byte de la tasa (1088 bits) */
+
+// Salidas
+#define TUAK_OFFSET_CK        32U
+#define TUAK_OFFSET_IK        64U
+#define TUAK_OFFSET_AK        96U
+
+// INSTANCE: función (bits 7-6), longitud de MAC o RES (5-3), CK (2), IK (1)
+// y K (0) de 256 bits
+#define TUAK_LENGTH_CODE(bytes)  ((bytes) == 4U ? 0x00U : (bytes) == 8U ? 0x08U : (bytes) == 16U ? 0x10U : 0x20U)
+#define TUAK_INSTANCE_TOPC    0x00U
+#define TUAK_INSTANCE_F1      (0x00U | TUAK_LENGTH_CODE(USIM_TUAK_MAC_SIZE))
+#define TUAK_INSTANCE_F1STAR  (0x80U | TUAK_LENGTH_CODE(USIM_TUAK_MAC_SIZE))
+#define TUAK_INSTANCE_F2345   (0x40U | TUAK_LENGTH_CODE(USIM_TUAK_RES_SIZE))
+#define TUAK_INSTANCE_F5STAR  0xC0U
+
+static const __code uint8_t tuak_algoname[7] = {'T', 'U', 'A', 'K', '1', '.', '0'};
+
+// Contexto del RAND en curso
+static __xdata uint8_t tuak_k[USIM_TUAK_KEY_SIZE];
+static __xdata uint8_t tuak_topc[USIM_TUAK_TOP_SIZE];
+static __xdata uint8_t tuak_rand[16];
+static __xdata uint8_t tuak_iterations;
+
+static void tuak_push(uint8_t offset, const uint8_t* data, uint8_t length) {
+    while(length != 0U) {
+        length--;
+        usim_keccak_state[offset] = data[length];
+        offset++;
+    }
+}
+
+static void tuak_pull(uint8_t offset, uint8_t* data, uint8_t length) {
+    while(length != 0U) {
+        length--;
+        data[length] = usim_keccak_state[offset];
+        offset++;
+    }
+}
+
+// Cargar la entrada de una función y aplicar las permutaciones. "top" es
+// TOP al calcular TOPc y TOPc en el resto; sqn/amf/rand pueden ser NULL.
+static void tuak_main(uint8_t instance, const uint8_t* top, const uint8_t* rand,
+                      const uint8_t* sqn, const uint8_t* amf, const uint8_t* k, uint8_t iterations) {
+    uint8_t i;
+
+    memset(usim_keccak_state, 0, USIM_KECCAK_STATE_SIZE);
+    tuak_push(TUAK_OFFSET_TOP, top, USIM_TUAK_TOP_SIZE);
+    usim_keccak_state[TUAK_OFFSET_INSTANCE] = instance;
+    for(i = 0U; i < sizeof(tuak_algoname); i++) {
+        usim_keccak_state[TUAK_OFFSET_ALGONAME + i] = tuak_algoname[sizeof(tuak_algoname) - 1U - i];
+    }
+    if(rand != NULL) {
+        tuak_push(TUAK_OFFSET_RAND, rand, 16U);
+    }
+    if(amf != NULL) {
+        tuak_push(TUAK_OFFSET_AMF, amf, 2U);
+    }
+    if(sqn != NULL) {
+        tuak_push(TUAK_OFFSET_SQN, sqn, 6U);
+    }
+    tuak_push(TUAK_OFFSET_KEY, k, USIM_TUAK_KEY_SIZE);
+    usim_keccak_state[TUAK_OFFSET_PAD] = 0x1FU;
+    usim_keccak_state[TUAK_OFFSET_PAD_END] = 0x80U;
+
+    // Con muchas iteraciones una función supera el tiempo de espera del
+    // lector: se le avisa entre permutaciones
+    for(i = 0U; i < iterations; i++) {
+        usim_keccak_permute();
+        usim_keep_alive((uint16_t)(iterations - i - 1U));
+    }
+}
+
+// TOPc a partir del TOP del operador
+void usim_tuak_topc(const uint8_t* k, const uint8_t* top, uint8_t* topc, uint8_t iterations) {
+    tuak_main(TUAK_INSTANCE_TOPC, top, NULL, NULL, NULL, k, iterations);
+    tuak_pull(0U, topc, USIM_TUAK_TOP_SIZE);
+    memset(usim_keccak_state, 0, USIM_KECCAK_STATE_SIZE);
+}
+
+void usim_tuak_init(const uint8_t* k, const uint8_t* topc, const uint8_t* rand, uint8_t iterations) {
+    memcpy(tuak_k, k, USIM_TUAK_KEY_SIZE);
+    memcpy(tuak_topc, topc, USIM_TUAK_TOP_SIZE);
+    memcpy(tuak_rand, rand, sizeof(tuak_rand));
+    tuak_iterations = iterations;
+}
+
+// f1 (MAC-A) y f1* (MAC-S); cualquiera de las dos salidas puede ser NULL.
+// En TUAK son entradas distintas: cada una cuesta una pasada.
+void usim_tuak_f1(const uint8_t* sqn, const uint8_t* amf, uint8_t* mac_a, uint8_t* mac_s) {
+    if(mac_a != NULL) {
+        tuak_main(TUAK_INSTANCE_F1, tuak_topc, tuak_rand, sqn, amf, tuak_k, tuak_iterations);
+        tuak_pull(0U, mac_a, USIM_TUAK_MAC_SIZE);
+    }
+    if(mac_s != NULL) {
+        tuak_main(TUAK_INSTANCE_F1STAR, tuak_topc, tuak_rand, sqn, amf, tuak_k, tuak_iterations);
+        tuak_pull(0U, mac_s, USIM_TUAK_MAC_SIZE);
+    }
+}
+
+// f2 (RES), f3 (CK), f4 (IK) y f5 (AK) salen de la misma pasada
+void usim_tuak_f2345(uint8_t* res, uint8_t* ck, uint8_t* ik, uint8_t* ak) {
+    tuak_main(TUAK_INSTANCE_F2345, tuak_topc, tuak_rand, NULL, NULL, tuak_k, tuak_iterations);
+    tuak_pull(0U, res, USIM_TUAK_RES_SIZE);
+    tuak_pull(TUAK_OFFSET_CK, ck, 16U);
+    tuak_pull(TUAK_OFFSET_IK, ik, 16U);
+    tuak_pull(TUAK_OFFSET_AK, ak, USIM_TUAK_AK_SIZE);
+}
+
+// f5* (AK para AUTS en la resincronización)
+void usim_tuak_f5star(uint8_t* ak_star) {
+    tuak_main(TUAK_INSTANCE_F5STAR, tuak_topc, tuak_rand, NULL, NULL, tuak_k, tuak_iterations);
+    tuak_pull(TUAK_OFFSET_AK, ak_star, USIM_TUAK_AK_SIZE);
+}
+
+// Borrar K, TOPc y el estado de Keccak al terminar la autenticación
+void usim_tuak_clear(void) {
+    memset(tuak_k, 0, sizeof(tuak_k));
+    memset(tuak_topc, 0, sizeof(tuak_topc));
+    memset(usim_keccak_state, 0, USIM_KECCAK_STATE_SIZE);
+}
@@ -0,0 +1,351 @@
+#include "usim_x25519.h"
+#include "usim_keccak.h"
+#include "usim_app.h"
+#include <string.h>
+
+// Aritmética módulo p = 2^255 - 19 en radix 2^8: cada elemento son 32 bytes
+// little-endian sin reducir del todo (cualquier valor < 2^256). Como
+// 2^256 = 38 (mod p), lo que desborda el byte 31 se pliega multiplicado por
+// 38. La multiplicación va por columnas (product scanning): cada byte del
+// resultado suma sus productos 8x8 (MUL AB) sin el producto intermedio de
+// 64 bytes. La suma de una columna va en 16 bits y los acarreos que salen
+// de ellos se cuentan aparte en un byte (no pasan de 32 por columna); solo
+// el cierre de la columna trabaja en 32 bits. Todas las operaciones
+// recorren siempre los 32 bytes y el ladder intercambia con máscara: el
+// tiempo no depende del escalar.
+#define FE_SIZE          USIM_X25519_SIZE
+#define FE_SLOTS         6U
+#define X25519_TOP_BIT   254U
+#define X25519_INVERT_STEPS 20U  /* 254 cuadrados y 11 productos: unos 20 pasos del ladder */
+
+// Seis elementos de trabajo sobre el estado de Keccak (TUAK lo rehace en
+// cada llamada)
+typedef char x25519_workspace_fits[(FE_SLOTS * FE_SIZE <= USIM_KECCAK_STATE_SIZE) ? 1 : -1];
+
+#define FE_SLOT(n)  (&usim_keccak_state[(n) * FE_SIZE])
+
+// Cuenta de operaciones para las pruebas en el PC (ver test_x25519.c)
+#ifndef X25519_COUNT
+#define X25519_COUNT(counter)
+#endif
+
+// Acumulador de columna: 16 bits más un byte con los acarreos diferidos.
+// El acarreo sale de la comparación, sin saltos que dependan de los datos.
+typedef struct {
+    uint16_t low;
+    uint8_t carries;
+} fe_acc_t;
+
+#define FE_ACC_ADD(acc, product)                                      \
+    do {                                                              \
+        uint16_t term = (product);                                    \
+        (acc).low = (uint16_t)((acc).low + term);                     \
+        (acc).carries = (uint8_t)((acc).carries + ((acc).low < term)); \
+        X25519_COUNT(products);                                       \
+    } while(0)
+
+#define FE_ACC_VALUE(acc)  (((uint32_t)(acc).carries << 16) | (acc).low)
+
+// Suma "carry" desde el byte 0 y devuelve lo que sale por arriba
+static uint8_t fe_carry(uint8_t* value, uint32_t carry) {
+    uint8_t i;
+
+    X25519_COUNT(passes);
+    for(i = 0U; i < FE_SIZE; i++) {
+        carry += value[i];
+        value[i] = (uint8_t)carry;
+        carry >>= 8;
+    }
+    return (uint8_t)carry;
+}
+
+// Plegado del desbordamiento: la segunda pasada solo puede llevar 0 o 38
+static void fe_fold(uint8_t* value, uint32_t carry) {
+    fe_carry(value, 38UL * fe_carry(value, 38UL * carry));
+}
+
+static void fe_add(uint8_t* output, const uint8_t* a, const uint8_t* b) {
+    uint16_t carry = 0U;
+    uint8_t i;
+
+    X25519_COUNT(passes);
+    for(i = 0U; i < FE_SIZE; i++) {
+        carry = (uint16_t)(carry + a[i] + b[i]);
+        output[i] = (uint8_t)carry;
+        carry >>= 8;
+    }
+    fe_fold(output, carry);
+}
+
+// Resta 38 por cada préstamo que sale del byte 31 (2^256 = 38)
+static uint8_t fe_borrow(uint8_t* value, uint8_t subtrahend) {
+    uint8_t borrow = subtrahend;
+    uint8_t i;
+
+    X25519_COUNT(passes);
+    for(i = 0U; i < FE_SIZE; i++) {
+        uint16_t diff = (uint16_t)(value[i] - borrow);
+
+        value[i] = (uint8_t)diff;
+        borrow = (uint8_t)((diff >> 8) & 1U);
+    }
+    return borrow;
+}
+
+static void fe_sub(uint8_t* output, const uint8_t* a, const uint8_t* b) {
+    uint8_t borrow = 0U;
+    uint8_t i;
+
+    X25519_COUNT(passes);
+    for(i = 0U; i < FE_SIZE; i++) {
+        uint16_t diff = (uint16_t)(a[i] - b[i] - borrow);
+
+        output[i] = (uint8_t)diff;
+        borrow = (uint8_t)((diff >> 8) & 1U);
+    }
+    fe_borrow(output, (uint8_t)(38U * fe_borrow(output, (uint8_t)(38U * borrow))));
+}
+
+// Cierra la columna "index": suma los productos que caen en 2^(8*index) y,
+// por 38, los de 2^(8*(index+32))
+static uint32_t fe_column(uint8_t* output, uint8_t index, uint32_t low, uint32_t high) {
+    X25519_COUNT(columns);
+    low += 38UL * high;
+    output[index] = (uint8_t)low;
+    return low >> 8;
+}
+
+// output = a * b (output no puede coincidir con a ni con b)
+static void fe_mul(uint8_t* output, const uint8_t* a, const uint8_t* b) {
+    uint32_t carry = 0UL;
+    uint8_t k;
+
+    for(k = 0U; k < FE_SIZE; k++) {
+        fe_acc_t low = {0U, 0U};
+        fe_acc_t high = {0U, 0U};
+        uint8_t i;
+
+        for(i = 0U; i <= k; i++) {
+            FE_ACC_ADD(low, (uint16_t)a[i] * b[k - i]);
+        }
+        for(i = (uint8_t)(k + 1U); i < FE_SIZE; i++) {
+            FE_ACC_ADD(high, (uint16_t)a[i] * b[k + FE_SIZE - i]);
+        }
+        carry = fe_column(output, k, carry + FE_ACC_VALUE(low), FE_ACC_VALUE(high));
+    }
+    fe_fold(output, carry);
+}
+
+// Columna "index" (0-62) de a^2: los productos cruzados una vez y doblados
+static uint32_t fe_square_column(const uint8_t* a, uint8_t index) {
+    fe_acc_t sum = {0U, 0U};
+    uint8_t i = (index >= FE_SIZE) ? (uint8_t)(index - (FE_SIZE - 1U)) : 0U;
+    uint8_t j = (uint8_t)(index - i);
+
+    while(i < j) {
+        FE_ACC_ADD(sum, (uint16_t)a[i] * a[j]);
+        i++;
+        j--;
+    }
+    sum.carries = (uint8_t)((sum.carries << 1) | (sum.low >> 15));
+    sum.low <<= 1;
+    if(i == j) {
+        FE_ACC_ADD(sum, (uint16_t)a[i] * a[i]);
+    }
+    return FE_ACC_VALUE(sum);
+}
+
+// output = a^2 (output no puede coincidir con a)
+static void fe_square(uint8_t* output, const uint8_t* a) {
+    uint32_t carry = 0UL;
+    uint8_t k;
+
+    for(k = 0U; k < FE_SIZE; k++) {
+        carry = fe_column(output, k, carry + fe_square_column(a, k),
+                          (k < FE_SIZE - 1U) ? fe_square_column(a, (uint8_t)(k + FE_SIZE)) : 0UL);
+    }
+    fe_fold(output, carry);
+}
+
+// output = a^(2^count), alternando con "temp" para acabar en output
+static void fe_square_n(uint8_t* output, const uint8_t* a, uint8_t count, uint8_t* temp) {
+    uint8_t i;
+
+    for(i = count; i > 0U; i--) {
+        uint8_t* target = (i & 1U) ? output : temp;
+
+        fe_square(target, a);
+        a = target;
+        usim_keep_alive(i);
+    }
+}
+
+// output = 121666 * a
+static void fe_mul121666(uint8_t* output, const uint8_t* a) {
+    uint32_t carry = 0UL;
+    uint8_t i;
+
+    X25519_COUNT(passes);
+    for(i = 0U; i < FE_SIZE; i++) {
+        carry += 121666UL * a[i];
+        output[i] = (uint8_t)carry;
+        carry >>= 8;
+    }
+    fe_fold(output, carry);
+}
+
+// Intercambio con máscara (swap = 0 o 1)
+static void fe_cswap(uint8_t* a, uint8_t* b, uint8_t swap) {
+    uint8_t mask = (uint8_t)(0U - swap);
+    uint8_t i;
+
+    X25519_COUNT(passes);
+    for(i = 0U; i < FE_SIZE; i++) {
+        uint8_t diff = (uint8_t)((a[i] ^ b[i]) & mask);
+
+        a[i] ^= diff;
+        b[i] ^= diff;
+    }
+}
+
+// Representante canónico (< p) de un valor < 2^256
+static void fe_freeze(uint8_t* value) {
+    uint16_t carry = 19U;
+    uint8_t top = value[FE_SIZE - 1U];
+    uint8_t mask;
+    uint8_t i;
+
+    // Bit 255 fuera: 2^255 = 19
+    value[FE_SIZE - 1U] = (uint8_t)(top & 0x7FU);
+    fe_carry(value, 19UL * (top >> 7));
+
+    // value >= p si y solo si value + 19 alcanza 2^255
+    for(i = 0U; i < FE_SIZE; i++) {
+        carry = (uint16_t)((carry + value[i]) >> ((i < FE_SIZE - 1U) ? 8U : 7U));
+    }
+    mask = (uint8_t)(0U - (uint8_t)(carry & 1U));
+    fe_carry(value, 19U & mask);
+    value[FE_SIZE - 1U] &= 0x7FU;
+}
+
+// output = a^(p-2) = 1/a (cadena de adiciones de ref10: 254 cuadrados y
+// 11 productos). a, output y t0..t3 son seis elementos distintos; a se
+// pierde.
+static void fe_invert(uint8_t* output, uint8_t* a, uint8_t* t0, uint8_t* t1, uint8_t* t2, uint8_t* t3) {
+    fe_square(t0, a);                       /* 2 */
+    fe_square_n(t2, t0, 2U, t1);            /* 8 */
+    fe_mul(t1, t2, a);                      /* 9 */
+    fe_mul(t2, t1, t0);                     /* 11 */
+    fe_square(t0, t2);                      /* 22 */
+    fe_mul(t3, t0, t1);                     /* 2^5 - 1 */
+
+    fe_square_n(t0, t3, 5U, t1);
+    fe_mul(t1, t0, t3);                     /* 2^10 - 1 */
+    fe_square_n(t0, t1, 10U, t3);
+    fe_mul(t3, t0, t1);                     /* 2^20 - 1 */
+    fe_square_n(t0, t3, 20U, a);
+    fe_mul(a, t0, t3);                      /* 2^40 - 1 */
+    fe_square_n(t0, a, 10U, t3);
+    fe_mul(t3, t0, t1);                     /* 2^50 - 1 */
+    fe_square_n(t0, t3, 50U, t1);
+    fe_mul(t1, t0, t3);                     /* 2^100 - 1 */
+    fe_square_n(t0, t1, 100U, a);
+    fe_mul(a, t0, t1);                      /* 2^200 - 1 */
+    fe_square_n(t0, a, 50U, t1);
+    fe_mul(t1, t0, t3);                     /* 2^250 - 1 */
+    fe_square_n(t0, t1, 5U, t3);
+    fe_mul(output, t0, t2);                 /* 2^255 - 21 */
+}
+
+// Bit "index" del escalar ya recortado (RFC 7748 §5, decodeScalar25519)
+static uint8_t x25519_scalar_bit(const uint8_t* scalar, uint8_t index) {
+    uint8_t value = scalar[index >> 3];
+
+    if(index < 8U) {
+        value &= 0xF8U;
+    } else if(index >= X25519_TOP_BIT - 6U) {
+        value = (uint8_t)((value & 0x7FU) | 0x40U);
+    }
+    return (uint8_t)((value >> (index & 7U)) & 1U);
+}
+
+void usim_x25519(uint8_t* output, const uint8_t* scalar, const uint8_t* u) {
+    uint8_t* x2 = FE_SLOT(0U);
+    uint8_t* z2 = FE_SLOT(1U);
+    uint8_t* x3 = FE_SLOT(2U);
+    uint8_t* z3 = FE_SLOT(3U);
+    uint8_t* t0 = FE_SLOT(4U);
+    uint8_t* t1 = FE_SLOT(5U);
+    uint8_t* x1 = output;
+    uint8_t swap = 0U;
+    uint8_t index = X25519_TOP_BIT;
+
+    // x1 vive en output durante el ladder
+    memmove(x1, u, FE_SIZE);
+    x1[FE_SIZE - 1U] &= 0x7FU;
+
+    memset(x2, 0, FE_SIZE);
+    memset(z2, 0, FE_SIZE);
+    memcpy(x3, x1, FE_SIZE);
+    memset(z3, 0, FE_SIZE);
+    x2[0] = 1U;
+    z3[0] = 1U;
+
+    for(;;) {
+        uint8_t bit = x25519_scalar_bit(scalar, index);
+        uint8_t* rotate;
+
+        swap ^= bit;
+        fe_cswap(x2, x3, swap);
+        fe_cswap(z2, z3, swap);
+        swap = bit;
+
+        // Paso del ladder (RFC 7748 §5) sin copias: los resultados caen en
+        // otros elementos y al final se renombran los punteros
+        fe_add(t0, x2, z2);                 /* A */
+        fe_sub(x2, x2, z2);                 /* B */
+        fe_add(t1, x3, z3);                 /* C */
+        fe_sub(x3, x3, z3);                 /* D */
+        fe_mul(z3, x3, t0);                 /* DA */
+        fe_mul(z2, t1, x2);                 /* CB */
+        fe_add(x3, z3, z2);
+        fe_square(t1, x3);                  /* x3 nuevo */
+        fe_sub(x3, z3, z2);
+        fe_square(z3, x3);
+        fe_mul(x3, z3, x1);                 /* z3 nuevo */
+        fe_square(z3, t0);                  /* AA */
+        fe_square(t0, x2);                  /* BB */
+        fe_mul(x2, z3, t0);                 /* x2 nuevo */
+        fe_sub(z3, z3, t0);                 /* E */
+        fe_mul121666(z2, z3);
+        fe_add(z2, z2, t0);
+        fe_mul(t0, z3, z2);                 /* z2 nuevo */
+
+        rotate = z2;
+        z2 = t0;
+        t0 = rotate;
+        rotate = z3;
+        z3 = x3;
+        x3 = t1;
+        t1 = rotate;
+
+        // Un paso son 7232 productos 8x8 (test_x25519.c). El aviso al
+        // lector queda de respaldo: solo sale si ya se ha ido la mitad
+        // del tiempo de espera
+        usim_keep_alive((uint16_t)(index + X25519_INVERT_STEPS));
+
+        if(index == 0U) {
+            break;
+        }
+        index--;
+    }
+    fe_cswap(x2, x3, swap);
+    fe_cswap(z2, z3, swap);
+
+    // x1 ya no hace falta: output sirve de temporal en la inversión
+    fe_invert(x3, z2, z3, t0, t1, output);
+    fe_mul(output, x2, x3);
+    fe_freeze(output);
+
+    memset(usim_keccak_state, 0, FE_SLOTS * FE_SIZE);
+}
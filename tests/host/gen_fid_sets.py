@@ -0,0 +1,55 @@
+#!/usr/bin/env python3
+"""Índices FID de prueba para test_fid_index.c.
+
+Genera con ``build_index()`` de ``scripts/gen_fid_index.py`` el hash
+perfecto de varios conjuntos de FID aleatorios (semilla fija), de tamaños
+como los de un perfil 3GPP real, para medir en el PC la búsqueda en
+función del tamaño de la tabla.
+"""
+
+from __future__ import annotations
+
+import random
+import sys
+from pathlib import Path
+
+sys.path.insert(0, str(Path(__file__).resolve().parents[2] / "scripts"))
+
+from gen_fid_index import build_index  # noqa: E402
+
+SIZES = (16, 64, 100, 200)
+
+
+def c_array(values) -> str:
+    return ", ".join(f"0x{value:02X}" for value in values)
+
+
+def main() -> int:
+    if len(sys.argv) != 2:
+        print("uso: gen_fid_sets.py salida.h")
+        return 1
+
+    rng = random.Random(0x7816)
+    lines = ["// Generado por tests/host/gen_fid_sets.py: no editar", ""]
+    names = []
+    for size in SIZES:
+        fids = rng.sample(range(0x2F00, 0x7000), size)
+        disps, slots = build_index(fids)
+        name = f"fid_set_{size}"
+        names.append(name)
+        lines.append(f"static const uint16_t {name}_fids[] = {{{', '.join(f'0x{fid:04X}' for fid in fids)}}};")
+        lines.append(f"static const uint8_t {name}_disp[] = {{{c_array(disps)}}};")
+        lines.append(f"static const uint8_t {name}_slots[] = {{{c_array(slots)}}};")
+        lines.append("")
+
+    lines.append("static const fid_set_t fid_sets[] = {")
+    for size, name in zip(SIZES, names):
+        lines.append(f"    {{{size}U, {name}_fids, {name}_disp, sizeof({name}_disp), {name}_slots, "
+                     f"sizeof({name}_slots)}},")
+    lines.append("};")
+    Path(sys.argv[1]).write_text("\n".join(lines) + "\n", encoding="utf-8")
+    return 0
+
+
+if __name__ == "__main__":
+    raise SystemExit(main())
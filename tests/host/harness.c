@@ -0,0 +1,100 @@
+#include "harness.h"
+#include "usim_app.h"
+#include "usim_constants.h"
+#include "apdu_handler.h"
+#include <stdio.h>
+#include <string.h>
+
+// Globales que en la tarjeta define main.c
+session_context_t session;
+subscriber_data_t subscriber;
+current_file_t current_file;
+
+uint8_t host_resp[USIM_APDU_RESPONSE_MAX_LEN];
+uint16_t host_resp_len = 0U;
+
+static unsigned host_checks = 0U;
+static unsigned host_failures = 0U;
+
+void host_check(bool ok, const char* file, int line, const char* text) {
+    host_checks++;
+    if(!ok) {
+        host_failures++;
+        printf("%s:%d: FALLO %s\n", file, line, text);
+    }
+}
+
+void host_check_eq(unsigned long actual, unsigned long expected, const char* file, int line, const char* text) {
+    host_checks++;
+    if(actual != expected) {
+        host_failures++;
+        printf("%s:%d: FALLO %s = 0x%lX, se esperaba 0x%lX\n", file, line, text, actual, expected);
+    }
+}
+
+void host_check_hex(const uint8_t* actual, uint16_t length, const char* expected_hex,
+                    const char* file, int line, const char* text) {
+    uint8_t expected[512];
+    uint16_t expected_len = host_hex(expected_hex, expected);
+    uint16_t i;
+
+    host_checks++;
+    if(expected_len == length && memcmp(actual, expected, length) == 0) {
+        return;
+    }
+
+    host_failures++;
+    printf("%s:%d: FALLO %s =\n    ", file, line, text);
+    for(i = 0U; i < length; i++) {
+        printf("%02X", actual[i]);
+    }
+    printf("\n  se esperaba\n    %s\n", expected_hex);
+}
+
+int host_report(const char* name) {
+    printf("%s: %u comprobaciones, %u fallos\n", name, host_checks, host_failures);
+    return (host_failures == 0U) ? 0 : 1;
+}
+
+uint16_t host_hex(const char* hex, uint8_t* output) {
+    uint16_t length = 0U;
+    unsigned value;
+
+    while(*hex != '\0') {
+        if(*hex == ' ') {
+            hex++;
+            continue;
+        }
+        if(sscanf(hex, "%2x", &value) != 1) {
+            break;
+        }
+        output[length++] = (uint8_t)value;
+        hex += 2;
+    }
+    return length;
+}
+
+uint16_t host_apdu(const char* hex) {
+    uint8_t command[USIM_APDU_COMMAND_MAX_LEN + 8U];
+    uint8_t response[USIM_APDU_RESPONSE_MAX_LEN];
+    uint16_t length = host_hex(hex, command);
+    uint16_t response_len = 0U;
+
+    (void)apdu_process_command(command, length, response, &response_len);
+    if(response_len < 2U) {
+        host_resp_len = 0U;
+        return 0U;
+    }
+
+    host_resp_len = (uint16_t)(response_len - 2U);
+    memcpy(host_resp, response, host_resp_len);
+    return (uint16_t)((response[response_len - 2U] << 8) | response[response_len - 1U]);
+}
+
+void host_boot(bool verified) {
+    usim_init();
+    (void)host_apdu("00A4040C10 A0000000871002FF33FF018900000100");
+    if(verified) {
+        (void)host_apdu("0020000108 30303030FFFFFFFF");
+    }
+}
@@ -0,0 +1,74 @@
+#ifndef HARNESS_H
+#define HARNESS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <setjmp.h>
+
+// Comprobaciones: un fallo se informa y la prueba sigue; host_report()
+// devuelve el código de salida del programa
+#define CHECK(cond) \
+    host_check((cond) != 0, __FILE__, __LINE__, #cond)
+#define CHECK_EQ(actual, expected) \
+    host_check_eq((unsigned long)(actual), (unsigned long)(expected), __FILE__, __LINE__, #actual)
+#define CHECK_HEX(actual, length, expected_hex) \
+    host_check_hex((const uint8_t*)(actual), (length), (expected_hex), __FILE__, __LINE__, #actual)
+
+void host_check(bool ok, const char* file, int line, const char* text);
+void host_check_eq(unsigned long actual, unsigned long expected, const char* file, int line, const char* text);
+void host_check_hex(const uint8_t* actual, uint16_t length, const char* expected_hex,
+                    const char* file, int line, const char* text);
+int host_report(const char* name);
+
+// Hexadecimal con espacios opcionales; devuelve el número de bytes
+uint16_t host_hex(const char* hex, uint8_t* output);
+
+// APDU por apdu_process_command(): devuelve SW1SW2 y deja los datos de la
+// respuesta (sin SW) en host_resp / host_resp_len
+extern uint8_t host_resp[];
+extern uint16_t host_resp_len;
+uint16_t host_apdu(const char* hex);
+
+// Arranque de la tarjeta: usim_init() y selección de la ADF USIM; con
+// "verified", además, PIN1 verificado
+void host_boot(bool verified);
+
+// --- Dobles de chip_init.c (host_io.c) --------------------------------------
+
+// Transporte: lo que lee sim_receive_byte() y lo que envía sim_send_byte();
+// host_rx_misses cuenta las lecturas con la cola vacía (timeouts) desde el
+// último host_rx_feed()
+extern uint8_t host_protocol;
+extern uint8_t host_tx[];
+extern uint16_t host_tx_len;
+extern uint16_t host_rx_misses;
+void host_rx_feed(const char* hex);
+uint16_t host_rx_left(void);
+void host_tx_clear(void);
+
+// APDU por el transporte (usim_receive_apdu(), apdu_process_command() y
+// usim_send_response()) como en el bucle de main.c, con el protocolo de
+// host_protocol. Devuelve SW1SW2 (0 si no hubo respuesta) y suma a
+// host_bus_bytes los bytes que pasan por la línea en los dos sentidos.
+extern uint32_t host_bus_bytes;
+uint16_t host_exchange(const char* hex);
+
+// Cronómetro: cada lectura de sim_elapsed_ticks() avanza host_elapsed_step
+// ticks; sim_wait_time_ticks() devuelve host_wait_ticks
+extern uint32_t host_elapsed_step;
+extern uint32_t host_wait_ticks;
+
+// Flash de datos: host_flash_cut_after(n) deja pasar n operaciones
+// (bytes programados o sectores borrados) y en la siguiente simula un
+// corte de alimentación con longjmp(host_flash_cut); -1 sin corte
+extern jmp_buf host_flash_cut;
+extern uint32_t host_flash_ops;
+extern uint32_t host_flash_read_bytes;   /* Bytes leídos con flash_read() */
+extern uint16_t host_flash_erases[];
+void host_flash_blank(void);
+void host_flash_cut_after(long operations);
+void host_flash_save(uint8_t* image);
+void host_flash_restore(const uint8_t* image);
+uint32_t host_flash_size(void);
+
+#endif
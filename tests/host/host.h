@@ -0,0 +1,39 @@
+#ifndef HOST_H
+#define HOST_H
+
+// Se incluye delante de cada fuente (gcc -include) para compilar el
+// firmware en el PC: las extensiones de SDCC desaparecen y los SFR pasan a
+// ser variables globales.
+#define __sfr           volatile unsigned char
+#define __sbit          volatile unsigned char
+#define __at(address)
+#define __interrupt(n)
+#define __using(n)
+#define __code
+#define __xdata
+#define __idata
+#define __data
+#define __pdata
+#define __near
+#define __far
+#define __critical
+#define __reentrant
+#define __naked
+
+// "__asm nop __endasm;" queda en una sentencia vacía
+#define __asm           ((void)0)
+#define __endasm
+#define nop
+
+#if HOST_LINE
+// Pruebas de chip_init.c: el Timer 0, sus interrupciones y el modo IDLE
+// los simula host_line.c
+#define TCON            (*host_line_tcon())
+#define PCON            (*host_line_pcon())
+#define IE              (*host_line_ie())
+volatile unsigned char* host_line_tcon(void);
+volatile unsigned char* host_line_pcon(void);
+volatile unsigned char* host_line_ie(void);
+#endif
+
+#endif
@@ -0,0 +1,194 @@
+#include "harness.h"
+#include "chip_specific.h"
+#include "usim_app.h"
+#include "apdu_handler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Dobles de chip_init.c para probar el firmware por encima del transporte:
+// bytes en cola en lugar de la línea IO, un cronómetro que avanza a golpes
+// fijos y la flash de datos en memoria con cortes de alimentación a
+// voluntad.
+
+uint8_t host_protocol = 0U;
+
+static uint8_t host_rx[1024];
+static uint16_t host_rx_len = 0U;
+static uint16_t host_rx_pos = 0U;
+
+uint8_t host_tx[4096];
+uint16_t host_tx_len = 0U;
+uint16_t host_rx_misses = 0U;
+
+void host_rx_feed(const char* hex) {
+    host_rx_len = host_hex(hex, host_rx);
+    host_rx_pos = 0U;
+    host_rx_misses = 0U;
+}
+
+uint16_t host_rx_left(void) {
+    return (uint16_t)(host_rx_len - host_rx_pos);
+}
+
+void host_tx_clear(void) {
+    host_tx_len = 0U;
+}
+
+bool sim_send_byte(uint8_t data) {
+    if(host_tx_len < sizeof(host_tx)) {
+        host_tx[host_tx_len++] = data;
+    }
+    return true;
+}
+
+// Sin bytes en cola el lector no envía nada: timeout
+bool sim_receive_byte(uint8_t* data, uint32_t timeout_cycles) {
+    (void)timeout_cycles;
+    if(host_rx_pos >= host_rx_len) {
+        host_rx_misses++;
+        return false;
+    }
+    *data = host_rx[host_rx_pos++];
+    return true;
+}
+
+uint8_t sim_get_protocol(void) {
+    return host_protocol;
+}
+
+uint32_t host_bus_bytes = 0UL;
+
+uint16_t host_exchange(const char* hex) {
+    static uint8_t command[USIM_APDU_COMMAND_MAX_LEN];
+    static uint8_t response[USIM_APDU_RESPONSE_MAX_LEN];
+    uint16_t command_len = 0U;
+    uint16_t response_len = 0U;
+
+    host_tx_clear();
+    host_rx_feed(hex);
+    if(usim_receive_apdu(command, &command_len)) {
+        (void)apdu_process_command(command, command_len, response, &response_len);
+        usim_send_response(response, response_len);
+    }
+
+    host_bus_bytes += (uint32_t)(host_hex(hex, command) - host_rx_left() + host_tx_len);
+    if(host_tx_len < 2U) {
+        return 0U;
+    }
+    return (uint16_t)((host_tx[host_tx_len - 2U] << 8) | host_tx[host_tx_len - 1U]);
+}
+
+uint32_t host_elapsed_step = 0UL;
+uint32_t host_wait_ticks = 1228800UL;
+static uint32_t host_elapsed = 0UL;
+
+void sim_elapsed_start(void) {
+    host_elapsed = 0UL;
+}
+
+uint32_t sim_elapsed_ticks(void) {
+    host_elapsed += host_elapsed_step;
+    return host_elapsed;
+}
+
+uint32_t sim_wait_time_ticks(void) {
+    return host_wait_ticks;
+}
+
+void uart_send_char(char c) {
+    (void)c;
+}
+
+void uart_send_string(const char* str) {
+    (void)str;
+}
+
+// Flash de datos
+static uint8_t host_flash[NVM_SECTOR_COUNT * FLASH_SECTOR_SIZE];
+static bool host_flash_ready = false;
+static long host_flash_budget = -1L;
+jmp_buf host_flash_cut;
+uint32_t host_flash_ops = 0UL;
+uint32_t host_flash_read_bytes = 0UL;
+uint16_t host_flash_erases[NVM_SECTOR_COUNT];
+
+void host_flash_blank(void) {
+    memset(host_flash, FLASH_ERASED_BYTE, sizeof(host_flash));
+    memset(host_flash_erases, 0, sizeof(host_flash_erases));
+    host_flash_ready = true;
+    host_flash_budget = -1L;
+}
+
+void host_flash_cut_after(long operations) {
+    host_flash_budget = operations;
+}
+
+void host_flash_save(uint8_t* image) {
+    memcpy(image, host_flash, sizeof(host_flash));
+}
+
+void host_flash_restore(const uint8_t* image) {
+    memcpy(host_flash, image, sizeof(host_flash));
+}
+
+uint32_t host_flash_size(void) {
+    return sizeof(host_flash);
+}
+
+static uint8_t* host_flash_at(uint32_t address) {
+    if(!host_flash_ready) {
+        host_flash_blank();
+    }
+    if(address < NVM_FLASH_BASE || address >= NVM_FLASH_BASE + sizeof(host_flash)) {
+        printf("flash: dirección %06lX fuera de la zona de datos\n", (unsigned long)address);
+        abort();
+    }
+    return &host_flash[address - NVM_FLASH_BASE];
+}
+
+static void host_flash_operation(void) {
+    host_flash_ops++;
+    if(host_flash_budget == 0L) {
+        host_flash_budget = -1L;
+        longjmp(host_flash_cut, 1);
+    }
+    if(host_flash_budget > 0L) {
+        host_flash_budget--;
+    }
+}
+
+void flash_read(uint32_t address, uint8_t* data, uint16_t length) {
+    uint16_t i;
+
+    host_flash_read_bytes += length;
+    for(i = 0U; i < length; i++) {
+        data[i] = *host_flash_at(address + i);
+    }
+}
+
+// Como en el chip, programar solo pasa bits de 1 a 0
+bool flash_program(uint32_t address, const uint8_t* data, uint16_t length) {
+    uint16_t i;
+
+    for(i = 0U; i < length; i++) {
+        uint8_t* cell = host_flash_at(address + i);
+
+        host_flash_operation();
+        if((*cell & data[i]) != data[i]) {
+            printf("flash: programar %06lX pasaría bits de 0 a 1\n", (unsigned long)(address + i));
+            abort();
+        }
+        *cell &= data[i];
+    }
+    return true;
+}
+
+bool flash_erase_sector(uint32_t address) {
+    uint32_t sector = address & ~((uint32_t)FLASH_SECTOR_SIZE - 1UL);
+
+    host_flash_operation();
+    memset(host_flash_at(sector), FLASH_ERASED_BYTE, FLASH_SECTOR_SIZE);
+    host_flash_erases[(sector - NVM_FLASH_BASE) / FLASH_SECTOR_SIZE]++;
+    return true;
+}
@@ -0,0 +1,294 @@
+#include "host_line.h"
+#include "harness.h"
+#include "chip_specific.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define HOST_LINE_MAX_SEGMENTS  4096U
+#define HOST_LINE_MAX_RX        256U
+#define HOST_LINE_FRAME_BITS    10U     /* Start, 8 datos y paridad */
+
+static volatile unsigned char host_line_tcon_reg = 0U;
+static volatile unsigned char host_line_pcon_reg = 0U;
+static volatile unsigned char host_line_ie_reg = 0U;
+static bool host_line_polling = false;
+static uint16_t host_line_latency = 0U;
+
+static bool host_line_level[HOST_LINE_MAX_SEGMENTS];
+static uint32_t host_line_ticks[HOST_LINE_MAX_SEGMENTS];
+static uint16_t host_line_count = 0U;
+
+// Recepción por pasos de tiempo (en ticks del Timer 0): ETU del lector,
+// desviación de sus flancos y latencia de las ISR
+static uint32_t host_line_now = 0UL;
+static uint32_t host_line_reader_etu = 93UL;
+static uint8_t host_line_jitter = 0U;        /* % de ETU, a cada lado */
+static uint8_t host_line_isr_latency = 0U;   /* Máxima, en ticks */
+static uint32_t host_line_seed = 1UL;
+static int32_t host_line_errors[HOST_LINE_FRAME_BITS];
+static uint8_t host_line_samples = 0U;
+
+static uint8_t host_line_rx_value[HOST_LINE_MAX_RX];
+static bool host_line_rx_parity[HOST_LINE_MAX_RX];
+static uint16_t host_line_rx_len = 0U;
+static uint16_t host_line_rx_pos = 0U;
+
+void host_line_reset(void) {
+    host_line_count = 0U;
+    host_line_rx_len = 0U;
+    host_line_rx_pos = 0U;
+    host_line_latency = 0U;
+    host_line_now = 0UL;
+    host_line_reader_etu = 93UL;
+    host_line_jitter = 0U;
+    host_line_isr_latency = 0U;
+    host_line_seed = 1UL;
+    host_line_samples = 0U;
+    P1 |= SIM_IO_PIN;
+}
+
+void host_line_set_rx_timing(uint32_t etu, uint8_t jitter_percent, uint8_t isr_latency) {
+    host_line_reader_etu = etu;
+    host_line_jitter = jitter_percent;
+    host_line_isr_latency = isr_latency;
+}
+
+void host_line_set_latency(uint16_t ticks) {
+    host_line_latency = ticks;
+}
+
+static void host_line_record(bool level, uint32_t ticks) {
+    if(host_line_count > 0U && host_line_level[host_line_count - 1U] == level) {
+        host_line_ticks[host_line_count - 1U] += ticks;
+        return;
+    }
+    if(host_line_count >= HOST_LINE_MAX_SEGMENTS) {
+        printf("host_line: demasiados tramos\n");
+        abort();
+    }
+    host_line_level[host_line_count] = level;
+    host_line_ticks[host_line_count] = ticks;
+    host_line_count++;
+}
+
+// Con la interrupción del Timer 0 habilitada el timer no es una espera por
+// sondeo (recepción o cronómetro)
+volatile unsigned char* host_line_ie(void) {
+    if((host_line_ie_reg & IE_ET0) != 0U) {
+        host_line_polling = false;
+    }
+    return &host_line_ie_reg;
+}
+
+// Espera por sondeo: si el Timer 0 se arrancó con su interrupción
+// deshabilitada, el desborde llega en la siguiente lectura. Parar el timer
+// que dejó en marcha la recepción no es una espera. El firmware tarda
+// host_line_latency ticks en ver el desborde y volver a tocar el pin o el
+// timer; mientras tanto el modo 1 sigue contando desde 0000.
+volatile unsigned char* host_line_tcon(void) {
+    if((host_line_ie_reg & IE_ET0) != 0U) {
+        host_line_polling = false;
+    } else if((host_line_tcon_reg & TCON_TR0) == 0U) {
+        host_line_polling = true;
+    } else if(host_line_polling && (host_line_tcon_reg & TCON_TF0) == 0U) {
+        uint32_t ticks = 0x10000UL - (((uint32_t)TH0 << 8) | TL0);
+
+        host_line_record((P1 & SIM_IO_PIN) != 0U, ticks + host_line_latency);
+        TH0 = (uint8_t)(host_line_latency >> 8);
+        TL0 = (uint8_t)(host_line_latency & 0xFFU);
+        host_line_tcon_reg |= TCON_TF0;
+    }
+    return &host_line_tcon_reg;
+}
+
+static bool host_line_timer_armed(void) {
+    return (host_line_ie_reg & IE_ET0) != 0U && (host_line_tcon_reg & TCON_TR0) != 0U;
+}
+
+static void host_line_set_io(bool level) {
+    if(level) {
+        P1 |= SIM_IO_PIN;
+    } else {
+        P1 &= (uint8_t)~SIM_IO_PIN;
+    }
+}
+
+// Pseudoaleatorio reproducible en [0, range]
+static uint32_t host_line_random(uint32_t range) {
+    host_line_seed = (host_line_seed * 1103515245UL) + 12345UL;
+    return ((host_line_seed >> 8) & 0xFFFFUL) % (range + 1UL);
+}
+
+// Un carácter del lector: start, datos (LSB primero), paridad par y stop.
+// Cada flanco se desvía hasta host_line_jitter % de la ETU. El flanco de
+// start dispara INT0 y cada desborde del Timer 0 su interrupción, las dos
+// con una latencia de hasta host_line_isr_latency ticks; mientras tanto el
+// timer sigue contando desde 0000, que es lo que ve la ISR al recargar.
+// El nivel que lee cada ISR es el de la línea en ese instante.
+static void host_line_deliver(uint8_t value, bool parity_ok) {
+    uint32_t edges[HOST_LINE_FRAME_BITS + 1U];
+    bool levels[HOST_LINE_FRAME_BITS];
+    uint32_t etu = host_line_reader_etu;
+    uint32_t jitter = (etu * host_line_jitter) / 100UL;
+    uint32_t start = host_line_now + etu;
+    uint32_t now;
+    uint8_t parity = 0U;
+    uint8_t bit;
+
+    levels[0] = false;
+    for(bit = 0U; bit < 8U; bit++) {
+        levels[1U + bit] = ((value >> bit) & 0x01U) != 0U;
+        parity ^= levels[1U + bit] ? 1U : 0U;
+    }
+    levels[9] = (parity != 0U) == parity_ok;
+
+    edges[0] = start;
+    for(bit = 1U; bit <= HOST_LINE_FRAME_BITS; bit++) {
+        edges[bit] = start + (bit * etu) + host_line_random(2UL * jitter) - jitter;
+    }
+
+    now = start + host_line_random(host_line_isr_latency);
+    host_line_set_io(false);
+    sim_io_start_isr();
+
+    for(host_line_samples = 0U; host_line_samples < HOST_LINE_FRAME_BITS && host_line_timer_armed();
+        host_line_samples++) {
+        uint32_t latency = host_line_random(host_line_isr_latency);
+        uint8_t index = host_line_samples;
+
+        now += 0x10000UL - (((uint32_t)TH0 << 8) | TL0) + latency;
+        TH0 = (uint8_t)(latency >> 8);
+        TL0 = (uint8_t)(latency & 0xFFU);
+
+        // Bit de la trama que hay en la línea en este instante
+        bit = 0U;
+        while(bit < HOST_LINE_FRAME_BITS && now >= edges[bit + 1U]) {
+            bit++;
+        }
+        host_line_set_io(bit >= HOST_LINE_FRAME_BITS || levels[bit]);
+        host_line_errors[index] = (int32_t)(now - ((edges[index] + edges[index + 1U]) / 2UL));
+        sim_rx_timer_isr();
+    }
+
+    host_line_set_io(true);
+    host_line_now = (now > edges[HOST_LINE_FRAME_BITS]) ? now : edges[HOST_LINE_FRAME_BITS];
+}
+
+uint8_t host_line_rx_samples(void) {
+    return host_line_samples;
+}
+
+int32_t host_line_rx_sample_error(uint8_t bit) {
+    return host_line_errors[bit];
+}
+
+volatile unsigned char* host_line_pcon(void) {
+    if(host_line_rx_pos < host_line_rx_len && (host_line_ie_reg & IE_EX0) != 0U) {
+        host_line_deliver(host_line_rx_value[host_line_rx_pos], host_line_rx_parity[host_line_rx_pos]);
+        host_line_rx_pos++;
+    } else if(host_line_timer_armed()) {
+        sim_rx_timer_isr();
+    } else {
+        printf("host_line: IDLE sin ninguna interrupción que lo despierte\n");
+        abort();
+    }
+    return &host_line_pcon_reg;
+}
+
+void host_line_rx(uint8_t value, bool parity_ok) {
+    if(host_line_rx_len < HOST_LINE_MAX_RX) {
+        host_line_rx_value[host_line_rx_len] = value;
+        host_line_rx_parity[host_line_rx_len] = parity_ok;
+        host_line_rx_len++;
+    }
+}
+
+void host_line_rx_hex(const char* hex) {
+    uint8_t bytes[HOST_LINE_MAX_RX];
+    uint16_t length = host_hex(hex, bytes);
+    uint16_t i;
+
+    for(i = 0U; i < length; i++) {
+        host_line_rx(bytes[i], true);
+    }
+}
+
+uint16_t host_line_rx_left(void) {
+    return (uint16_t)(host_line_rx_len - host_line_rx_pos);
+}
+
+uint16_t host_line_segments(void) {
+    return host_line_count;
+}
+
+uint32_t host_line_segment_ticks(uint16_t index) {
+    return host_line_ticks[index];
+}
+
+bool host_line_segment_level(uint16_t index) {
+    return host_line_level[index];
+}
+
+// Nivel de la línea "time" ticks después del primer tramo (alto al final)
+static bool host_line_level_at(uint32_t time) {
+    uint16_t i;
+
+    for(i = 0U; i < host_line_count; i++) {
+        if(time < host_line_ticks[i]) {
+            return host_line_level[i];
+        }
+        time -= host_line_ticks[i];
+    }
+    return true;
+}
+
+uint16_t host_line_tx_decode(uint32_t etu, uint8_t* output, uint16_t max) {
+    uint32_t total = 0UL;
+    uint32_t time = 0UL;
+    uint16_t length = 0U;
+    uint16_t i;
+
+    for(i = 0U; i < host_line_count; i++) {
+        total += host_line_ticks[i];
+    }
+
+    while(length < max) {
+        uint8_t value = 0U;
+        uint8_t parity = 0U;
+        uint8_t bit;
+
+        // Flanco de bajada del start
+        while(time < total && host_line_level_at(time)) {
+            time++;
+        }
+        if(time >= total) {
+            break;
+        }
+
+        // Muestreo en el centro de cada ETU
+        for(bit = 0U; bit < HOST_LINE_FRAME_BITS; bit++) {
+            bool level = host_line_level_at(time + (bit * etu) + (etu / 2UL));
+
+            if(bit == 0U) {
+                if(level) {
+                    return length;
+                }
+            } else if(bit <= 8U) {
+                value |= (uint8_t)((level ? 1U : 0U) << (bit - 1U));
+                parity ^= level ? 1U : 0U;
+            } else if((parity != 0U) != level) {
+                return length;
+            }
+        }
+
+        // Stop en alto
+        if(!host_line_level_at(time + (HOST_LINE_FRAME_BITS * etu) + (etu / 2UL))) {
+            return length;
+        }
+
+        output[length++] = value;
+        time += (HOST_LINE_FRAME_BITS * etu) + (etu / 2UL);
+    }
+
+    return length;
+}
@@ -0,0 +1,53 @@
+#ifndef HOST_LINE_H
+#define HOST_LINE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Línea IO y Timer 0 simulados para probar chip_init.c (se compila con
+// HOST_LINE=1, ver host.h).
+//
+// Envío: sim_send_byte() mantiene cada nivel esperando por sondeo el
+// desborde del Timer 0 (ET0 deshabilitada); cada espera se anota como un
+// tramo (nivel, ticks) y termina al instante.
+//
+// Recepción: cuando el firmware duerme en IDLE esperando un byte, el
+// siguiente carácter en cola se entrega por las ISR como lo haría el
+// hardware (flanco de start en INT0 y una interrupción del Timer 0 por
+// bit), avanzando un reloj en ticks: la línea cambia en los flancos del
+// lector y cada ISR lee el nivel del instante en que entra. Sin nada en
+// cola pasa un periodo de espera del Timer 0.
+
+void host_line_reset(void);
+
+// Ticks que tarda el firmware desde el desborde de una espera por sondeo
+// hasta su siguiente acción (0 tras host_line_reset())
+void host_line_set_latency(uint16_t ticks);
+
+// Carácter que enviará el lector; "parity_ok" en falso invierte la paridad
+void host_line_rx(uint8_t value, bool parity_ok);
+void host_line_rx_hex(const char* hex);
+uint16_t host_line_rx_left(void);
+
+// ETU del lector en ticks, desviación máxima de cada flanco (% de la ETU,
+// a cada lado) y latencia máxima de las ISR en ticks. Tras
+// host_line_reset(): 93, 0 y 0.
+void host_line_set_rx_timing(uint32_t etu, uint8_t jitter_percent, uint8_t isr_latency);
+
+// Muestreos del último carácter recibido (start, 8 datos y paridad) y
+// distancia en ticks de cada uno al centro de su bit tal como lo envió el
+// lector (negativa si se muestreó antes)
+uint8_t host_line_rx_samples(void);
+int32_t host_line_rx_sample_error(uint8_t bit);
+
+// Tramos registrados desde el último host_line_reset()
+uint16_t host_line_segments(void);
+uint32_t host_line_segment_ticks(uint16_t index);
+bool host_line_segment_level(uint16_t index);
+
+// Decodifica los caracteres enviados suponiendo una ETU de "etu" ticks;
+// devuelve cuántos bytes con paridad correcta se leyeron hasta el primer
+// error de trama
+uint16_t host_line_tx_decode(uint32_t etu, uint8_t* output, uint16_t max);
+
+#endif
@@ -0,0 +1,219 @@
+// Lote de AKA (INS_BATCH_AUTH, CLA 80 INS A1): la tarjeta genera AUTN con
+// SQN consecutivos o verifica los que le da la red, y devuelve un registro
+// por vector; el SQN se graba una vez por lote
+#include "harness.h"
+#include "usim_app.h"
+#include "usim_auth.h"
+#include "usim_constants.h"
+#include "usim_milenage.h"
+#include "usim_secrets.h"
+#include <stdio.h>
+#include <string.h>
+
+#define AMF "8000"
+
+typedef struct {
+    uint8_t autn[USIM_AUTN_SIZE];
+    uint8_t res[USIM_MILENAGE_RES_SIZE];
+    uint8_t ck[16];
+    uint8_t ik[16];
+} vector_t;
+
+static void make_rand(uint8_t index, uint8_t* rand) {
+    memset(rand, 0xA5U, 16U);
+    rand[15] = index;
+}
+
+// La red: el vector de SEQ/IND para el RAND, con la K y el OPc de la tarjeta
+static void network_vector(const uint8_t* rand, uint64_t seq, vector_t* vector) {
+    uint8_t k[USIM_SECRET_KEY_SIZE];
+    uint8_t opc[USIM_SECRET_KEY_SIZE];
+    uint8_t sqn[USIM_MILENAGE_SQN_SIZE];
+    uint8_t ak[USIM_MILENAGE_AK_SIZE];
+    uint64_t value = seq << USIM_SQN_IND_BITS;
+    uint8_t i;
+
+    for(i = 0U; i < USIM_MILENAGE_SQN_SIZE; i++) {
+        sqn[USIM_MILENAGE_SQN_SIZE - 1U - i] = (uint8_t)(value >> (8U * i));
+    }
+    usim_secret_get(USIM_SECRET_K, k);
+    usim_secret_get(USIM_SECRET_OPC, opc);
+    usim_milenage_init(k, opc, rand);
+    usim_milenage_f2345(vector->res, vector->ck, vector->ik, ak);
+    for(i = 0U; i < USIM_MILENAGE_SQN_SIZE; i++) {
+        vector->autn[i] = (uint8_t)(sqn[i] ^ ak[i]);
+    }
+    (void)host_hex(AMF, &vector->autn[USIM_AUTN_AMF_OFFSET]);
+    usim_milenage_f1(sqn, &vector->autn[USIM_AUTN_AMF_OFFSET], &vector->autn[USIM_AUTN_MAC_OFFSET], NULL);
+}
+
+static void append_hex(char* apdu, const uint8_t* data, uint8_t len) {
+    uint8_t i;
+
+    for(i = 0U; i < len; i++) {
+        (void)sprintf(&apdu[strlen(apdu)], "%02X", data[i]);
+    }
+}
+
+// Caso 4 en T=0: 61xx y GET RESPONSE
+static uint16_t command(const char* hex) {
+    char get_response[16];
+    uint16_t sw = host_apdu(hex);
+
+    if((sw & 0xFF00U) != 0x6100U) {
+        return sw;
+    }
+    (void)sprintf(get_response, "00C00000%02X", sw & 0xFFU);
+    return host_apdu(get_response);
+}
+
+// Lote generado: AUTN, RES, CK e IK de una red que espera SEQ_MS + 1, + 2...
+static void test_generate(void) {
+    static char apdu[600];
+    uint8_t rand[16];
+    vector_t vector;
+    uint8_t i;
+
+    host_flash_blank();
+    host_boot(true);
+    (void)sprintf(apdu, "80A1010042" AMF);
+    for(i = 0U; i < 4U; i++) {
+        make_rand(i, rand);
+        append_hex(apdu, rand, sizeof(rand));
+    }
+    CHECK_EQ(command(apdu), 0x9000U);
+    CHECK_EQ(host_resp_len, 4U * USIM_BATCH_GEN_RECORD_SIZE);
+
+    for(i = 0U; i < 4U; i++) {
+        const uint8_t* record = &host_resp[i * USIM_BATCH_GEN_RECORD_SIZE];
+
+        make_rand(i, rand);
+        network_vector(rand, i + 1U, &vector);
+        CHECK_EQ(record[0], USIM_AKA_OK);
+        CHECK(memcmp(&record[1], vector.autn, USIM_AUTN_SIZE) == 0);
+        record = &record[1U + USIM_AUTN_SIZE];
+        CHECK(memcmp(record, vector.res, USIM_MILENAGE_RES_SIZE) == 0);
+        CHECK(memcmp(&record[USIM_AUTH_RES_MAX], vector.ck, 16U) == 0);
+        CHECK(memcmp(&record[USIM_AUTH_RES_MAX + 16U], vector.ik, 16U) == 0);
+    }
+
+    // El SQN del lote quedó grabado: tras un reset SEQ 5 vale y SEQ 4 no
+    host_boot(true);
+    make_rand(0x10U, rand);
+    network_vector(rand, 5U, &vector);
+    (void)sprintf(apdu, "80A1000020");
+    append_hex(apdu, rand, sizeof(rand));
+    append_hex(apdu, vector.autn, USIM_AUTN_SIZE);
+    CHECK_EQ(command(apdu), 0x9000U);
+    CHECK_EQ(host_resp[0], USIM_AKA_OK);
+    make_rand(0x11U, rand);
+    network_vector(rand, 4U, &vector);
+    (void)sprintf(apdu, "80A1000020");
+    append_hex(apdu, rand, sizeof(rand));
+    append_hex(apdu, vector.autn, USIM_AUTN_SIZE);
+    CHECK_EQ(command(apdu), 0x9000U);
+    CHECK_EQ(host_resp[0], USIM_AKA_SYNC_FAILURE);
+}
+
+// Lote verificado: un vector válido, el mismo repetido y uno con MAC-A malo
+static void test_verify(void) {
+    static char apdu[600];
+    uint8_t rand[16];
+    vector_t vector;
+    const uint8_t* record;
+
+    host_flash_blank();
+    host_boot(true);
+    make_rand(0x20U, rand);
+    network_vector(rand, 10U, &vector);
+    (void)sprintf(apdu, "80A1000060");
+    append_hex(apdu, rand, sizeof(rand));
+    append_hex(apdu, vector.autn, USIM_AUTN_SIZE);
+    append_hex(apdu, rand, sizeof(rand));
+    append_hex(apdu, vector.autn, USIM_AUTN_SIZE);
+    vector.autn[USIM_AUTN_MAC_OFFSET] ^= 0x01U;
+    append_hex(apdu, rand, sizeof(rand));
+    append_hex(apdu, vector.autn, USIM_AUTN_SIZE);
+    CHECK_EQ(command(apdu), 0x9000U);
+    CHECK_EQ(host_resp_len, 3U * USIM_BATCH_RECORD_SIZE);
+
+    record = host_resp;
+    CHECK_EQ(record[0], USIM_AKA_OK);
+    CHECK(memcmp(&record[1], vector.res, USIM_MILENAGE_RES_SIZE) == 0);
+    CHECK(memcmp(&record[1U + USIM_AUTH_RES_MAX], vector.ck, 16U) == 0);
+    record = &record[USIM_BATCH_RECORD_SIZE];
+    CHECK_EQ(record[0], USIM_AKA_SYNC_FAILURE);
+    record = &record[USIM_BATCH_RECORD_SIZE];
+    CHECK_EQ(record[0], USIM_AKA_MAC_FAILURE);
+}
+
+static void test_errors(void) {
+    static char apdu[600];
+    uint8_t rand[16];
+    uint8_t i;
+
+    host_flash_blank();
+    host_boot(false);
+    CHECK_EQ(host_apdu("80A1010012" AMF "A5A5A5A5A5A5A5A5A5A5A5A5A5A5A5A5"), SW_SECURITY_STATUS_NOT_SATISFIED);
+
+    host_boot(true);
+    CHECK_EQ(host_apdu("80A1020012" AMF "A5A5A5A5A5A5A5A5A5A5A5A5A5A5A5A5"), SW_WRONG_P1P2);
+    CHECK_EQ(host_apdu("80A1010112" AMF "A5A5A5A5A5A5A5A5A5A5A5A5A5A5A5A5"), SW_WRONG_P1P2);
+    CHECK_EQ(host_apdu("80A1010002" AMF), SW_WRONG_LENGTH);
+    CHECK_EQ(host_apdu("80A1010011" AMF "A5A5A5A5A5A5A5A5A5A5A5A5A5A5A5"), SW_WRONG_LENGTH);
+
+    // Cinco registros generados no caben en una respuesta
+    (void)sprintf(apdu, "80A1010052" AMF);
+    for(i = 0U; i < 5U; i++) {
+        make_rand(i, rand);
+        append_hex(apdu, rand, sizeof(rand));
+    }
+    CHECK_EQ(host_apdu(apdu), SW_WRONG_LENGTH);
+}
+
+// Bytes NULL que la tarjeta intercala tras el byte de procedimiento
+static unsigned count_nulls(void) {
+    unsigned count = 0U;
+    uint16_t i;
+
+    for(i = 1U; (uint16_t)(i + 2U) < host_tx_len; i++) {
+        count += (host_tx[i] == 0x60U) ? 1U : 0U;
+    }
+    return count;
+}
+
+// Si cada vector consume medio tiempo de espera, en T=0 sale un byte NULL
+// entre vectores; sin que el tiempo pase, ninguno
+static void test_keep_alive(void) {
+    static char apdu[600];
+    uint8_t rand[16];
+    unsigned nulls;
+    uint8_t i;
+
+    host_protocol = 0U;
+    host_flash_blank();
+    host_boot(true);
+    (void)sprintf(apdu, "80A1010042" AMF);
+    for(i = 0U; i < 4U; i++) {
+        make_rand(i, rand);
+        append_hex(apdu, rand, sizeof(rand));
+    }
+
+    host_elapsed_step = 0UL;
+    CHECK_EQ(host_exchange(apdu), SW_BYTES_AVAILABLE(4U * USIM_BATCH_GEN_RECORD_SIZE));
+    CHECK_EQ(count_nulls(), 0U);
+
+    host_elapsed_step = host_wait_ticks / 2U;
+    CHECK_EQ(host_exchange(apdu), SW_BYTES_AVAILABLE(4U * USIM_BATCH_GEN_RECORD_SIZE));
+    nulls = count_nulls();
+    host_elapsed_step = 0UL;
+    CHECK(nulls >= 3U);
+}
+
+int main(void) {
+    test_generate();
+    test_verify();
+    test_errors();
+    test_keep_alive();
+    return host_report("test_batch");
+}
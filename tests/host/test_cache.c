@@ -0,0 +1,94 @@
+// Caché write-back de los EF marcados "write_back" (EF_LOCI): la escritura
+// se confirma en XRAM sin tocar la flash, se fusiona con la pendiente y se
+// vuelca en usim_files_flush() o al reiniciar; GET DIAGNOSTICS (80 D2)
+// devuelve los contadores y los ciclos del último comando lento
+#include "harness.h"
+#include "usim_app.h"
+#include "usim_constants.h"
+#include "usim_files.h"
+
+static void test_write_back(void) {
+    uint32_t ops;
+
+    host_flash_blank();
+    host_boot(true);
+    CHECK_EQ(host_apdu("80D200010B"), 0x9000U);
+
+    // EF_LOCI: 9000 sin programar nada y lectura desde la copia
+    ops = host_flash_ops;
+    CHECK_EQ(host_apdu("00D68B0001 AA"), 0x9000U);
+    CHECK_EQ(host_flash_ops - ops, 0U);
+    CHECK_EQ(usim_cache_pending(), 1U);
+    CHECK_EQ(host_apdu("00B08B0001"), 0x9000U);
+    CHECK_HEX(host_resp, host_resp_len, "AA");
+
+    // Una segunda escritura ocupa la misma entrada
+    CHECK_EQ(host_apdu("00D68B0101 BB"), 0x9000U);
+    CHECK_EQ(usim_cache_pending(), 1U);
+    CHECK_EQ(host_flash_ops - ops, 0U);
+
+    // Un EF write-through va a la flash en el mismo APDU
+    CHECK_EQ(host_apdu("00D6870001 08"), 0x9000U);
+    CHECK(host_flash_ops > ops);
+
+    ops = host_flash_ops;
+    CHECK(usim_files_flush());
+    CHECK(host_flash_ops > ops);
+    CHECK_EQ(usim_cache_pending(), 0U);
+
+    // Sin nada pendiente, volcar no cuesta nada
+    ops = host_flash_ops;
+    CHECK(usim_files_flush());
+    CHECK_EQ(host_flash_ops - ops, 0U);
+
+    // 1 lectura con datos pendientes, 1 escritura fusionada y 1 volcado;
+    // P2 bit 0 los pone a cero
+    CHECK_EQ(host_apdu("80D200010B"), 0x9000U);
+    CHECK_HEX(host_resp, 7U, "00010001000100");
+    CHECK_EQ(host_apdu("80D200000B"), 0x9000U);
+    CHECK_HEX(host_resp, 7U, "00000000000000");
+    CHECK_EQ(host_apdu("80D201000B"), SW_WRONG_PARAMETERS);
+}
+
+// Los 4 últimos bytes: ciclos del último comando lento, sin los avisos al
+// lector
+static void test_slow_ticks(void) {
+    uint32_t ticks;
+
+    host_protocol = 0U;
+    host_flash_blank();
+    host_boot(true);
+    CHECK_EQ(host_apdu("80D200010B"), 0x9000U);
+
+    // GET IDENTITY con el esquema nulo, por la línea
+    host_elapsed_step = 1000UL;
+    CHECK_EQ(host_exchange("807800010D"), 0x9000U);
+    host_elapsed_step = 0UL;
+    ticks = usim_slow_ticks;
+    CHECK(ticks > 0UL);
+    CHECK_EQ(host_apdu("80D200010B"), 0x9000U);
+    CHECK_EQ(host_resp_len, 11U);
+    CHECK_EQ(((uint32_t)host_resp[7] << 24) | ((uint32_t)host_resp[8] << 16) |
+             ((uint32_t)host_resp[9] << 8) | host_resp[10], ticks);
+    CHECK_EQ(usim_slow_ticks, 0UL);
+}
+
+// Un reset en caliente vuelca lo pendiente antes de montar la flash
+static void test_warm_reset(void) {
+    host_flash_blank();
+    host_boot(true);
+    CHECK_EQ(host_apdu("00D68B0002 CCDD"), 0x9000U);
+    CHECK_EQ(usim_cache_pending(), 1U);
+
+    host_boot(true);
+    CHECK_EQ(usim_cache_pending(), 0U);
+    CHECK_EQ(host_apdu("00B08B0002"), 0x9000U);
+    CHECK_HEX(host_resp, host_resp_len, "CCDD");
+}
+
+int main(void) {
+    test_write_back();
+    test_slow_ticks();
+    test_warm_reset();
+    return host_report("test_cache");
+}
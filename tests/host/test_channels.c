@@ -0,0 +1,132 @@
+// Canales lógicos: MANAGE CHANNEL y un archivo actual (con su puntero de
+// registro) por canal, tomado de CLA en apdu_process_command()
+#include "harness.h"
+#include "usim_app.h"
+#include "usim_constants.h"
+#include "apdu_handler.h"
+
+static unsigned selects;
+
+// host_apdu() contando los SELECT, que es lo que los canales ahorran
+static uint16_t apdu(const char* hex) {
+    uint8_t command[USIM_APDU_COMMAND_MAX_LEN];
+
+    (void)host_hex(hex, command);
+    if(command[1] == INS_SELECT_FILE) {
+        selects++;
+    }
+    return host_apdu(hex);
+}
+
+static void test_open_close(void) {
+    host_boot(true);
+
+    // La tarjeta asigna el primer canal libre
+    CHECK_EQ(apdu("0070000001"), 0x9000U);
+    CHECK_HEX(host_resp, host_resp_len, "01");
+    CHECK_EQ(apdu("0070000001"), 0x9000U);
+    CHECK_HEX(host_resp, host_resp_len, "02");
+    CHECK_EQ(apdu("0070000300"), 0x9000U);
+    CHECK_EQ(apdu("0070000001"), SW_NO_CHANNEL_AVAILABLE);
+    CHECK_EQ(apdu("0070000200"), SW_CONDITIONS_NOT_SATISFIED);
+
+    // Abierto desde el canal básico, el canal empieza en el MF
+    CHECK_EQ(apdu("03F2000005"), 0x9000U);
+    CHECK_EQ(apdu("03A4000C027F20"), 0x9000U);
+
+    // Cerrar: por P2 o desde el propio canal; el básico no se cierra
+    CHECK_EQ(apdu("0070800300"), 0x9000U);
+    CHECK_EQ(apdu("03B0000001"), SW_LOGICAL_CHANNEL_NOT_SUPPORTED);
+    CHECK_EQ(apdu("0270800000"), 0x9000U);
+    CHECK_EQ(apdu("02B0000001"), SW_LOGICAL_CHANNEL_NOT_SUPPORTED);
+    CHECK_EQ(apdu("0070800000"), SW_WRONG_P1P2);
+    CHECK_EQ(apdu("0070800200"), SW_WRONG_P1P2);
+
+    // Canales de la clase ampliada: no hay tantos
+    CHECK_EQ(apdu("40B0000001"), SW_LOGICAL_CHANNEL_NOT_SUPPORTED);
+
+    // Un reset los cierra todos
+    host_boot(true);
+    CHECK_EQ(apdu("01B0000001"), SW_LOGICAL_CHANNEL_NOT_SUPPORTED);
+}
+
+// Lecturas intercaladas en cuatro canales: cada uno se selecciona una vez y
+// mantiene su EF
+static void test_interleaved_reads(void) {
+    uint8_t round;
+
+    host_boot(true);
+    selects = 0U;
+
+    CHECK_EQ(apdu("0070000100"), 0x9000U);
+    CHECK_EQ(apdu("0070000200"), 0x9000U);
+    CHECK_EQ(apdu("0070000300"), 0x9000U);
+
+    CHECK_EQ(apdu("00A4000C026FAD"), 0x9000U);
+    CHECK_EQ(apdu("01A4080C047F206F07"), 0x9000U);
+    CHECK_EQ(apdu("02A4040C10A0000000871002FF33FF018900000100"), 0x9000U);
+    CHECK_EQ(apdu("02A4000C026F7E"), 0x9000U);
+    CHECK_EQ(apdu("03A4080C047FF06F78"), 0x9000U);
+
+    for(round = 0U; round < 3U; round++) {
+        CHECK_EQ(apdu("00B0000002"), 0x9000U);
+        CHECK_HEX(host_resp, host_resp_len, "0000");
+        CHECK_EQ(apdu("01B0000009"), 0x9000U);
+        CHECK_HEX(host_resp, host_resp_len, "080901020304050607");
+        CHECK_EQ(apdu("02B0000004"), 0x9000U);
+        CHECK_HEX(host_resp, host_resp_len, "07254310");
+        CHECK_EQ(apdu("03B0000002"), 0x9000U);
+        CHECK_HEX(host_resp, host_resp_len, "0001");
+    }
+    CHECK_EQ(selects, 5U);
+
+    // Lo escrito por un canal se ve en otro que tenga el mismo EF
+    CHECK_EQ(apdu("02D6000201AA"), 0x9000U);
+    CHECK_EQ(apdu("00A4000C026F7E"), 0x9000U);
+    CHECK_EQ(apdu("00B0000004"), 0x9000U);
+    CHECK_HEX(host_resp, host_resp_len, "0725AA10");
+}
+
+// El puntero de registro forma parte del archivo actual de cada canal
+static void test_record_pointers(void) {
+    host_boot(true);
+
+    CHECK_EQ(apdu("0070000100"), 0x9000U);
+    CHECK_EQ(apdu("01A4040C10A0000000871002FF33FF018900000100"), 0x9000U);
+    CHECK_EQ(apdu("00A4000C026FB7"), 0x9000U);
+    CHECK_EQ(apdu("01A4000C026FB7"), 0x9000U);
+
+    CHECK_EQ(apdu("00B2000204"), 0x9000U);
+    CHECK_HEX(host_resp, host_resp_len, "11F2FF00");
+    CHECK_EQ(apdu("01B2000204"), 0x9000U);
+    CHECK_HEX(host_resp, host_resp_len, "11F2FF00");
+    CHECK_EQ(apdu("00B2000204"), 0x9000U);
+    CHECK_HEX(host_resp, host_resp_len, "19F1FF00");
+    CHECK_EQ(apdu("00B2000204"), SW_RECORD_NOT_FOUND);
+    CHECK_EQ(apdu("01B2000204"), 0x9000U);
+    CHECK_HEX(host_resp, host_resp_len, "19F1FF00");
+}
+
+// Abierto desde otro canal, el nuevo hereda su archivo actual
+static void test_open_from_channel(void) {
+    host_boot(true);
+
+    CHECK_EQ(apdu("0070000100"), 0x9000U);
+    CHECK_EQ(apdu("01A4080C047F206F07"), 0x9000U);
+    CHECK_EQ(apdu("0170000001"), 0x9000U);
+    CHECK_HEX(host_resp, host_resp_len, "02");
+    CHECK_EQ(apdu("02B0000009"), 0x9000U);
+    CHECK_HEX(host_resp, host_resp_len, "080901020304050607");
+
+    // La clase GSM no lleva canal: A0 es siempre el básico
+    CHECK_EQ(apdu("A0B0000002"), SW_COMMAND_NOT_ALLOWED);
+}
+
+int main(void) {
+    host_flash_blank();
+    test_open_close();
+    test_interleaved_reads();
+    test_record_pointers();
+    test_open_from_channel();
+    return host_report("test_channels");
+}
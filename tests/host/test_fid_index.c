@@ -0,0 +1,172 @@
+// Índice FID -> archivo (hash perfecto de scripts/gen_fid_index.py):
+// exactitud sobre los 65536 FID con la tabla real y con tablas de varios
+// tamaños frente a un recorrido lineal, y su coste en operaciones del 8051:
+// FID comparados, lecturas de __code (MOVC) y MUL AB
+#include "harness.h"
+#include "usim_files.h"
+#include "usim_fs.h"
+#include <stdio.h>
+#include <string.h>
+
+typedef struct {
+    uint16_t count;
+    const uint16_t* fids;
+    const uint8_t* disp;
+    uint8_t buckets;
+    const uint8_t* slots;
+    uint16_t slot_count;
+} fid_set_t;
+
+#include "fid_sets.h"
+
+typedef struct {
+    uint32_t probes;   /* FID de la tabla comparados con el buscado */
+    uint32_t movc;     /* Bytes leídos de __code */
+    uint32_t mul;
+} fid_cost_t;
+
+static fid_cost_t fid_cost;
+
+// La misma función que usim_find_file_index() sobre las tablas de un conjunto
+static uint8_t set_lookup(const fid_set_t* set, uint16_t fid) {
+    uint8_t shift = 8U;
+    uint8_t lo = (uint8_t)fid;
+    uint8_t hi = (uint8_t)(fid >> 8);
+    uint8_t mixed = (uint8_t)((uint8_t)(lo ^ set->disp[(uint8_t)(lo + hi) & (set->buckets - 1U)]) *
+                              USIM_FID_MIX1);
+    uint16_t slots = set->slot_count;
+    uint8_t index;
+
+    while(slots > 1U) {
+        slots >>= 1;
+        shift--;
+    }
+    index = set->slots[(uint8_t)((uint8_t)(mixed ^ hi) * USIM_FID_MIX2) >> shift];
+    fid_cost.movc += 2U;
+    fid_cost.mul += 2U;
+    if(index == USIM_FID_SLOT_EMPTY) {
+        return USIM_FILE_NOT_FOUND;
+    }
+    fid_cost.probes++;
+    fid_cost.movc += 2U;
+    if(set->fids[index] != fid) {
+        return USIM_FILE_NOT_FOUND;
+    }
+    return index;
+}
+
+// La búsqueda que sustituyó el índice
+static uint8_t set_scan(const fid_set_t* set, uint16_t fid) {
+    uint16_t i;
+
+    for(i = 0U; i < set->count; i++) {
+        fid_cost.probes++;
+        fid_cost.movc += 2U;
+        if(set->fids[i] == fid) {
+            return (uint8_t)i;
+        }
+    }
+    return USIM_FILE_NOT_FOUND;
+}
+
+static void test_profile_table(void) {
+    uint32_t fid;
+    uint32_t wrong = 0UL;
+    uint8_t file;
+
+    for(file = 0U; file < USIM_FILE_COUNT; file++) {
+        uint8_t first = 0U;
+
+        while(usim_file_fid[first] != usim_file_fid[file]) {
+            first++;
+        }
+        // Un FID repetido bajo varios DF devuelve la primera entrada
+        CHECK_EQ(usim_find_file_index(usim_file_fid[file]), first);
+    }
+
+    for(fid = 0UL; fid <= 0xFFFFUL; fid++) {
+        uint8_t found = usim_find_file_index((uint16_t)fid);
+        bool present = false;
+
+        for(file = 0U; file < USIM_FILE_COUNT; file++) {
+            present = present || (usim_file_fid[file] == fid);
+        }
+        if(present != (found != USIM_FILE_NOT_FOUND) ||
+           (found != USIM_FILE_NOT_FOUND && usim_file_fid[found] != fid)) {
+            wrong++;
+        }
+    }
+    CHECK_EQ(wrong, 0U);
+}
+
+static void test_table_sizes(void) {
+    uint8_t set;
+
+    for(set = 0U; set < (uint8_t)(sizeof(fid_sets) / sizeof(fid_sets[0])); set++) {
+        const fid_set_t* current = &fid_sets[set];
+        uint32_t fid;
+        uint32_t wrong = 0UL;
+        uint16_t hits = 0U;
+
+        for(fid = 0UL; fid <= 0xFFFFUL; fid++) {
+            uint8_t found = set_lookup(current, (uint16_t)fid);
+
+            if(found != set_scan(current, (uint16_t)fid)) {
+                wrong++;
+            }
+            hits = (uint16_t)(hits + ((found != USIM_FILE_NOT_FOUND) ? 1U : 0U));
+        }
+        CHECK_EQ(wrong, 0U);
+        CHECK_EQ(hits, current->count);
+    }
+}
+
+// Coste de buscar cada FID de la tabla y un FID ausente: el índice no
+// depende del tamaño; el recorrido lineal crece con él
+static void test_lookup_cost(void) {
+    uint8_t set;
+
+    for(set = 0U; set < (uint8_t)(sizeof(fid_sets) / sizeof(fid_sets[0])); set++) {
+        const fid_set_t* current = &fid_sets[set];
+        fid_cost_t worst = {0UL, 0UL, 0UL};
+        fid_cost_t scan_hits;
+        fid_cost_t scan_miss;
+        uint16_t i;
+
+        for(i = 0U; i < current->count; i++) {
+            memset(&fid_cost, 0, sizeof(fid_cost));
+            CHECK_EQ(set_lookup(current, current->fids[i]), i);
+            worst.probes = (fid_cost.probes > worst.probes) ? fid_cost.probes : worst.probes;
+            worst.movc = (fid_cost.movc > worst.movc) ? fid_cost.movc : worst.movc;
+            worst.mul = (fid_cost.mul > worst.mul) ? fid_cost.mul : worst.mul;
+        }
+        // Dos MUL AB, el desplazamiento, el hueco y el FID: un solo intento
+        CHECK_EQ(worst.probes, 1U);
+        CHECK_EQ(worst.movc, 4U);
+        CHECK_EQ(worst.mul, 2U);
+
+        memset(&fid_cost, 0, sizeof(fid_cost));
+        for(i = 0U; i < current->count; i++) {
+            (void)set_scan(current, current->fids[i]);
+        }
+        scan_hits = fid_cost;
+        memset(&fid_cost, 0, sizeof(fid_cost));
+        CHECK_EQ(set_scan(current, 0xFFFFU), USIM_FILE_NOT_FOUND);
+        scan_miss = fid_cost;
+        CHECK_EQ(scan_hits.probes, ((uint32_t)current->count * (current->count + 1U)) / 2U);
+        CHECK_EQ(scan_miss.probes, current->count);
+
+        printf("FID en %u archivos: índice 1 FID, %lu MOVC y %lu MUL; lineal %lu FID de media (%lu MOVC), "
+               "%lu si no está\n",
+               current->count, (unsigned long)worst.movc, (unsigned long)worst.mul,
+               (unsigned long)(scan_hits.probes / current->count),
+               (unsigned long)(scan_hits.movc / current->count), (unsigned long)scan_miss.probes);
+    }
+}
+
+int main(void) {
+    test_profile_table();
+    test_table_sizes();
+    test_lookup_cost();
+    return host_report("test_fid_index");
+}
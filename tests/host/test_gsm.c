@@ -0,0 +1,157 @@
+// Contexto GSM de AUTHENTICATE (P2 = 80, TS 31.102) y RUN GSM ALGORITHM
+// (CLA A0, TS 51.011): SRES y Kc por las conversiones c2 y c3 de
+// TS 33.102 §6.8.1.2 sobre la salida de MILENAGE
+#include "harness.h"
+#include "usim_app.h"
+#include "usim_auth.h"
+#include "usim_constants.h"
+#include "usim_milenage.h"
+#include "usim_secrets.h"
+#include <stdio.h>
+#include <string.h>
+
+#define RAND "0123456789ABCDEF0123456789ABCDEF"
+
+// La red: SRES || Kc con la K y el OPc de la tarjeta
+static void network_gsm(const uint8_t* rand, uint8_t* sres_kc) {
+    uint8_t k[USIM_SECRET_KEY_SIZE];
+    uint8_t opc[USIM_SECRET_KEY_SIZE];
+    uint8_t res[USIM_MILENAGE_RES_SIZE];
+    uint8_t ck[16];
+    uint8_t ik[16];
+    uint8_t ak[USIM_MILENAGE_AK_SIZE];
+    uint8_t i;
+
+    usim_secret_get(USIM_SECRET_K, k);
+    usim_secret_get(USIM_SECRET_OPC, opc);
+    usim_milenage_init(k, opc, rand);
+    usim_milenage_f2345(res, ck, ik, ak);
+    for(i = 0U; i < USIM_GSM_SRES_SIZE; i++) {
+        sres_kc[i] = (uint8_t)(res[i] ^ res[i + 4U]);
+    }
+    for(i = 0U; i < USIM_GSM_KC_SIZE; i++) {
+        sres_kc[USIM_GSM_SRES_SIZE + i] = (uint8_t)(ck[i] ^ ck[i + 8U] ^ ik[i] ^ ik[i + 8U]);
+    }
+}
+
+static void expected_hex(const uint8_t* rand, char* hex) {
+    uint8_t sres_kc[USIM_GSM_SRES_SIZE + USIM_GSM_KC_SIZE];
+    uint8_t i;
+
+    network_gsm(rand, sres_kc);
+    for(i = 0U; i < sizeof(sres_kc); i++) {
+        (void)sprintf(&hex[2U * i], "%02X", sres_kc[i]);
+    }
+}
+
+// Caso 4 en T=0: 61xx y GET RESPONSE en la misma clase
+static uint16_t command(const char* hex) {
+    char get_response[16];
+    uint16_t sw = host_apdu(hex);
+
+    if((sw & 0xFF00U) != 0x6100U) {
+        return sw;
+    }
+    (void)sprintf(get_response, "%.2sC00000%02X", hex, sw & 0xFFU);
+    return host_apdu(get_response);
+}
+
+// AUTHENTICATE 3G con un AUTN válido para el RAND
+static uint16_t authenticate_3g(const uint8_t* rand) {
+    uint8_t k[USIM_SECRET_KEY_SIZE];
+    uint8_t opc[USIM_SECRET_KEY_SIZE];
+    uint8_t sqn[USIM_MILENAGE_SQN_SIZE] = {0x00, 0x00, 0x00, 0x00, 0x01, 0x00};
+    uint8_t res[USIM_MILENAGE_RES_SIZE];
+    uint8_t ck[16];
+    uint8_t ik[16];
+    uint8_t ak[USIM_MILENAGE_AK_SIZE];
+    uint8_t autn[USIM_AUTN_SIZE];
+    char apdu[128];
+    uint8_t i;
+
+    usim_secret_get(USIM_SECRET_K, k);
+    usim_secret_get(USIM_SECRET_OPC, opc);
+    usim_milenage_init(k, opc, rand);
+    usim_milenage_f2345(res, ck, ik, ak);
+    for(i = 0U; i < USIM_MILENAGE_SQN_SIZE; i++) {
+        autn[i] = (uint8_t)(sqn[i] ^ ak[i]);
+    }
+    autn[USIM_AUTN_AMF_OFFSET] = 0x80U;
+    autn[USIM_AUTN_AMF_OFFSET + 1U] = 0x00U;
+    usim_milenage_f1(sqn, &autn[USIM_AUTN_AMF_OFFSET], &autn[USIM_AUTN_MAC_OFFSET], NULL);
+
+    (void)sprintf(apdu, "008800812210" RAND "10");
+    for(i = 0U; i < USIM_AUTN_SIZE; i++) {
+        (void)sprintf(&apdu[strlen(apdu)], "%02X", autn[i]);
+    }
+    return command(apdu);
+}
+
+static void test_formats(void) {
+    uint8_t rand[16];
+    char expected[2U * (USIM_GSM_SRES_SIZE + USIM_GSM_KC_SIZE) + 1U];
+
+    host_flash_blank();
+    host_boot(true);
+    (void)host_hex(RAND, rand);
+    expected_hex(rand, expected);
+
+    // 31.102: L SRES L Kc
+    CHECK_EQ(command("0088008011 10" RAND), 0x9000U);
+    CHECK_EQ(host_resp_len, 2U + USIM_GSM_SRES_SIZE + USIM_GSM_KC_SIZE);
+    CHECK_EQ(host_resp[0], USIM_GSM_SRES_SIZE);
+    CHECK_EQ(host_resp[1U + USIM_GSM_SRES_SIZE], USIM_GSM_KC_SIZE);
+    memmove(&host_resp[1U + USIM_GSM_SRES_SIZE], &host_resp[2U + USIM_GSM_SRES_SIZE], USIM_GSM_KC_SIZE);
+    CHECK_HEX(&host_resp[1], USIM_GSM_SRES_SIZE + USIM_GSM_KC_SIZE, expected);
+
+    // 51.011: SRES || Kc
+    CHECK_EQ(command("A088000010" RAND), 0x9000U);
+    CHECK_HEX(host_resp, host_resp_len, expected);
+
+    // Tras un AKA 3G con el mismo RAND el contexto GSM da lo mismo
+    CHECK_EQ(authenticate_3g(rand), 0x9000U);
+    CHECK_EQ(host_resp[0], AUTH_TAG_SUCCESS);
+    CHECK_EQ(command("A088000010" RAND), 0x9000U);
+    CHECK_HEX(host_resp, host_resp_len, expected);
+}
+
+static void test_errors(void) {
+    host_flash_blank();
+    host_boot(false);
+    CHECK_EQ(host_apdu("0088008011 10" RAND), SW_SECURITY_STATUS_NOT_SATISFIED);
+    CHECK_EQ(host_apdu("A088000010" RAND), SW_SECURITY_STATUS_NOT_SATISFIED);
+
+    host_boot(true);
+    CHECK_EQ(host_apdu("0088008211 10" RAND), SW_WRONG_P1P2);
+    CHECK_EQ(host_apdu("A088008010" RAND), SW_WRONG_P1P2);
+    CHECK_EQ(host_apdu("0088008010" RAND), SW_WRONG_LENGTH);
+    CHECK_EQ(host_apdu("0088008011 0F" RAND), SW_WRONG_DATA);
+    CHECK_EQ(host_apdu("A08800000F" "0123456789ABCDEF0123456789ABCD"), SW_WRONG_LENGTH);
+}
+
+// Una K nueva invalida el RAND ya preparado
+static void test_new_key(void) {
+    uint8_t rand[16];
+    char before[2U * (USIM_GSM_SRES_SIZE + USIM_GSM_KC_SIZE) + 1U];
+    char after[sizeof(before)];
+
+    host_flash_blank();
+    host_boot(true);
+    (void)host_hex(RAND, rand);
+    expected_hex(rand, before);
+    CHECK_EQ(command("A088000010" RAND), 0x9000U);
+    CHECK_HEX(host_resp, host_resp_len, before);
+
+    CHECK_EQ(host_apdu("80D0020010 000102030405060708090A0B0C0D0E0F"), 0x9000U);
+    expected_hex(rand, after);
+    CHECK(strcmp(before, after) != 0);
+    CHECK_EQ(command("A088000010" RAND), 0x9000U);
+    CHECK_HEX(host_resp, host_resp_len, after);
+}
+
+int main(void) {
+    test_formats();
+    test_errors();
+    test_new_key();
+    return host_report("test_gsm");
+}
@@ -0,0 +1,197 @@
+// Vectores de prueba conocidos: AES-128 (FIPS-197 apéndices B y C.1) y
+// MILENAGE (TS 35.208, conjuntos 1 a 6, y los valores intermedios del
+// conjunto 1 de TS 35.207) sobre usim_aes_encrypt()
+#include "harness.h"
+#include "usim_aes.h"
+#include "usim_milenage.h"
+#include <string.h>
+
+typedef struct {
+    const char* k;
+    const char* rand;
+    const char* sqn;
+    const char* amf;
+    const char* op;
+    const char* opc;
+    const char* f1;
+    const char* f1star;
+    const char* f2;
+    const char* f5;
+    const char* f3;
+    const char* f4;
+    const char* f5star;
+} milenage_set_t;
+
+static const milenage_set_t milenage_sets[] = {
+    {
+        "465b5ce8b199b49faa5f0a2ee238a6bc", "23553cbe9637a89d218ae64dae47bf35",
+        "ff9bb4d0b607", "b9b9",
+        "cdc202d5123e20f62b6d676ac72cb318", "cd63cb71954a9f4e48a5994e37a02baf",
+        "4a9ffac354dfafb3", "01cfaf9ec4e871e9", "a54211d5e3ba50bf", "aa689c648370",
+        "b40ba9a3c58b2a05bbf0d987b21bf8cb", "f769bcd751044604127672711c6d3441", "451e8beca43b",
+    },
+    {
+        "0396eb317b6d1c36f19c1c84cd6ffd16", "c00d603103dcee52c4478119494202e8",
+        "fd8eef40df7d", "af17",
+        "ff53bade17df5d4e793073ce9d7579fa", "53c15671c60a4b731c55b4a441c0bde2",
+        "5df5b31807e258b0", "a8c016e51ef4a343", "d3a628ed988620f0", "c47783995f72",
+        "58c433ff7a7082acd424220f2b67c556", "21a8c1f929702adb3e738488b9f5c5da", "30f1197061c1",
+    },
+    {
+        "fec86ba6eb707ed08905757b1bb44b8f", "9f7c8d021accf4db213ccff0c7f71a6a",
+        "9d0277595ffc", "725c",
+        "dbc59adcb6f9a0ef735477b7fadf8374", "1006020f0a478bf6b699f15c062e42b3",
+        "9cabc3e99baf7281", "95814ba2b3044324", "8011c48c0c214ed2", "33484dc2136b",
+        "5dbdbb2954e8f3cde665b046179a5098", "59a92d3b476a0443487055cf88b2307b", "deacdd848cc6",
+    },
+    {
+        "9e5944aea94b81165c82fbf9f32db751", "ce83dbc54ac0274a157c17f80d017bd6",
+        "0b604a81eca8", "9e09",
+        "223014c5806694c007ca1eeef57f004f", "a64a507ae1a2a98bb88eb4210135dc87",
+        "74a58220cba84c49", "ac2cc74a96871837", "f365cd683cd92e96", "f0b9c08ad02e",
+        "e203edb3971574f5a94b0d61b816345d", "0c4524adeac041c4dd830d20854fc46b", "6085a86c6f63",
+    },
+    {
+        "4ab1deb05ca6ceb051fc98e77d026a84", "74b0cd6031a1c8339b2b6ce2b8c4a186",
+        "e880a1b580b6", "9f07",
+        "2d16c5cd1fdf6b22383584e3bef2a8d8", "dcf07cbd51855290b92a07a9891e523e",
+        "49e785dd12626ef2", "9e85790336bb3fa2", "5860fc1bce351e7e", "31e11a609118",
+        "7657766b373d1c2138f307e3de9242f9", "1c42e960d89b8fa99f2744e0708ccb53", "fe2555e54aa9",
+    },
+    {
+        "6c38a116ac280c454f59332ee35c8c4f", "ee6466bc96202c5a557abbeff8babf63",
+        "414b98222181", "4464",
+        "1ba00a1a7c6700ac8c3ff3e96ad08725", "3803ef5363b947c6aaa225e58fae3934",
+        "078adfb488241a57", "80246b8d0186bcf1", "16c8233f05a0ac28", "45b0f69ab06c",
+        "3f8c7587fe8e4b233af676aede30ba3b", "a7466cc1e6b2a1337d49d3b66e95d7b4", "1f53cd2b1113",
+    },
+};
+
+// TS 35.207, conjunto 1: TEMP y las cinco salidas OUT completas (OUT2 y OUT5
+// llevan bytes que f2-f5 y f5* no devuelven)
+static const char milenage_temp_1[] = "9e2980c59739da67b136355e3cede6a2";
+static const char* const milenage_out_1[] = {
+    "4a9ffac354dfafb301cfaf9ec4e871e9", "aa689c648370ac1ea54211d5e3ba50bf",
+    "b40ba9a3c58b2a05bbf0d987b21bf8cb", "f769bcd751044604127672711c6d3441",
+    "451e8beca43b78e0f940c8db54fd21c1",
+};
+
+static void test_aes(void) {
+    uint8_t key[USIM_AES_BLOCK_SIZE];
+    uint8_t input[USIM_AES_BLOCK_SIZE];
+    uint8_t output[USIM_AES_BLOCK_SIZE];
+
+    (void)host_hex("2b7e151628aed2a6abf7158809cf4f3c", key);
+    (void)host_hex("3243f6a8885a308d313198a2e0370734", input);
+    usim_aes_encrypt(key, input, output);
+    CHECK_HEX(output, sizeof(output), "3925841d02dc09fbdc118597196a0b32");
+
+    (void)host_hex("000102030405060708090a0b0c0d0e0f", key);
+    (void)host_hex("00112233445566778899aabbccddeeff", input);
+    usim_aes_encrypt(key, input, output);
+    CHECK_HEX(output, sizeof(output), "69c4e0d86a7b0430d8cdb78070b4c55a");
+
+    // Entrada y salida en el mismo buffer
+    usim_aes_encrypt(key, input, input);
+    CHECK_HEX(input, sizeof(input), "69c4e0d86a7b0430d8cdb78070b4c55a");
+}
+
+static void test_milenage(void) {
+    uint8_t set;
+
+    for(set = 0U; set < (uint8_t)(sizeof(milenage_sets) / sizeof(milenage_sets[0])); set++) {
+        const milenage_set_t* vector = &milenage_sets[set];
+        uint8_t k[16];
+        uint8_t rand[16];
+        uint8_t sqn[USIM_MILENAGE_SQN_SIZE];
+        uint8_t amf[USIM_MILENAGE_AMF_SIZE];
+        uint8_t op[16];
+        uint8_t opc[16];
+        uint8_t mac_a[USIM_MILENAGE_MAC_SIZE];
+        uint8_t mac_s[USIM_MILENAGE_MAC_SIZE];
+        uint8_t res[USIM_MILENAGE_RES_SIZE];
+        uint8_t ck[16];
+        uint8_t ik[16];
+        uint8_t ak[USIM_MILENAGE_AK_SIZE];
+
+        (void)host_hex(vector->k, k);
+        (void)host_hex(vector->rand, rand);
+        (void)host_hex(vector->sqn, sqn);
+        (void)host_hex(vector->amf, amf);
+        (void)host_hex(vector->op, op);
+
+        usim_milenage_opc(k, op, opc);
+        CHECK_HEX(opc, sizeof(opc), vector->opc);
+
+        usim_milenage_init(k, opc, rand);
+        usim_milenage_f1(sqn, amf, mac_a, mac_s);
+        CHECK_HEX(mac_a, sizeof(mac_a), vector->f1);
+        CHECK_HEX(mac_s, sizeof(mac_s), vector->f1star);
+
+        // Cada salida de f1 por separado
+        usim_milenage_f1(sqn, amf, NULL, mac_s);
+        CHECK_HEX(mac_s, sizeof(mac_s), vector->f1star);
+        usim_milenage_f1(sqn, amf, mac_a, NULL);
+        CHECK_HEX(mac_a, sizeof(mac_a), vector->f1);
+
+        usim_milenage_f2345(res, ck, ik, ak);
+        CHECK_HEX(res, sizeof(res), vector->f2);
+        CHECK_HEX(ck, sizeof(ck), vector->f3);
+        CHECK_HEX(ik, sizeof(ik), vector->f4);
+        CHECK_HEX(ak, sizeof(ak), vector->f5);
+
+        usim_milenage_f5star(ak);
+        CHECK_HEX(ak, sizeof(ak), vector->f5star);
+        usim_milenage_clear();
+    }
+}
+
+// Paso a paso con el núcleo AES: TEMP = E_K(RAND ^ OPc) y
+// OUTn = E_K(rot(TEMP ^ OPc, rn) ^ cn) ^ OPc, y OUT1 con IN1 = SQN|AMF|SQN|AMF
+static void test_milenage_intermediate(void) {
+    static const uint8_t rotate[] = { 8U, 0U, 4U, 8U, 12U };
+    static const uint8_t constant[] = { 0x00U, 0x01U, 0x02U, 0x04U, 0x08U };
+    const milenage_set_t* vector = &milenage_sets[0];
+    uint8_t k[16];
+    uint8_t rand[16];
+    uint8_t opc[16];
+    uint8_t in1[16];
+    uint8_t temp[16];
+    uint8_t block[16];
+    uint8_t n;
+    uint8_t i;
+
+    (void)host_hex(vector->k, k);
+    (void)host_hex(vector->rand, rand);
+    (void)host_hex(vector->opc, opc);
+    (void)host_hex(vector->sqn, in1);
+    (void)host_hex(vector->amf, &in1[USIM_MILENAGE_SQN_SIZE]);
+    memcpy(&in1[8], in1, 8U);
+
+    for(i = 0U; i < 16U; i++) {
+        temp[i] = (uint8_t)(rand[i] ^ opc[i]);
+    }
+    usim_aes_encrypt(k, temp, temp);
+    CHECK_HEX(temp, sizeof(temp), milenage_temp_1);
+
+    for(n = 0U; n < 5U; n++) {
+        for(i = 0U; i < 16U; i++) {
+            uint8_t j = (uint8_t)((i + rotate[n]) & 0x0FU);
+
+            block[i] = (n == 0U) ? (uint8_t)(temp[i] ^ in1[j] ^ opc[j]) : (uint8_t)(temp[j] ^ opc[j]);
+        }
+        block[15] ^= constant[n];
+        usim_aes_encrypt(k, block, block);
+        for(i = 0U; i < 16U; i++) {
+            block[i] ^= opc[i];
+        }
+        CHECK_HEX(block, sizeof(block), milenage_out_1[n]);
+    }
+}
+
+int main(void) {
+    test_aes();
+    test_milenage();
+    test_milenage_intermediate();
+    return host_report("test_milenage");
+}
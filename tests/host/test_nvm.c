@@ -0,0 +1,279 @@
+// Diario de usim_nvm.c sobre la flash simulada: cortes de alimentación en
+// cada byte programado (escritura, compactación y formato), reparto de los
+// borrados por el anillo, montaje acotado a una página y persistencia de lo
+// que escriben los APDU
+#include "harness.h"
+#include "usim_app.h"
+#include "usim_constants.h"
+#include "usim_nvm.h"
+#include "chip_specific.h"
+#include <string.h>
+
+#define NVM_PAGE_BYTES (2U * FLASH_SECTOR_SIZE)
+
+static uint8_t image[NVM_SECTOR_COUNT * FLASH_SECTOR_SIZE];
+
+static void sqn_fill(uint8_t* value, uint8_t fill) {
+    memset(value, fill, USIM_NVM_SQN_SIZE);
+}
+
+static bool write_sqn(uint8_t fill) {
+    uint8_t value[USIM_NVM_SQN_SIZE];
+
+    sqn_fill(value, fill);
+    return usim_nvm_write(USIM_NVM_OBJ_SQN, value, USIM_NVM_SQN_SIZE);
+}
+
+// Valor de relleno del SQN guardado; 0 si falta o no es uniforme
+static uint8_t stored_sqn(void) {
+    uint8_t value[USIM_NVM_SQN_SIZE];
+    uint8_t expected[USIM_NVM_SQN_SIZE];
+
+    if(usim_nvm_length(USIM_NVM_OBJ_SQN) != USIM_NVM_SQN_SIZE) {
+        return 0U;
+    }
+    usim_nvm_read(USIM_NVM_OBJ_SQN, 0U, value, USIM_NVM_SQN_SIZE);
+    sqn_fill(expected, value[0]);
+    return (memcmp(value, expected, USIM_NVM_SQN_SIZE) == 0) ? value[0] : 0U;
+}
+
+static bool stored_chv_is(uint8_t fill) {
+    uint8_t value[USIM_NVM_CHV_SIZE];
+    uint8_t i;
+
+    if(usim_nvm_length(USIM_NVM_OBJ_CHV) != USIM_NVM_CHV_SIZE) {
+        return false;
+    }
+    usim_nvm_read(USIM_NVM_OBJ_CHV, 0U, value, USIM_NVM_CHV_SIZE);
+    for(i = 0U; i < USIM_NVM_CHV_SIZE; i++) {
+        if(value[i] != fill) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Escribe el SQN cortando la alimentación tras "cut" operaciones de flash;
+// devuelve si llegó a cortarse
+static bool torn_write_sqn(uint8_t fill, long cut) {
+    host_flash_cut_after(cut);
+    if(setjmp(host_flash_cut) != 0) {
+        return true;
+    }
+    (void)write_sqn(fill);
+    host_flash_cut_after(-1L);
+    return false;
+}
+
+static void test_format_and_mount(void) {
+    uint32_t ops;
+    long cut;
+
+    host_flash_blank();
+    usim_nvm_mount();
+    CHECK_EQ(usim_nvm_length(USIM_NVM_OBJ_SQN), 0U);
+    CHECK(write_sqn(0x11U));
+    CHECK_EQ(stored_sqn(), 0x11U);
+
+    usim_nvm_mount();
+    CHECK_EQ(stored_sqn(), 0x11U);
+
+    // Corte durante el formato de una flash en blanco: se vuelve a formatear
+    host_flash_blank();
+    ops = host_flash_ops;
+    usim_nvm_mount();
+    ops = host_flash_ops - ops;
+    for(cut = 0L; cut < (long)ops; cut++) {
+        host_flash_blank();
+        host_flash_cut_after(cut);
+        if(setjmp(host_flash_cut) == 0) {
+            usim_nvm_mount();
+            CHECK(false);
+        }
+        host_flash_cut_after(-1L);
+        usim_nvm_mount();
+        CHECK(write_sqn(0x22U));
+        usim_nvm_mount();
+        CHECK_EQ(stored_sqn(), 0x22U);
+    }
+}
+
+// Corte en cada byte de una escritura: al montar queda el valor anterior, y
+// la siguiente escritura funciona aunque la cola de la página esté sucia
+static void test_torn_write(void) {
+    uint8_t chv[USIM_NVM_CHV_SIZE];
+    uint32_t ops;
+    long cut;
+
+    host_flash_blank();
+    usim_nvm_mount();
+    memset(chv, 0x5AU, sizeof(chv));
+    CHECK(usim_nvm_write(USIM_NVM_OBJ_CHV, chv, USIM_NVM_CHV_SIZE));
+    CHECK(write_sqn(0x11U));
+    host_flash_save(image);
+
+    ops = host_flash_ops;
+    CHECK(write_sqn(0x22U));
+    ops = host_flash_ops - ops;
+    // Cabecera, datos y CRC del registro, y el registro de confirmación
+    CHECK_EQ(ops, USIM_NVM_SQN_SIZE + (2U * USIM_NVM_RECORD_OVERHEAD));
+
+    for(cut = 0L; cut < (long)ops; cut++) {
+        host_flash_restore(image);
+        usim_nvm_mount();
+        CHECK(torn_write_sqn(0x22U, cut));
+
+        usim_nvm_mount();
+        CHECK_EQ(stored_sqn(), 0x11U);
+        CHECK(stored_chv_is(0x5AU));
+
+        CHECK(write_sqn(0x33U));
+        usim_nvm_mount();
+        CHECK_EQ(stored_sqn(), 0x33U);
+        CHECK(stored_chv_is(0x5AU));
+    }
+}
+
+// Escrituras hasta dar varias vueltas al anillo: los borrados se reparten y
+// montar solo lee la página activa
+static void test_compaction_and_wear(void) {
+    uint16_t i;
+    uint16_t most = 0U;
+    uint16_t least = 0xFFFFU;
+    uint32_t reads;
+
+    host_flash_blank();
+    usim_nvm_mount();
+    for(i = 0U; i < 600U; i++) {
+        CHECK(write_sqn((uint8_t)(1U + (i % 250U))));
+    }
+    CHECK_EQ(stored_sqn(), 1U + (599U % 250U));
+
+    for(i = 0U; i < NVM_SECTOR_COUNT; i++) {
+        most = (host_flash_erases[i] > most) ? host_flash_erases[i] : most;
+        least = (host_flash_erases[i] < least) ? host_flash_erases[i] : least;
+    }
+    CHECK(least >= 2U);
+    CHECK((uint16_t)(most - least) <= 1U);
+
+    reads = host_flash_read_bytes;
+    usim_nvm_mount();
+    reads = host_flash_read_bytes - reads;
+    CHECK_EQ(stored_sqn(), 1U + (599U % 250U));
+    // Cabecera de cada página y la activa, con las cabeceras de registro leídas
+    // dos veces; nunca el resto del anillo
+    CHECK(reads <= (NVM_SECTOR_COUNT / 2U) * 3U + NVM_PAGE_BYTES + NVM_PAGE_BYTES / 2U);
+}
+
+// Corte en cada paso de la escritura que pasa a la página siguiente: hasta
+// confirmar la instantánea sigue valiendo la página anterior
+static void test_torn_compaction(void) {
+    uint8_t chv[USIM_NVM_CHV_SIZE];
+    uint32_t erases;
+    uint32_t ops;
+    uint8_t fill = 1U;
+    long cut;
+
+    host_flash_blank();
+    usim_nvm_mount();
+    memset(chv, 0xA5U, sizeof(chv));
+    CHECK(usim_nvm_write(USIM_NVM_OBJ_CHV, chv, USIM_NVM_CHV_SIZE));
+
+    // Avanzar hasta la escritura que compacta
+    while(1) {
+        uint8_t sector;
+
+        host_flash_save(image);
+        erases = 0UL;
+        for(sector = 0U; sector < NVM_SECTOR_COUNT; sector++) {
+            erases += host_flash_erases[sector];
+        }
+        ops = host_flash_ops;
+        CHECK(write_sqn((uint8_t)(fill + 1U)));
+        ops = host_flash_ops - ops;
+        for(sector = 0U; sector < NVM_SECTOR_COUNT; sector++) {
+            erases -= host_flash_erases[sector];
+        }
+        if(erases != 0UL) {
+            break;
+        }
+        fill++;
+    }
+    // Borrado de la página, copia de lo vivo y la escritura pendiente
+    CHECK(ops > USIM_NVM_SQN_SIZE + USIM_NVM_CHV_SIZE + (3U * USIM_NVM_RECORD_OVERHEAD));
+
+    for(cut = 0L; cut < (long)ops; cut++) {
+        host_flash_restore(image);
+        usim_nvm_mount();
+        CHECK(torn_write_sqn((uint8_t)(fill + 1U), cut));
+
+        usim_nvm_mount();
+        CHECK_EQ(stored_sqn(), fill);
+        CHECK(stored_chv_is(0xA5U));
+
+        CHECK(write_sqn(0xEEU));
+        usim_nvm_mount();
+        CHECK_EQ(stored_sqn(), 0xEEU);
+        CHECK(stored_chv_is(0xA5U));
+    }
+}
+
+// UPDATE BINARY con un corte en cada byte: tras el reset, el EF completo de
+// antes o el de después, nunca una mezcla
+static void test_torn_update_binary(void) {
+    uint32_t ops;
+    long cut;
+
+    host_flash_blank();
+    host_boot(true);
+    host_flash_save(image);
+
+    ops = host_flash_ops;
+    CHECK_EQ(host_apdu("00D6870009 091032547698BADCFE"), 0x9000U);
+    ops = host_flash_ops - ops;
+    CHECK(ops > 0UL);
+
+    host_boot(true);
+    CHECK_EQ(host_apdu("00B0870009"), 0x9000U);
+    CHECK_HEX(host_resp, host_resp_len, "091032547698BADCFE");
+
+    for(cut = 0L; cut < (long)ops; cut++) {
+        host_flash_restore(image);
+        host_boot(true);
+        host_flash_cut_after(cut);
+        if(setjmp(host_flash_cut) == 0) {
+            (void)host_apdu("00D6870009 091032547698BADCFE");
+            CHECK(false);
+        }
+        host_flash_cut_after(-1L);
+
+        host_boot(true);
+        CHECK_EQ(host_apdu("00B0870009"), 0x9000U);
+        CHECK_HEX(host_resp, host_resp_len, "080901020304050607");
+    }
+}
+
+// Los intentos de PIN no se recuperan con un reset
+static void test_pin_counter(void) {
+    host_flash_blank();
+    host_boot(false);
+    CHECK_EQ(host_apdu("0020000108 31313131FFFFFFFF"), SW_REMAINING_ATTEMPTS(2U));
+
+    host_boot(false);
+    CHECK_EQ(subscriber.pin1_retries, 2U);
+    CHECK_EQ(host_apdu("0020000108 31313131FFFFFFFF"), SW_REMAINING_ATTEMPTS(1U));
+    CHECK_EQ(host_apdu("0020000108 30303030FFFFFFFF"), 0x9000U);
+
+    host_boot(false);
+    CHECK_EQ(subscriber.pin1_retries, 3U);
+}
+
+int main(void) {
+    test_format_and_mount();
+    test_torn_write();
+    test_compaction_and_wear();
+    test_torn_compaction();
+    test_torn_update_binary();
+    test_pin_counter();
+    return host_report("test_nvm");
+}
@@ -0,0 +1,112 @@
+// Personalización de lote (WRITE CONFIG, tipo 0A): un APDU con IMSI, ICCID
+// e índice de OP graba EF_IMSI y EF_ICCID y deriva K y OPc en la tarjeta
+#include "harness.h"
+#include "usim_app.h"
+#include "usim_constants.h"
+#include "usim_milenage.h"
+#include "usim_secrets.h"
+#include <string.h>
+
+#define BATCH_OP "CDC202D5123E20F62B6D676AC72CB318"
+#define IMSI     "0809101032547698F0"
+#define ICCID_A  "98440010325476981032"
+#define ICCID_B  "98440010325476981042"
+
+// K y OPc de scripts/diversify.py derive() con la clave maestra y el OP 0 de
+// config/files.json, el IMSI de arriba y cada ICCID
+#define K_A      "77870807711D9670C586C30B069648F4"
+#define OPC_A    "55419EDE9023323974AD470653EA1A1E"
+#define K_B      "A0EF0EA615A884D18AF5BF43D3B08B42"
+#define OPC_B    "81D6B561285AA951AC0302A6AA25CF84"
+
+static void secrets(uint8_t* k, uint8_t* opc) {
+    usim_secret_get(USIM_SECRET_K, k);
+    usim_secret_get(USIM_SECRET_OPC, opc);
+}
+
+static void test_personalize(void) {
+    uint8_t k[USIM_SECRET_KEY_SIZE];
+    uint8_t opc[USIM_SECRET_KEY_SIZE];
+    uint8_t factory_k[USIM_SECRET_KEY_SIZE];
+    uint8_t op[USIM_SECRET_KEY_SIZE];
+    uint8_t expected[USIM_SECRET_KEY_SIZE];
+
+    host_flash_blank();
+    host_boot(true);
+    secrets(factory_k, opc);
+
+    CHECK_EQ(host_apdu("80D00A0014" IMSI ICCID_A "00"), 0x9000U);
+    CHECK_EQ(host_apdu("00B0870009"), 0x9000U);
+    CHECK_HEX(host_resp, host_resp_len, IMSI);
+    CHECK_EQ(host_apdu("00A4000C023F00"), 0x9000U);
+    CHECK_EQ(host_apdu("00A4000C022FE2"), 0x9000U);
+    CHECK_EQ(host_apdu("00B000000A"), 0x9000U);
+    CHECK_HEX(host_resp, host_resp_len, ICCID_A);
+
+    // K nueva y OPc = AES_K(OP) ^ OP con el OP del lote
+    secrets(k, opc);
+    CHECK(memcmp(k, factory_k, sizeof(k)) != 0);
+    (void)host_hex(BATCH_OP, op);
+    usim_milenage_opc(k, op, expected);
+    CHECK(memcmp(opc, expected, sizeof(opc)) == 0);
+
+    // Otro ICCID da otra K; el mismo, la misma. Todo sobrevive al reset.
+    host_boot(true);
+    CHECK_EQ(host_apdu("80D00A0014" IMSI ICCID_B "00"), 0x9000U);
+    secrets(expected, opc);
+    CHECK(memcmp(k, expected, sizeof(k)) != 0);
+    CHECK_EQ(host_apdu("80D00A0014" IMSI ICCID_A "00"), 0x9000U);
+    host_boot(true);
+    secrets(expected, opc);
+    CHECK(memcmp(k, expected, sizeof(k)) == 0);
+}
+
+// La tarjeta y el script del lote derivan lo mismo
+static void test_matches_script(void) {
+    uint8_t k[USIM_SECRET_KEY_SIZE];
+    uint8_t opc[USIM_SECRET_KEY_SIZE];
+
+    host_flash_blank();
+    host_boot(true);
+    CHECK_EQ(host_apdu("80D00A0014" IMSI ICCID_A "00"), 0x9000U);
+    secrets(k, opc);
+    CHECK_HEX(k, sizeof(k), K_A);
+    CHECK_HEX(opc, sizeof(opc), OPC_A);
+
+    CHECK_EQ(host_apdu("80D00A0014" IMSI ICCID_B "00"), 0x9000U);
+    host_boot(true);
+    secrets(k, opc);
+    CHECK_HEX(k, sizeof(k), K_B);
+    CHECK_HEX(opc, sizeof(opc), OPC_B);
+}
+
+static void test_rejected(void) {
+    uint8_t k[USIM_SECRET_KEY_SIZE];
+    uint8_t opc[USIM_SECRET_KEY_SIZE];
+    uint8_t after[USIM_SECRET_KEY_SIZE];
+
+    host_flash_blank();
+    host_boot(true);
+    secrets(k, opc);
+
+    CHECK_EQ(host_apdu("80D00A0014" IMSI ICCID_A "01"), SW_WRONG_DATA);
+    CHECK_EQ(host_apdu("80D00A0013" IMSI ICCID_A), SW_WRONG_LENGTH);
+    CHECK_EQ(host_apdu("00B0870009"), 0x9000U);
+    CHECK_HEX(host_resp, host_resp_len, "080901020304050607");
+
+    // Dentro de una transacción abierta, abortar deja IMSI y K como estaban
+    CHECK_EQ(host_apdu("80D3010000"), 0x9000U);
+    CHECK_EQ(host_apdu("80D00A0014" IMSI ICCID_A "00"), 0x9000U);
+    CHECK_EQ(host_apdu("80D3030000"), 0x9000U);
+    CHECK_EQ(host_apdu("00B0870009"), 0x9000U);
+    CHECK_HEX(host_resp, host_resp_len, "080901020304050607");
+    secrets(after, opc);
+    CHECK(memcmp(k, after, sizeof(k)) == 0);
+}
+
+int main(void) {
+    test_personalize();
+    test_matches_script();
+    test_rejected();
+    return host_report("test_personalize");
+}
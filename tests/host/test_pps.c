@@ -0,0 +1,203 @@
+// PPS y tablas Fi/Di de ISO/IEC 7816-3 sobre el motor de bits de
+// chip_init.c, con la línea IO simulada
+#include "harness.h"
+#include "host_line.h"
+#include "chip_init.c"
+
+static uint8_t tx[64];
+
+static void line_restart(void) {
+    chip_init();
+    host_line_reset();
+}
+
+static void test_fi_di_tables(void) {
+    sim_base_etu_ticks = SIM_DEFAULT_ETU_TICKS;
+
+    CHECK_EQ(SIM_DEFAULT_ETU_TICKS, 93U);
+    // TA1 anuncia justo la ETU mínima del motor de bits (gen_atr.py)
+    CHECK_EQ(USIM_ATR_TA1, 0x92U);
+    CHECK_EQ(USIM_ATR_FI / USIM_ATR_DI, SIM_PPS_MIN_ETU_TICKS * SIM_MACHINE_CYCLE_DIV);
+    CHECK_EQ(sim_etu_ticks_for_pps1(USIM_ATR_TA1), SIM_PPS_MIN_ETU_TICKS);
+
+    // Fi=372/Di=1 por defecto
+    CHECK_EQ(sim_etu_ticks_for_pps1(0x11U), 93U);
+    CHECK_EQ(sim_etu_ticks_for_pps1(0x12U), 0U);
+    CHECK_EQ(sim_etu_ticks_for_pps1(0x92U), SIM_PPS_MIN_ETU_TICKS);
+    CHECK_EQ(sim_etu_ticks_for_pps1(0xD4U), 64U);
+    CHECK_EQ(sim_etu_ticks_for_pps1(0x22U), 70U);
+    // Más rápido que lo anunciado en TA1
+    CHECK_EQ(sim_etu_ticks_for_pps1(0x93U), 0U);
+    CHECK_EQ(sim_etu_ticks_for_pps1(0x94U), 0U);
+    CHECK_EQ(sim_etu_ticks_for_pps1(0x18U), 0U);
+    // Códigos RFU de Fi (7, 8, E, F) y de Di (0, A..F)
+    CHECK_EQ(sim_etu_ticks_for_pps1(0x71U), 0U);
+    CHECK_EQ(sim_etu_ticks_for_pps1(0x81U), 0U);
+    CHECK_EQ(sim_etu_ticks_for_pps1(0xE1U), 0U);
+    CHECK_EQ(sim_etu_ticks_for_pps1(0x10U), 0U);
+    CHECK_EQ(sim_etu_ticks_for_pps1(0x1AU), 0U);
+
+    // Con un reloj más lento que el nominal la ETU escala
+    sim_base_etu_ticks = 186UL;
+    CHECK_EQ(sim_etu_ticks_for_pps1(0x92U), 128U);
+    sim_base_etu_ticks = SIM_DEFAULT_ETU_TICKS;
+}
+
+static void test_wait_time(void) {
+    line_restart();
+    // WWT = 960·10·Fi ciclos de reloj, en ticks de 4 ciclos
+    CHECK_EQ(sim_wait_time_ticks(), 9600UL * 93UL);
+
+    CHECK(sim_apply_transmission_factors(0x92U));
+    CHECK_EQ(sim_etu_ticks, 64U);
+    CHECK_EQ(sim_fi, 512U);
+    CHECK_EQ(sim_wait_time_ticks(), (9600UL * 512UL / 372UL) * 93UL);
+
+    CHECK(!sim_apply_transmission_factors(0x96U));
+    CHECK_EQ(sim_etu_ticks, 64U);
+}
+
+static void test_pps_accepted(void) {
+    line_restart();
+    host_line_rx_hex("FF 10 92 7D");
+
+    CHECK(sim_handle_pps_sequence());
+    CHECK_EQ(host_line_tx_decode(93UL, tx, sizeof(tx)), 4U);
+    CHECK_HEX(tx, 4U, "FF 10 92 7D");
+    CHECK_EQ(sim_get_protocol(), 0U);
+    CHECK_EQ(sim_etu_ticks, 64U);
+    CHECK_EQ(sim_fi, 512U);
+
+    // El siguiente byte ya sale a la velocidad negociada
+    host_line_reset();
+    CHECK(sim_send_byte(0x60U));
+    CHECK_EQ(host_line_tx_decode(64UL, tx, sizeof(tx)), 1U);
+    CHECK_EQ(tx[0], 0x60U);
+    // Media ETU de guarda; start y bits 0..4 a cero: 6 ETU en bajo
+    CHECK(host_line_segment_level(0));
+    CHECK(!host_line_segment_level(1));
+    CHECK_EQ(host_line_segment_ticks(1), 6U * 64U);
+}
+
+// Al par Fi/Di más rápido que se acepta, con el coste de atender cada
+// desborde y mover el pin (unos 32 ciclos máquina: LCALL/RET, bucle de
+// sondeo, recarga y escritura en P1), los flancos siguen en la rejilla de
+// la ETU: la recarga acumulativa descuenta lo que el timer ya ha contado.
+static void test_tx_overhead(void) {
+    uint32_t total = 0UL;
+    uint16_t i;
+
+    line_restart();
+    CHECK(sim_apply_transmission_factors(USIM_ATR_TA1));
+    CHECK_EQ(sim_etu_ticks, SIM_PPS_MIN_ETU_TICKS);
+
+    host_line_set_latency(32U);
+    CHECK(sim_send_byte(0x55U));
+    CHECK(sim_send_byte(0xA3U));
+    CHECK_EQ(host_line_tx_decode(SIM_PPS_MIN_ETU_TICKS, tx, sizeof(tx)), 2U);
+    CHECK_HEX(tx, 2U, "55 A3");
+
+    // Entre el start del primer carácter y el stop del último cada tramo
+    // dura un número entero de ETU
+    CHECK(host_line_segment_level(0));
+    CHECK_EQ(host_line_segment_ticks(0), (SIM_PPS_MIN_ETU_TICKS / 2UL) + 32UL);
+    for(i = 1U; i + 1U < host_line_segments(); i++) {
+        CHECK_EQ(host_line_segment_ticks(i) % SIM_PPS_MIN_ETU_TICKS, 0UL);
+        total += host_line_segment_ticks(i);
+    }
+    // Dos caracteres de 11,5 ETU: la latencia solo aparece una vez por
+    // carácter (al arrancar la guarda) y no una vez por bit
+    total += host_line_segment_ticks(0) + host_line_segment_ticks(host_line_segments() - 1U);
+    CHECK_EQ(total, (23UL * SIM_PPS_MIN_ETU_TICKS) + (2UL * 32UL));
+}
+
+static void test_pps_t1(void) {
+    line_restart();
+    host_line_rx_hex("FF 11 22 CC");
+
+    CHECK(sim_handle_pps_sequence());
+    CHECK_EQ(host_line_tx_decode(93UL, tx, sizeof(tx)), 4U);
+    CHECK_HEX(tx, 4U, "FF 11 22 CC");
+    CHECK_EQ(sim_get_protocol(), 1U);
+    CHECK_EQ(sim_etu_ticks, 70U);
+    CHECK_EQ(sim_fi, 558U);
+}
+
+static void test_pps_out_of_reach(void) {
+    line_restart();
+    // Di=32 supera TA1: se responde sin PPS1 y se sigue con Fi=372/Di=1
+    host_line_rx_hex("FF 10 96 79");
+
+    CHECK(sim_handle_pps_sequence());
+    CHECK_EQ(host_line_tx_decode(93UL, tx, sizeof(tx)), 3U);
+    CHECK_HEX(tx, 3U, "FF 00 FF");
+    CHECK_EQ(sim_etu_ticks, 93U);
+    CHECK_EQ(sim_fi, 372U);
+}
+
+static void test_pps_pps2_not_echoed(void) {
+    line_restart();
+    // PPS2 presente: no se soporta y no se devuelve
+    host_line_rx_hex("FF 30 92 01 5C");
+
+    CHECK(sim_handle_pps_sequence());
+    CHECK_EQ(host_line_tx_decode(93UL, tx, sizeof(tx)), 4U);
+    CHECK_HEX(tx, 4U, "FF 10 92 7D");
+    CHECK_EQ(sim_etu_ticks, 64U);
+}
+
+static void test_pps_not_a_pps(void) {
+    uint8_t value = 0U;
+    uint8_t i;
+
+    // Sin PPSS: el byte es el primero de un APDU
+    line_restart();
+    host_line_rx_hex("A0 A4");
+    CHECK(sim_handle_pps_sequence());
+    CHECK_EQ(host_line_tx_decode(93UL, tx, sizeof(tx)), 0U);
+    CHECK(sim_receive_byte(&value, 0UL));
+    CHECK_EQ(value, 0xA0U);
+    CHECK(sim_receive_byte(&value, 0UL));
+    CHECK_EQ(value, 0xA4U);
+
+    // PCK incorrecto: todo lo leído vuelve a la entrada en orden
+    line_restart();
+    host_line_rx_hex("FF 10 94 00");
+    CHECK(sim_handle_pps_sequence());
+    CHECK_EQ(host_line_tx_decode(93UL, tx, sizeof(tx)), 0U);
+    for(i = 0U; i < 4U; i++) {
+        CHECK(sim_receive_byte(&tx[i], 0UL));
+    }
+    CHECK_HEX(tx, 4U, "FF 10 94 00");
+    CHECK_EQ(sim_etu_ticks, 93U);
+
+    // Protocolo no ofrecido en el ATR: sin respuesta
+    line_restart();
+    host_line_rx_hex("FF 12 94 79");
+    CHECK(sim_handle_pps_sequence());
+    CHECK_EQ(host_line_tx_decode(93UL, tx, sizeof(tx)), 0U);
+    CHECK_EQ(sim_get_protocol(), 0U);
+
+    // El lector no envía nada
+    line_restart();
+    CHECK(sim_handle_pps_sequence());
+    CHECK_EQ(host_line_tx_decode(93UL, tx, sizeof(tx)), 0U);
+    CHECK_EQ(sim_etu_ticks, 93U);
+
+    // Solo se atiende un PPS tras cada ATR
+    host_line_rx_hex("FF 10 94 7B");
+    CHECK(sim_handle_pps_sequence());
+    CHECK_EQ(host_line_rx_left(), 4U);
+}
+
+int main(void) {
+    test_fi_di_tables();
+    test_wait_time();
+    test_pps_accepted();
+    test_tx_overhead();
+    test_pps_t1();
+    test_pps_out_of_reach();
+    test_pps_pps2_not_echoed();
+    test_pps_not_a_pps();
+    return host_report("test_pps");
+}
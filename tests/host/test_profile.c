@@ -0,0 +1,323 @@
+// Perfiles de suscriptor (INS_SWITCH_PROFILE, CLA 80 INS D4): cada ranura
+// conserva su IMSI, sus secretos, su SQN y su PIN; el perfil activo
+// sobrevive al reset
+#include "harness.h"
+#include "usim_app.h"
+#include "usim_auth.h"
+#include "usim_constants.h"
+#include "usim_files.h"
+#include "usim_milenage.h"
+#include "usim_nvm.h"
+#include "usim_secrets.h"
+#include <stdio.h>
+#include <string.h>
+
+#define FACTORY_IMSI "080901020304050607"
+#define FACTORY_K    "465B5CE8B199B49FAA5F0A2EE238A6BC"
+#define FACTORY_OPC  "CD63CB71954A9F4E48A5994B865AE955"
+#define IMSI_0 "080910101010101010"
+#define IMSI_1 "080921212121212121"
+#define IMSI_3 "080943434343434343"
+#define K_0    "000102030405060708090A0B0C0D0E0F"
+#define K_1    "F0F1F2F3F4F5F6F7F8F9FAFBFCFDFEFF"
+#define OPC_1  "1006020F0A478BF6B699F15C062E42B3"
+#define PIN    "30303030FFFFFFFF"
+#define PIN_0  "31313131FFFFFFFF"
+#define MSISDN "FFFFFFFFFFFFFFFFFFFFFF0791214365870900FFFFFFFFFF"
+
+static uint8_t rand_counter;
+
+// Cambiar de perfil y volver a la ADF; el PIN queda sin verificar
+static uint16_t switch_profile(uint8_t profile) {
+    char apdu[16];
+    uint16_t sw;
+
+    (void)sprintf(apdu, "80D4%02X00", profile);
+    sw = host_apdu(apdu);
+    (void)host_apdu("00A4040C10 A0000000871002FF33FF018900000100");
+    return sw;
+}
+
+static uint16_t verify(const char* pin) {
+    char apdu[32];
+
+    (void)sprintf(apdu, "0020000108%s", pin);
+    return host_apdu(apdu);
+}
+
+static void check_imsi(const char* imsi) {
+    CHECK_EQ(host_apdu("00B0870009"), 0x9000U);
+    CHECK_HEX(host_resp, host_resp_len, imsi);
+}
+
+static void check_k(const char* k) {
+    uint8_t secret[USIM_SECRET_KEY_SIZE];
+
+    usim_secret_get(USIM_SECRET_K, secret);
+    CHECK_HEX(secret, sizeof(secret), k);
+}
+
+// AUTHENTICATE (contexto 3G) con SEQ "seq" e IND 0, calculado por la red con
+// la K y el OPc que debería tener el perfil activo. Devuelve la etiqueta de
+// la respuesta (DB o DC), o SW1SW2 si el comando falla; con DB comprueba RES.
+static uint16_t authenticate(const char* k_hex, const char* opc_hex, uint64_t seq) {
+    uint8_t k[USIM_SECRET_KEY_SIZE];
+    uint8_t opc[USIM_SECRET_KEY_SIZE];
+    uint8_t rand[16];
+    uint8_t sqn[USIM_MILENAGE_SQN_SIZE];
+    uint8_t autn[USIM_AUTN_SIZE];
+    uint8_t res[USIM_MILENAGE_RES_SIZE];
+    uint8_t ck[16];
+    uint8_t ik[16];
+    uint8_t ak[USIM_MILENAGE_AK_SIZE];
+    uint64_t value = seq << USIM_SQN_IND_BITS;
+    char apdu[128];
+    char get_response[16];
+    uint16_t sw;
+    uint8_t i;
+
+    (void)host_hex(k_hex, k);
+    (void)host_hex(opc_hex, opc);
+    memset(rand, 0x3CU, sizeof(rand));
+    rand[15] = ++rand_counter;
+    for(i = 0U; i < USIM_MILENAGE_SQN_SIZE; i++) {
+        sqn[USIM_MILENAGE_SQN_SIZE - 1U - i] = (uint8_t)(value >> (8U * i));
+    }
+    usim_milenage_init(k, opc, rand);
+    usim_milenage_f2345(res, ck, ik, ak);
+    for(i = 0U; i < USIM_MILENAGE_SQN_SIZE; i++) {
+        autn[i] = (uint8_t)(sqn[i] ^ ak[i]);
+    }
+    autn[USIM_AUTN_AMF_OFFSET] = 0x80U;
+    autn[USIM_AUTN_AMF_OFFSET + 1U] = 0x00U;
+    usim_milenage_f1(sqn, &autn[USIM_AUTN_AMF_OFFSET], &autn[USIM_AUTN_MAC_OFFSET], NULL);
+
+    (void)sprintf(apdu, "008800812210");
+    for(i = 0U; i < sizeof(rand); i++) {
+        (void)sprintf(&apdu[strlen(apdu)], "%02X", rand[i]);
+    }
+    (void)sprintf(&apdu[strlen(apdu)], "10");
+    for(i = 0U; i < USIM_AUTN_SIZE; i++) {
+        (void)sprintf(&apdu[strlen(apdu)], "%02X", autn[i]);
+    }
+    sw = host_apdu(apdu);
+    if((sw & 0xFF00U) == 0x6100U) {
+        (void)sprintf(get_response, "00C00000%02X", sw & 0xFFU);
+        sw = host_apdu(get_response);
+    }
+    if(sw != 0x9000U) {
+        return sw;
+    }
+    if(host_resp[0] == AUTH_TAG_SUCCESS) {
+        CHECK_EQ(host_resp[1], USIM_MILENAGE_RES_SIZE);
+        CHECK(memcmp(&host_resp[2], res, USIM_MILENAGE_RES_SIZE) == 0);
+    }
+    return host_resp[0];
+}
+
+static void test_isolation(void) {
+    host_flash_blank();
+    host_boot(true);
+    CHECK_EQ(host_apdu("80D0010009" IMSI_0), 0x9000U);
+    CHECK_EQ(host_apdu("80D0020010" K_0), 0x9000U);
+    CHECK_EQ(authenticate(K_0, FACTORY_OPC, 5U), AUTH_TAG_SUCCESS);
+
+    // Una ranura sin personalizar empieza con los valores de fábrica
+    CHECK_EQ(switch_profile(1U), 0x9000U);
+    CHECK_EQ(verify(PIN), 0x9000U);
+    check_imsi(FACTORY_IMSI);
+    CHECK_EQ(authenticate(FACTORY_K, FACTORY_OPC, 1U), AUTH_TAG_SUCCESS);
+    CHECK_EQ(host_apdu("80D0010009" IMSI_1), 0x9000U);
+    CHECK_EQ(host_apdu("80D0020010" K_1), 0x9000U);
+    CHECK_EQ(host_apdu("80D0030010" OPC_1), 0x9000U);
+    CHECK_EQ(authenticate(K_1, OPC_1, 2U), AUTH_TAG_SUCCESS);
+
+    // Cada perfil autentica con su K, su OPc y su SQN
+    CHECK_EQ(switch_profile(0U), 0x9000U);
+    CHECK_EQ(verify(PIN), 0x9000U);
+    check_imsi(IMSI_0);
+    check_k(K_0);
+    CHECK_EQ(authenticate(K_1, OPC_1, 9U), SW_AUTH_MAC_FAILURE);
+    CHECK_EQ(authenticate(K_0, FACTORY_OPC, 5U), AUTH_TAG_SYNC_FAILURE);
+    CHECK_EQ(authenticate(K_0, FACTORY_OPC, 6U), AUTH_TAG_SUCCESS);
+
+    CHECK_EQ(switch_profile(1U), 0x9000U);
+    CHECK_EQ(verify(PIN), 0x9000U);
+    check_imsi(IMSI_1);
+    check_k(K_1);
+    CHECK_EQ(authenticate(K_0, FACTORY_OPC, 9U), SW_AUTH_MAC_FAILURE);
+    CHECK_EQ(authenticate(K_1, OPC_1, 3U), AUTH_TAG_SUCCESS);
+
+    // El perfil activo sobrevive al reset, y su SQN con él
+    host_boot(true);
+    check_imsi(IMSI_1);
+    check_k(K_1);
+    CHECK_EQ(authenticate(K_1, OPC_1, 3U), AUTH_TAG_SYNC_FAILURE);
+    CHECK_EQ(authenticate(K_1, OPC_1, 4U), AUTH_TAG_SUCCESS);
+}
+
+// PIN y contadores de intentos de cada perfil, también tras un reset
+static void test_pin_isolation(void) {
+    host_flash_blank();
+    host_boot(true);
+    CHECK_EQ(host_apdu("0024000110" PIN PIN_0), 0x9000U);
+
+    CHECK_EQ(switch_profile(1U), 0x9000U);
+    CHECK_EQ(verify(PIN_0), SW_REMAINING_ATTEMPTS(2U));
+    // Sin PIN el perfil no deja leer EF_IMSI ni autenticar
+    CHECK_EQ(host_apdu("00B0870009"), SW_SECURITY_STATUS_NOT_SATISFIED);
+    CHECK_EQ(authenticate(FACTORY_K, FACTORY_OPC, 1U), SW_SECURITY_STATUS_NOT_SATISFIED);
+    CHECK_EQ(verify(PIN), 0x9000U);
+
+    // El fallo del perfil 1 no cuenta en el perfil 0: quedan 3 intentos
+    CHECK_EQ(switch_profile(0U), 0x9000U);
+    CHECK_EQ(verify(PIN), SW_REMAINING_ATTEMPTS(2U));
+    CHECK_EQ(verify(PIN_0), 0x9000U);
+    CHECK_EQ(authenticate(FACTORY_K, FACTORY_OPC, 1U), AUTH_TAG_SUCCESS);
+
+    // Dos fallos en el perfil 1 siguen contando tras el reset, solo allí
+    CHECK_EQ(switch_profile(1U), 0x9000U);
+    CHECK_EQ(verify(PIN_0), SW_REMAINING_ATTEMPTS(2U));
+    CHECK_EQ(verify(PIN_0), SW_REMAINING_ATTEMPTS(1U));
+    host_boot(false);
+    CHECK_EQ(verify(PIN_0), SW_PIN_BLOCKED);
+    CHECK_EQ(verify(PIN), SW_PIN_BLOCKED);
+    CHECK_EQ(switch_profile(0U), 0x9000U);
+    CHECK_EQ(verify(PIN_0), 0x9000U);
+    CHECK_EQ(authenticate(FACTORY_K, FACTORY_OPC, 2U), AUTH_TAG_SUCCESS);
+}
+
+// nvm_object(): los objetos de perfil de cada ranura (también la última)
+// son distintos y los compartidos son uno solo
+static void test_remap(void) {
+    uint8_t imsi = usim_file_buffer[usim_find_file_index(0x6F07)];
+    uint8_t profile;
+
+    host_flash_blank();
+    host_boot(true);
+    CHECK_EQ(switch_profile(USIM_PROFILE_COUNT - 1U), 0x9000U);
+    CHECK_EQ(verify(PIN), 0x9000U);
+    CHECK_EQ(host_apdu("80D0010009" IMSI_3), 0x9000U);
+    CHECK_EQ(host_apdu("0024000110" PIN PIN_0), 0x9000U);
+    // EF_MSISDN no es de perfil
+    CHECK_EQ(host_apdu("00A4000C026F40"), 0x9000U);
+    CHECK_EQ(host_apdu("00DC010418" MSISDN), 0x9000U);
+
+    for(profile = 0U; profile < USIM_PROFILE_COUNT; profile++) {
+        bool last = (profile == USIM_PROFILE_COUNT - 1U);
+
+        usim_nvm_set_profile(profile);
+        CHECK_EQ(usim_nvm_length(USIM_NVM_OBJ_BUFFER(imsi)), last ? 9U : 0U);
+        if(profile != 0U) {
+            CHECK_EQ(usim_nvm_length(USIM_NVM_OBJ_CHV), last ? USIM_NVM_CHV_SIZE : 0U);
+        }
+        CHECK_EQ(usim_nvm_length(USIM_NVM_OBJ_PROFILE), USIM_NVM_PROFILE_SIZE);
+    }
+    usim_nvm_set_profile(USIM_PROFILE_COUNT - 1U);
+
+    CHECK_EQ(switch_profile(USIM_PROFILE_COUNT - 2U), 0x9000U);
+    CHECK_EQ(verify(PIN), 0x9000U);
+    check_imsi(FACTORY_IMSI);
+    CHECK_EQ(host_apdu("00A4000C026F40"), 0x9000U);
+    CHECK_EQ(host_apdu("00B2010418"), 0x9000U);
+    CHECK_HEX(host_resp, host_resp_len, MSISDN);
+
+    host_boot(false);
+    CHECK_EQ(verify(PIN), 0x9000U);
+    check_imsi(FACTORY_IMSI);
+    CHECK_EQ(switch_profile(USIM_PROFILE_COUNT - 1U), 0x9000U);
+    CHECK_EQ(verify(PIN_0), 0x9000U);
+    check_imsi(IMSI_3);
+}
+
+// El cambio solo suelta las copias de los EF de perfil y relee el estado
+// del suscriptor: lee de flash menos que un arranque y no toca el resto
+static void test_switch_cost(void) {
+    uint8_t imsi = usim_file_buffer[usim_find_file_index(0x6F07)];
+    uint8_t msisdn = usim_file_buffer[usim_find_file_index(0x6F40)];
+    uint32_t boot_reads;
+    uint32_t switch_reads;
+
+    host_flash_blank();
+    host_boot(true);
+    CHECK_EQ(host_apdu("80D0010009" IMSI_0), 0x9000U);
+    CHECK_EQ(host_apdu("00A4000C026F40"), 0x9000U);
+    CHECK_EQ(host_apdu("00DC010418" MSISDN), 0x9000U);
+    CHECK_EQ(switch_profile(1U), 0x9000U);
+    CHECK_EQ(verify(PIN), 0x9000U);
+    CHECK_EQ(host_apdu("80D0010009" IMSI_1), 0x9000U);
+
+    host_flash_read_bytes = 0UL;
+    usim_init();
+    boot_reads = host_flash_read_bytes;
+
+    CHECK_EQ(switch_profile(0U), 0x9000U);
+    CHECK_EQ(verify(PIN), 0x9000U);
+    check_imsi(IMSI_0);
+    CHECK_EQ(host_apdu("00A4000C026F40"), 0x9000U);
+    CHECK_EQ(host_apdu("00B2010418"), 0x9000U);
+    CHECK_HEX(host_resp, host_resp_len, MSISDN);
+    CHECK(usim_buffer_state[imsi].flags & USIM_BUFFER_SHADOWED);
+    CHECK(usim_buffer_state[msisdn].flags & USIM_BUFFER_SHADOWED);
+
+    host_flash_read_bytes = 0UL;
+    CHECK_EQ(host_apdu("80D4010000"), 0x9000U);
+    switch_reads = host_flash_read_bytes;
+    CHECK(!(usim_buffer_state[imsi].flags & USIM_BUFFER_SHADOWED));
+    CHECK(usim_buffer_state[msisdn].flags & USIM_BUFFER_SHADOWED);
+    CHECK(switch_reads < boot_reads);
+    CHECK_EQ(host_apdu("00A4040C10 A0000000871002FF33FF018900000100"), 0x9000U);
+    CHECK_EQ(verify(PIN), 0x9000U);
+    check_imsi(IMSI_1);
+    printf("Cambio de perfil: %lu bytes leídos de flash, arranque %lu\n",
+           (unsigned long)switch_reads, (unsigned long)boot_reads);
+}
+
+static void test_errors(void) {
+    host_boot(true);
+    CHECK_EQ(host_apdu("80D4040000"), SW_WRONG_P1P2);
+    CHECK_EQ(host_apdu("80D4000100"), SW_WRONG_PARAMETERS);
+
+    // Con una transacción abierta no se cambia de perfil
+    CHECK_EQ(host_apdu("80D3010000"), 0x9000U);
+    CHECK_EQ(host_apdu("80D4000000"), SW_CONDITIONS_NOT_SATISFIED);
+    CHECK_EQ(host_apdu("80D3030000"), 0x9000U);
+}
+
+// Muchos cambios seguidos compactan el journal varias veces sin perder nada
+static void test_many_switches(void) {
+    uint8_t i;
+
+    host_flash_blank();
+    host_boot(true);
+    CHECK_EQ(host_apdu("80D0010009" IMSI_0), 0x9000U);
+    CHECK_EQ(host_apdu("80D0020010" K_0), 0x9000U);
+    CHECK_EQ(switch_profile(1U), 0x9000U);
+    CHECK_EQ(verify(PIN), 0x9000U);
+    CHECK_EQ(host_apdu("80D0010009" IMSI_1), 0x9000U);
+    CHECK_EQ(authenticate(FACTORY_K, FACTORY_OPC, 1U), AUTH_TAG_SUCCESS);
+
+    for(i = 0U; i < 120U; i++) {
+        CHECK_EQ(switch_profile((uint8_t)(i & 1U)), 0x9000U);
+    }
+    host_boot(true);
+    check_imsi(IMSI_1);
+    CHECK_EQ(switch_profile(0U), 0x9000U);
+    CHECK_EQ(verify(PIN), 0x9000U);
+    check_imsi(IMSI_0);
+    check_k(K_0);
+    CHECK_EQ(authenticate(K_0, FACTORY_OPC, 1U), AUTH_TAG_SUCCESS);
+    CHECK_EQ(switch_profile(1U), 0x9000U);
+    CHECK_EQ(verify(PIN), 0x9000U);
+    CHECK_EQ(authenticate(FACTORY_K, FACTORY_OPC, 1U), AUTH_TAG_SYNC_FAILURE);
+}
+
+int main(void) {
+    test_isolation();
+    test_pin_isolation();
+    test_remap();
+    test_switch_cost();
+    test_errors();
+    test_many_switches();
+    return host_report("test_profile");
+}
@@ -0,0 +1,158 @@
+// EF de registros lineales y cíclicos: READ/UPDATE RECORD con el puntero de
+// registro, SEARCH RECORD y el descriptor del FCP
+#include "harness.h"
+#include "usim_app.h"
+#include "usim_constants.h"
+#include <stdio.h>
+#include <string.h>
+
+#define MSISDN_RECORD "0102030405060708090A0B0C0D0E0F101112131415161718"
+
+// Resultado de SEARCH RECORD: los números de registro que deja pendientes
+static uint16_t search(const char* command) {
+    char get_response[16];
+    uint16_t sw = host_apdu(command);
+
+    if((sw & 0xFF00U) != 0x6100U) {
+        return sw;
+    }
+    (void)sprintf(get_response, "00C00000%02X", sw & 0xFFU);
+    return host_apdu(get_response);
+}
+
+static void test_linear_fixed(void) {
+    host_boot(true);
+
+    // EF_MSISDN: dos registros de 24 bytes
+    CHECK_EQ(host_apdu("00A4000C026F40"), 0x9000U);
+    CHECK_EQ(host_apdu("00DC010418" MSISDN_RECORD), 0x9000U);
+    CHECK_EQ(host_apdu("00B2010418"), 0x9000U);
+    CHECK_HEX(host_resp, host_resp_len, MSISDN_RECORD);
+
+    // Le distinto de la longitud del registro; registro fuera de rango
+    CHECK_EQ(host_apdu("00B2010410"), SW_WRONG_LE(0x18U));
+    CHECK_EQ(host_apdu("00B2030418"), SW_RECORD_NOT_FOUND);
+    CHECK_EQ(host_apdu("00DC01041A 0102"), SW_WRONG_LENGTH);
+
+    // NEXT recorre los registros desde el primero y no da la vuelta
+    CHECK_EQ(host_apdu("00A4000C026F40"), 0x9000U);
+    CHECK_EQ(host_apdu("00B2000218"), 0x9000U);
+    CHECK_HEX(host_resp, host_resp_len, MSISDN_RECORD);
+    CHECK_EQ(host_apdu("00B2000218"), 0x9000U);
+    CHECK_EQ(host_apdu("00B2000218"), SW_RECORD_NOT_FOUND);
+    CHECK_EQ(host_apdu("00B2000318"), 0x9000U);
+    CHECK_HEX(host_resp, host_resp_len, MSISDN_RECORD);
+
+    // Los comandos binarios no valen para un EF de registros
+    CHECK_EQ(host_apdu("00B0000001"), SW_COMMAND_NOT_ALLOWED);
+}
+
+static void test_cyclic(void) {
+    host_boot(true);
+
+    // EF_ACM: cinco registros de 3 bytes; el descriptor lo declara cíclico
+    CHECK_EQ(host_apdu("00A4000402 6F39"), SW_BYTES_AVAILABLE(0x13U));
+    CHECK_EQ(host_apdu("00C0000013"), 0x9000U);
+    CHECK_HEX(&host_resp[6], 7U, "82050621000305");
+
+    // UPDATE RECORD solo en modo PREVIOUS: el más antiguo pasa a ser el 1
+    CHECK_EQ(host_apdu("00DC000303 000001"), 0x9000U);
+    CHECK_EQ(host_apdu("00DC000303 000002"), 0x9000U);
+    CHECK_EQ(host_apdu("00DC010403 000009"), SW_WRONG_PARAMETERS);
+    CHECK_EQ(host_apdu("00B2010403"), 0x9000U);
+    CHECK_HEX(host_resp, host_resp_len, "000002");
+    CHECK_EQ(host_apdu("00B2020403"), 0x9000U);
+    CHECK_HEX(host_resp, host_resp_len, "000001");
+    CHECK_EQ(host_apdu("00B2060403"), SW_RECORD_NOT_FOUND);
+}
+
+// UPDATE RECORD sobre EF_ACM cortado tras "cut" operaciones de flash
+static void cut_update(long cut) {
+    host_flash_blank();
+    host_boot(true);
+    CHECK_EQ(host_apdu("00A4000C026F39"), 0x9000U);
+    CHECK_EQ(host_apdu("00DC000303 000001"), 0x9000U);
+    host_flash_cut_after(cut);
+    if(setjmp(host_flash_cut) == 0) {
+        (void)host_apdu("00DC000303 000002");
+        CHECK(false);
+    }
+    host_flash_cut_after(-1L);
+}
+
+// Un corte en cualquier punto de UPDATE RECORD deja el registro nuevo como
+// 1 y el anterior como 2, o todo como estaba: datos y puntero cíclico van
+// en la misma confirmación
+static void test_cyclic_torn(void) {
+    uint32_t ops;
+    long cut;
+    unsigned old_state = 0U;
+    unsigned new_state = 0U;
+
+    host_flash_blank();
+    host_boot(true);
+    CHECK_EQ(host_apdu("00A4000C026F39"), 0x9000U);
+    CHECK_EQ(host_apdu("00DC000303 000001"), 0x9000U);
+    ops = host_flash_ops;
+    CHECK_EQ(host_apdu("00DC000303 000002"), 0x9000U);
+    ops = host_flash_ops - ops;
+
+    for(cut = 0L; cut < (long)ops; cut++) {
+        cut_update(cut);
+        host_boot(true);
+        CHECK_EQ(host_apdu("00A4000C026F39"), 0x9000U);
+        CHECK_EQ(host_apdu("00B2010403"), 0x9000U);
+        if(host_resp[2] == 0x02U) {
+            new_state++;
+            CHECK_EQ(host_apdu("00B2020403"), 0x9000U);
+            CHECK_HEX(host_resp, host_resp_len, "000001");
+        } else {
+            old_state++;
+            CHECK_HEX(host_resp, host_resp_len, "000001");
+        }
+    }
+    CHECK_EQ(old_state + new_state, (unsigned)ops);
+    CHECK(old_state > 0U);
+}
+
+static void test_search(void) {
+    host_boot(true);
+
+    // EF_ECC: registros 11F2FF00 y 19F1FF00
+    CHECK_EQ(host_apdu("00A4000C026FB7"), 0x9000U);
+    CHECK_EQ(search("00A2010402 19F1"), 0x9000U);
+    CHECK_HEX(host_resp, host_resp_len, "02");
+    CHECK_EQ(search("00A2010401 FF"), 0x9000U);
+    CHECK_HEX(host_resp, host_resp_len, "0102");
+    CHECK_EQ(search("00A2020401 11"), 0x9000U);
+    CHECK_EQ(host_resp_len, 0U);
+
+    // Modos de TS 102 221 §11.1.7: hacia atrás desde P1, y desde el
+    // registro siguiente o el anterior a P1; 02 y 03 no son búsquedas
+    CHECK_EQ(search("00A2020501 FF"), 0x9000U);
+    CHECK_HEX(host_resp, host_resp_len, "0201");
+    CHECK_EQ(search("00A2010601 FF"), 0x9000U);
+    CHECK_HEX(host_resp, host_resp_len, "02");
+    CHECK_EQ(host_apdu("00A2010201 FF"), SW_WRONG_P1P2);
+    CHECK_EQ(host_apdu("00A2010301 FF"), SW_WRONG_P1P2);
+    CHECK_EQ(search("00A2020701 FF"), 0x9000U);
+    CHECK_HEX(host_resp, host_resp_len, "01");
+
+    // P1 = 00: desde el registro actual, que es el primero encontrado
+    CHECK_EQ(search("00A2000601 FF"), 0x9000U);
+    CHECK_HEX(host_resp, host_resp_len, "02");
+
+    // Con el SFI en P2, desde la ADF
+    CHECK_EQ(host_apdu("00A4000C027FFF"), 0x9000U);
+    CHECK_EQ(search("00A2010C01 19"), 0x9000U);
+    CHECK_HEX(host_resp, host_resp_len, "02");
+}
+
+int main(void) {
+    host_flash_blank();
+    test_linear_fixed();
+    test_cyclic();
+    test_cyclic_torn();
+    test_search();
+    return host_report("test_records");
+}
@@ -0,0 +1,67 @@
+// Almacén de secretos: K, OPc y TOPc fuera de la tabla de archivos, con
+// los valores de fábrica de files.json hasta que la personalización los
+// sustituye en NVM
+#include "harness.h"
+#include "usim_app.h"
+#include "usim_constants.h"
+#include "usim_secrets.h"
+#include <string.h>
+
+#define FACTORY_K   "465B5CE8B199B49FAA5F0A2EE238A6BC"
+#define FACTORY_OPC "CD63CB71954A9F4E48A5994B865AE955"
+#define NEW_K       "000102030405060708090A0B0C0D0E0F"
+#define NEW_TOPC    "101112131415161718191A1B1C1D1E1F202122232425262728292A2B2C2D2E2F"
+
+static void test_factory(void) {
+    uint8_t secret[32];
+    uint8_t k[USIM_SECRET_KEY_SIZE];
+
+    host_flash_blank();
+    host_boot(true);
+    usim_secret_get(USIM_SECRET_K, secret);
+    CHECK_HEX(secret, USIM_SECRET_KEY_SIZE, FACTORY_K);
+    usim_secret_get(USIM_SECRET_OPC, secret);
+    CHECK_HEX(secret, USIM_SECRET_KEY_SIZE, FACTORY_OPC);
+    CHECK_EQ(usim_secret_size(USIM_SECRET_TOPC), 32U);
+
+    // La tabla de fábrica está enmascarada
+    (void)host_hex(FACTORY_K, k);
+    CHECK(memcmp(usim_secret_init, k, sizeof(k)) != 0);
+
+    // Ningún EF expone los secretos
+    CHECK_EQ(host_apdu("00A4000C026F08"), SW_FILE_NOT_FOUND);
+    CHECK_EQ(host_apdu("00A4000C026F09"), SW_FILE_NOT_FOUND);
+    CHECK_EQ(host_apdu("00A4000C026F0B"), SW_FILE_NOT_FOUND);
+}
+
+// Los secretos nuevos sobreviven al reset; con la flash vacía vuelven los de
+// fábrica
+static void test_persisted(void) {
+    uint8_t secret[32];
+
+    host_flash_blank();
+    host_boot(true);
+    CHECK_EQ(host_apdu("80D0020010" NEW_K), 0x9000U);
+    CHECK_EQ(host_apdu("80D0070020" NEW_TOPC), 0x9000U);
+    usim_secret_get(USIM_SECRET_K, secret);
+    CHECK_HEX(secret, USIM_SECRET_KEY_SIZE, NEW_K);
+
+    host_boot(true);
+    usim_secret_get(USIM_SECRET_K, secret);
+    CHECK_HEX(secret, USIM_SECRET_KEY_SIZE, NEW_K);
+    usim_secret_get(USIM_SECRET_OPC, secret);
+    CHECK_HEX(secret, USIM_SECRET_KEY_SIZE, FACTORY_OPC);
+    usim_secret_get(USIM_SECRET_TOPC, secret);
+    CHECK_HEX(secret, 32U, NEW_TOPC);
+
+    host_flash_blank();
+    host_boot(true);
+    usim_secret_get(USIM_SECRET_K, secret);
+    CHECK_HEX(secret, USIM_SECRET_KEY_SIZE, FACTORY_K);
+}
+
+int main(void) {
+    test_factory();
+    test_persisted();
+    return host_report("test_secrets");
+}
@@ -0,0 +1,127 @@
+// Árbol de archivos: SELECT por FID, DF hijo/padre, AID completo o parcial y
+// ruta desde el MF o desde el DF actual
+#include "harness.h"
+#include "usim_app.h"
+#include "usim_constants.h"
+#include "usim_files.h"
+
+#define AID_USIM "A0000000871002FF33FF018900000100"
+
+static void test_fid(void) {
+    host_boot(true);
+
+    // Un FID se busca entre los hijos del DF actual, el padre y los DF
+    // hermanos
+    CHECK_EQ(host_apdu("00A4000C023F00"), 0x9000U);
+    CHECK_EQ(host_apdu("00A4000C027F20"), 0x9000U);
+    CHECK_EQ(host_apdu("00A4000C026F07"), 0x9000U);
+    CHECK_EQ(current_file.file_id, 0x6F07U);
+    CHECK_EQ(host_apdu("00A4000C027F10"), 0x9000U);
+    CHECK_EQ(host_apdu("00A4000C026F40"), 0x9000U);
+    CHECK_EQ(host_apdu("00A4000C026F07"), SW_FILE_NOT_FOUND);
+
+    // 7FFF es la ADF que contiene el archivo actual; fuera de ella no hay
+    CHECK_EQ(host_apdu("00A4000C027FF0"), 0x9000U);
+    CHECK_EQ(host_apdu("00A4000C026FB7"), 0x9000U);
+    CHECK_EQ(host_apdu("00A4000C027FFF"), 0x9000U);
+    CHECK_EQ(current_file.file_id, 0x7FF0U);
+    CHECK_EQ(host_apdu("00A4000C027F20"), 0x9000U);
+    CHECK_EQ(host_apdu("00A4000C027FFF"), SW_FILE_NOT_FOUND);
+}
+
+static void test_child_parent(void) {
+    host_boot(true);
+
+    // P1 01/02: DF o EF hijo, y solo de ese tipo
+    CHECK_EQ(host_apdu("00A4020C026F07"), 0x9000U);
+    CHECK_EQ(host_apdu("00A4030C00"), 0x9000U);
+    CHECK_EQ(current_file.file_id, 0x3F00U);
+    CHECK_EQ(host_apdu("00A4010C027F20"), 0x9000U);
+    CHECK_EQ(host_apdu("00A4020C027F20"), SW_FILE_NOT_FOUND);
+    CHECK_EQ(host_apdu("00A4010C026F07"), SW_FILE_NOT_FOUND);
+
+    // P1 03 desde un EF: el padre de su DF
+    CHECK_EQ(host_apdu("00A4020C026F07"), 0x9000U);
+    CHECK_EQ(host_apdu("00A4030C00"), 0x9000U);
+    CHECK_EQ(current_file.file_id, 0x3F00U);
+}
+
+static void test_aid(void) {
+    host_boot(true);
+
+    CHECK_EQ(host_apdu("00A4000C023F00"), 0x9000U);
+    CHECK_EQ(host_apdu("00A4040C07A0000000871002"), 0x9000U);
+    CHECK_EQ(current_file.file_id, 0x7FF0U);
+    CHECK_EQ(host_apdu("00A4040C05A000000099"), SW_FILE_NOT_FOUND);
+
+    // El FCP de la ADF lleva su AID en el tag 84
+    CHECK_EQ(host_apdu("00A4040410" AID_USIM), SW_BYTES_AVAILABLE(0x1FU));
+    CHECK_EQ(host_apdu("00C000001F"), 0x9000U);
+    CHECK_HEX(&host_resp[host_resp_len - 18U], 18U, "8410" AID_USIM);
+}
+
+static void test_path(void) {
+    host_boot(true);
+
+    // P1 08: desde el MF, sin 3F00 al principio
+    CHECK_EQ(host_apdu("00A4080C047F206F07"), 0x9000U);
+    CHECK_EQ(current_file.file_id, 0x6F07U);
+    CHECK_EQ(host_apdu("00A4080C023F00"), SW_FILE_NOT_FOUND);
+    CHECK_EQ(host_apdu("00A4080C047F206FFF"), SW_FILE_NOT_FOUND);
+
+    // P1 09: desde el DF actual
+    CHECK_EQ(host_apdu("00A4000C023F00"), 0x9000U);
+    CHECK_EQ(host_apdu("00A4090C047F206F07"), 0x9000U);
+    CHECK_EQ(host_apdu("00A4000C027F10"), 0x9000U);
+    CHECK_EQ(host_apdu("00A4090C026F07"), SW_FILE_NOT_FOUND);
+
+    // Un EF fallido deja el archivo actual como estaba
+    CHECK_EQ(current_file.file_id, 0x7F10U);
+}
+
+// Las copias GSM de los EF comparten datos con las de la ADF
+static void test_shared_data(void) {
+    host_boot(true);
+
+    CHECK_EQ(host_apdu("00A4000C026F7E"), 0x9000U);
+    CHECK_EQ(host_apdu("00D6000201AA"), 0x9000U);
+    CHECK_EQ(host_apdu("00A4080C047F206F7E"), 0x9000U);
+    CHECK_EQ(host_apdu("00B0000004"), 0x9000U);
+    CHECK_HEX(host_resp, host_resp_len, "0725AA10");
+}
+
+// El árbol que genera scripts/gen_fs.py: cada hijo apunta a su DF y los
+// hijos de un DF son consecutivos y ordenados por FID
+static void test_generated_tree(void) {
+    uint8_t file;
+
+    CHECK_EQ(usim_file_type[USIM_FILE_INDEX_MF], FILE_TYPE_MF);
+    CHECK_EQ(usim_file_parent[USIM_FILE_INDEX_MF], USIM_FILE_NO_PARENT);
+    for(file = 0U; file < USIM_FILE_COUNT; file++) {
+        uint8_t first = usim_file_first_child[file];
+        uint8_t child;
+
+        if(usim_file_type[file] == FILE_TYPE_EF) {
+            CHECK_EQ(usim_file_child_count[file], 0U);
+            CHECK(usim_file_buffer[file] < USIM_BUFFER_COUNT || usim_file_buffer[file] == USIM_FILE_NO_BUFFER);
+            continue;
+        }
+        for(child = 0U; child < usim_file_child_count[file]; child++) {
+            CHECK_EQ(usim_file_parent[first + child], file);
+            if(child > 0U) {
+                CHECK(usim_file_fid[first + child - 1U] < usim_file_fid[first + child]);
+            }
+        }
+    }
+}
+
+int main(void) {
+    host_flash_blank();
+    test_generated_tree();
+    test_fid();
+    test_child_parent();
+    test_aid();
+    test_path();
+    test_shared_data();
+    return host_report("test_select");
+}
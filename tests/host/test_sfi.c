@@ -0,0 +1,141 @@
+// Direccionamiento por SFI en READ/UPDATE BINARY y en los comandos de
+// registros, tag 88 del FCP, y APDUs y bytes de una lectura de arranque con y
+// sin SFI
+#include "harness.h"
+#include "usim_app.h"
+#include "usim_constants.h"
+#include <stdio.h>
+#include <string.h>
+
+// FCP de un EF del DF actual (SELECT con 61xx y GET RESPONSE)
+static uint16_t select_fcp(const char* fid) {
+    char command[32];
+    uint16_t sw;
+
+    (void)sprintf(command, "00A4000402%s", fid);
+    sw = host_apdu(command);
+    if((sw & 0xFF00U) != 0x6100U) {
+        return sw;
+    }
+    (void)sprintf(command, "00C00000%02X", sw & 0xFFU);
+    return host_apdu(command);
+}
+
+static void test_fcp_tag(void) {
+    host_boot(true);
+
+    CHECK_EQ(select_fcp("6F07"), 0x9000U);
+    CHECK_HEX(&host_resp[host_resp_len - 3U], 3U, "880138");
+
+    // EF sin SFI: el tag va vacío
+    CHECK_EQ(select_fcp("6F39"), 0x9000U);
+    CHECK_HEX(&host_resp[host_resp_len - 2U], 2U, "8800");
+
+    // Los DF no llevan tag 88
+    CHECK_EQ(select_fcp("7F20"), 0x9000U);
+    CHECK(memchr(host_resp, 0x88, host_resp_len) == NULL);
+}
+
+static void test_read_update_binary(void) {
+    host_boot(true);
+
+    CHECK_EQ(host_apdu("00B0870009"), 0x9000U);
+    CHECK_HEX(host_resp, host_resp_len, "080901020304050607");
+    CHECK_EQ(current_file.file_id, 0x6F07U);
+
+    // P2 es el offset
+    CHECK_EQ(host_apdu("00B0870203"), 0x9000U);
+    CHECK_HEX(host_resp, host_resp_len, "010203");
+
+    // UPDATE BINARY por SFI deja el EF como actual
+    CHECK_EQ(host_apdu("00D68B0202 AABB"), 0x9000U);
+    CHECK_EQ(current_file.file_id, 0x6F7EU);
+    CHECK_EQ(host_apdu("00B0000004"), 0x9000U);
+    CHECK_HEX(host_resp, host_resp_len, "0725AABB");
+
+    // P1 b7..b6 deben ser 0; SFI inexistente; EF de registros
+    CHECK_EQ(host_apdu("00B0A70001"), SW_WRONG_PARAMETERS);
+    CHECK_EQ(host_apdu("00B09E0001"), SW_FILE_NOT_FOUND);
+    CHECK_EQ(host_apdu("00B0810001"), SW_COMMAND_NOT_ALLOWED);
+    CHECK_EQ(host_apdu("00B0870A01"), SW_WRONG_PARAMETERS);
+
+    // El SFI es relativo al DF actual: desde el MF no hay EF_IMSI con SFI
+    CHECK_EQ(host_apdu("00A4000C023F00"), 0x9000U);
+    CHECK_EQ(host_apdu("00B0870001"), SW_FILE_NOT_FOUND);
+
+    // Las condiciones de acceso se comprueban igual que tras SELECT
+    host_boot(false);
+    CHECK_EQ(host_apdu("00B0870001"), SW_SECURITY_STATUS_NOT_SATISFIED);
+    CHECK_EQ(host_apdu("00B0830002"), 0x9000U);
+}
+
+static void test_records(void) {
+    host_boot(true);
+
+    // READ RECORD con SFI en P2 b8..b4
+    CHECK_EQ(host_apdu("00B2010C04"), 0x9000U);
+    CHECK_HEX(host_resp, host_resp_len, "11F2FF00");
+    CHECK_EQ(current_file.file_id, 0x6FB7U);
+    CHECK_EQ(host_apdu("00B2020404"), 0x9000U);
+    CHECK_HEX(host_resp, host_resp_len, "19F1FF00");
+
+    // Seleccionar por SFI reinicia el puntero de registro
+    CHECK_EQ(host_apdu("00B2000204"), 0x9000U);
+    CHECK_EQ(host_apdu("00B2000204"), 0x9000U);
+    CHECK_HEX(host_resp, host_resp_len, "19F1FF00");
+    CHECK_EQ(host_apdu("00B2000A04"), 0x9000U);
+    CHECK_HEX(host_resp, host_resp_len, "11F2FF00");
+
+    CHECK_EQ(host_apdu("00B201FC04"), SW_WRONG_PARAMETERS);
+    CHECK_EQ(host_apdu("00B201F404"), SW_FILE_NOT_FOUND);
+}
+
+// Lectura de arranque (IMSI, AD, ACC y LOCI) en T=0: SELECT + READ
+// BINARY por EF frente a un READ BINARY por SFI
+static void test_attach_reads(void) {
+    static const char* const with_select[] = {
+        "00A4000C026F07", "00B0000009",
+        "00A4000C026FAD", "00B0000002",
+        "00A4000C026F78", "00B0000002",
+        "00A4000C026F7E", "00B000000B",
+    };
+    static const char* const with_sfi[] = {
+        "00B0870009",
+        "00B0830002",
+        "00B0860002",
+        "00B08B000B",
+    };
+    uint32_t select_bytes;
+    uint32_t sfi_bytes;
+    uint8_t i;
+
+    host_protocol = 0U;
+    host_boot(true);
+    host_bus_bytes = 0UL;
+    for(i = 0U; i < sizeof(with_select) / sizeof(with_select[0]); i++) {
+        CHECK_EQ(host_exchange(with_select[i]), 0x9000U);
+    }
+    select_bytes = host_bus_bytes;
+
+    host_boot(true);
+    host_bus_bytes = 0UL;
+    for(i = 0U; i < sizeof(with_sfi) / sizeof(with_sfi[0]); i++) {
+        CHECK_EQ(host_exchange(with_sfi[i]), 0x9000U);
+    }
+    sfi_bytes = host_bus_bytes;
+
+    // Un carácter son 12 ETU en T=0 (11 más la guarda mínima)
+    printf("Lectura de arranque: %u APDU y %lu ETU con SELECT, %u APDU y %lu ETU con SFI\n",
+           (unsigned)(sizeof(with_select) / sizeof(with_select[0])), (unsigned long)(select_bytes * 12UL),
+           (unsigned)(sizeof(with_sfi) / sizeof(with_sfi[0])), (unsigned long)(sfi_bytes * 12UL));
+    CHECK_EQ(select_bytes - sfi_bytes, 4U * (5U + 2U + 1U + 2U));
+}
+
+int main(void) {
+    host_flash_blank();
+    test_fcp_tag();
+    test_read_update_binary();
+    test_records();
+    test_attach_reads();
+    return host_report("test_sfi");
+}
@@ -0,0 +1,152 @@
+// Datos de los EF servidos desde la imagen en flash hasta la primera
+// escritura, que los copia a una página del pool de XRAM; tras el reset los
+// EF escritos se leen del journal la primera vez que se usan
+#include "harness.h"
+#include "usim_app.h"
+#include "usim_constants.h"
+#include "usim_files.h"
+#include <string.h>
+
+static void test_copy_on_write(void) {
+    uint8_t loci = usim_find_file_index(0x6F7E);
+    const uint8_t* image = &usim_data_init[usim_buffer_offset[usim_file_buffer[loci]]];
+
+    host_flash_blank();
+    host_boot(true);
+    CHECK(usim_file_data(loci) == image);
+
+    CHECK_EQ(host_apdu("00D68B0202 AABB"), 0x9000U);
+    CHECK(usim_file_data(loci) != image);
+    CHECK_EQ(host_apdu("00B08B000B"), 0x9000U);
+    CHECK_HEX(host_resp, host_resp_len, "0725AABB0062F535010000");
+
+    // La imagen en flash no cambia y el EF_LOCI de DF_GSM ve la copia
+    CHECK_HEX(image, 4U, "07254310");
+    CHECK_EQ(host_apdu("00A4080C047F206F7E"), 0x9000U);
+    CHECK_EQ(host_apdu("00B0000004"), 0x9000U);
+    CHECK_HEX(host_resp, host_resp_len, "0725AABB");
+
+    // Tras el reset la copia se recarga desde el journal; con la flash
+    // vacía el EF vuelve a la imagen
+    host_boot(true);
+    CHECK(usim_file_data(loci) != image);
+    CHECK_EQ(host_apdu("00B08B0004"), 0x9000U);
+    CHECK_HEX(host_resp, host_resp_len, "0725AABB");
+    host_flash_blank();
+    host_boot(true);
+    CHECK(usim_file_data(loci) == image);
+    CHECK_EQ(host_apdu("00B08B0004"), 0x9000U);
+    CHECK_HEX(host_resp, host_resp_len, "07254310");
+}
+
+// Un EF por buffer, el primero que lo usa
+static uint8_t buffer_file(uint8_t buffer) {
+    uint8_t file;
+
+    for(file = 0U; file < USIM_FILE_COUNT; file++) {
+        if(usim_file_buffer[file] == buffer) {
+            break;
+        }
+    }
+    return file;
+}
+
+// Con todos los buffers escritos, tras el reset cada EF se lee del journal
+// al usarlo. El pool no los admite todos a la vez: cada APDU libera las
+// páginas del anterior y se reaprovechan las que se pueden releer.
+static void test_all_persisted(void) {
+    uint8_t buffer;
+
+    CHECK(USIM_SHADOW_POOL_SIZE < USIM_DATA_POOL_SIZE);
+
+    host_flash_blank();
+    host_boot(true);
+    for(buffer = 0U; buffer < USIM_BUFFER_COUNT; buffer++) {
+        uint8_t file = buffer_file(buffer);
+        uint8_t* data = usim_file_writable(file);
+
+        CHECK(data != NULL);
+        if(data != NULL) {
+            data[0] = (uint8_t)(0xA0U + buffer);
+            CHECK(usim_file_written(file, 1U));
+        }
+        usim_files_release();
+    }
+    CHECK(usim_files_flush());
+
+    // Nada se carga al arrancar
+    host_boot(true);
+    usim_files_release();
+    for(buffer = 0U; buffer < USIM_BUFFER_COUNT; buffer++) {
+        if(usim_file_buffer[usim_find_file_index(0x6F0A)] != buffer) {
+            CHECK(!(usim_buffer_state[buffer].flags & USIM_BUFFER_SHADOWED));
+        }
+    }
+
+    for(buffer = 0U; buffer < USIM_BUFFER_COUNT; buffer++) {
+        uint8_t file = buffer_file(buffer);
+        const uint8_t* data = usim_file_data(file);
+
+        CHECK(data != NULL && data != &usim_data_init[usim_buffer_offset[buffer]]);
+        if(data != NULL) {
+            CHECK_EQ(data[0], 0xA0U + buffer);
+        }
+        usim_files_release();
+    }
+}
+
+// Las páginas entregadas en el APDU en curso y las pendientes en la caché
+// write-back no se liberan para hacer sitio
+static void test_pages_kept(void) {
+    uint8_t imsi = usim_find_file_index(0x6F07);
+    uint8_t msisdn = usim_find_file_index(0x6F40);
+    const uint8_t* held;
+    uint8_t buffer;
+
+    host_flash_blank();
+    host_boot(true);
+    for(buffer = 0U; buffer < USIM_BUFFER_COUNT; buffer++) {
+        uint8_t file = buffer_file(buffer);
+        uint8_t* data = usim_file_writable(file);
+
+        if(data != NULL) {
+            data[0] = (uint8_t)(0xB0U + buffer);
+            (void)usim_file_written(file, 1U);
+        }
+        usim_files_release();
+    }
+    CHECK(usim_files_flush());
+    host_boot(true);
+
+    // EF_LOCI (write-back) queda solo en XRAM
+    CHECK_EQ(host_apdu("00D68B0202 CCDD"), 0x9000U);
+    CHECK_EQ(usim_cache_pending(), 1U);
+
+    // Un mismo APDU lee EF_IMSI y luego todo lo demás: la página de EF_IMSI
+    // sigue siendo suya aunque el pool se llene
+    usim_files_release();
+    held = usim_file_data(imsi);
+    CHECK(held != NULL);
+    for(buffer = 0U; buffer < USIM_BUFFER_COUNT; buffer++) {
+        (void)usim_file_data(buffer_file(buffer));
+    }
+    CHECK(held == usim_file_data(imsi));
+    CHECK_EQ(held[0], 0xB0U + usim_file_buffer[imsi]);
+
+    // En APDU siguientes EF_MSISDN (el mayor) desaloja lo que haga falta,
+    // pero no EF_LOCI
+    usim_files_release();
+    CHECK(usim_file_data(msisdn) != NULL);
+    CHECK_EQ(usim_file_data(msisdn)[0], 0xB0U + usim_file_buffer[msisdn]);
+    CHECK_EQ(usim_cache_pending(), 1U);
+    CHECK_EQ(host_apdu("00B08B0004"), 0x9000U);
+    CHECK_EQ(host_resp[0], 0xB0U + usim_file_buffer[usim_find_file_index(0x6F7E)]);
+    CHECK_HEX(&host_resp[2], 2U, "CCDD");
+}
+
+int main(void) {
+    test_copy_on_write();
+    test_all_persisted();
+    test_pages_kept();
+    return host_report("test_shadow");
+}
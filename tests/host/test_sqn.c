@@ -0,0 +1,183 @@
+// Frescura del SQN en usim_run_aka() (TS 33.102 anexo C): matriz SEQ/IND,
+// límite de antigüedad L, salto máximo DELTA, AUTS de resincronización y
+// SQN_MS grabado en NVM antes de entregar RES
+#include "harness.h"
+#include "usim_app.h"
+#include "usim_auth.h"
+#include "usim_constants.h"
+#include "usim_milenage.h"
+#include "usim_secrets.h"
+#include <string.h>
+
+static uint8_t rand_counter;
+
+static void make_sqn(uint64_t seq, uint8_t ind, uint8_t* sqn) {
+    uint64_t value = (seq << USIM_SQN_IND_BITS) | ind;
+    uint8_t i;
+
+    for(i = 0U; i < USIM_MILENAGE_SQN_SIZE; i++) {
+        sqn[USIM_MILENAGE_SQN_SIZE - 1U - i] = (uint8_t)(value >> (8U * i));
+    }
+}
+
+static uint64_t sqn_seq(const uint8_t* sqn) {
+    uint64_t value = 0U;
+    uint8_t i;
+
+    for(i = 0U; i < USIM_MILENAGE_SQN_SIZE; i++) {
+        value = (value << 8) | sqn[i];
+    }
+    return value >> USIM_SQN_IND_BITS;
+}
+
+// La red: MILENAGE con la K y el OPc de la tarjeta
+static void network_load(const uint8_t* rand) {
+    uint8_t k[USIM_SECRET_KEY_SIZE];
+    uint8_t opc[USIM_SECRET_KEY_SIZE];
+
+    usim_secret_get(USIM_SECRET_K, k);
+    usim_secret_get(USIM_SECRET_OPC, opc);
+    usim_milenage_init(k, opc, rand);
+}
+
+// ... y un RAND nuevo
+static void network_init(uint8_t* rand) {
+    memset(rand, 0x5AU, 16U);
+    rand[15] = ++rand_counter;
+    network_load(rand);
+}
+
+// AKA con AUTN = SQN^AK | AMF | MAC-A; devuelve el resultado de la tarjeta
+// y deja su respuesta en output
+static uint8_t authenticate(uint64_t seq, uint8_t ind, uint8_t* output, uint8_t* rand) {
+    uint8_t sqn[USIM_MILENAGE_SQN_SIZE];
+    uint8_t autn[USIM_AUTN_SIZE];
+    uint8_t res[USIM_MILENAGE_RES_SIZE];
+    uint8_t ck[16];
+    uint8_t ik[16];
+    uint8_t ak[USIM_MILENAGE_AK_SIZE];
+    uint16_t output_len;
+    uint8_t i;
+
+    network_init(rand);
+    make_sqn(seq, ind, sqn);
+    usim_milenage_f2345(res, ck, ik, ak);
+    for(i = 0U; i < USIM_MILENAGE_SQN_SIZE; i++) {
+        autn[i] = (uint8_t)(sqn[i] ^ ak[i]);
+    }
+    autn[USIM_AUTN_AMF_OFFSET] = 0x80U;
+    autn[USIM_AUTN_AMF_OFFSET + 1U] = 0x00U;
+    usim_milenage_f1(sqn, &autn[USIM_AUTN_AMF_OFFSET], &autn[USIM_AUTN_MAC_OFFSET], NULL);
+    return usim_run_aka(rand, autn, output, &output_len);
+}
+
+static bool accepted(uint64_t seq, uint8_t ind) {
+    uint8_t output[64];
+    uint8_t rand[16];
+
+    return authenticate(seq, ind, output, rand) == USIM_AKA_OK;
+}
+
+static void test_array(void) {
+    uint8_t ind;
+
+    host_flash_blank();
+    host_boot(true);
+
+    // SEQ nuevo y repetición
+    CHECK(accepted(10U, 0U));
+    CHECK(!accepted(10U, 0U));
+    CHECK(accepted(11U, 0U));
+    CHECK_EQ(sqn_seq(subscriber.sqn), 11U);
+
+    // Vectores de otros nodos (otros IND) fuera de orden
+    CHECK(accepted(20U, 3U));
+    CHECK(accepted(18U, 7U));
+    CHECK(accepted(19U, 7U));
+    CHECK(!accepted(19U, 7U));
+    CHECK(!accepted(18U, 3U));
+    CHECK_EQ(sqn_seq(subscriber.sqn), 20U);
+
+    // Un SEQ ya usado en un IND vale en cualquier otro IND sin usar
+    for(ind = 8U; ind < USIM_SQN_ARRAY_SIZE; ind++) {
+        CHECK(accepted(19U, ind));
+    }
+
+    // Límite de antigüedad: SEQ_MS - SEQ >= L se rechaza aunque el IND esté
+    // libre
+    CHECK(accepted(40U, 1U));
+    CHECK(!accepted(40U - USIM_SQN_AGE_LIMIT, 2U));
+    CHECK(accepted(40U - USIM_SQN_AGE_LIMIT + 1U, 2U));
+
+    // Salto máximo DELTA = 2^28
+    CHECK(!accepted(40U + (1ULL << 28) + 1U, 0U));
+    CHECK(accepted(40U + (1ULL << 27), 0U));
+}
+
+// AUTS = SQN_MS^AK* | MAC-S con AMF 0000, y un MAC erróneo no toca SQN_MS
+static void test_resync(void) {
+    uint8_t output[64];
+    uint8_t rand[16];
+    uint8_t expected[USIM_MILENAGE_SQN_SIZE];
+    uint8_t ak_star[USIM_MILENAGE_AK_SIZE];
+    uint8_t sqn_ms[USIM_MILENAGE_SQN_SIZE];
+    uint8_t mac_s[USIM_MILENAGE_MAC_SIZE];
+    static const uint8_t amf_resync[USIM_MILENAGE_AMF_SIZE] = {0x00, 0x00};
+    uint8_t autn[USIM_AUTN_SIZE];
+    uint16_t output_len;
+    uint8_t i;
+
+    host_flash_blank();
+    host_boot(true);
+    CHECK(accepted(100U, 4U));
+    memcpy(expected, subscriber.sqn, sizeof(expected));
+
+    CHECK_EQ(authenticate(50U, 4U, output, rand), USIM_AKA_SYNC_FAILURE);
+    CHECK_EQ(output[0], AUTH_TAG_SYNC_FAILURE);
+    CHECK_EQ(output[1], USIM_MILENAGE_SQN_SIZE + USIM_MILENAGE_MAC_SIZE);
+
+    // La red recupera SQN_MS y comprueba MAC-S (la tarjeta borró su estado)
+    network_load(rand);
+    usim_milenage_f5star(ak_star);
+    for(i = 0U; i < USIM_MILENAGE_SQN_SIZE; i++) {
+        sqn_ms[i] = (uint8_t)(output[2U + i] ^ ak_star[i]);
+    }
+    CHECK(memcmp(sqn_ms, expected, sizeof(sqn_ms)) == 0);
+    usim_milenage_f1(sqn_ms, amf_resync, NULL, mac_s);
+    CHECK(memcmp(mac_s, &output[2U + USIM_MILENAGE_SQN_SIZE], sizeof(mac_s)) == 0);
+
+    // MAC-A erróneo: fallo de MAC, sin AUTS y sin tocar SQN_MS
+    network_init(rand);
+    memset(autn, 0, sizeof(autn));
+    CHECK_EQ(usim_run_aka(rand, autn, output, &output_len), USIM_AKA_MAC_FAILURE);
+    CHECK_EQ(output_len, 0U);
+    CHECK(memcmp(subscriber.sqn, expected, sizeof(expected)) == 0);
+}
+
+// SQN_MS y la matriz sobreviven al reset: un vector aceptado no vuelve a
+// valer en la sesión siguiente
+static void test_persistence(void) {
+    uint8_t output[64];
+    uint8_t rand[16];
+    uint8_t age[sizeof(subscriber.sqn_age)];
+
+    host_flash_blank();
+    host_boot(true);
+    CHECK(accepted(200U, 9U));
+    CHECK(accepted(199U, 10U));
+    memcpy(age, subscriber.sqn_age, sizeof(age));
+
+    host_boot(true);
+    CHECK_EQ(sqn_seq(subscriber.sqn), 200U);
+    CHECK(memcmp(age, subscriber.sqn_age, sizeof(age)) == 0);
+    CHECK_EQ(authenticate(199U, 10U, output, rand), USIM_AKA_SYNC_FAILURE);
+    CHECK_EQ(authenticate(200U, 9U, output, rand), USIM_AKA_SYNC_FAILURE);
+    CHECK(accepted(199U, 11U));
+}
+
+int main(void) {
+    test_array();
+    test_resync();
+    test_persistence();
+    return host_report("test_sqn");
+}
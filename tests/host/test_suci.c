@@ -0,0 +1,233 @@
+// SUCI en la tarjeta: vectores conocidos de SHA-256 (FIPS 180-2) y HMAC
+// (RFC 4231; X25519 está en test_x25519.c), el perfil A de extremo a extremo
+// descifrado por la red doméstica, y el aviso al lector durante el cálculo
+// (bytes NULL en T=0, WTX en T=1)
+#include "harness.h"
+#include "usim_app.h"
+#include "usim_aes.h"
+#include "usim_constants.h"
+#include "usim_files.h"
+#include "usim_fs.h"
+#include "usim_sha256.h"
+#include "usim_suci.h"
+#include "usim_x25519.h"
+#include <stdio.h>
+#include <string.h>
+
+// Par de claves de la red doméstica del anexo C.4.3 de TS 33.501
+#define HN_PRIVATE "c53c22208b61860b06c62e5406a7b330c2b577aa5558981510d128247d38bd1d"
+#define HN_PUBLIC  "5a8d38864820197c3394b92613b20b91633cbd897119273bf8e4a6f4eec0a650"
+
+static void sha256_string(const char* message, uint8_t* digest) {
+    usim_sha256_ctx_t ctx;
+
+    usim_sha256_init(&ctx);
+    usim_sha256_update(&ctx, (const uint8_t*)message, (uint16_t)strlen(message));
+    usim_sha256_final(&ctx, digest);
+}
+
+static void test_sha256(void) {
+    usim_sha256_ctx_t ctx;
+    uint8_t digest[USIM_SHA256_DIGEST_SIZE];
+    uint8_t key[25];
+    uint8_t data[50];
+    uint8_t i;
+
+    sha256_string("", digest);
+    CHECK_HEX(digest, sizeof(digest), "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+    sha256_string("abc", digest);
+    CHECK_HEX(digest, sizeof(digest), "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+    sha256_string("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", digest);
+    CHECK_HEX(digest, sizeof(digest), "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+
+    // El mismo mensaje en trozos que cruzan el bloque
+    usim_sha256_init(&ctx);
+    usim_sha256_update(&ctx, (const uint8_t*)"abcdbcdecdefdefgefghfghighijh", 29U);
+    usim_sha256_update(&ctx, (const uint8_t*)"ijkijkljklmklmnlmnomnopnopq", 27U);
+    usim_sha256_final(&ctx, digest);
+    CHECK_HEX(digest, sizeof(digest), "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+
+    // RFC 4231, casos 1 a 4 (claves de hasta un bloque, como las del KDF)
+    memset(key, 0x0BU, 20U);
+    usim_hmac_sha256(&ctx, key, 20U, (const uint8_t*)"Hi There", 8U, digest);
+    CHECK_HEX(digest, sizeof(digest), "b0344c61d8db38535ca8afceaf0bf12b881dc200c9833da726e9376c2e32cff7");
+    usim_hmac_sha256(&ctx, (const uint8_t*)"Jefe", 4U,
+                     (const uint8_t*)"what do ya want for nothing?", 28U, digest);
+    CHECK_HEX(digest, sizeof(digest), "5bdcc146bf60754e6a042426089575c75a003f089d2739839dec58b964ec3843");
+    memset(key, 0xAAU, 20U);
+    memset(data, 0xDDU, sizeof(data));
+    usim_hmac_sha256(&ctx, key, 20U, data, sizeof(data), digest);
+    CHECK_HEX(digest, sizeof(digest), "773ea91e36800e46854db8ebd09181a72959098b3ef8c122d9635514ced565fe");
+    for(i = 0U; i < 25U; i++) {
+        key[i] = (uint8_t)(i + 1U);
+    }
+    memset(data, 0xCDU, sizeof(data));
+    usim_hmac_sha256(&ctx, key, 25U, data, sizeof(data), digest);
+    CHECK_HEX(digest, sizeof(digest), "82558a389a443c0ea4cc819899f2083a85f0faa3e578f8077a2e3ff46729665b");
+}
+
+// EF_SUCI_Calc_Info con el perfil A y la clave de red, clave 1 con id 01
+static void provision_profile_a(void) {
+    uint8_t file = usim_find_file_index(0x4F07);
+    uint8_t* data = usim_file_writable(file);
+
+    memset(data, 0xFF, usim_file_size[file]);
+    (void)host_hex("A0020101 A1258001018120" HN_PUBLIC, data);
+    CHECK(usim_file_written(file, usim_file_size[file]));
+}
+
+// La red doméstica descifra el SUCI: KDF X9.63, AES-128-CTR y HMAC
+static void test_profile_a(void) {
+    uint8_t hn_private[USIM_X25519_SIZE];
+    uint8_t shared[USIM_X25519_SIZE];
+    uint8_t keys[64];
+    uint8_t stream[USIM_AES_BLOCK_SIZE];
+    uint8_t mac[USIM_SHA256_DIGEST_SIZE];
+    uint8_t first[USIM_X25519_SIZE];
+    uint8_t counter[4] = {0U, 0U, 0U, 0U};
+    uint8_t msin[5];
+    usim_sha256_ctx_t ctx;
+    uint8_t i;
+
+    host_flash_blank();
+    host_boot(true);
+
+    // Esquema nulo de fábrica: el MSIN va en claro
+    CHECK_EQ(host_apdu("807800010D"), 0x9000U);
+    CHECK_HEX(host_resp, host_resp_len, "0110F002F0FF00000304050607");
+
+    provision_profile_a();
+    CHECK_EQ(host_apdu("8078000135"), 0x9000U);
+    CHECK_EQ(host_resp_len, 8U + USIM_X25519_SIZE + sizeof(msin) + USIM_SUCI_MAC_SIZE);
+    CHECK_HEX(host_resp, 8U, "0110F002F0FF0101");
+    memcpy(first, &host_resp[8], sizeof(first));
+
+    (void)host_hex(HN_PRIVATE, hn_private);
+    usim_x25519(shared, hn_private, &host_resp[8]);
+    for(i = 0U; i < 2U; i++) {
+        counter[3] = (uint8_t)(i + 1U);
+        usim_sha256_init(&ctx);
+        usim_sha256_update(&ctx, shared, sizeof(shared));
+        usim_sha256_update(&ctx, counter, sizeof(counter));
+        usim_sha256_update(&ctx, &host_resp[8], USIM_X25519_SIZE);
+        usim_sha256_final(&ctx, &keys[i * USIM_SHA256_DIGEST_SIZE]);
+    }
+
+    usim_hmac_sha256(&ctx, &keys[32], 32U, &host_resp[8U + USIM_X25519_SIZE], sizeof(msin), mac);
+    CHECK(memcmp(mac, &host_resp[8U + USIM_X25519_SIZE + sizeof(msin)], USIM_SUCI_MAC_SIZE) == 0);
+
+    usim_aes_encrypt(keys, &keys[16], stream);
+    for(i = 0U; i < sizeof(msin); i++) {
+        msin[i] = (uint8_t)(host_resp[8U + USIM_X25519_SIZE + i] ^ stream[i]);
+    }
+    CHECK_HEX(msin, sizeof(msin), "0304050607");
+
+    // Cada GET IDENTITY lleva otra clave efímera, también tras un reset
+    CHECK_EQ(host_apdu("8078000135"), 0x9000U);
+    CHECK(memcmp(first, &host_resp[8], sizeof(first)) != 0);
+    host_boot(true);
+    provision_profile_a();
+    CHECK_EQ(host_apdu("8078000135"), 0x9000U);
+    CHECK(memcmp(first, &host_resp[8], sizeof(first)) != 0);
+}
+
+// Bytes NULL antes del byte de procedimiento (el INS)
+static unsigned count_nulls(void) {
+    unsigned count = 0U;
+
+    while(count < host_tx_len && host_tx[count] == 0x60U) {
+        count++;
+    }
+    return count;
+}
+
+// El cálculo dura varias veces el tiempo de espera del lector: en T=0 la
+// tarjeta intercala bytes NULL antes del byte de procedimiento; sin que el
+// tiempo pase, ninguno
+static void test_keep_alive_t0(void) {
+    unsigned nulls;
+
+    host_protocol = 0U;
+    host_flash_blank();
+    host_boot(true);
+    provision_profile_a();
+
+    host_elapsed_step = 0UL;
+    CHECK_EQ(host_exchange("8078000135"), 0x9000U);
+    CHECK_EQ(count_nulls(), 0U);
+    CHECK_EQ(host_tx[0], INS_GET_IDENTITY);
+
+    host_elapsed_step = host_wait_ticks / 16U;
+    CHECK_EQ(host_exchange("8078000135"), 0x9000U);
+    nulls = count_nulls();
+    host_elapsed_step = 0UL;
+    printf("GET IDENTITY en T=0: %u bytes NULL\n", nulls);
+    // Al menos uno cada 8 pasos de las dos escaleras de X25519
+    CHECK(nulls >= (2U * 255U) / 8U);
+    CHECK_EQ(host_tx[nulls], INS_GET_IDENTITY);
+    CHECK_EQ(host_tx_len, nulls + 1U + 0x35U + 2U);
+}
+
+// En T=1 la tarjeta pide WTX con un multiplicador que cubre lo que falta al
+// ritmo medido
+static void test_keep_alive_t1(void) {
+    static char reader[4096];
+    uint8_t command[5];
+    uint8_t lrc = 0x05U;   /* PCB 00 y LEN 05 del I-block */
+    uint16_t used;
+    uint16_t requests = 0U;
+    uint16_t offset = 5U;
+    uint8_t first_multiplier = 0U;
+    uint8_t i;
+
+    host_protocol = 1U;
+    host_flash_blank();
+    host_boot(true);
+    provision_profile_a();
+
+    // IFSD de 254 bytes: la respuesta va en un solo I-block
+    (void)host_hex("8078000135", command);
+    used = (uint16_t)sprintf(reader, "00C101FE3E 000005");
+    for(i = 0U; i < sizeof(command); i++) {
+        used = (uint16_t)(used + sprintf(&reader[used], "%02X", command[i]));
+        lrc ^= command[i];
+    }
+    used = (uint16_t)(used + sprintf(&reader[used], "%02X", lrc));
+    // Respuestas S(WTX) de sobra: la tarjeta no comprueba el valor devuelto
+    for(i = 0U; i < 64U; i++) {
+        used = (uint16_t)(used + sprintf(&reader[used], " 00E30101E3"));
+    }
+
+    host_elapsed_step = host_wait_ticks / 16U;
+    (void)host_exchange(reader);
+    host_elapsed_step = 0UL;
+    CHECK_HEX(host_tx, 5U, "00E101FE1E");
+
+    while((uint16_t)(offset + 4U) <= host_tx_len && host_tx[offset + 1U] == 0xC3U) {
+        CHECK_EQ(host_tx[offset + 2U], 1U);
+        CHECK(host_tx[offset + 3U] >= 1U);
+        if(requests == 0U) {
+            first_multiplier = host_tx[offset + 3U];
+        }
+        requests++;
+        offset = (uint16_t)(offset + 5U);
+    }
+    printf("GET IDENTITY en T=1: %u WTX, el primero de x%u\n", requests, first_multiplier);
+    CHECK(requests >= 1U);
+    CHECK(first_multiplier > 1U);
+    CHECK_EQ(host_rx_left(), (64U - requests) * 5U);
+
+    // Tras los WTX, la respuesta en un I-block
+    CHECK_EQ(host_tx[offset + 1U], 0x00U);
+    CHECK_EQ(host_tx[offset + 2U], 8U + USIM_X25519_SIZE + 5U + USIM_SUCI_MAC_SIZE + 2U);
+    CHECK_HEX(&host_tx[host_tx_len - 3U], 2U, "9000");
+    host_protocol = 0U;
+}
+
+int main(void) {
+    test_sha256();
+    test_profile_a();
+    test_keep_alive_t0();
+    test_keep_alive_t1();
+    return host_report("test_suci");
+}
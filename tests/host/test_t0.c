@@ -0,0 +1,165 @@
+// Recepción T=0 de usim_app.c: el caso del comando sale de la tabla de
+// instrucciones al llegar INS, sin esperar bytes que el lector no envía
+#include "harness.h"
+#include "usim_app.h"
+#include "apdu_handler.h"
+#include "usim_constants.h"
+
+static uint8_t command[USIM_APDU_COMMAND_MAX_LEN];
+static uint16_t command_len;
+
+// Un intercambio completo como el bucle de main.c; devuelve los dos últimos
+// bytes enviados (SW1SW2) o 0 si no se recibió ningún comando
+static uint16_t t0_exchange(const char* hex) {
+    uint8_t response[USIM_APDU_RESPONSE_MAX_LEN];
+    uint16_t response_len = 0U;
+
+    host_tx_clear();
+    host_rx_feed(hex);
+    command_len = 0U;
+    if(!usim_receive_apdu(command, &command_len)) {
+        return 0U;
+    }
+
+    (void)apdu_process_command(command, command_len, response, &response_len);
+    usim_send_response(response, response_len);
+    if(host_tx_len < 2U) {
+        return 0U;
+    }
+    return (uint16_t)((host_tx[host_tx_len - 2U] << 8) | host_tx[host_tx_len - 1U]);
+}
+
+// Secuencia de arranque de nuestro terminal: cada comando se resuelve con los
+// bytes que envía el lector, sin ninguna lectura con la cola vacía
+static void test_boot_sequence(void) {
+    host_protocol = 0U;
+    usim_init();
+
+    // SELECT MF (caso 4 en T=0: byte de procedimiento, datos y 61xx)
+    CHECK_EQ(t0_exchange("00 A4 00 04 02 3F00"), 0x610DU);
+    CHECK_EQ(command_len, 7U);
+    CHECK_EQ(host_tx_len, 3U);
+    CHECK_EQ(host_tx[0], INS_SELECT_FILE);
+    CHECK_EQ(host_rx_misses, 0U);
+
+    // GET RESPONSE (caso 2: byte de procedimiento delante de los datos)
+    CHECK_EQ(t0_exchange("00 C0 00 00 0D"), 0x9000U);
+    CHECK_EQ(command_len, 5U);
+    CHECK_EQ(host_tx_len, 1U + 0x0DU + 2U);
+    CHECK_EQ(host_tx[0], INS_GET_RESPONSE);
+    CHECK_EQ(host_tx[1], 0x62U);
+    CHECK_EQ(host_rx_misses, 0U);
+
+    // VERIFY PIN (caso 3: nada detrás de los datos)
+    CHECK_EQ(t0_exchange("00 20 00 01 08 30303030FFFFFFFF"), 0x9000U);
+    CHECK_EQ(command_len, 13U);
+    CHECK_EQ(host_tx_len, 3U);
+    CHECK_EQ(host_tx[0], INS_VERIFY_CHV);
+    CHECK_EQ(host_rx_misses, 0U);
+
+    CHECK_EQ(t0_exchange("00 A4 04 0C 10 A0000000871002FF33FF018900000100"), 0x9000U);
+    CHECK_EQ(host_rx_misses, 0U);
+
+    CHECK_EQ(t0_exchange("00 B0 87 00 09"), 0x9000U);
+    CHECK_EQ(host_tx[0], INS_READ_BINARY);
+    CHECK_HEX(&host_tx[1], 9U, "080901020304050607");
+    CHECK_EQ(host_rx_misses, 0U);
+
+    CHECK_EQ(t0_exchange("00 F2 00 00 05"), 0x9000U);
+    CHECK_EQ(host_tx_len, 1U + 5U + 2U);
+    CHECK_EQ(host_rx_misses, 0U);
+}
+
+// Caso 1 (P3 = 00 en una instrucción sin datos de salida): el APDU queda en
+// 4 bytes y no se espera nada más
+static void test_case1(void) {
+    host_boot(false);
+
+    (void)t0_exchange("00 20 00 01 00");
+    CHECK_EQ(command_len, 4U);
+    CHECK_EQ(host_tx_len, 2U);
+    CHECK_EQ(host_rx_misses, 0U);
+
+    // Instrucción desconocida: tampoco tiene datos de salida
+    CHECK_EQ(t0_exchange("00 E8 00 00 00"), 0x6D00U);
+    CHECK_EQ(command_len, 4U);
+    CHECK_EQ(host_tx_len, 2U);
+    CHECK_EQ(host_rx_misses, 0U);
+
+    // SELECT con P3 = 00: el FCP se anuncia con 61xx
+    CHECK_EQ(t0_exchange("00 A4 00 04 00"), 0x610DU);
+    CHECK_EQ(command_len, 4U);
+    CHECK_EQ(host_tx_len, 2U);
+}
+
+// P3 mayor que los datos: 6Cxx sin datos ni byte de procedimiento, y el
+// lector repite el comando con la longitud exacta
+static void test_wrong_le(void) {
+    host_boot(true);
+
+    CHECK_EQ(t0_exchange("00 B0 87 00 20"), 0x6C09U);
+    CHECK_EQ(host_tx_len, 2U);
+    CHECK_EQ(t0_exchange("00 B0 87 00 09"), 0x9000U);
+    CHECK_EQ(host_tx_len, 1U + 9U + 2U);
+
+    // STATUS con P3 = 00 es Le = 256, no un caso 1
+    CHECK_EQ(t0_exchange("00 F2 00 00 00"), 0x6C05U);
+    CHECK_EQ(command_len, 5U);
+    CHECK_EQ(host_tx_len, 2U);
+
+    // READ RECORD NEXT con P3 = 00 no mueve el puntero de registro
+    CHECK_EQ(t0_exchange("00 A4 00 0C 02 6F40"), 0x9000U);
+    CHECK_EQ(t0_exchange("00 B2 00 02 00"), 0x6C18U);
+    CHECK_EQ(t0_exchange("00 B2 00 02 18"), 0x9000U);
+    CHECK_EQ(t0_exchange("00 B2 00 02 18"), 0x9000U);
+    CHECK_EQ(t0_exchange("00 B2 00 02 18"), SW_RECORD_NOT_FOUND);
+}
+
+// Respuesta pendiente leída por partes; una P3 mayor que lo que queda da
+// 6Cxx y cualquier otro comando la descarta
+static void test_get_response(void) {
+    usim_init();
+
+    CHECK_EQ(t0_exchange("00 A4 00 04 02 3F00"), 0x610DU);
+    CHECK_EQ(t0_exchange("00 C0 00 00 05"), 0x6108U);
+    CHECK_EQ(host_tx_len, 1U + 5U + 2U);
+    CHECK_HEX(&host_tx[1], 5U, "620B800200");
+    CHECK_EQ(t0_exchange("00 C0 00 00 10"), 0x6C08U);
+    CHECK_EQ(host_tx_len, 2U);
+    CHECK_EQ(t0_exchange("00 C0 00 00 08"), 0x9000U);
+    CHECK_HEX(&host_tx[1], 8U, "0082013883023F00");
+    CHECK_EQ(t0_exchange("00 C0 00 00 01"), SW_CONDITIONS_NOT_SATISFIED);
+
+    CHECK_EQ(t0_exchange("00 A4 00 04 02 3F00"), 0x610DU);
+    CHECK_EQ(t0_exchange("00 F2 00 00 05"), 0x9000U);
+    CHECK_EQ(t0_exchange("00 C0 00 00 0D"), SW_CONDITIONS_NOT_SATISFIED);
+}
+
+// El lector deja de enviar a mitad de comando: se abandona sin responder
+static void test_truncated(void) {
+    host_boot(true);
+
+    CHECK_EQ(t0_exchange("00 B0 87"), 0U);
+    CHECK_EQ(host_rx_misses, 1U);
+    CHECK_EQ(host_tx_len, 0U);
+
+    // Datos incompletos tras el byte de procedimiento
+    CHECK_EQ(t0_exchange("00 20 00 01 08 3030"), 0U);
+    CHECK_EQ(host_rx_misses, 1U);
+    CHECK_EQ(host_tx_len, 1U);
+    CHECK_EQ(host_tx[0], INS_VERIFY_CHV);
+
+    // El siguiente comando no arrastra nada del anterior
+    CHECK_EQ(t0_exchange("00 B0 87 00 09"), 0x9000U);
+    CHECK_EQ(host_rx_misses, 0U);
+}
+
+int main(void) {
+    host_flash_blank();
+    test_boot_sequence();
+    test_case1();
+    test_get_response();
+    test_wrong_le();
+    test_truncated();
+    return host_report("test_t0");
+}
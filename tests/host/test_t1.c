@@ -0,0 +1,283 @@
+// Protocolo de bloques T=1 de usim_t1.c con un lector emulado: secuencia
+// de N(S)/N(R), encadenado en los dos sentidos, IFSD, recuperación de
+// errores, WTX y bytes en la línea frente a T=0 con el mismo comando
+#include "harness.h"
+#include "usim_app.h"
+#include "usim_t1.h"
+#include "apdu_handler.h"
+#include "usim_constants.h"
+#include <stdio.h>
+#include <string.h>
+
+#define AID_USIM "A0000000871002FF33FF018900000100"
+
+static char reader[2048];
+static char card[2048];
+static uint16_t reader_bytes;
+
+static void block_hex(char* output, uint8_t pcb, const char* inf_hex, bool lrc_ok) {
+    uint8_t inf[256];
+    uint16_t length = host_hex(inf_hex, inf);
+    uint8_t lrc = (uint8_t)(pcb ^ length);
+    size_t used = strlen(output);
+    uint16_t i;
+
+    used += (size_t)sprintf(&output[used], "00%02X%02X", pcb, length);
+    for(i = 0U; i < length; i++) {
+        lrc ^= inf[i];
+        used += (size_t)sprintf(&output[used], "%02X", inf[i]);
+    }
+    (void)sprintf(&output[used], "%02X ", lrc_ok ? lrc : (uint8_t)~lrc);
+}
+
+// Lo que enviará el lector y lo que se espera de la tarjeta
+static void reader_block(uint8_t pcb, const char* inf_hex) {
+    block_hex(reader, pcb, inf_hex, true);
+}
+
+static void reader_corrupt_block(uint8_t pcb, const char* inf_hex) {
+    block_hex(reader, pcb, inf_hex, false);
+}
+
+static void card_block(uint8_t pcb, const char* inf_hex) {
+    block_hex(card, pcb, inf_hex, true);
+}
+
+static void start(void) {
+    reader[0] = '\0';
+    card[0] = '\0';
+}
+
+// Un ciclo del bucle de main.c con lo preparado en "reader"; devuelve si se
+// recibió un APDU
+static bool exchange(void) {
+    // Como apdu_response en main.c: la tarjeta puede repetir su último
+    // I-block cuando ya se está recibiendo el comando siguiente
+    static uint8_t command[USIM_APDU_COMMAND_MAX_LEN];
+    static uint8_t response[USIM_APDU_RESPONSE_MAX_LEN];
+    uint16_t command_len = 0U;
+    uint16_t response_len = 0U;
+    uint8_t queued[1024];
+
+    reader_bytes = host_hex(reader, queued);
+    host_tx_clear();
+    host_rx_feed(reader);
+    if(!usim_receive_apdu(command, &command_len)) {
+        return false;
+    }
+
+    (void)apdu_process_command(command, command_len, response, &response_len);
+    usim_send_response(response, response_len);
+    return true;
+}
+
+static void check_card(const char* file, int line) {
+    host_check_hex(host_tx, host_tx_len, card, file, line, "tarjeta");
+    host_check(host_rx_left() == 0U, file, line, "el lector no tiene nada más que enviar");
+}
+#define CHECK_CARD() check_card(__FILE__, __LINE__)
+
+static void boot_t1(void) {
+    host_protocol = 1U;
+    host_boot(true);
+}
+
+static void test_sequence(void) {
+    boot_t1();
+
+    start();
+    reader_block(0x00U, "00 B0 87 00 09");
+    card_block(0x00U, "080901020304050607 9000");
+    CHECK(exchange());
+    CHECK_CARD();
+
+    // N(S) alterna en cada sentido
+    start();
+    reader_block(0x40U, "00 F2 00 00 05");
+    CHECK(exchange());
+    CHECK_EQ(host_tx[1], 0x40U);
+    CHECK_EQ(host_tx[2], 7U);
+    CHECK_HEX(&host_tx[8], 2U, "9000");
+
+    start();
+    reader_block(0x00U, "00 B0 87 00 02");
+    card_block(0x00U, "0809 9000");
+    CHECK(exchange());
+    CHECK_CARD();
+}
+
+static void test_reader_chaining(void) {
+    boot_t1();
+
+    // VERIFY en dos I-blocks: la tarjeta confirma el primero con R(N(R))
+    start();
+    reader_block(0x20U, "00 20 00 01 08 3030");
+    reader_block(0x40U, "3030 FFFFFFFF");
+    card_block(0x90U, "");
+    card_block(0x00U, "9000");
+    CHECK(exchange());
+    CHECK_CARD();
+}
+
+static void test_card_chaining(void) {
+    boot_t1();
+
+    // IFSD = 4: la respuesta de 11 bytes sale en tres I-blocks
+    start();
+    reader_block(0xC1U, "04");
+    reader_block(0x00U, "00 B0 87 00 09");
+    reader_block(0x90U, "");
+    reader_block(0x80U, "");
+    card_block(0xE1U, "04");
+    card_block(0x20U, "08090102");
+    card_block(0x60U, "03040506");
+    card_block(0x00U, "07 9000");
+    CHECK(exchange());
+    CHECK_CARD();
+
+    // Un R-block con el N(S) del bloque pendiente pide repetirlo
+    start();
+    reader_block(0x40U, "00 B0 87 00 04");
+    reader_block(0x90U, "");
+    reader_block(0x90U, "");
+    reader_block(0x80U, "");
+    card_block(0x60U, "08090102");
+    card_block(0x60U, "08090102");
+    card_block(0x60U, "08090102");
+    card_block(0x00U, "9000");
+    CHECK(exchange());
+    CHECK_CARD();
+}
+
+static void test_error_recovery(void) {
+    boot_t1();
+
+    // LRC erróneo: R-block con error de EDC y el lector repite
+    start();
+    reader_corrupt_block(0x00U, "00 B0 87 00 02");
+    reader_block(0x00U, "00 B0 87 00 02");
+    card_block(0x81U, "");
+    card_block(0x00U, "0809 9000");
+    CHECK(exchange());
+    CHECK_CARD();
+
+    // El lector no recibió la respuesta y la pide con un R-block: se repite
+    // el último I-block de la tarjeta
+    start();
+    reader_block(0x80U, "");
+    reader_block(0x40U, "00 B0 87 00 01");
+    card_block(0x00U, "0809 9000");
+    card_block(0x40U, "08 9000");
+    CHECK(exchange());
+    CHECK_CARD();
+
+    // I-block con un N(S) que no toca
+    start();
+    reader_block(0x40U, "00 B0 87 00 01");
+    reader_block(0x00U, "00 B0 87 00 01");
+    card_block(0x82U, "");
+    card_block(0x00U, "08 9000");
+    CHECK(exchange());
+    CHECK_CARD();
+
+    // RESYNCH pone a cero N(S) en los dos sentidos
+    start();
+    reader_block(0xC0U, "");
+    reader_block(0x00U, "00 B0 87 00 01");
+    card_block(0xE0U, "");
+    card_block(0x00U, "08 9000");
+    CHECK(exchange());
+    CHECK_CARD();
+
+    // ABORT de una cadena del lector: lo recibido se descarta
+    start();
+    reader_block(0x60U, "00 20 00 01 08 3030");
+    reader_block(0xC2U, "");
+    reader_block(0x00U, "00 B0 87 00 01");
+    card_block(0x80U, "");
+    card_block(0xE2U, "");
+    card_block(0x40U, "08 9000");
+    CHECK(exchange());
+    CHECK_CARD();
+
+    // Demasiados errores seguidos: se abandona el comando
+    start();
+    reader_corrupt_block(0x40U, "00 B0 87 00 01");
+    reader_corrupt_block(0x40U, "00 B0 87 00 01");
+    reader_corrupt_block(0x40U, "00 B0 87 00 01");
+    reader_corrupt_block(0x40U, "00 B0 87 00 01");
+    CHECK(!exchange());
+    CHECK_EQ(host_tx_len, 3U * 4U);
+}
+
+static void test_wtx(void) {
+    boot_t1();
+
+    start();
+    reader_block(0xE3U, "02");
+    card_block(0xC3U, "02");
+    host_tx_clear();
+    host_rx_feed(reader);
+    CHECK(usim_t1_request_wtx(2U));
+    CHECK_CARD();
+
+    // Sin respuesta del lector se reintenta y se desiste
+    host_tx_clear();
+    host_rx_feed("");
+    CHECK(!usim_t1_request_wtx(2U));
+    CHECK_EQ(host_tx_len, (T1_MAX_RETRIES + 1U) * 5U);
+}
+
+// SELECT de la ADF con FCP: un intercambio en T=1 frente a 61xx y GET
+// RESPONSE en T=0, con los mismos datos. T=0 cambia cinco veces el sentido
+// de la línea (cabecera, byte de procedimiento, datos, 61xx, GET RESPONSE y
+// su respuesta); T=1, una. En bytes el prólogo y el LRC de cada bloque
+// igualan lo que ahorra T=1 con respuestas cortas.
+static void test_line_bytes(void) {
+    uint8_t fcp[256];
+    uint16_t fcp_len;
+    uint16_t t0_bytes;
+    uint16_t t1_bytes;
+    char get_response[16];
+
+    host_protocol = 0U;
+    usim_init();
+    start();
+    strcpy(reader, "00 A4 04 04 10 " AID_USIM);
+    CHECK(exchange());
+    CHECK_EQ(host_tx[1], 0x61U);
+    fcp_len = host_tx[2];
+    t0_bytes = (uint16_t)(reader_bytes + host_tx_len);
+
+    (void)sprintf(get_response, "00C00000%02X", fcp_len);
+    strcpy(reader, get_response);
+    CHECK(exchange());
+    CHECK_EQ(host_tx_len, 1U + fcp_len + 2U);
+    memcpy(fcp, &host_tx[1], fcp_len);
+    t0_bytes = (uint16_t)(t0_bytes + reader_bytes + host_tx_len);
+
+    boot_t1();
+    start();
+    reader_block(0xC1U, "FE");
+    reader_block(0x00U, "00 A4 04 04 10 " AID_USIM " 00");
+    CHECK(exchange());
+    // S(IFS) se negocia una vez por sesión: no cuenta para el comando
+    CHECK_EQ(host_tx[5 + 1], 0x00U);
+    CHECK_EQ(host_tx[5 + 2], fcp_len + 2U);
+    t1_bytes = (uint16_t)((reader_bytes - 5U) + (host_tx_len - 5U));
+
+    printf("SELECT ADF + FCP: %u bytes en T=0, %u en T=1\n", t0_bytes, t1_bytes);
+    CHECK(t1_bytes <= t0_bytes);
+    CHECK(memcmp(fcp, &host_tx[5 + 3], fcp_len) == 0);
+}
+
+int main(void) {
+    host_flash_blank();
+    test_sequence();
+    test_reader_chaining();
+    test_card_chaining();
+    test_error_recovery();
+    test_wtx();
+    test_line_bytes();
+    return host_report("test_t1");
+}
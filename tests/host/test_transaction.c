@@ -0,0 +1,211 @@
+// Transacción de personalización (INS_TRANSACTION): IMSI, K, OPc, PIN y un
+// UPDATE BINARY van a flash juntos al confirmar o no van; un corte de
+// alimentación en cada byte programado y un reset entre APDU dejan la
+// tarjeta entera en el estado de antes o en el de después
+#include "harness.h"
+#include "usim_app.h"
+#include "usim_constants.h"
+#include "usim_files.h"
+#include "usim_fs.h"
+#include "usim_secrets.h"
+#include "chip_specific.h"
+#include <stdio.h>
+#include <string.h>
+
+#define NEW_IMSI "082926030000000001"
+#define NEW_K    "000102030405060708090A0B0C0D0E0F"
+#define NEW_OPC  "F0E0D0C0B0A090807060504030201000"
+#define NEW_PIN  "31323334FFFFFFFF"
+#define NEW_LOCI "11223344"
+
+static const char* const writes[] = {
+    "80D0010009" NEW_IMSI,
+    "80D0020010" NEW_K,
+    "80D0030010" NEW_OPC,
+    "80D0040008" NEW_PIN,
+    "00D68B0004" NEW_LOCI,
+};
+#define WRITE_COUNT (sizeof(writes) / sizeof(writes[0]))
+
+typedef struct {
+    uint8_t imsi[USIM_IMSI_SIZE];
+    uint8_t k[USIM_SECRET_KEY_SIZE];
+    uint8_t opc[USIM_SECRET_KEY_SIZE];
+    uint8_t pin[8];
+    uint8_t loci[4];
+} card_state_t;
+
+static uint8_t image[NVM_SECTOR_COUNT * FLASH_SECTOR_SIZE];
+static card_state_t before;
+static card_state_t after;
+
+static void read_state(card_state_t* state) {
+    memcpy(state->imsi, usim_file_data(usim_find_file_index(0x6F07)), USIM_IMSI_SIZE);
+    usim_secret_get(USIM_SECRET_K, state->k);
+    usim_secret_get(USIM_SECRET_OPC, state->opc);
+    memcpy(state->pin, subscriber.pin1, sizeof(state->pin));
+    memcpy(state->loci, usim_file_data(usim_find_file_index(0x6F7E)), sizeof(state->loci));
+}
+
+// 0: estado de antes, 1: de después, 2: una mezcla
+static uint8_t state_after_reset(void) {
+    card_state_t state;
+
+    usim_init();
+    read_state(&state);
+    if(memcmp(&state, &before, sizeof(state)) == 0) {
+        return 0U;
+    }
+    return (memcmp(&state, &after, sizeof(state)) == 0) ? 1U : 2U;
+}
+
+// Tarjeta de fábrica con el PIN verificado, lista para personalizar
+static void factory(void) {
+    host_flash_blank();
+    host_boot(true);
+    read_state(&before);
+    host_flash_save(image);
+}
+
+static void personalize(void) {
+    uint8_t i;
+
+    CHECK_EQ(host_apdu("80D3010000"), 0x9000U);
+    for(i = 0U; i < WRITE_COUNT; i++) {
+        CHECK_EQ(host_apdu(writes[i]), 0x9000U);
+    }
+    CHECK_EQ(host_apdu("80D3020000"), 0x9000U);
+}
+
+static void test_commit_and_abort(void) {
+    uint32_t ops;
+    uint8_t i;
+
+    factory();
+    personalize();
+    read_state(&after);
+    CHECK(memcmp(&after, &before, sizeof(after)) != 0);
+    CHECK_HEX(after.imsi, USIM_IMSI_SIZE, NEW_IMSI);
+    CHECK_HEX(after.k, USIM_SECRET_KEY_SIZE, NEW_K);
+    CHECK_HEX(after.opc, USIM_SECRET_KEY_SIZE, NEW_OPC);
+    CHECK_HEX(after.pin, 8U, NEW_PIN);
+    CHECK_HEX(after.loci, 4U, NEW_LOCI);
+    CHECK_EQ(state_after_reset(), 1U);
+
+    // Dentro de la transacción nada toca la flash hasta COMMIT
+    host_flash_restore(image);
+    host_boot(true);
+    CHECK_EQ(host_apdu("80D3010000"), 0x9000U);
+    ops = host_flash_ops;
+    for(i = 0U; i < WRITE_COUNT; i++) {
+        CHECK_EQ(host_apdu(writes[i]), 0x9000U);
+    }
+    CHECK_EQ(host_flash_ops - ops, 0U);
+
+    // Lo escrito ya se lee; ABORT lo deshace en XRAM
+    CHECK_EQ(host_apdu("80D1010009"), 0x9000U);
+    CHECK_HEX(host_resp, host_resp_len, NEW_IMSI);
+    CHECK_EQ(host_apdu("80D3030000"), 0x9000U);
+    {
+        card_state_t state;
+
+        read_state(&state);
+        CHECK(memcmp(&state, &before, sizeof(state)) == 0);
+    }
+    CHECK_EQ(state_after_reset(), 0U);
+
+    // Sin transacción abierta, COMMIT y ABORT no tienen sentido
+    host_boot(true);
+    CHECK_EQ(host_apdu("80D3020000"), SW_CONDITIONS_NOT_SATISFIED);
+    CHECK_EQ(host_apdu("80D3030000"), SW_CONDITIONS_NOT_SATISFIED);
+    CHECK_EQ(host_apdu("80D3010000"), 0x9000U);
+    CHECK_EQ(host_apdu("80D3010000"), SW_CONDITIONS_NOT_SATISFIED);
+}
+
+// Tarjeta extraída entre dos APDU de la secuencia: el reset la deja como
+// estaba
+static void test_reset_between_commands(void) {
+    uint8_t done;
+    uint8_t i;
+
+    for(done = 0U; done <= WRITE_COUNT; done++) {
+        host_flash_restore(image);
+        host_boot(true);
+        CHECK_EQ(host_apdu("80D3010000"), 0x9000U);
+        for(i = 0U; i < done; i++) {
+            CHECK_EQ(host_apdu(writes[i]), 0x9000U);
+        }
+        CHECK_EQ(state_after_reset(), 0U);
+    }
+}
+
+// Corte de alimentación en cada byte que programa la secuencia completa
+static void test_power_cut(void) {
+    uint32_t ops;
+    long cut;
+    static unsigned old_state;
+    static unsigned new_state;
+
+    host_flash_restore(image);
+    host_boot(true);
+    ops = host_flash_ops;
+    personalize();
+    ops = host_flash_ops - ops;
+    CHECK(ops > 0UL);
+
+    for(cut = 0L; cut < (long)ops; cut++) {
+        uint8_t state;
+
+        host_flash_restore(image);
+        host_boot(true);
+        host_flash_cut_after(cut);
+        if(setjmp(host_flash_cut) == 0) {
+            personalize();
+            CHECK(false);
+        }
+        host_flash_cut_after(-1L);
+
+        state = state_after_reset();
+        CHECK(state != 2U);
+        old_state += (state == 0U) ? 1U : 0U;
+        new_state += (state == 1U) ? 1U : 0U;
+    }
+    // Solo el último byte del registro de confirmación cambia de estado
+    CHECK_EQ(old_state, ops);
+    CHECK_EQ(new_state, 0U);
+}
+
+// Una grabación por transacción frente a una por APDU
+static void test_batched_commit(void) {
+    uint32_t grouped;
+    uint32_t single;
+    uint8_t i;
+
+    host_flash_restore(image);
+    host_boot(true);
+    grouped = host_flash_ops;
+    personalize();
+    grouped = host_flash_ops - grouped;
+
+    host_flash_restore(image);
+    host_boot(true);
+    single = host_flash_ops;
+    for(i = 0U; i < WRITE_COUNT; i++) {
+        CHECK_EQ(host_apdu(writes[i]), 0x9000U);
+    }
+    CHECK(usim_files_flush());
+    single = host_flash_ops - single;
+    CHECK_EQ(state_after_reset(), 1U);
+
+    printf("Personalización: %lu bytes programados en una transacción, %lu APDU a APDU\n",
+           (unsigned long)grouped, (unsigned long)single);
+    CHECK(grouped < single);
+}
+
+int main(void) {
+    test_commit_and_abort();
+    test_reset_between_commands();
+    test_power_cut();
+    test_batched_commit();
+    return host_report("test_transaction");
+}
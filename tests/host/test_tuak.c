@@ -0,0 +1,136 @@
+// Vectores de prueba conocidos: Keccak-f[1600] (SHA3-256 de FIPS 202) y
+// TUAK (TS 35.233, conjunto 1, con AK y f5*, y el mismo conjunto con 2
+// iteraciones). El conjunto 1 usa RES de 32 bits y la longitud de RES entra
+// en INSTANCE, así que usim_tuak.c se compila aquí con ese tamaño, como
+// test_pps incluye chip_init.c; los demás tamaños están en
+// test_tuak_sizes.c. También el aviso al lector durante AUTHENTICATE con
+// muchas iteraciones.
+#define USIM_TUAK_RES_SIZE 4U
+#include "harness.h"
+#include "usim_tuak.c"
+#include "usim_keccak.h"
+#include "usim_app.h"
+#include "usim_constants.h"
+#include <stdio.h>
+
+// SHA3-256 de un mensaje que cabe en un bloque (tasa de 136 bytes)
+static void sha3_256(const char* message, uint8_t* digest) {
+    uint8_t length = (uint8_t)strlen(message);
+    uint8_t i;
+
+    memset(usim_keccak_state, 0, USIM_KECCAK_STATE_SIZE);
+    for(i = 0U; i < length; i++) {
+        usim_keccak_state[i] = (uint8_t)message[i];
+    }
+    usim_keccak_state[length] ^= 0x06U;
+    usim_keccak_state[135] ^= 0x80U;
+    usim_keccak_permute();
+    memcpy(digest, usim_keccak_state, 32U);
+}
+
+static void test_keccak(void) {
+    uint8_t digest[32];
+
+    sha3_256("", digest);
+    CHECK_HEX(digest, sizeof(digest), "a7ffc6f8bf1ed76651c14756a061d662f580ff4de43b49fa82d80a4b80f8434a");
+    sha3_256("abc", digest);
+    CHECK_HEX(digest, sizeof(digest), "3a985da74fe225b2045c172d6bd390bd855f086e3e9d525b46bfe24511431532");
+}
+
+static void test_tuak(void) {
+    uint8_t k[USIM_TUAK_KEY_SIZE];
+    uint8_t top[USIM_TUAK_TOP_SIZE];
+    uint8_t topc[USIM_TUAK_TOP_SIZE];
+    uint8_t rand[16];
+    uint8_t sqn[6];
+    uint8_t amf[2];
+    uint8_t mac_a[USIM_TUAK_MAC_SIZE];
+    uint8_t mac_s[USIM_TUAK_MAC_SIZE];
+    uint8_t res[USIM_TUAK_RES_SIZE];
+    uint8_t ck[16];
+    uint8_t ik[16];
+    uint8_t ak[USIM_TUAK_AK_SIZE];
+
+    (void)host_hex("abababababababababababababababab", k);
+    (void)host_hex("5555555555555555555555555555555555555555555555555555555555555555", top);
+    (void)host_hex("42424242424242424242424242424242", rand);
+    (void)host_hex("111111111111", sqn);
+    (void)host_hex("ffff", amf);
+
+    usim_tuak_topc(k, top, topc, USIM_TUAK_ITERATIONS);
+    CHECK_HEX(topc, sizeof(topc), "bd04d9530e87513c5d837ac2ad954623a8e2330c115305a73eb45d1f40cccbff");
+
+    usim_tuak_init(k, topc, rand, USIM_TUAK_ITERATIONS);
+    usim_tuak_f1(sqn, amf, mac_a, mac_s);
+    CHECK_HEX(mac_a, sizeof(mac_a), "f9a54e6aeaa8618d");
+    CHECK_HEX(mac_s, sizeof(mac_s), "e94b4dc6c7297df3");
+
+    usim_tuak_f2345(res, ck, ik, ak);
+    CHECK_HEX(res, sizeof(res), "657acd64");
+    CHECK_HEX(ck, sizeof(ck), "d71a1e5c6caffe986a26f783e5c78be1");
+    CHECK_HEX(ik, sizeof(ik), "be849fa2564f869aecee6f62d4337e72");
+    CHECK_HEX(ak, sizeof(ak), "719f1e9b9054");
+    usim_tuak_f5star(ak);
+    CHECK_HEX(ak, sizeof(ak), "e7af6b3d0e38");
+
+    // Con 2 iteraciones de Keccak, también al calcular TOPc
+    usim_tuak_topc(k, top, topc, 2U);
+    CHECK_HEX(topc, sizeof(topc), "aae061307999b1942568d11d74c3ee0b2e5f264a96919100f63a01a13f5bfd5b");
+    usim_tuak_init(k, topc, rand, 2U);
+    usim_tuak_f1(sqn, amf, mac_a, mac_s);
+    CHECK_HEX(mac_a, sizeof(mac_a), "c3b4bd50ed5e9f00");
+    CHECK_HEX(mac_s, sizeof(mac_s), "e56a8372b87206ec");
+    usim_tuak_f2345(res, ck, ik, ak);
+    CHECK_HEX(res, sizeof(res), "b29f8573");
+    CHECK_HEX(ck, sizeof(ck), "5255234b878aaef6558fe1ba367baed5");
+    CHECK_HEX(ik, sizeof(ik), "f280076d9aee7fec1cf39cff697cc825");
+    CHECK_HEX(ak, sizeof(ak), "9c3fac710aa2");
+    usim_tuak_f5star(ak);
+    CHECK_HEX(ak, sizeof(ak), "969a168d18ec");
+
+    usim_tuak_clear();
+}
+
+// Bytes NULL que la tarjeta intercala tras el byte de procedimiento
+static unsigned count_nulls(void) {
+    unsigned count = 0U;
+    uint16_t i;
+
+    for(i = 1U; (uint16_t)(i + 2U) < host_tx_len; i++) {
+        count += (host_tx[i] == 0x60U) ? 1U : 0U;
+    }
+    return count;
+}
+
+// AUTHENTICATE con TUAK y 255 iteraciones dura varias veces el tiempo de
+// espera del lector: en T=0 la tarjeta le avisa con bytes NULL entre
+// permutaciones. El AUTN no vale: f1 se calcula igual antes del rechazo.
+static void test_keep_alive(void) {
+    const char* authenticate = "008800812210 42424242424242424242424242424242"
+                               "10 00000000000000000000000000000000";
+    unsigned nulls;
+
+    host_protocol = 0U;
+    host_flash_blank();
+    host_boot(true);
+    CHECK_EQ(host_apdu("80D0060002 01FF"), 0x9000U);
+
+    host_elapsed_step = 0UL;
+    CHECK_EQ(host_exchange(authenticate), SW_AUTH_MAC_FAILURE);
+    CHECK_EQ(count_nulls(), 0U);
+
+    host_elapsed_step = host_wait_ticks / 16U;
+    CHECK_EQ(host_exchange(authenticate), SW_AUTH_MAC_FAILURE);
+    nulls = count_nulls();
+    host_elapsed_step = 0UL;
+    printf("AUTHENTICATE con TUAK en T=0: %u bytes NULL\n", nulls);
+    // Al menos uno cada 8 permutaciones
+    CHECK(nulls >= 255U / 8U);
+}
+
+int main(void) {
+    test_keccak();
+    test_tuak();
+    test_keep_alive();
+    return host_report("test_tuak");
+}
@@ -0,0 +1,107 @@
+// TUAK con RES y MAC de 64, 128 y 256 bits. Las longitudes entran en
+// INSTANCE y se fijan al compilar, así que el Makefile compila este fichero
+// una vez por tamaño (test_tuak_res8, test_tuak_res16 y test_tuak_res32)
+// con USIM_TUAK_RES_SIZE y USIM_TUAK_MAC_SIZE iguales. Cada tamaño usa
+// además otro número de iteraciones. Valores de una implementación de
+// referencia en Python que reproduce el conjunto 1 de TS 35.233 completo.
+#include "harness.h"
+#include "usim_tuak.c"
+
+typedef struct {
+    const char* k;
+    const char* top;
+    const char* rand;
+    const char* sqn;
+    const char* amf;
+    uint8_t iterations;
+    const char* topc;
+    const char* f1;
+    const char* f1star;
+    const char* f2;
+    const char* f3;
+    const char* f4;
+    const char* f5;
+    const char* f5star;
+} tuak_set_t;
+
+#if USIM_TUAK_RES_SIZE == 8U
+static const tuak_set_t tuak_set = {
+    "fec86ba6eb707ed08905757b1bb44b8f",
+    "dbc59adcb6f9a0ef735477b7fadf8374dbc59adcb6f9a0ef735477b7fadf8374",
+    "9f7c8d021accf4db213ccff0c7f71a6a", "9d0277595ffc", "725c", 1U,
+    "84868881ad4c9258cbce3357c399093f1b94f457e554e7d6f6dbfc95f0fdaf28",
+    "9e179d206e6723c1", "8429bdf131df5cf4", "629621b8b61f290c",
+    "0336cc9d9724661ffd6e7d93eba941cb", "a6768ce8a425b761d5762627da15917d",
+    "3e18398a6add", "cbd7082c2c8d",
+};
+#elif USIM_TUAK_RES_SIZE == 16U
+static const tuak_set_t tuak_set = {
+    "9e5944aea94b81165c82fbf9f32db751",
+    "223014c5806694c007ca1eeef57f004f223014c5806694c007ca1eeef57f004f",
+    "ce83dbc54ac0274a157c17f80d017bd6", "0b604a81eca8", "9e09", 2U,
+    "11eb2cdbf422ab7ca22125051c4d684fac53600e0e372304b4e7c59500eabf45",
+    "aa71a09f8e72ea376d5aea30144356d7", "2266bf7928997b2e8aeeef8f1d2d4848",
+    "58badfe3cfc0dbdc7143daa82a2e0eb5",
+    "75943ce1539dd91bcc5fb751d1f53a49", "94521ee0b3be4295fb46c7c06ab486ca",
+    "ae72810c6e56", "d052489c4ff5",
+};
+#elif USIM_TUAK_RES_SIZE == 32U
+static const tuak_set_t tuak_set = {
+    "4ab1deb05ca6ceb051fc98e77d026a84",
+    "2d16c5cd1fdf6b22383584e3bef2a8d82d16c5cd1fdf6b22383584e3bef2a8d8",
+    "74b0cd6031a1c8339b2b6ce2b8c4a186", "e880a1b580b6", "9f07", 16U,
+    "564a0fbc144bebe0ba0179b8164ecd6223b20991f01991bd961d991703b09f0b",
+    "d966b615b3b24997e2c82cd9d3b60dd5d13d288ddb3eb2b7a9152abf1905172e",
+    "6ff2dd50c7f42e2a0f9a52b3e6d5d7f9646f9b0f67ffcb204cbc72139ec2bd10",
+    "b063212866660015ac2ad68fa833a6e705fb00f3e26772498a5dce47b355ead5",
+    "57cf331276d941ca3441942bd365fa28", "f19cf6d09b10d6599851b3cd6cebf1c0",
+    "94d438ec3109", "0f12cfc7705c",
+};
+#else
+#error "Sin vectores para este USIM_TUAK_RES_SIZE"
+#endif
+
+static void test_tuak_set(void) {
+    uint8_t k[USIM_TUAK_KEY_SIZE];
+    uint8_t top[USIM_TUAK_TOP_SIZE];
+    uint8_t topc[USIM_TUAK_TOP_SIZE];
+    uint8_t rand[16];
+    uint8_t sqn[6];
+    uint8_t amf[2];
+    uint8_t mac_a[USIM_TUAK_MAC_SIZE];
+    uint8_t mac_s[USIM_TUAK_MAC_SIZE];
+    uint8_t res[USIM_TUAK_RES_SIZE];
+    uint8_t ck[16];
+    uint8_t ik[16];
+    uint8_t ak[USIM_TUAK_AK_SIZE];
+
+    CHECK_EQ(USIM_TUAK_MAC_SIZE, USIM_TUAK_RES_SIZE);
+    (void)host_hex(tuak_set.k, k);
+    (void)host_hex(tuak_set.top, top);
+    (void)host_hex(tuak_set.rand, rand);
+    (void)host_hex(tuak_set.sqn, sqn);
+    (void)host_hex(tuak_set.amf, amf);
+
+    usim_tuak_topc(k, top, topc, tuak_set.iterations);
+    CHECK_HEX(topc, sizeof(topc), tuak_set.topc);
+
+    usim_tuak_init(k, topc, rand, tuak_set.iterations);
+    usim_tuak_f1(sqn, amf, mac_a, mac_s);
+    CHECK_HEX(mac_a, sizeof(mac_a), tuak_set.f1);
+    CHECK_HEX(mac_s, sizeof(mac_s), tuak_set.f1star);
+
+    usim_tuak_f2345(res, ck, ik, ak);
+    CHECK_HEX(res, sizeof(res), tuak_set.f2);
+    CHECK_HEX(ck, sizeof(ck), tuak_set.f3);
+    CHECK_HEX(ik, sizeof(ik), tuak_set.f4);
+    CHECK_HEX(ak, sizeof(ak), tuak_set.f5);
+
+    usim_tuak_f5star(ak);
+    CHECK_HEX(ak, sizeof(ak), tuak_set.f5star);
+    usim_tuak_clear();
+}
+
+int main(void) {
+    test_tuak_set();
+    return host_report(TUAK_TEST_NAME);
+}
@@ -0,0 +1,233 @@
+// Motor de bits por software de chip_init.c: tramas enviadas, recepción por
+// INT0 + Timer 0 hacia el anillo en XRAM y reparto del Timer 0
+#include "harness.h"
+#include "host_line.h"
+#include "chip_init.c"
+#include <stdio.h>
+
+static uint8_t tx[64];
+
+static void line_restart(void) {
+    chip_init();
+    host_line_reset();
+}
+
+static void test_send_framing(void) {
+    uint32_t total = 0UL;
+    uint16_t i;
+
+    line_restart();
+    CHECK(sim_send_byte(0x3BU));
+    // Start, 8 datos, paridad y stop de una ETU más media ETU de guarda
+    for(i = 0U; i < host_line_segments(); i++) {
+        total += host_line_segment_ticks(i);
+    }
+    CHECK_EQ(total, (11UL * 93UL) + 46UL);
+    CHECK_EQ(host_line_tx_decode(93UL, tx, sizeof(tx)), 1U);
+    CHECK_EQ(tx[0], 0x3BU);
+
+    line_restart();
+    CHECK(sim_send_byte(0x00U));
+    CHECK(sim_send_byte(0xFFU));
+    CHECK(sim_send_byte(0xA5U));
+    CHECK(sim_send_byte(0x80U));
+    CHECK_EQ(host_line_tx_decode(93UL, tx, sizeof(tx)), 4U);
+    CHECK_HEX(tx, 4U, "00 FF A5 80");
+}
+
+static void test_receive_in_order(void) {
+    uint8_t i;
+
+    line_restart();
+    host_line_rx_hex("00 A4 04 00 02 3F 00");
+    for(i = 0U; i < 7U; i++) {
+        CHECK(sim_receive_byte(&tx[i], 1000UL));
+    }
+    CHECK_HEX(tx, 7U, "00 A4 04 00 02 3F 00");
+    CHECK_EQ(sim_rx_parity_errors, 0U);
+    CHECK_EQ(sim_rx_overruns, 0U);
+
+    // Sin más bytes: timeout
+    CHECK(!sim_receive_byte(&tx[0], 1000UL));
+    CHECK(sim_rx_timed_out);
+}
+
+static void test_sampling_reloads(void) {
+    line_restart();
+    sim_rx_start();
+    CHECK_EQ(sim_rx_state, SIM_RX_STATE_IDLE);
+    CHECK(IE & IE_EX0);
+
+    // Flanco de start: el primer muestreo a media ETU
+    P1 &= (uint8_t)~SIM_IO_PIN;
+    sim_io_start_isr();
+    CHECK_EQ(sim_rx_state, SIM_RX_STATE_SAMPLING);
+    CHECK_EQ(((uint16_t)TH0 << 8) | TL0, 0x10000UL - 46UL);
+    CHECK(!(IE & IE_EX0));
+
+    // Recarga acumulativa: la latencia de la ISR no desplaza el muestreo
+    TH0 = 0x00U;
+    TL0 = 0x10U;
+    sim_rx_timer_isr();
+    CHECK_EQ(((uint16_t)TH0 << 8) | TL0, 0x10000UL - 93UL + 0x10UL);
+    CHECK_EQ(sim_rx_bitcount, 1U);
+}
+
+static void test_false_start(void) {
+    line_restart();
+    sim_rx_start();
+
+    // Pulso de ruido: en el centro del start la línea ya está en alto
+    P1 &= (uint8_t)~SIM_IO_PIN;
+    sim_io_start_isr();
+    P1 |= SIM_IO_PIN;
+    sim_rx_timer_isr();
+
+    CHECK_EQ(sim_rx_state, SIM_RX_STATE_IDLE);
+    CHECK_EQ(sim_rx_head, sim_rx_tail);
+    CHECK(IE & IE_EX0);
+
+    // El carácter siguiente se recibe bien
+    host_line_rx(0x5AU, true);
+    CHECK(sim_receive_byte(&tx[0], 1000UL));
+    CHECK_EQ(tx[0], 0x5AU);
+}
+
+static void test_parity_error(void) {
+    line_restart();
+    host_line_rx(0x11U, false);
+    host_line_rx(0x22U, true);
+
+    // Se entrega el byte y se cuenta el error (la ISR no reintenta)
+    sim_rx_start();
+    PCON |= PCON_IDL;
+    CHECK_EQ(sim_rx_parity_errors, 1U);
+    CHECK(sim_receive_byte(&tx[0], 1000UL));
+    CHECK_EQ(tx[0], 0x11U);
+    CHECK_EQ(sim_rx_parity_errors, 0U);
+    CHECK(sim_receive_byte(&tx[1], 1000UL));
+    CHECK_EQ(tx[1], 0x22U);
+}
+
+static void test_ring_overrun(void) {
+    uint8_t value = 0U;
+    uint8_t i;
+
+    line_restart();
+    for(i = 0U; i < SIM_RX_RING_SIZE + 2U; i++) {
+        host_line_rx(i, true);
+    }
+
+    // El lector envía sin que nadie lea: caben SIM_RX_RING_SIZE - 1 bytes
+    sim_rx_start();
+    for(i = 0U; i < SIM_RX_RING_SIZE + 2U; i++) {
+        PCON |= PCON_IDL;
+    }
+    CHECK_EQ(sim_rx_overruns, 3U);
+
+    for(i = 0U; i < SIM_RX_RING_SIZE - 1U; i++) {
+        CHECK(sim_receive_byte(&value, 1000UL));
+        CHECK_EQ(value, i);
+    }
+    CHECK_EQ(sim_rx_overruns, 0U);
+    CHECK(!sim_receive_byte(&value, 1000UL));
+}
+
+static void test_reset_during_receive(void) {
+    line_restart();
+    host_line_rx_hex("A0");
+    sim_rst_isr();
+    CHECK(!sim_receive_byte(&tx[0], 1000UL));
+    CHECK_EQ(sim_rx_state, SIM_RX_STATE_OFF);
+    CHECK(sim_reset_pending);
+}
+
+static void test_timer_sharing(void) {
+    line_restart();
+
+    // Cronómetro: la ISR cuenta los desbordes del modo 1
+    sim_elapsed_start();
+    CHECK(IE & IE_ET0);
+    sim_rx_timer_isr();
+    sim_rx_timer_isr();
+    TH0 = 0x12U;
+    TL0 = 0x34U;
+    CHECK_EQ(sim_elapsed_ticks(), 0x21234UL);
+    // Desborde pendiente de atender al leer: cuenta ya como el siguiente
+    TCON |= TCON_TF0;
+    CHECK_EQ(sim_elapsed_ticks(), 0x31234UL);
+    TCON &= (uint8_t)~TCON_TF0;
+
+    // Enviar usa el Timer 0 por sondeo y detiene el cronómetro
+    CHECK(sim_send_byte(0x60U));
+    CHECK_EQ(sim_elapsed_ticks(), 0UL);
+    CHECK(!(IE & IE_ET0));
+
+    // Recibir lo devuelve al modo de espera con interrupciones
+    host_line_rx(0x61U, true);
+    CHECK(sim_receive_byte(&tx[0], 1000UL));
+    CHECK_EQ(tx[0], 0x61U);
+    CHECK_EQ(sim_rx_state, SIM_RX_STATE_IDLE);
+    CHECK(IE & IE_ET0);
+}
+
+// Lector con flancos desviados un 10 % de la ETU e ISR que entran con hasta
+// 11 ticks de retraso: los bytes llegan bien y cada muestreo cae cerca del
+// centro de su bit, a la ETU por defecto y a la mínima
+static void test_receive_jitter(void) {
+    static const uint32_t etus[] = { SIM_DEFAULT_ETU_TICKS, SIM_PPS_MIN_ETU_TICKS };
+    uint32_t seed = 7UL;
+    uint8_t sent[200];
+    uint8_t value = 0U;
+    uint8_t e;
+    uint16_t i;
+
+    for(e = 0U; e < sizeof(etus) / sizeof(etus[0]); e++) {
+        int32_t limit = (2 * 11) + (int32_t)(etus[e] / 10UL) + 1;
+        int32_t worst = 0;
+        uint8_t bit;
+
+        CHECK(limit < (int32_t)(etus[e] / 2UL));
+        line_restart();
+        sim_set_etu_ticks(etus[e]);
+        host_line_set_rx_timing(etus[e], 10U, 11U);
+        for(i = 0U; i < sizeof(sent); i++) {
+            seed = (seed * 1103515245UL) + 12345UL;
+            sent[i] = (uint8_t)(seed >> 16);
+        }
+
+        for(i = 0U; i < sizeof(sent); i++) {
+            host_line_rx(sent[i], true);
+            CHECK(sim_receive_byte(&value, 1000UL));
+            CHECK_EQ(value, sent[i]);
+            CHECK_EQ(host_line_rx_samples(), 10U);
+            for(bit = 0U; bit < host_line_rx_samples(); bit++) {
+                int32_t error = host_line_rx_sample_error(bit);
+
+                if(error < 0) {
+                    error = -error;
+                }
+                if(error > worst) {
+                    worst = error;
+                }
+            }
+        }
+        CHECK_EQ(sim_rx_parity_errors, 0U);
+        CHECK_EQ(sim_rx_overruns, 0U);
+        CHECK(worst <= limit);
+        printf("Muestreo con ETU %lu: desvío máximo %ld ticks\n", (unsigned long)etus[e], (long)worst);
+    }
+}
+
+int main(void) {
+    test_send_framing();
+    test_receive_in_order();
+    test_sampling_reloads();
+    test_false_start();
+    test_parity_error();
+    test_ring_overrun();
+    test_reset_during_receive();
+    test_timer_sharing();
+    test_receive_jitter();
+    return host_report("test_uart");
+}
@@ -0,0 +1,157 @@
+// X25519: vectores de RFC 7748 y TS 33.501, y el trabajo de cada etapa
+// contado por usim_x25519.c (productos 8x8 de MUL AB, cierres de columna en
+// 32 bits y pasadas de 32 bytes). usim_x25519.c se compila aquí con
+// X25519_COUNT, como test_tuak incluye usim_tuak.c. El recuento no depende
+// del escalar: el tiempo tampoco.
+#include <stdint.h>
+
+typedef struct {
+    uint32_t products;
+    uint32_t columns;
+    uint32_t passes;
+} x25519_ops_t;
+
+static x25519_ops_t x25519_ops;
+
+#define X25519_COUNT(counter)  (x25519_ops.counter++)
+#include "harness.h"
+#include "usim_x25519.c"
+#include <stdio.h>
+
+// Par de claves de la red doméstica del anexo C.4.3 de TS 33.501
+#define HN_PRIVATE "c53c22208b61860b06c62e5406a7b330c2b577aa5558981510d128247d38bd1d"
+#define HN_PUBLIC  "5a8d38864820197c3394b92613b20b91633cbd897119273bf8e4a6f4eec0a650"
+
+static void test_vectors(void) {
+    uint8_t scalar[USIM_X25519_SIZE];
+    uint8_t u[USIM_X25519_SIZE];
+    uint8_t output[USIM_X25519_SIZE];
+    uint8_t alice[USIM_X25519_SIZE];
+    uint8_t bob[USIM_X25519_SIZE];
+
+    // RFC 7748 §5.2
+    (void)host_hex("a546e36bf0527c9d3b16154b82465edd62144c0ac1fc5a18506a2244ba449ac4", scalar);
+    (void)host_hex("e6db6867583030db3594c1a424b15f7c726624ec26b3353b10a903a6d0ab1c4c", u);
+    usim_x25519(output, scalar, u);
+    CHECK_HEX(output, sizeof(output), "c3da55379de9c6908e94ea4df28d084f32eccf03491c71f754b4075577a28552");
+
+    (void)host_hex("4b66e9d4d1b4673c5ad22691957d6af5c11b6421e0ea01d42ca4169e7918ba0d", scalar);
+    (void)host_hex("e5210f12786811d3f4b7959d0538ae2c31dbe7106fc03c3efc4cd549c715a493", u);
+    usim_x25519(output, scalar, u);
+    CHECK_HEX(output, sizeof(output), "95cbde9476e8907d7aade45cb4b873f88b595a68799fa152e6f8f7647aac7957");
+
+    // Una iteración del §5.2 con salida sobre la entrada
+    memset(u, 0, sizeof(u));
+    u[0] = 9U;
+    memcpy(scalar, u, sizeof(scalar));
+    usim_x25519(u, scalar, u);
+    CHECK_HEX(u, sizeof(u), "422c8e7a6227d7bca1350b3e2bb7279f7897b87bb6854b783c60e80311ae3079");
+
+    // RFC 7748 §6.1: claves públicas y secreto compartido
+    memset(u, 0, sizeof(u));
+    u[0] = 9U;
+    (void)host_hex("77076d0a7318a57d3c16c17251b26645df4c2f87ebc0992ab177fba51db92c2a", alice);
+    (void)host_hex("5dab087e624a8a4b79e17f8b83800ee66f3bb1292618b6fd1c2f8b27ff88e0eb", bob);
+    usim_x25519(output, alice, u);
+    CHECK_HEX(output, sizeof(output), "8520f0098930a754748b7ddcb43ef75a0dbf3a0d26381af4eba4a98eaa9b4e6a");
+    usim_x25519(output, bob, u);
+    CHECK_HEX(output, sizeof(output), "de9edb7d7b7dc1b4d35b61c2ece435373f8343c85b78674dadfc7e146f882b4f");
+    usim_x25519(output, alice, output);
+    CHECK_HEX(output, sizeof(output), "4a5d9d5ba4ce2de1728e3bf480350f25e07e21c947d19e3376f09b3c1e161742");
+
+    // Clave de red del anexo C.4.3 de TS 33.501
+    (void)host_hex(HN_PRIVATE, scalar);
+    usim_x25519(output, scalar, u);
+    CHECK_HEX(output, sizeof(output), HN_PUBLIC);
+}
+
+// Valores extremos: con todos los bytes a FF las columnas llegan a su máximo
+// (32 acarreos diferidos) y el resultado sigue cuadrando con el cuadrado
+static void test_saturated(void) {
+    uint8_t* a = FE_SLOT(0U);
+    uint8_t* b = FE_SLOT(1U);
+    uint8_t* product = FE_SLOT(2U);
+    uint8_t* square = FE_SLOT(3U);
+
+    memset(a, 0xFF, FE_SIZE);
+    memset(b, 0xFF, FE_SIZE);
+    fe_mul(product, a, b);
+    fe_square(square, a);
+    fe_freeze(product);
+    fe_freeze(square);
+    CHECK(memcmp(product, square, FE_SIZE) == 0);
+    // (2^256 - 1) = 37 (mod p): 37^2 = 1369 = 0x0559
+    CHECK_EQ(product[0], 0x59U);
+    CHECK_EQ(product[1], 0x05U);
+    memset(usim_keccak_state, 0, FE_SLOTS * FE_SIZE);
+}
+
+static x25519_ops_t count_x25519(const char* scalar_hex) {
+    uint8_t scalar[USIM_X25519_SIZE];
+    uint8_t u[USIM_X25519_SIZE];
+    uint8_t output[USIM_X25519_SIZE];
+
+    (void)host_hex(scalar_hex, scalar);
+    memset(u, 0, sizeof(u));
+    u[0] = 9U;
+    memset(&x25519_ops, 0, sizeof(x25519_ops));
+    usim_x25519(output, scalar, u);
+    return x25519_ops;
+}
+
+static void test_stage_costs(void) {
+    uint8_t* slot = FE_SLOT(0U);
+    x25519_ops_t mul;
+    x25519_ops_t square;
+    x25519_ops_t invert;
+    x25519_ops_t total;
+    x25519_ops_t other;
+    x25519_ops_t step;
+
+    memset(usim_keccak_state, 0x5A, FE_SLOTS * FE_SIZE);
+    memset(&x25519_ops, 0, sizeof(x25519_ops));
+    fe_mul(FE_SLOT(2U), FE_SLOT(0U), FE_SLOT(1U));
+    mul = x25519_ops;
+    memset(&x25519_ops, 0, sizeof(x25519_ops));
+    fe_square(FE_SLOT(2U), FE_SLOT(0U));
+    square = x25519_ops;
+    memset(&x25519_ops, 0, sizeof(x25519_ops));
+    fe_invert(slot, FE_SLOT(1U), FE_SLOT(2U), FE_SLOT(3U), FE_SLOT(4U), FE_SLOT(5U));
+    invert = x25519_ops;
+
+    // Producto: 32 x 32; cuadrado: 496 cruzados y 32 diagonales
+    CHECK_EQ(mul.products, 1024UL);
+    CHECK_EQ(mul.columns, 32UL);
+    CHECK_EQ(square.products, 528UL);
+    CHECK_EQ(square.columns, 32UL);
+    CHECK_EQ(invert.products, (254UL * 528UL) + (11UL * 1024UL));
+
+    // Ladder: 255 pasos iguales, más la inversión y el producto final
+    total = count_x25519(HN_PRIVATE);
+    other = count_x25519("0000000000000000000000000000000000000000000000000000000000000000");
+    CHECK_EQ(total.products, other.products);
+    CHECK_EQ(total.columns, other.columns);
+    CHECK_EQ(total.passes, other.passes);
+
+    step.products = (total.products - invert.products - mul.products) / 255UL;
+    step.columns = (total.columns - invert.columns - mul.columns) / 255UL;
+    CHECK_EQ(step.products * 255UL, total.products - invert.products - mul.products);
+    CHECK_EQ(step.products, (5UL * 1024UL) + (4UL * 528UL));
+
+    printf("X25519: producto %lu MUL y %lu columnas, cuadrado %lu MUL y %lu columnas\n",
+           (unsigned long)mul.products, (unsigned long)mul.columns,
+           (unsigned long)square.products, (unsigned long)square.columns);
+    printf("X25519: paso del ladder %lu MUL y %lu columnas, inversión %lu MUL y %lu columnas\n",
+           (unsigned long)step.products, (unsigned long)step.columns,
+           (unsigned long)invert.products, (unsigned long)invert.columns);
+    printf("X25519: total %lu MUL, %lu columnas y %lu pasadas de 32 bytes\n",
+           (unsigned long)total.products, (unsigned long)total.columns, (unsigned long)total.passes);
+    memset(usim_keccak_state, 0, FE_SLOTS * FE_SIZE);
+}
+
+int main(void) {
+    test_vectors();
+    test_saturated();
+    test_stage_costs();
+    return host_report("test_x25519");
+}